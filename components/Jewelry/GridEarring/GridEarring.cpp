@@ -21,7 +21,7 @@ GridEarring::~GridEarring()
 {
 }
 
-void GridEarring::setup(const RaftJsonIF& config, DeviceManager& devMan)
+void GridEarring::setup(const RaftJsonIF& config, DeviceManager& devMan, DeadlineScheduler& scheduler)
 {
     // Setup LED grid
     RaftJsonPrefixed configLEDGrid(config, "LEDGrid");
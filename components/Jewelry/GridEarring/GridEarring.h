@@ -21,15 +21,15 @@ public:
     virtual ~GridEarring();
 
     // Setup
-    virtual void setup(const RaftJsonIF& config, DeviceManager& devMan) override final;
+    virtual void setup(const RaftJsonIF& config, DeviceManager& devMan, DeadlineScheduler& scheduler) override final;
 
     // Service
     virtual void loop() override final;
 
     // Sleep currently handled within the loop function
-    virtual uint32_t getSleepDurationUs()
+    virtual bool isSleepAllowed() override final
     {
-        return 0;
+        return false;
     }
 
     // Shutdown
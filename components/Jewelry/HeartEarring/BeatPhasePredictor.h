@@ -0,0 +1,200 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Beat phase predictor
+//
+// Extrapolates the heart beat phase from recent beats (zero crossings of the filtered signal) so the time of
+// the next peak can be predicted at any time rather than only from the time of the last sensor sample. Phase
+// and period are tracked from the beats (starting from the PLL beat frequency). Predicted peaks are moved
+// earlier by the signal delay (bandpass filter phase delay and sensor averaging) and the measured lateness
+// of timer wakeups so that the displayed pulse lines up with the actual heart beat
+//
+// Each measured beat is compared with the prediction from the previous beats and the phase error
+// statistics are accumulated
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+class BeatPhasePredictor
+{
+public:
+    // Phase error statistics (errors are measured beat time less predicted beat time)
+    struct Stats
+    {
+        uint32_t numBeats = 0;
+        double meanErrorMs = 0;
+        double meanAbsErrorMs = 0;
+        double rmsErrorMs = 0;
+        double maxAbsErrorMs = 0;
+        double signalDelayMs = 0;
+        double sampleLatencyMs = 0;
+        double wakeLatencyMs = 0;
+    };
+
+    // Setup
+    // peakPhase is the fraction of the beat period from a beat (zero crossing) to the peak, phaseGain and
+    // periodGain the fractions of each measured phase error applied to the phase and period, and the
+    // period is limited to the PLL frequency range
+    void setup(double peakPhase, double phaseGain, double periodGain, double latencyAlpha,
+                double minFreqHz, double maxFreqHz)
+    {
+        _peakPhase = peakPhase;
+        _phaseGain = phaseGain;
+        _periodGain = periodGain;
+        _latencyAlpha = latencyAlpha;
+        _minPeriodUs = maxFreqHz > 0 ? 1e6 / maxFreqHz : 0;
+        _maxPeriodUs = minFreqHz > 0 ? 1e6 / minFreqHz : 1e7;
+    }
+
+    // Add a measured beat with the PLL beat frequency at that time
+    void addBeat(uint64_t beatTimeUs, double beatFreqHz)
+    {
+        if (beatFreqHz <= 0)
+            return;
+
+        // First beat
+        double periodUs = std::clamp(1e6 / beatFreqHz, _minPeriodUs, _maxPeriodUs);
+        if (!_isValid)
+        {
+            _phaseRefUs = beatTimeUs;
+            _periodUs = periodUs;
+            _isValid = true;
+            return;
+        }
+
+        // Phase error against the nearest predicted beat - beats less than half a period after the reference
+        // are ignored (e.g. a second zero crossing caused by noise)
+        double sinceRefUs = (double)beatTimeUs - (double)_phaseRefUs;
+        double numPeriods = round(sinceRefUs / _periodUs);
+        if (numPeriods < 1)
+            return;
+        double predictedUs = _phaseRefUs + numPeriods * _periodUs;
+        double errorUs = (double)beatTimeUs - predictedUs;
+        addError(errorUs / 1000);
+
+        // Correct phase and period (alpha-beta tracker) - the period is kept within the PLL frequency range
+        // and is reset to the PLL period after several beats with large errors (e.g. a change of heart rate)
+        _phaseRefUs = predictedUs + _phaseGain * errorUs;
+        _periodUs += _periodGain * errorUs / numPeriods;
+        if (fabs(errorUs) > _periodUs * LARGE_ERROR_PERIOD_FRACTION)
+            _numLargeErrors++;
+        else
+            _numLargeErrors = 0;
+        if (_numLargeErrors >= LARGE_ERRORS_BEFORE_RESET)
+        {
+            _phaseRefUs = beatTimeUs;
+            _periodUs = periodUs;
+            _numLargeErrors = 0;
+        }
+        _periodUs = std::clamp(_periodUs, _minPeriodUs, _maxPeriodUs);
+    }
+
+    // Check valid (at least one beat)
+    bool isValid() const
+    {
+        return _isValid;
+    }
+
+    // Signal delay - time from the actual beat to its detection in the filtered signal
+    void setSignalDelayUs(double signalDelayUs)
+    {
+        _signalDelayUs = signalDelayUs;
+        _stats.signalDelayMs = signalDelayUs / 1000;
+    }
+
+    // Measured latency from sample time to processing (averaged) - sample times are absolute so this is
+    // reported but doesn't move predictions
+    void addSampleLatencyUs(double latencyUs)
+    {
+        _sampleLatencyUs = _sampleLatencyUs * (1 - _latencyAlpha) + latencyUs * _latencyAlpha;
+        _stats.sampleLatencyMs = _sampleLatencyUs / 1000;
+    }
+
+    // Measured lateness of a timer (deadline to time run) - includes exit from light sleep (averaged)
+    void addWakeLatencyUs(double latencyUs)
+    {
+        _wakeLatencyUs = _wakeLatencyUs * (1 - _latencyAlpha) + latencyUs * _latencyAlpha;
+        _stats.wakeLatencyMs = _wakeLatencyUs / 1000;
+    }
+    double getWakeLatencyUs() const
+    {
+        return _wakeLatencyUs;
+    }
+
+    // Get time of the next predicted (delay compensated) peak at or after a time
+    // Returns timeUs if there is no prediction
+    uint64_t getNextPeakUs(uint64_t timeUs) const
+    {
+        if (!_isValid)
+            return timeUs;
+        double peakRefUs = _phaseRefUs + _peakPhase * _periodUs - _signalDelayUs;
+        double numPeriods = ceil(((double)timeUs - peakRefUs) / _periodUs);
+        double peakUs = peakRefUs + numPeriods * _periodUs;
+        return peakUs > timeUs ? (uint64_t)peakUs : timeUs;
+    }
+
+    // Stats
+    const Stats& getStats() const
+    {
+        return _stats;
+    }
+    void resetStats()
+    {
+        _stats.numBeats = 0;
+        _stats.meanErrorMs = 0;
+        _stats.meanAbsErrorMs = 0;
+        _stats.rmsErrorMs = 0;
+        _stats.maxAbsErrorMs = 0;
+        _sumErrorMs = 0;
+        _sumAbsErrorMs = 0;
+        _sumSqErrorMs = 0;
+    }
+
+private:
+    // Settings
+    double _peakPhase = 0.75;
+    double _phaseGain = 0.5;
+    double _periodGain = 0.1;
+    double _latencyAlpha = 0.1;
+    double _minPeriodUs = 0;
+    double _maxPeriodUs = 1e7;
+
+    // Phase reference (time of a beat) and period
+    bool _isValid = false;
+    double _phaseRefUs = 0;
+    double _periodUs = 1e6;
+
+    // Reset to the PLL on consecutive large errors
+    static constexpr double LARGE_ERROR_PERIOD_FRACTION = 0.25;
+    static const uint32_t LARGE_ERRORS_BEFORE_RESET = 4;
+    uint32_t _numLargeErrors = 0;
+
+    // Delays
+    double _signalDelayUs = 0;
+    double _sampleLatencyUs = 0;
+    double _wakeLatencyUs = 0;
+
+    // Stats
+    Stats _stats;
+    double _sumErrorMs = 0;
+    double _sumAbsErrorMs = 0;
+    double _sumSqErrorMs = 0;
+    void addError(double errorMs)
+    {
+        _stats.numBeats++;
+        _sumErrorMs += errorMs;
+        _sumAbsErrorMs += fabs(errorMs);
+        _sumSqErrorMs += errorMs * errorMs;
+        _stats.meanErrorMs = _sumErrorMs / _stats.numBeats;
+        _stats.meanAbsErrorMs = _sumAbsErrorMs / _stats.numBeats;
+        _stats.rmsErrorMs = sqrt(_sumSqErrorMs / _stats.numBeats);
+        if (fabs(errorMs) > _stats.maxAbsErrorMs)
+            _stats.maxAbsErrorMs = fabs(errorMs);
+    }
+};
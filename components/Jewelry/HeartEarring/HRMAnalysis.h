@@ -8,22 +8,85 @@
 
 #pragma once
 
-#include "IIRFilter4thOrder.h"
+#include "BiquadCascade.h"
+#include "ButterworthDesign.h"
 #include "ZeroCrossingDetector.h"
 #include "PhaseLockedLoop.h"
+#include "HRMSignalQuality.h"
+#include "HRMTrace.h"
 #include <vector>
+#include <type_traits>
+#include <utility>
+
+// Filter arithmetic can be set to fixed point for targets without an FPU (e.g. ESP32-C3)
+// by defining HRM_FILTER_FIXED_POINT
+#ifdef HRM_FILTER_FIXED_POINT
+typedef FixedQ<8> HRMFilterSampleType;
+typedef FixedQ<29> HRMFilterCoeffType;
+#else
+typedef double HRMFilterSampleType;
+typedef double HRMFilterCoeffType;
+#endif
+
+// Bandpass filter order (must be even - the filter is a cascade of second order sections)
+#ifndef HRM_BANDPASS_ORDER
+#define HRM_BANDPASS_ORDER 4
+#endif
+static_assert((HRM_BANDPASS_ORDER >= 2) && (HRM_BANDPASS_ORDER % 2 == 0), "HRM_BANDPASS_ORDER must be even");
+
+// Phase locked loop frequency PID parameters and acquisition (wide gain until locked - gain 0 disables)
+// Acquisition supersedes the PID tuning - it does nearly all of the tracking (re-acquiring when lock is lost)
+// and the PID gains only trim the beat frequency while locked. Higher kP (e.g. 0.03) with acquisitionGain
+// 0.1 tracks more closely once locked but roughly doubles relock time after a sensor restart
+struct HRMPLLParams
+{
+    double maxPIDOutput = 10.0;
+    double kP = 0.00005;
+    double kI = 0.000005;
+    double kD = 0.0005;
+    double acquisitionGain = 0.25;
+    double lockTolerance = 0.1;
+    uint32_t lockIntervals = 4;
+    uint32_t lockLossIntervals = 8;
+};
+
+// Check if a sample record has an IR member (used for contact detection when present)
+template<typename SampleRec, typename = void>
+struct HRMSampleHasIR : std::false_type {};
+template<typename SampleRec>
+struct HRMSampleHasIR<SampleRec, std::void_t<decltype(std::declval<SampleRec>().IR)>> : std::true_type {};
 
 class HRMAnalysis
 {
 public:
-    HRMAnalysis(double freqBandLowerHz = 0.75, double freqBandUpperHz = 3.0, double freqCentreHz = 1.0) :
+    typedef HRMPLLParams PLLParams;
+    typedef HRMSignalQualityParams QualityParams;
+    typedef ZeroCrossingDetectorParams CrossingParams;
+
+    HRMAnalysis(double freqBandLowerHz = 0.75, double freqBandUpperHz = 3.0, double freqCentreHz = 1.0,
+                double sampleRateHz = DEFAULT_SAMPLE_RATE_HZ, const PLLParams& pllParams = PLLParams(),
+                const QualityParams& qualityParams = QualityParams(), 
+                const CrossingParams& crossingParams = CrossingParams()) :
         // Bandpass filter
-        _butterBandpassFilter(_butterCoeff4A, _butterCoeff4B, _butterZi),
+        _butterBandpassCoeffs(designBandpass(sampleRateHz, freqBandLowerHz, freqBandUpperHz)),
+        _butterBandpassFilter(_butterBandpassCoeffs),
+        _freqBandLowerHz(freqBandLowerHz),
+        _freqBandUpperHz(freqBandUpperHz),
+        _sampleRateHz(sampleRateHz),
+
+        // Zero crossing detector (hysteresis, refractory period and interpolated crossing times)
+        _zeroCrossingDetector(crossingParams, sampleRateHz),
 
         // Phase locked loop
         // Parameters set highest and lowest expected heart rate in Hz and max PID output (+/-)
-        _phaseLockedLoop(freqBandLowerHz, freqBandUpperHz, freqCentreHz, maxPIDOutput, kP_PID, kI_PID, kD_PID)
+        _phaseLockedLoop(freqBandLowerHz, freqBandUpperHz, freqCentreHz, 
+                    pllParams.maxPIDOutput, pllParams.kP, pllParams.kI, pllParams.kD),
+
+        // Signal quality
+        _signalQuality(qualityParams, sampleRateHz)
     {
+        _phaseLockedLoop.setAcquisition(pllParams.acquisitionGain, pllParams.lockTolerance, 
+                    pllParams.lockIntervals, pllParams.lockLossIntervals);
     }
     ~HRMAnalysis()
     {
@@ -34,26 +97,89 @@ public:
         double heartRateHz = 0;
         uint32_t timeOfNextPeakMs = 0;
         uint32_t heartRatePulseIntervalMs = 0;
+        float confidence = 0;
+        float contactDC = 0;
+        bool isSkinContact = false;
+    };
+
+    // Beat (zero crossing of the filtered signal passed to the PLL)
+    struct HRMBeat
+    {
+        uint32_t timeMs = 0;
+        float heartRateHz = 0;
     };
 
-    HRMResult process(double sample, uint32_t sampleTimeMs)
+    // Process a sample - irSample is only used for skin contact detection (0 if not available)
+    HRMResult process(double sample, uint32_t sampleTimeMs, double irSample = 0)
     {
         // Filtering
-        double filteredSample = _butterBandpassFilter.process(sample);
+        warmStart(sample);
+        HRMFilterSampleType filteredOut = _butterBandpassFilter.process(SampleConv<HRMFilterSampleType>::fromDouble(sample));
+        double filteredSample = SampleConv<HRMFilterSampleType>::toDouble(filteredOut);
         _debugFilteredSample = filteredSample;
         
-        // Zero crossing detector
-        bool isZeroCrossing = _zeroCrossingDetector.process(filteredSample, false);
+        // Zero crossing detector (full precision filter output)
+        bool isZeroCrossing = _zeroCrossingDetector.process(filteredSample, sampleTimeMs);
         _debugIsZeroCrossing = isZeroCrossing;
 
-        // Phase locked loop
-        if (isZeroCrossing)
-            _phaseLockedLoop.processZeroCrossing(sampleTimeMs);
+        // Signal quality and phase locked loop
+        bool isPLLUpdated = false;
+        updateQualityAndPLL(sample, irSample, filteredSample, isZeroCrossing, isPLLUpdated);
+
+        // Trace
+        if (_pTrace && _pTrace->isEnabled())
+            traceSample(sampleTimeMs, (int32_t)sample, filteredSample, isZeroCrossing, isPLLUpdated);
 
         // Return beat frequency
-        return HRMResult{getHeartRateHz(), 
-                    getTimeOfNextPeakMs(sampleTimeMs), 
-                    getHeartRatePulseIntervalMs()};
+        return getResult(sampleTimeMs);
+    }
+
+    // Process a block of samples (e.g. a decoded sensor FIFO burst)
+    // SampleRec must have Red and timeMs members (e.g. poll_MAX30101) and IR is used if present
+    // The result is only computed once - for the time of the last sample in the block
+    // If beatFn is supplied it is called (as beatFn(const HRMBeat&)) for each beat passed to the PLL
+    template<typename SampleRec, typename BeatFn = std::nullptr_t>
+    HRMResult processBlock(const SampleRec* pSamples, uint32_t numSamples, BeatFn beatFn = nullptr)
+    {
+        // Check valid
+        if (!pSamples || (numSamples == 0))
+        {
+            HRMResult result = getResult(0);
+            result.timeOfNextPeakMs = 0;
+            return result;
+        }
+
+        // Run all stages over the block
+        HRMFilterSampleType filteredSample = HRMFilterSampleType();
+        bool isZeroCrossing = false;
+        for (uint32_t i = 0; i < numSamples; i++)
+        {
+            warmStart(pSamples[i].Red);
+            filteredSample = _butterBandpassFilter.process(SampleConv<HRMFilterSampleType>::fromInt(pSamples[i].Red));
+            isZeroCrossing = _zeroCrossingDetector.process(SampleConv<HRMFilterSampleType>::toDouble(filteredSample), 
+                        pSamples[i].timeMs);
+            double irSample = 0;
+            if constexpr (HRMSampleHasIR<SampleRec>::value)
+                irSample = pSamples[i].IR;
+            bool isPLLUpdated = false;
+            bool isBeat = updateQualityAndPLL(pSamples[i].Red, irSample, SampleConv<HRMFilterSampleType>::toDouble(filteredSample),
+                        isZeroCrossing, isPLLUpdated);
+            if constexpr (!std::is_same<BeatFn, std::nullptr_t>::value)
+            {
+                if (isBeat)
+                    beatFn(HRMBeat{getBeatTimeMs(), (float)getHeartRateHz()});
+            }
+            if (_pTrace && _pTrace->isEnabled())
+                traceSample(pSamples[i].timeMs, pSamples[i].Red, SampleConv<HRMFilterSampleType>::toDouble(filteredSample), 
+                            isZeroCrossing, isPLLUpdated);
+        }
+
+        // Debug values are for the last sample only
+        _debugFilteredSample = SampleConv<HRMFilterSampleType>::toDouble(filteredSample);
+        _debugIsZeroCrossing = isZeroCrossing;
+
+        // Return beat frequency at the time of the last sample
+        return getResult(pSamples[numSamples-1].timeMs);
     }
 
     // Get heart rate
@@ -81,27 +207,254 @@ public:
         return 1000 / _phaseLockedLoop.getBeatFreqHz();
     }
 
+    // Change sample rate - the bandpass filter coefficients are re-derived
+    void setSampleRate(double sampleRateHz)
+    {
+        if (sampleRateHz == _sampleRateHz)
+            return;
+        _sampleRateHz = sampleRateHz;
+        _butterBandpassCoeffs = designBandpass(_sampleRateHz, _freqBandLowerHz, _freqBandUpperHz);
+        _butterBandpassFilter.setCoeffs(_butterBandpassCoeffs);
+        _signalQuality.setSampleRate(_sampleRateHz);
+        _zeroCrossingDetector.setSampleRate(_sampleRateHz);
+
+        // The filter state for the old coefficients would cause a large transient from the DC level
+        // so the state is set to the steady state for the DC level (if samples have been processed)
+        if (_signalQuality.getDCRed() != 0)
+            _butterBandpassFilter.settle(_signalQuality.getDCRed());
+    }
+
+    // Restart after a gap in the samples (e.g. sensor FIFO overflow) - sample is the first sample after the gap
+    // The filter state is set to the steady state for the sample (so the step across the gap doesn't ring
+    // through the filter), the zero crossing detector and crossing intervals are restarted and the PLL keeps its
+    // frequency but restarts its interval at the next crossing
+    void restart(double sample)
+    {
+        _butterBandpassFilter.settle(sample);
+        _zeroCrossingDetector.reset();
+        _signalQuality.restartIntervals();
+        _isPLLHeld = true;
+    }
+
+    // Analysis state (e.g. kept in memory that survives a restart) - trivially copyable and compact
+    // The bandpass filter state is only valid for the sample rate it was saved at
+    struct State
+    {
+        float sampleRateHz;
+        float lastSample;
+        float filterState[HRM_BANDPASS_ORDER];
+        float crossingEnvelope;
+        HRMSignalQuality::State quality;
+        PhaseLockedLoop::State pll;
+    };
+    State getState() const
+    {
+        State state = {};
+        state.sampleRateHz = _sampleRateHz;
+        state.lastSample = _lastSample;
+        for (uint32_t i = 0; i < HRM_BANDPASS_ORDER / 2; i++)
+        {
+            state.filterState[i * 2] = SampleConv<HRMFilterSampleType>::toDouble(_butterBandpassFilter.getSection(i).getZ1());
+            state.filterState[i * 2 + 1] = SampleConv<HRMFilterSampleType>::toDouble(_butterBandpassFilter.getSection(i).getZ2());
+        }
+        state.crossingEnvelope = _zeroCrossingDetector.getEnvelope();
+        state.quality = _signalQuality.getState();
+        state.pll = _phaseLockedLoop.getState();
+        return state;
+    }
+
+    // Set the analysis state (e.g. after a restart) - timeOffsetMs moves times in the state to the sample time
+    // base now in use. The PLL keeps its frequency, PID and lock state and restarts its interval at the next
+    // crossing (the crossing intervals in the state are from before the break). If restoreFilter is set (e.g.
+    // for a short break) and the state is for the current sample rate the filter state is kept and shifted to the
+    // level of the first sample processed - otherwise the filter is settled to it as on a warm start
+    void setState(const State& state, int32_t timeOffsetMs, bool restoreFilter)
+    {
+        _isFilterRestored = restoreFilter && (state.sampleRateHz == (float)_sampleRateHz);
+        if (_isFilterRestored)
+        {
+            for (uint32_t i = 0; i < HRM_BANDPASS_ORDER / 2; i++)
+                _butterBandpassFilter.getSection(i).reset(SampleConv<HRMFilterSampleType>::fromDouble(state.filterState[i * 2]),
+                            SampleConv<HRMFilterSampleType>::fromDouble(state.filterState[i * 2 + 1]));
+            _lastSample = state.lastSample;
+        }
+        _zeroCrossingDetector.reset(state.crossingEnvelope);
+        _signalQuality.setState(state.quality);
+        _phaseLockedLoop.setState(state.pll, timeOffsetMs);
+        _isPLLHeld = true;
+        _isFirstSample = true;
+    }
+
+    // Enable / disable warm start (enabled by default) - the filter state is set to the steady state for the
+    // first sample and for the first sample after skin contact is detected (the large DC step would otherwise
+    // ring through the bandpass filter for several seconds)
+    void setWarmStartEnabled(bool enabled)
+    {
+        _isWarmStartEnabled = enabled;
+    }
+
+    // Check if the PLL is locked (acquisition complete)
+    bool isPLLLocked() const
+    {
+        return _phaseLockedLoop.isLocked();
+    }
+
+    // Enable / disable gating of PLL updates by signal quality (enabled by default)
+    void setQualityGateEnabled(bool enabled)
+    {
+        _isQualityGateEnabled = enabled;
+    }
+
+    // Get signal quality
+    const HRMSignalQuality& getSignalQuality() const
+    {
+        return _signalQuality;
+    }
+
+    // Get bandpass filter phase delay at a frequency - zero crossings (and so the PLL phase) lag the
+    // sensor signal by this amount at the heart rate (negative values are a lead)
+    double getFilterPhaseDelayMs(double freqHz) const
+    {
+        if (_sampleRateHz <= 0)
+            return 0;
+        double omega = 2 * ButterworthDesign::DESIGN_PI * freqHz / _sampleRateHz;
+        return BandpassFilter::phaseDelaySamples(_butterBandpassCoeffs, omega) * 1000 / _sampleRateHz;
+    }
+
+    // Get sample rate
+    double getSampleRateHz() const
+    {
+        return _sampleRateHz;
+    }
+
+    // Set trace (nullptr to remove) - records are only added while the trace is enabled
+    void setTrace(HRMTrace* pTrace)
+    {
+        _pTrace = pTrace;
+    }
+
     // Debug values
     double _debugFilteredSample = 0;
     bool _debugIsZeroCrossing = false;
 
+    // Bandpass filter type
+    typedef BiquadCascade<HRM_BANDPASS_ORDER / 2, HRMFilterSampleType, HRMFilterCoeffType> BandpassFilter;
+
+    // Bandpass filter design (Butterworth) - allocation free so it can be used at setup time on the target
+    static BandpassFilter::CoeffsArray designBandpass(double sampleRateHz, double freqBandLowerHz, double freqBandUpperHz)
+    {
+        return ButterworthDesign::bandpass<HRM_BANDPASS_ORDER / 2>(sampleRateHz, freqBandLowerHz, freqBandUpperHz);
+    }
+
+    // Default design (evaluated at compile time)
+    static constexpr double DEFAULT_SAMPLE_RATE_HZ = 25.0;
+    static constexpr BandpassFilter::CoeffsArray _butterSOSDefault = 
+                ButterworthDesign::bandpass<HRM_BANDPASS_ORDER / 2>(DEFAULT_SAMPLE_RATE_HZ, 0.75, 3.0);
+
 private:
-    // 25Hz sampling 8th order
-    // static constexpr double _butterCoeff8A[] = {1.0, -6.05960751, 16.45391545, -26.18801509, 26.74607739, -17.95499326, 7.73746173, -1.9574456, 0.22281157};
-    // static constexpr double _butterCoeff8B[] = {0.00336282, 0.0, -0.01345126, 0.0, 0.02017689, 0.0, -0.01345126, 0.0, 0.00336282};
-    // // static constexpr double _butterZi[] = {-0.00336282, -0.00336282, 0.01008845, 0.01008845, -0.01008845, -0.01008845, 0.00336282, 0.00336282};
-    // static constexpr double _butter8Zi[] = {0,0,0,0,0,0,0,0};
-
-    // 25Hz sampling 4th order
-    static constexpr double _butterCoeff4A[] = {1.0, -2.99198635, 3.52764744, -1.97218019, 0.45044543};
-    static constexpr double _butterCoeff4B[] = {0.05644846, 0.0, -0.11289692, 0.0, 0.05644846};
-    static constexpr double _butterZi[] = {-0.05644846, -0.05644846, 0.05644846, 0.05644846};
-    static constexpr double maxPIDOutput = 10.0;
-    static constexpr double kP_PID = 0.00005;
-    static constexpr double kI_PID = 0.000005;
-    static constexpr double kD_PID = 0.0005;
-
-    IIRFilter4thOrder _butterBandpassFilter;
+    BandpassFilter::CoeffsArray _butterBandpassCoeffs;
+    BandpassFilter _butterBandpassFilter;
+    double _freqBandLowerHz;
+    double _freqBandUpperHz;
+    double _sampleRateHz;
     ZeroCrossingDetector _zeroCrossingDetector;
     PhaseLockedLoop _phaseLockedLoop;
+
+    // Signal quality - zero crossings are held back from the PLL while the quality is low
+    HRMSignalQuality _signalQuality;
+    bool _isQualityGateEnabled = true;
+    bool _isPLLHeld = false;
+
+    // Warm start
+    bool _isWarmStartEnabled = true;
+    bool _isFirstSample = true;
+    bool _wasContact = false;
+    bool _isFilterRestored = false;
+    double _lastSample = 0;
+    void warmStart(double sample)
+    {
+        // Contact is from the signal quality before this sample (the first sample is treated as in contact as
+        // the filter has just been settled to it). A restored filter state is shifted to the first sample
+        // rather than settled
+        bool isContact = _signalQuality.isContact();
+        if (_isFilterRestored)
+        {
+            _butterBandpassFilter.shiftLevel(sample - _lastSample);
+            _isFilterRestored = false;
+        }
+        else if (_isWarmStartEnabled && (_isFirstSample || (isContact && !_wasContact)))
+        {
+            _butterBandpassFilter.settle(sample);
+            if (!_isFirstSample)
+                _zeroCrossingDetector.reset();
+        }
+        _wasContact = isContact || _isFirstSample;
+        _isFirstSample = false;
+
+        // Level of the last sample (kept in the state so a restored filter can be shifted)
+        _lastSample = sample;
+    }
+
+    // Update signal quality and pass a zero crossing to the PLL if the quality is good enough (the crossing
+    // time is the interpolated time from the detector rather than the sample time)
+    // Returns true if there was a zero crossing that was passed to the PLL
+    bool updateQualityAndPLL(double sample, double irSample, double filteredSample, bool isZeroCrossing, 
+                bool& isPLLUpdated)
+    {
+        _signalQuality.process(sample, irSample, filteredSample);
+        if (!isZeroCrossing)
+            return false;
+        uint32_t crossingMs = _zeroCrossingDetector.getCrossingTimeMs();
+        double crossingFracMs = _zeroCrossingDetector.getCrossingFracMs();
+        _signalQuality.addZeroCrossing(crossingMs);
+        if (_isQualityGateEnabled && !_signalQuality.isGateOpen())
+        {
+            _isPLLHeld = true;
+            return false;
+        }
+
+        // The interval since the last crossing passed to the PLL is not valid after crossings have been held
+        if (_isPLLHeld)
+        {
+            _phaseLockedLoop.restartInterval(crossingMs, crossingFracMs);
+            _isPLLHeld = false;
+        }
+        else
+        {
+            isPLLUpdated = _phaseLockedLoop.processZeroCrossing(crossingMs, crossingFracMs);
+        }
+        return true;
+    }
+
+    // Time of the last beat (zero crossing) rounded to ms
+    uint32_t getBeatTimeMs() const
+    {
+        return _zeroCrossingDetector.getCrossingTimeMs() + (_zeroCrossingDetector.getCrossingFracMs() >= 0.5 ? 1 : 0);
+    }
+
+    // Result at a sample time
+    HRMResult getResult(uint32_t sampleTimeMs)
+    {
+        HRMResult result;
+        result.heartRateHz = getHeartRateHz();
+        result.timeOfNextPeakMs = getTimeOfNextPeakMs(sampleTimeMs);
+        result.heartRatePulseIntervalMs = getHeartRatePulseIntervalMs();
+        result.confidence = _signalQuality.getConfidence();
+        result.contactDC = _signalQuality.getContactDC();
+        result.isSkinContact = _signalQuality.isContact();
+        return result;
+    }
+
+    // Trace
+    HRMTrace* _pTrace = nullptr;
+    void traceSample(uint32_t sampleTimeMs, int32_t sample, double filteredSample, bool isZeroCrossing, bool isPLLUpdated)
+    {
+        const PIDControl& pid = _phaseLockedLoop.getFrequencyPID();
+        _pTrace->add(HRMTrace::Record{sampleTimeMs, sample, (float)filteredSample,
+                    (float)_phaseLockedLoop.getLastMeasuredFreqHz(), (float)_phaseLockedLoop.getBeatFreqHz(),
+                    (float)pid.getLastP(), (float)pid.getLastI(), (float)pid.getLastD(),
+                    (uint8_t)((isZeroCrossing ? HRMTrace::FLAG_ZERO_CROSSING : 0) | 
+                              (isPLLUpdated ? HRMTrace::FLAG_PLL_UPDATED : 0) |
+                              (_signalQuality.isGateOpen() ? HRMTrace::FLAG_QUALITY_GATE_OPEN : 0))});
+    }
 };
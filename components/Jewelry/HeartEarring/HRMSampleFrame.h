@@ -0,0 +1,86 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM sample frame
+//
+// Compact binary framing of HRM sensor samples for streaming (decoded on the host by
+// evaluations/HRMAnalysis/DebugCPPAnalysis/DecodeHRMSampleFrames.py)
+//
+// Frame layout (multi-byte values are little-endian)
+//   0      magic (0xA5)
+//   1      frame sequence number (wraps at 256 - gaps indicate dropped frames)
+//   2      number of samples N
+//   3..6   time of first sample in ms (uint32)
+//   7..    N samples of 6 bytes each
+//            0      time delta from previous sample in ms (0 for the first sample)
+//            1..5   40 bit value - Red in bits 0..17, IR in bits 18..35, bits 36..39 zero
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+class HRMSampleFrame
+{
+public:
+    static const uint8_t FRAME_MAGIC = 0xA5;
+    static const uint32_t HEADER_BYTES = 7;
+    static const uint32_t BYTES_PER_SAMPLE = 6;
+    static const uint32_t MAX_SAMPLES = 32;
+    static const uint32_t MAX_FRAME_BYTES = HEADER_BYTES + MAX_SAMPLES * BYTES_PER_SAMPLE;
+    static const uint32_t SAMPLE_VALUE_MASK = 0x3ffff;
+    static const uint32_t MAX_TIME_DELTA_MS = 255;
+
+    // Start a frame
+    void start(uint8_t seqNum, uint32_t firstSampleTimeMs)
+    {
+        _data[0] = FRAME_MAGIC;
+        _data[1] = seqNum;
+        _data[2] = 0;
+        _data[3] = firstSampleTimeMs & 0xff;
+        _data[4] = (firstSampleTimeMs >> 8) & 0xff;
+        _data[5] = (firstSampleTimeMs >> 16) & 0xff;
+        _data[6] = (firstSampleTimeMs >> 24) & 0xff;
+        _lastTimeMs = firstSampleTimeMs;
+        _len = HEADER_BYTES;
+    }
+
+    // Add a sample - returns false if the frame is full or the time delta can't be represented
+    // (in which case the caller should start a new frame)
+    bool add(uint32_t timeMs, uint32_t red, uint32_t ir)
+    {
+        uint32_t deltaMs = timeMs - _lastTimeMs;
+        if ((_data[2] >= MAX_SAMPLES) || (deltaMs > MAX_TIME_DELTA_MS))
+            return false;
+        uint64_t packed = (uint64_t)(red & SAMPLE_VALUE_MASK) | ((uint64_t)(ir & SAMPLE_VALUE_MASK) << 18);
+        uint8_t* pSample = _data + _len;
+        pSample[0] = deltaMs;
+        for (uint32_t i = 0; i < 5; i++)
+            pSample[i + 1] = (packed >> (i * 8)) & 0xff;
+        _len += BYTES_PER_SAMPLE;
+        _lastTimeMs = timeMs;
+        _data[2]++;
+        return true;
+    }
+
+    // Access
+    uint32_t numSamples() const
+    {
+        return _data[2];
+    }
+    uint32_t length() const
+    {
+        return _len;
+    }
+    const uint8_t* data() const
+    {
+        return _data;
+    }
+
+private:
+    uint8_t _data[MAX_FRAME_BYTES] = {};
+    uint32_t _len = 0;
+    uint32_t _lastTimeMs = 0;
+};
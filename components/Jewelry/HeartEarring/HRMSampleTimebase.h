@@ -0,0 +1,195 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM sample timebase
+//
+// Reconstructs sensor sample times from the arrival times of bursts of samples (FIFO reads). The sensor
+// produces samples at a fixed period from its own oscillator - which drifts from the nominal period and
+// from the host timer - and samples arrive in bursts at poll (or FIFO interrupt) times. The time from a
+// sample being produced to its arrival varies (with the poll time relative to the sample times and with the
+// number of samples waiting in the FIFO) so stamping samples back from the arrival time at the nominal period
+// puts both the drift and the arrival jitter into the intervals at burst boundaries (and so into the
+// intervals between beats).
+//
+// The arrival time of each burst is fitted against the index of the latest sample produced (the last sample of
+// the burst plus any samples left in the FIFO to be read by the next burst) with a recursive least
+// squares line fit with exponential forgetting (weighted sums in coordinates relative to the latest burst so
+// the values stay small). The slope is the sample period and the fitted time of the latest sample is used to
+// stamp the samples of the burst at the fitted period. Until there are enough bursts for the slope to be
+// reliable it is pulled towards the previous period estimate (initially nominal) by a prior weight. As
+// samples arrive some time after they are produced the stamped times include the average arrival latency
+// (as stamping from the arrival time does).
+//
+// Samples known to be lost (e.g. sensor FIFO overflow) advance the sample index. An arrival time more than a
+// few sample periods from the fit (e.g. samples lost without being counted, a gap in polling or a change of
+// sample rate that wasn't signalled) restarts the fit from that burst keeping the period estimate.
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+class HRMSampleTimebase
+{
+public:
+    // Setup
+    // windowSamples is the time constant (in samples) of the exponential forgetting, periodPriorWeight the
+    // weight of the previous period estimate (comparable with the weighted sum of squared sample index
+    // deviations of the fitted bursts) and the period is limited to the nominal period +/- maxPeriodError
+    // (fraction)
+    void setup(double windowSamples, double periodPriorWeight, double maxPeriodError)
+    {
+        _forgetPerSample = windowSamples > 0 ? exp(-1 / windowSamples) : 0;
+        _periodPriorWeight = periodPriorWeight;
+        _maxPeriodError = maxPeriodError;
+    }
+
+    // Restart with a nominal sample period (e.g. when the sensor sample rate is changed)
+    void reset(double nominalPeriodMs)
+    {
+        _nominalPeriodMs = nominalPeriodMs;
+        _periodMs = nominalPeriodMs;
+        _priorPeriodMs = nominalPeriodMs;
+        _isValid = false;
+    }
+
+    // Restart keeping the period estimate (e.g. after samples are lost)
+    void restart()
+    {
+        _priorPeriodMs = _periodMs;
+        _isValid = false;
+    }
+
+    // Restamp a burst of samples - the time of the last sample is taken as the arrival time of the burst,
+    // numLost is the number of samples lost (not received) before the burst and numPending the number left
+    // in the FIFO after it
+    // SampleRec must have a timeMs member (e.g. poll_MAX30101)
+    template<typename SampleRec>
+    void restamp(SampleRec* pSamples, uint32_t numSamples, uint32_t numLost = 0, uint32_t numPending = 0)
+    {
+        if (!pSamples || (numSamples == 0))
+            return;
+        addBurst(pSamples[numSamples-1].timeMs, numSamples, numLost, numPending);
+        for (uint32_t i = 0; i < numSamples; i++)
+        {
+            double sampleOffsetMs = _lastSampleOffsetMs - (numPending + numSamples - 1 - i) * _periodMs;
+            pSamples[i].timeMs = _lastArrivalMs + (int32_t)floor(sampleOffsetMs + 0.5);
+        }
+    }
+
+    // Add a burst of samples (numLost samples lost before the burst and numPending left in the FIFO after it
+    // advance the index of the latest sample) - returns the arrival time error (arrival time less the time of
+    // the latest sample predicted by the fit before this burst) in ms
+    double addBurst(uint32_t arrivalMs, uint32_t numSamples, uint32_t numLost = 0, uint32_t numPending = 0)
+    {
+        if (numSamples == 0)
+            return 0;
+
+        // First burst
+        if (!_isValid)
+        {
+            restartFit(arrivalMs, numPending);
+            return 0;
+        }
+
+        // Error against the prediction
+        double sinceLastMs = (double)(int32_t)(arrivalMs - _lastArrivalMs);
+        double dx = (double)numSamples + numLost + numPending - _lastPending;
+        double errorMs = sinceLastMs - (_lastSampleOffsetMs + dx * _periodMs);
+        if (fabs(errorMs) > LARGE_ERROR_PERIODS * _periodMs)
+        {
+            _priorPeriodMs = _periodMs;
+            restartFit(arrivalMs, numPending);
+            _numRestarts++;
+            return errorMs;
+        }
+
+        // Move the origin to this burst (x is sample index, y is arrival time in ms), forget and add the burst
+        double dy = sinceLastMs;
+        _sumXY += -dy * _sumX - dx * _sumY + dx * dy * _sum1;
+        _sumXX += -2 * dx * _sumX + dx * dx * _sum1;
+        _sumX -= dx * _sum1;
+        _sumY -= dy * _sum1;
+        double forget = pow(_forgetPerSample, dx);
+        _sum1 = _sum1 * forget + 1;
+        _sumX *= forget;
+        _sumY *= forget;
+        _sumXX *= forget;
+        _sumXY *= forget;
+        _lastArrivalMs = arrivalMs;
+        _lastPending = numPending;
+        updateFit();
+        return errorMs;
+    }
+
+    // Fitted sample period
+    double getPeriodMs() const
+    {
+        return _periodMs;
+    }
+
+    // Drift of the fitted period from nominal (parts per million, positive if the sensor is slow)
+    double getDriftPPM() const
+    {
+        return _nominalPeriodMs > 0 ? (_periodMs / _nominalPeriodMs - 1) * 1e6 : 0;
+    }
+
+    // Number of times the fit has been restarted on a large error
+    uint32_t getNumRestarts() const
+    {
+        return _numRestarts;
+    }
+
+private:
+    // Settings
+    double _forgetPerSample = 0;
+    double _periodPriorWeight = 0;
+    double _maxPeriodError = 0.05;
+    double _nominalPeriodMs = 40;
+
+    // Weighted sums relative to the last burst (arrival time and index of latest sample)
+    bool _isValid = false;
+    uint32_t _lastArrivalMs = 0;
+    uint32_t _lastPending = 0;
+    double _sum1 = 0;
+    double _sumX = 0;
+    double _sumY = 0;
+    double _sumXX = 0;
+    double _sumXY = 0;
+
+    // Fit - period and time of the latest sample relative to the arrival time
+    double _periodMs = 40;
+    double _priorPeriodMs = 40;
+    double _lastSampleOffsetMs = 0;
+
+    // Restart the fit if the arrival time is more than this number of periods from the prediction
+    static constexpr double LARGE_ERROR_PERIODS = 5;
+    uint32_t _numRestarts = 0;
+
+    void restartFit(uint32_t arrivalMs, uint32_t numPending)
+    {
+        _lastArrivalMs = arrivalMs;
+        _lastPending = numPending;
+        _sum1 = 1;
+        _sumX = _sumY = _sumXX = _sumXY = 0;
+        _periodMs = _priorPeriodMs;
+        _lastSampleOffsetMs = 0;
+        _isValid = true;
+    }
+
+    void updateFit()
+    {
+        double meanX = _sumX / _sum1;
+        double meanY = _sumY / _sum1;
+        double varXX = _sumXX - _sumX * meanX;
+        double covXY = _sumXY - _sumX * meanY;
+        double periodMs = (covXY + _periodPriorWeight * _priorPeriodMs) / (varXX + _periodPriorWeight);
+        _periodMs = std::clamp(periodMs, _nominalPeriodMs * (1 - _maxPeriodError),
+                    _nominalPeriodMs * (1 + _maxPeriodError));
+        _lastSampleOffsetMs = meanY - _periodMs * meanX;
+    }
+};
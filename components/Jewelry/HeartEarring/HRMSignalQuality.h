@@ -0,0 +1,228 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM signal quality
+//
+// Streaming estimate of how much the sensor signal can be trusted, updated in constant time per sample:
+//   Contact        DC level of Red and IR (exponential average) - skin reflects much more light than air
+//   Perfusion      AC/DC ratio - RMS of the bandpass filtered signal relative to the DC level. Too small
+//                  and there is no pulse, too large and the sensor is moving against the skin
+//   Band power     Fraction of the AC power (sample less DC) that is in the heart rate band - motion and
+//                  baseline wander put most of the power outside the band
+//   Intervals      Variability (coefficient of variation) of the zero crossing intervals - crossings of a
+//                  pulse are regular
+// Each measure is mapped to a score between 0 and 1 and the confidence is the product of the scores (0 if
+// there is no skin contact)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+struct HRMSignalQualityParams
+{
+    double dcTimeConstSecs = 1.0;
+    double powerTimeConstSecs = 2.0;
+    double intervalAlpha = 0.25;
+    double contactMinDC = 50000;
+    double perfusionMin = 0.00001;
+    double perfusionMax = 0.02;
+    double bandPowerRatioMin = 0.1;
+    double intervalCVMax = 0.5;
+    double gateConfidence = 0.25;
+};
+
+class HRMSignalQuality
+{
+public:
+    typedef HRMSignalQualityParams Params;
+
+    HRMSignalQuality(const Params& params = Params(), double sampleRateHz = 25.0) :
+        _params(params)
+    {
+        setSampleRate(sampleRateHz);
+    }
+
+    // Set sample rate (averaging coefficients depend on it)
+    void setSampleRate(double sampleRateHz)
+    {
+        _dcAlpha = alphaFromTimeConst(_params.dcTimeConstSecs, sampleRateHz);
+        _powerAlpha = alphaFromTimeConst(_params.powerTimeConstSecs, sampleRateHz);
+    }
+
+    // Restart (e.g. after a gap in the samples) - averages are re-initialised from the next sample
+    void reset()
+    {
+        _isFirstSample = true;
+        _lastCrossingMs = 0;
+        _numIntervals = 0;
+    }
+
+    // Restart the zero crossing intervals (e.g. after a gap that has been bridged) - the interval across the
+    // gap is not added but the averages and interval statistics are kept
+    void restartIntervals()
+    {
+        _lastCrossingMs = 0;
+    }
+
+    // State (e.g. for saving and restoring across a restart) - averages and interval statistics (the zero
+    // crossing intervals restart when the state is set)
+    struct State
+    {
+        uint8_t isStarted;
+        float dcRed;
+        float dcIR;
+        float totalPower;
+        float bandPower;
+        uint32_t numIntervals;
+        float intervalMeanMs;
+        float intervalVarMs2;
+    };
+    State getState() const
+    {
+        return State{(uint8_t)!_isFirstSample, (float)_dcRed, (float)_dcIR, (float)_totalPower, (float)_bandPower, 
+                    _numIntervals, (float)_intervalMeanMs, (float)_intervalVarMs2};
+    }
+    void setState(const State& state)
+    {
+        _isFirstSample = !state.isStarted;
+        _dcRed = state.dcRed;
+        _dcIR = state.dcIR;
+        _totalPower = state.totalPower;
+        _bandPower = state.bandPower;
+        _numIntervals = state.numIntervals;
+        _intervalMeanMs = state.intervalMeanMs;
+        _intervalVarMs2 = state.intervalVarMs2;
+        _lastCrossingMs = 0;
+    }
+
+    // Process a sample - red and ir are raw sensor values (ir 0 if not available) and filtered is the
+    // bandpass filtered red value
+    void process(double red, double ir, double filtered)
+    {
+        if (_isFirstSample)
+        {
+            _dcRed = red;
+            _dcIR = ir;
+            _totalPower = 0;
+            _bandPower = 0;
+            _isFirstSample = false;
+        }
+        _dcRed += _dcAlpha * (red - _dcRed);
+        _dcIR += _dcAlpha * (ir - _dcIR);
+        double ac = red - _dcRed;
+        _totalPower += _powerAlpha * (ac * ac - _totalPower);
+        _bandPower += _powerAlpha * (filtered * filtered - _bandPower);
+    }
+
+    // Add a zero crossing (all crossings, whether or not they are passed to the PLL)
+    void addZeroCrossing(uint32_t timeMs)
+    {
+        if (_lastCrossingMs != 0)
+        {
+            double intervalMs = (double)(timeMs - _lastCrossingMs);
+            if (_numIntervals == 0)
+            {
+                _intervalMeanMs = intervalMs;
+                _intervalVarMs2 = 0;
+            }
+            else
+            {
+                double deltaMs = intervalMs - _intervalMeanMs;
+                _intervalMeanMs += _params.intervalAlpha * deltaMs;
+                _intervalVarMs2 = (1 - _params.intervalAlpha) * (_intervalVarMs2 + _params.intervalAlpha * deltaMs * deltaMs);
+            }
+            _numIntervals++;
+        }
+        _lastCrossingMs = timeMs;
+    }
+
+    // Confidence (0..1) - calculated when requested (usually once per zero crossing or block of samples)
+    double getConfidence() const
+    {
+        if (!isContact() || (_numIntervals == 0))
+            return 0;
+        double perfusion = getPerfusion();
+        double perfusionScore = ramp(perfusion, _params.perfusionMin, 2 * _params.perfusionMin) *
+                    (1 - ramp(perfusion, _params.perfusionMax, 2 * _params.perfusionMax));
+        double bandScore = ramp(getBandPowerRatio(), _params.bandPowerRatioMin, 2 * _params.bandPowerRatioMin);
+        double intervalScore = 1 - ramp(getIntervalCV(), _params.intervalCVMax / 2, _params.intervalCVMax);
+        return perfusionScore * bandScore * intervalScore;
+    }
+
+    // Check if the confidence is high enough for the signal to be used (e.g. by the PLL)
+    bool isGateOpen() const
+    {
+        return getConfidence() >= _params.gateConfidence;
+    }
+
+    // Skin contact
+    bool isContact() const
+    {
+        return !_isFirstSample && (getContactDC() >= _params.contactMinDC);
+    }
+
+    // DC level used for contact detection (the higher of Red and IR so that either LED can be used)
+    double getContactDC() const
+    {
+        return std::max(_dcRed, _dcIR);
+    }
+
+    // DC level of Red
+    double getDCRed() const
+    {
+        return _dcRed;
+    }
+
+    // Measures
+    double getPerfusion() const
+    {
+        return _dcRed > 0 ? sqrt(_bandPower) / _dcRed : 0;
+    }
+    double getBandPowerRatio() const
+    {
+        return _totalPower > 0 ? std::min(_bandPower / _totalPower, 1.0) : 0;
+    }
+    double getIntervalCV() const
+    {
+        return _intervalMeanMs > 0 ? sqrt(_intervalVarMs2) / _intervalMeanMs : 0;
+    }
+
+private:
+    Params _params;
+    double _dcAlpha = 0;
+    double _powerAlpha = 0;
+
+    // Averages
+    bool _isFirstSample = true;
+    double _dcRed = 0;
+    double _dcIR = 0;
+    double _totalPower = 0;
+    double _bandPower = 0;
+
+    // Zero crossing intervals
+    uint32_t _lastCrossingMs = 0;
+    uint32_t _numIntervals = 0;
+    double _intervalMeanMs = 0;
+    double _intervalVarMs2 = 0;
+
+    // 0 below lo rising linearly to 1 at hi
+    static double ramp(double val, double lo, double hi)
+    {
+        if (hi <= lo)
+            return val >= hi ? 1 : 0;
+        return std::clamp((val - lo) / (hi - lo), 0.0, 1.0);
+    }
+
+    // Exponential average coefficient for a time constant
+    static double alphaFromTimeConst(double timeConstSecs, double sampleRateHz)
+    {
+        if ((timeConstSecs <= 0) || (sampleRateHz <= 0))
+            return 1;
+        return 1 - exp(-1 / (timeConstSecs * sampleRateHz));
+    }
+};
@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM analysis state snapshot
+//
+// Versioned record of the HRM analysis state for memory that survives a restart or deep sleep (RTC memory on
+// the device) so that the analysis resumes with the PLL frequency and lock, PID, filter and signal quality
+// state rather than re-acquiring from scratch. The memory isn't initialised on power up so the record is
+// checked (magic, version, size and CRC) before it is used
+//
+// Two times are saved with the state:
+//   RTC time       Keeps counting through deep sleep and software resets so gives the age of the snapshot
+//   millis()       Restarts from 0 after a reset so times in the state are moved to the new timeline by
+//                  the offset between the save time (advanced by the age) and millis() now
+//
+// The record is trivially constructible (no member initialisers) so a static instance isn't cleared at startup
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+#include "HRMAnalysis.h"
+
+class HRMStateSnapshot
+{
+public:
+    static const uint32_t MAGIC = 0x534d5248;
+    static const uint16_t VERSION = 1;
+
+    // Save state - rtcTimeUs is the RTC time and timeMs the millis() time now
+    void save(const HRMAnalysis::State& state, uint64_t rtcTimeUs, uint32_t timeMs)
+    {
+        memset(this, 0, sizeof(*this));
+        _magic = MAGIC;
+        _version = VERSION;
+        _size = sizeof(HRMAnalysis::State);
+        _saveRTCTimeUs = rtcTimeUs;
+        _saveTimeMs = timeMs;
+        memcpy(&_state, &state, sizeof(_state));
+        _crc = calcCRC();
+    }
+
+    // Restore state if valid and no older than maxAgeUs - returns false if not restored
+    // timeOffsetMs is the offset to add to millis() times in the state
+    bool restore(HRMAnalysis::State& state, uint64_t rtcTimeUs, uint32_t timeMs, uint64_t maxAgeUs,
+                int32_t& timeOffsetMs, uint64_t& ageUs) const
+    {
+        if (!isValid() || (rtcTimeUs < _saveRTCTimeUs))
+            return false;
+        ageUs = rtcTimeUs - _saveRTCTimeUs;
+        if (ageUs > maxAgeUs)
+            return false;
+        timeOffsetMs = (int32_t)(timeMs - (_saveTimeMs + (uint32_t)(ageUs / 1000)));
+        memcpy(&state, &_state, sizeof(state));
+        return true;
+    }
+
+    // Check valid
+    bool isValid() const
+    {
+        return (_magic == MAGIC) && (_version == VERSION) && (_size == sizeof(HRMAnalysis::State)) &&
+                    (_crc == calcCRC());
+    }
+
+private:
+    uint32_t _magic;
+    uint16_t _version;
+    uint16_t _size;
+    uint64_t _saveRTCTimeUs;
+    uint32_t _saveTimeMs;
+    HRMAnalysis::State _state;
+    uint32_t _crc;
+
+    // CRC-32 (reflected, polynomial 0xedb88320) of the record up to the CRC
+    uint32_t calcCRC() const
+    {
+        const uint8_t* pData = (const uint8_t*)this;
+        uint32_t crc = 0xffffffff;
+        for (size_t i = 0; i < offsetof(HRMStateSnapshot, _crc); i++)
+        {
+            crc ^= pData[i];
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+        return ~crc;
+    }
+};
+
+static_assert(std::is_trivial<HRMStateSnapshot>::value, "HRMStateSnapshot must be trivial (not cleared at startup)");
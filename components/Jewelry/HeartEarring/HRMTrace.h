@@ -0,0 +1,153 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM pipeline trace
+//
+// Per-sample trace of the HRM analysis stages (filter output, zero crossings, PLL and PID state) held in
+// a preallocated ring and drained in batches as binary frames. Tracing is enabled at runtime and when
+// disabled the cost is a single flag check per sample
+//
+// Frame layout (multi-byte values are little-endian, floats are IEEE754 single precision)
+//   0      magic (0xA6)
+//   1      number of records N
+//   2..3   records dropped since the previous frame (uint16, saturates)
+//   4..    N records of RECORD_BYTES each
+//            0..3    sample time ms (uint32)
+//            4..7    raw sample (int32)
+//            8..11   filtered sample (float)
+//            12..15  PLL measured frequency Hz (float) - from the last zero crossing interval
+//            16..19  PLL beat (locked) frequency Hz (float)
+//            20..23  PID proportional term (float)
+//            24..27  PID integral term (float)
+//            28..31  PID derivative term (float)
+//            32      flags - bit 0 zero crossing, bit 1 PLL updated, bit 2 signal quality gate open
+//
+// Decoded on the host by evaluations/HRMAnalysis/HRMTraceReplay/DecodeHRMTraceFrames.py
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include "SPSCRing.h"
+
+class HRMTrace
+{
+public:
+    static const uint8_t FRAME_MAGIC = 0xA6;
+    static const uint32_t HEADER_BYTES = 4;
+    static const uint32_t RECORD_BYTES = 33;
+    static const uint32_t MAX_RECORDS_PER_FRAME = 255;
+
+    // Flags
+    static const uint8_t FLAG_ZERO_CROSSING = 0x01;
+    static const uint8_t FLAG_PLL_UPDATED = 0x02;
+    static const uint8_t FLAG_QUALITY_GATE_OPEN = 0x04;
+
+    // Trace record
+    struct Record
+    {
+        uint32_t timeMs;
+        int32_t sample;
+        float filtered;
+        float measuredFreqHz;
+        float beatFreqHz;
+        float pidP;
+        float pidI;
+        float pidD;
+        uint8_t flags;
+    };
+
+    // Enable / disable (can be called from any task)
+    void setEnabled(bool enabled)
+    {
+        _isEnabled.store(enabled, std::memory_order_relaxed);
+    }
+    bool isEnabled() const
+    {
+        return _isEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Add a record (producer only) - the record is dropped if the ring is full
+    void add(const Record& rec)
+    {
+        _records.put(rec);
+    }
+
+    // Get frame of records (consumer only) - returns the number of bytes written to pBuf
+    // (0 if no records are available or the buffer can't hold a header and one record)
+    uint32_t getFrame(uint8_t* pBuf, uint32_t bufLen)
+    {
+        if (bufLen < HEADER_BYTES + RECORD_BYTES)
+            return 0;
+        uint32_t maxRecs = (bufLen - HEADER_BYTES) / RECORD_BYTES;
+        if (maxRecs > MAX_RECORDS_PER_FRAME)
+            maxRecs = MAX_RECORDS_PER_FRAME;
+        uint32_t numRecs = 0;
+        Record rec;
+        while ((numRecs < maxRecs) && _records.get(rec))
+            serialize(rec, pBuf + HEADER_BYTES + (numRecs++) * RECORD_BYTES);
+        if (numRecs == 0)
+            return 0;
+
+        // Header
+        uint32_t droppedCount = _records.getDroppedCount();
+        uint32_t droppedSinceLast = droppedCount - _lastDroppedCount;
+        _lastDroppedCount = droppedCount;
+        if (droppedSinceLast > UINT16_MAX)
+            droppedSinceLast = UINT16_MAX;
+        pBuf[0] = FRAME_MAGIC;
+        pBuf[1] = numRecs;
+        pBuf[2] = droppedSinceLast & 0xff;
+        pBuf[3] = (droppedSinceLast >> 8) & 0xff;
+        return HEADER_BYTES + numRecs * RECORD_BYTES;
+    }
+
+    // Get count of changes (changes whenever records are added or removed)
+    uint32_t getChangeCount() const
+    {
+        return _records.getPutCount() + _records.getGetCount();
+    }
+
+    // Number of records dropped because the ring was full
+    uint32_t getDroppedCount() const
+    {
+        return _records.getDroppedCount();
+    }
+
+private:
+    static const uint32_t RING_SIZE = 128;
+    std::atomic<bool> _isEnabled = false;
+    SPSCRing<Record, RING_SIZE> _records;
+    uint32_t _lastDroppedCount = 0;
+
+    // Serialize a record
+    static void serialize(const Record& rec, uint8_t* pBuf)
+    {
+        putUint32(pBuf, rec.timeMs);
+        putUint32(pBuf + 4, (uint32_t)rec.sample);
+        putFloat(pBuf + 8, rec.filtered);
+        putFloat(pBuf + 12, rec.measuredFreqHz);
+        putFloat(pBuf + 16, rec.beatFreqHz);
+        putFloat(pBuf + 20, rec.pidP);
+        putFloat(pBuf + 24, rec.pidI);
+        putFloat(pBuf + 28, rec.pidD);
+        pBuf[32] = rec.flags;
+    }
+    static void putUint32(uint8_t* pBuf, uint32_t val)
+    {
+        pBuf[0] = val & 0xff;
+        pBuf[1] = (val >> 8) & 0xff;
+        pBuf[2] = (val >> 16) & 0xff;
+        pBuf[3] = (val >> 24) & 0xff;
+    }
+    static void putFloat(uint8_t* pBuf, float val)
+    {
+        uint32_t bits = 0;
+        memcpy(&bits, &val, sizeof(bits));
+        putUint32(pBuf, bits);
+    }
+};
@@ -11,23 +11,24 @@
 #include "RaftCore.h"
 #include "RaftJsonPrefixed.h"
 #include "DeviceManager.h"
-#include "DevicePollRecords_generated.h"
 #include "DeviceTypeRecords.h"
 #include "esp_sleep.h"
+#include "esp_attr.h"
+#include "esp_private/esp_clk.h"
+#include "driver/gpio.h"
 
 // Debug heart rate
 // #define DEBUG_HEART_RATE
 // #define DEBUG_HEART_RATE_SAMPLES
 // #define DEBUG_DEVICE_DATA_CALLBACK
 
+// HRM analysis state kept in RTC memory (not initialised on reset or wake from deep sleep)
+static RTC_NOINIT_ATTR HRMStateSnapshot hrmStateSnapshot;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Constructor
 HeartEarring::HeartEarring()
-{
-    // Mutexes
-    RaftMutex_init(_heartRateValueMutex);
-    RaftMutex_init(_lastSamplesJSONMutex);
-}
+{}
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Destructor
@@ -37,7 +38,7 @@ HeartEarring::~HeartEarring()
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Setup
-void HeartEarring::setup(const RaftJsonIF& config, DeviceManager& devMan)
+void HeartEarring::setup(const RaftJsonIF& config, DeviceManager& devMan, DeadlineScheduler& scheduler)
 {
     // Setup LED heart
     RaftJsonPrefixed configLEDHeart(config, "LEDHeart");
@@ -46,163 +47,668 @@ void HeartEarring::setup(const RaftJsonIF& config, DeviceManager& devMan)
     // Collect HRM samples
     _collectHRM = config.getBool("collectHRM", false);
 
+    // HRM analysis - the bandpass filter is designed for the sensor sample rate
+    double sampleRateHz = config.getDouble("HRMSensor/sampleRateHz", HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ);
+    double freqBandLowerHz = config.getDouble("HRMFilter/freqBandLowerHz", 0.75);
+    double freqBandUpperHz = config.getDouble("HRMFilter/freqBandUpperHz", 3.0);
+    double centreFreqHz = config.getDouble("HRMFilter/centreFreqHz", 1.0);
+    HRMAnalysis::PLLParams pllParams;
+    pllParams.maxPIDOutput = config.getDouble("HRMPLL/maxPIDOutput", pllParams.maxPIDOutput);
+    pllParams.kP = config.getDouble("HRMPLL/kP", pllParams.kP);
+    pllParams.kI = config.getDouble("HRMPLL/kI", pllParams.kI);
+    pllParams.kD = config.getDouble("HRMPLL/kD", pllParams.kD);
+    pllParams.acquisitionGain = config.getDouble("HRMPLL/acquisitionGain", pllParams.acquisitionGain);
+    pllParams.lockTolerance = config.getDouble("HRMPLL/lockTolerance", pllParams.lockTolerance);
+    pllParams.lockIntervals = config.getLong("HRMPLL/lockIntervals", pllParams.lockIntervals);
+    pllParams.lockLossIntervals = config.getLong("HRMPLL/lockLossIntervals", pllParams.lockLossIntervals);
+    HRMAnalysis::QualityParams qualityParams;
+    qualityParams.contactMinDC = config.getDouble("HRMQuality/contactMinDC", qualityParams.contactMinDC);
+    qualityParams.perfusionMin = config.getDouble("HRMQuality/perfusionMin", qualityParams.perfusionMin);
+    qualityParams.perfusionMax = config.getDouble("HRMQuality/perfusionMax", qualityParams.perfusionMax);
+    qualityParams.bandPowerRatioMin = config.getDouble("HRMQuality/bandPowerRatioMin", qualityParams.bandPowerRatioMin);
+    qualityParams.intervalCVMax = config.getDouble("HRMQuality/intervalCVMax", qualityParams.intervalCVMax);
+    qualityParams.gateConfidence = config.getDouble("HRMQuality/gateConfidence", qualityParams.gateConfidence);
+    HRMAnalysis::CrossingParams crossingParams;
+    crossingParams.hysteresis = config.getDouble("HRMCrossing/hysteresis", crossingParams.hysteresis);
+    crossingParams.refractoryMs = config.getDouble("HRMCrossing/refractoryMs", crossingParams.refractoryMs);
+    _hrmAnalysis = HRMAnalysis(freqBandLowerHz, freqBandUpperHz, centreFreqHz, sampleRateHz, pllParams, qualityParams,
+                crossingParams);
+    _hrmAnalysis.setQualityGateEnabled(config.getBool("HRMQuality/gateEnable", true));
+    _hrmAnalysis.setWarmStartEnabled(config.getBool("HRMFilter/warmStart", true));
+    LOG_I(MODULE_PREFIX, "setup HRM sampleRate %.2fHz band %.2f-%.2fHz centre %.2fHz PID max %.2f kP %g kI %g kD %g",
+                sampleRateHz, freqBandLowerHz, freqBandUpperHz, centreFreqHz,
+                pllParams.maxPIDOutput, pllParams.kP, pllParams.kI, pllParams.kD);
+    LOG_I(MODULE_PREFIX, "setup HRM warm start %s PLL acquisition gain %.2f lockTolerance %.2f lockIntervals %d lockLossIntervals %d",
+                config.getBool("HRMFilter/warmStart", true) ? "Y" : "N", pllParams.acquisitionGain, pllParams.lockTolerance,
+                (int)pllParams.lockIntervals, (int)pllParams.lockLossIntervals);
+    LOG_I(MODULE_PREFIX, "setup HRM quality gate %s contactMinDC %.0f perfusion %g-%g bandPowerRatioMin %.2f intervalCVMax %.2f gateConfidence %.2f",
+                config.getBool("HRMQuality/gateEnable", true) ? "Y" : "N", qualityParams.contactMinDC, 
+                qualityParams.perfusionMin, qualityParams.perfusionMax, qualityParams.bandPowerRatioMin, 
+                qualityParams.intervalCVMax, qualityParams.gateConfidence);
+    LOG_I(MODULE_PREFIX, "setup HRM crossing hysteresis %.2f refractory %.0fms",
+                crossingParams.hysteresis, crossingParams.refractoryMs);
+
+    // Sensor profiles - normal is as set by the device type initValues (apart from the LED pulse amplitude if
+    // configured) and the filter is designed for the configured sample rate. The pilot level contact threshold
+    // defaults to the contact threshold scaled by the LED current
+    _hrmSensorControl.setup(HRM_SENSOR_BUS_NAME, HRM_SENSOR_ADDRESS);
+    _sensorNormalSampleRateHz = sampleRateHz;
+    _sensorNormalSettings.redPA = _sensorNormalSettings.irPA = config.getLong("HRMSensor/ledPA", MAX30101Control::LED_PA_INIT);
+    _sensorLEDPowerDownEnabled = config.getBool("HRMSensor/ledPowerDown", true);
+    _sensorPilotLEDPA = config.getLong("HRMSensor/pilotLEDPA", SENSOR_PILOT_LED_PA_DEFAULT);
+    _pilotContactMinDC = config.getDouble("HRMSensor/pilotContactMinDC", _sensorNormalSettings.redPA > 0 ? 
+                qualityParams.contactMinDC * _sensorPilotLEDPA / _sensorNormalSettings.redPA : 0);
+    _noContactPowerDownUs = config.getDouble("HRMSensor/noContactSecs", NO_CONTACT_SECS_DEFAULT) * 1000000;
+    LOG_I(MODULE_PREFIX, "setup sensor LED power down %s LED PA 0x%02x pilot PA 0x%02x pilotContactMinDC %.0f noContact %.1fs",
+                _sensorLEDPowerDownEnabled ? "Y" : "N", _sensorNormalSettings.redPA, _sensorPilotLEDPA, _pilotContactMinDC,
+                _noContactPowerDownUs / 1e6);
+
+    // Low power sensor profile (the output sample rate must be high enough for the filter band)
+    _sensorLowPowerEnabled = config.getBool("HRMSensor/lowPower/enable", true);
+    _sensorLowPowerSettings.adcSampleRateHz = config.getLong("HRMSensor/lowPower/adcSampleRateHz", 50);
+    _sensorLowPowerSettings.sampleAvg = config.getLong("HRMSensor/lowPower/sampleAvg", MAX30101Control::SAMPLE_AVG_INIT);
+    _sensorLowPowerSettings.pulseWidthUs = config.getLong("HRMSensor/lowPower/pulseWidthUs", 215);
+    _sensorLowPowerSettings.redPA = config.getLong("HRMSensor/lowPower/ledPA", _sensorNormalSettings.redPA);
+    _sensorLowPowerSettings.irPA = config.getBool("HRMSensor/lowPower/irEnable", false) ? _sensorLowPowerSettings.redPA : 0;
+    _lowPowerLockBeats = config.getLong("HRMSensor/lowPower/lockBeats", LOW_POWER_LOCK_BEATS_DEFAULT);
+    _lowPowerLockConfidence = config.getDouble("HRMSensor/lowPower/lockConfidence", LOW_POWER_LOCK_CONFIDENCE_DEFAULT);
+    _lowPowerLockTolerance = config.getDouble("HRMSensor/lowPower/lockTolerance", LOW_POWER_LOCK_TOLERANCE_DEFAULT);
+    if (_sensorLowPowerEnabled && (_sensorLowPowerSettings.getOutputRateHz() <= 2 * freqBandUpperHz))
+    {
+        LOG_W(MODULE_PREFIX, "setup sensor low power sampleRate %.2fHz too low for band - disabled", 
+                    _sensorLowPowerSettings.getOutputRateHz());
+        _sensorLowPowerEnabled = false;
+    }
+    LOG_I(MODULE_PREFIX, "setup sensor low power %s sampleRate %.2fHz (ADC %dHz avg %d) pulseWidth %dus LED PA 0x%02x IR %s lockBeats %d lockConfidence %.2f lockTolerance %.2f",
+                _sensorLowPowerEnabled ? "Y" : "N", _sensorLowPowerSettings.getOutputRateHz(), 
+                (int)_sensorLowPowerSettings.adcSampleRateHz, (int)_sensorLowPowerSettings.sampleAvg, 
+                (int)_sensorLowPowerSettings.pulseWidthUs, _sensorLowPowerSettings.redPA, 
+                _sensorLowPowerSettings.irPA ? "Y" : "N", (int)_lowPowerLockBeats, _lowPowerLockConfidence, 
+                _lowPowerLockTolerance);
+    _hrmSampleIntervalUs = 1000000 / sampleRateHz;
+    _sensorSampleIntervalUs.store(_hrmSampleIntervalUs, std::memory_order_relaxed);
+
+    // Sample timebase
+    _sampleTimebaseEnabled = config.getBool("HRMTimebase/enable", true);
+    double timebaseWindowSamples = config.getDouble("HRMTimebase/windowSamples", TIMEBASE_WINDOW_SAMPLES_DEFAULT);
+    double timebasePeriodPriorWeight = config.getDouble("HRMTimebase/periodPriorWeight", TIMEBASE_PERIOD_PRIOR_WEIGHT_DEFAULT);
+    double timebaseMaxPeriodError = config.getDouble("HRMTimebase/maxPeriodError", TIMEBASE_MAX_PERIOD_ERROR_DEFAULT);
+    _sampleTimebase.setup(timebaseWindowSamples, timebasePeriodPriorWeight, timebaseMaxPeriodError);
+    _sampleTimebase.reset(_hrmSampleIntervalUs / 1000.0);
+    LOG_I(MODULE_PREFIX, "setup sample timebase %s window %.0f samples periodPriorWeight %.0f maxPeriodError %.3f",
+                _sampleTimebaseEnabled ? "Y" : "N", timebaseWindowSamples, timebasePeriodPriorWeight, timebaseMaxPeriodError);
+
+    // Sample gap handling
+    _sampleGapHandlingEnabled = config.getBool("HRMGap/enable", true);
+    _gapBridgeMaxSamples = std::min((uint32_t)config.getLong("HRMGap/bridgeMaxSamples", GAP_BRIDGE_MAX_SAMPLES_DEFAULT),
+                GAP_BRIDGE_MAX_SAMPLES);
+    LOG_I(MODULE_PREFIX, "setup sample gaps %s bridgeMaxSamples %d",
+                _sampleGapHandlingEnabled ? "Y" : "N", (int)_gapBridgeMaxSamples);
+
+    // HRM analysis state - restored from the last snapshot if recent enough (e.g. after a reset or deep sleep)
+    _hrmStateSaveEnabled = config.getBool("HRMState/enable", true);
+    _hrmStateSaveIntervalMs = config.getLong("HRMState/saveIntervalMs", HRM_STATE_SAVE_INTERVAL_MS_DEFAULT);
+    double hrmStateMaxAgeSecs = config.getDouble("HRMState/maxAgeSecs", HRM_STATE_MAX_AGE_SECS_DEFAULT);
+    _hrmStateFilterMaxAgeMs = config.getLong("HRMState/filterMaxAgeMs", HRM_STATE_FILTER_MAX_AGE_MS_DEFAULT);
+    if (_hrmStateSaveEnabled)
+        restoreHRMState(hrmStateMaxAgeSecs * 1000000);
+    LOG_I(MODULE_PREFIX, "setup HRM state %s saveInterval %dms maxAge %.0fs filterMaxAge %dms restored %s",
+                _hrmStateSaveEnabled ? "Y" : "N", (int)_hrmStateSaveIntervalMs, hrmStateMaxAgeSecs, 
+                (int)_hrmStateFilterMaxAgeMs,
+                _hrmStateRestoredAgeMs.load(std::memory_order_relaxed) >= 0 ? "Y" : "N");
+
+    // HRM analysis trace (can also be enabled at runtime)
+    _hrmAnalysis.setTrace(&_hrmTrace);
+    _hrmTrace.setEnabled(config.getBool("HRMTrace/enable", false));
+
+    // Beat phase predictor
+    _beatPredictorEnabled = config.getBool("HRMPredictor/enable", true);
+    _beatPredictor.setup(config.getDouble("HRMPredictor/peakPhase", 0.75),
+                config.getDouble("HRMPredictor/phaseGain", 0.5),
+                config.getDouble("HRMPredictor/periodGain", 0.1),
+                config.getDouble("HRMPredictor/latencyAlpha", 0.1),
+                freqBandLowerHz, freqBandUpperHz);
+    _sensorDelayUs = config.getDouble("HRMPredictor/sensorDelayMs", SENSOR_DELAY_MS_DEFAULT) * 1000;
+    LOG_I(MODULE_PREFIX, "setup beat predictor %s sensorDelay %.1fms animPeakOffset %dus",
+                _beatPredictorEnabled ? "Y" : "N", _sensorDelayUs / 1000, _ledHeart.getPeakOffsetUs());
+
+    // FIFO interrupt mode - the sensor FIFO almost full interrupt wakes the processor and the FIFO is read
+    // when the INT pin is active. The device type must have no pollInfo (see systypes/Heart1.7FIFOInt) as
+    // polls would take samples from the FIFO - if device data from polling arrives loop() falls back to polling
+    _fifoIntPin = config.getLong("HRMSensor/fifoInterrupt/intPin", -1);
+    _fifoInterruptEnabled = config.getBool("HRMSensor/fifoInterrupt/enable", false) && (_fifoIntPin >= 0);
+    if (_fifoInterruptEnabled)
+    {
+        uint32_t almostFullSamples = config.getLong("HRMSensor/fifoInterrupt/almostFullSamples", 
+                    MAX30101Control::FIFO_ALMOST_FULL_SAMPLES_INIT);
+        pinMode(_fifoIntPin, INPUT_PULLUP);
+        gpio_wakeup_enable((gpio_num_t)_fifoIntPin, GPIO_INTR_LOW_LEVEL);
+        _hrmSensorControl.setFIFOInterrupt(true, almostFullSamples);
+        LOG_I(MODULE_PREFIX, "setup sensor FIFO interrupt intPin %d almostFullSamples %d", 
+                    _fifoIntPin, (int)almostFullSamples);
+    }
+
     // Register with device manager
     devMan.registerForDeviceData("I2CA_0x57@0", 
-        [this](uint32_t deviceTypeIdx, std::vector<uint8_t> data, const void* pCallbackInfo) {
+        [this](uint32_t deviceTypeIdx, const std::vector<uint8_t>& data, const void* pCallbackInfo) {
+
+            // In FIFO interrupt mode samples are read directly - device data means the device type polls the
+            // FIFO so loop() is flagged to fall back to polling (the data is dropped until it has)
+            if (_fifoInterruptEnabled.load(std::memory_order_acquire))
+            {
+                _isSensorPolled.store(true, std::memory_order_relaxed);
+                return;
+            }
 
             // Decode device data
-            static const uint32_t MAX_ANALOG_READ_SAMPLES = 50;
-            poll_MAX30101 deviceData[MAX_ANALOG_READ_SAMPLES];
             DeviceTypeRecordDecodeFn pDecodeFn = deviceTypeRecords.getPollDecodeFn(deviceTypeIdx);
             if (!pDecodeFn)
                 return;
 
-            // Decode the data
-            uint32_t recsDecoded = pDecodeFn(data.data(), data.size(), &deviceData, sizeof(deviceData), MAX_ANALOG_READ_SAMPLES, _decodeState);
+            // Decode the data (directly from the poll data into the decode buffer - nothing is copied or
+            // allocated here but RaftDeviceDataChangeCB passes the poll data by value so Raft allocates a copy
+            // of it for each callback)
+            uint32_t recsDecoded = pDecodeFn(data.data(), data.size(), _sampleDecodeBuf, sizeof(_sampleDecodeBuf), 
+                        MAX_SAMPLES_PER_BLOCK, _decodeState);
 
             // Debug
 #ifdef DEBUG_DEVICE_DATA_CALLBACK
             LOG_I(MODULE_PREFIX, "deviceDataChangeCB devTypeIdx %d data bytes %d callbackInfo %p recs %d timeMs %d Red %d IR %d",
                     deviceTypeIdx, data.size(), pCallbackInfo, recsDecoded, 
-                    deviceData[0].timeMs, deviceData[0].Red, deviceData[0].IR);
+                    _sampleDecodeBuf[0].timeMs, _sampleDecodeBuf[0].Red, _sampleDecodeBuf[0].IR);
 #endif
 
-#ifdef DEBUG_HEART_RATE_SAMPLES
-            String debugStr;
+            // Process
+            processSamples(_sampleDecodeBuf, recsDecoded);
+        },
+        50
+    );
+
+    // Timers
+    _pScheduler = &scheduler;
+    uint64_t timeNowUs = micros();
+    _hrmUpdateIntervalUs = config.getLong("HRMSensor/updateIntervalMs", HRM_UPDATE_INTERVAL_MS_DEFAULT) * 1000;
+    _hrmUpdateTimer = scheduler.addTimer("hrmUpdate", [this](uint64_t timeNowUs) { updateHRM(timeNowUs); });
+    _hrmUpdateDeadlineUs = timeNowUs + _hrmUpdateIntervalUs;
+    scheduler.setDeadline(_hrmUpdateTimer, _hrmUpdateDeadlineUs);
+    _lastContactTimeUs = timeNowUs;
+#ifdef FEATURE_HEART_ANIMATIONS
+    _pulseStartTimer = scheduler.addTimer("pulseStart", [this](uint64_t timeNowUs) { startPulse(timeNowUs); });
+    _ledTimelineTimer = scheduler.addTimer("ledTimeline", [this](uint64_t timeNowUs) { playLEDTimeline(timeNowUs); });
+    _pulseStartDeadlineUs = timeNowUs + FIRST_PULSE_DELAY_US;
+    scheduler.setDeadline(_pulseStartTimer, _pulseStartDeadlineUs);
 #endif
-            // Process HRM value
-            HRMAnalysis::HRMResult analysisResult;
-            for (uint32_t i = 0; i < recsDecoded; i++)
-            {
-                // Process HRM value
-                analysisResult = _hrmAnalysis.process(deviceData[i].Red, deviceData[i].timeMs);
+
+    // Set initialized
+    _isInitialized = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Process a block of sensor samples (called from the device data callback or FIFO read)
+/// @param pSamples samples (times are adjusted)
+/// @param numSamples number of samples
+void HeartEarring::processSamples(poll_MAX30101* pSamples, uint32_t numSamples)
+{
+    // Check valid
+    if (!pSamples || (numSamples == 0))
+        return;
+
+    // If the sensor profile has changed the filter is re-designed for the new sample rate and the timebase restarted
+    uint32_t sampleIntervalUs = _sensorSampleIntervalUs.load(std::memory_order_relaxed);
+    if ((sampleIntervalUs != _hrmSampleIntervalUs) && (sampleIntervalUs > 0))
+    {
+        _hrmSampleIntervalUs = sampleIntervalUs;
+        _hrmAnalysis.setSampleRate(1e6 / sampleIntervalUs);
+        _sampleTimebase.reset(sampleIntervalUs / 1000.0);
+    }
+
+    // Samples lost are reported with the first sample after them so the block (which can contain several
+    // sensor reads) is processed in runs that start at a gap
+    HRMAnalysis::HRMResult analysisResult;
+    uint32_t runStart = 0;
+    for (uint32_t i = 1; i <= numSamples; i++)
+    {
+        if ((i < numSamples) && (getSampleLost(pSamples[i]) == 0))
+            continue;
+        analysisResult = processSampleRun(pSamples + runStart, i - runStart);
+        runStart = i;
+    }
+
+    // Publish the result (never blocks)
+    _hrmResultSnapshot.write(analysisResult);
+
+    // Latency of the last sample and filter delay at the heart rate (for the beat phase predictor)
+    // (re-timed samples can be slightly later than now)
+    int32_t sampleLatencyMs = (int32_t)(millis() - pSamples[numSamples-1].timeMs);
+    _sampleLatencyUs.store((sampleLatencyMs > 0) && (sampleLatencyMs < 10000) ? sampleLatencyMs * 1000 : 0, 
+                std::memory_order_relaxed);
+    _filterDelayUs.store(_hrmAnalysis.getFilterPhaseDelayMs(analysisResult.heartRateHz) * 1000, 
+                std::memory_order_relaxed);
+
+    // Save the analysis state at intervals (in this task as the analysis state is changed here)
+    if (_hrmStateSaveEnabled && Raft::isTimeout(millis(), _hrmStateLastSaveMs, _hrmStateSaveIntervalMs))
+        saveHRMState();
+
+    // Sample collection
+    if (_collectHRM)
+        addSampleFrames(pSamples, numSamples);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Process a run of sensor samples (samples lost before the first sample only)
+/// @param pSamples samples (times are adjusted)
+/// @param numSamples number of samples
+/// @return analysis result at the time of the last sample
+HRMAnalysis::HRMResult HeartEarring::processSampleRun(poll_MAX30101* pSamples, uint32_t numSamples)
+{
+    // Samples are timed back from the last sample at the device type sample interval (or are all at the
+    // time of the FIFO read) so they are re-timed - by the sample timebase (from the arrival time of the run
+    // and the fitted sensor sample period - samples lost and samples left in the FIFO for the next read
+    // advance the sample index) or at the interval of the sensor profile in use
+    uint32_t numLost = getSampleLost(pSamples[0]);
+    uint32_t numPending = getSamplePending(pSamples[numSamples-1]);
+    if (_sampleTimebaseEnabled)
+    {
+        // The number lost isn't known if the overflow counter has saturated
+        if (numLost >= MAX30101Control::FIFO_OVF_COUNTER_MAX)
+            _sampleTimebase.restart();
+        _sampleTimebase.restamp(pSamples, numSamples, numLost < MAX30101Control::FIFO_OVF_COUNTER_MAX ? numLost : 0,
+                    numPending);
+        _sensorDriftPPM.store((int32_t)_sampleTimebase.getDriftPPM(), std::memory_order_relaxed);
+    }
+    else
+    {
+        uint32_t arrivalMs = pSamples[numSamples-1].timeMs;
+        for (uint32_t i = 0; i < numSamples; i++)
+            pSamples[i].timeMs = arrivalMs - 
+                        (uint32_t)((uint64_t)(numPending + numSamples - 1 - i) * _hrmSampleIntervalUs / 1000);
+    }
+
+    // Bridge the gap or restart the analysis
+    if (numLost > 0)
+        handleSampleGap(pSamples[0], numLost);
+    _lastSample = pSamples[numSamples-1];
+    _isLastSampleValid = true;
 
 #ifdef DEBUG_HEART_RATE_SAMPLES
-                // Debug
-                debugStr += String(deviceData[i].timeMs) + "," + String(deviceData[i].Red) + "," + String(deviceData[i].IR) + "," + String(_hrmAnalysis._debugFilteredSample) + "," + String(_hrmAnalysis._debugIsZeroCrossing) + ";";
+    // Process HRM values one at a time to get per-sample debug values
+    String debugStr;
+    HRMAnalysis::HRMResult analysisResult;
+    for (uint32_t i = 0; i < numSamples; i++)
+    {
+        // Process HRM value
+        analysisResult = _hrmAnalysis.process(pSamples[i].Red, pSamples[i].timeMs, pSamples[i].IR);
+
+        // Debug
+        debugStr += String(pSamples[i].timeMs) + "," + String(pSamples[i].Red) + "," + String(pSamples[i].IR) + "," + String(_hrmAnalysis._debugFilteredSample) + "," + String(_hrmAnalysis._debugIsZeroCrossing) + ";";
+    }
+#else
+    // Process the run
+    HRMAnalysis::HRMResult analysisResult = _hrmAnalysis.processBlock(pSamples, numSamples,
+                [this](const HRMAnalysis::HRMBeat& beat) {
+                    _beatQueue.put(beat);
+                });
 #endif
-            }
 
 #ifdef DEBUG_HEART_RATE_SAMPLES
-            // Debug
-            LOG_I(MODULE_PREFIX, "loop BPM %.3f (%.3fHz) %s",
-                    analysisResult.heartRateHz * 60,
-                    analysisResult.heartRateHz,
-                    debugStr.c_str());
+    // Debug
+    LOG_I(MODULE_PREFIX, "loop BPM %.3f (%.3fHz) %s",
+            analysisResult.heartRateHz * 60,
+            analysisResult.heartRateHz,
+            debugStr.c_str());
 #endif
+    return analysisResult;
+}
 
-            // Take the semaphore controlling access to heart rate value
-            if (RaftMutex_lock(_heartRateValueMutex, 10))
-            {
-
-                // Update the heart rate
-                _hrmAnalysisResult = analysisResult;
-
-                // Give back the semaphore
-                RaftMutex_unlock(_heartRateValueMutex);
-            }
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Handle samples lost before a sample (sensor FIFO overflow)
+/// @param nextSample first sample after the gap (re-timed)
+/// @param numLost number of samples lost (FIFO_OVF_COUNTER_MAX if the overflow counter saturated)
+void HeartEarring::handleSampleGap(const poll_MAX30101& nextSample, uint32_t numLost)
+{
+    _sensorSamplesLost.fetch_add(numLost, std::memory_order_relaxed);
+    if (!_sampleGapHandlingEnabled || !_isLastSampleValid)
+        return;
 
-            // Sample collection
-            if (_collectHRM)
-            {                
-                // For sample JSON 
-                String irJson, redJson, timeJson;
-                irJson.reserve(recsDecoded * 10);
-                redJson.reserve(recsDecoded * 10);
-                timeJson.reserve(recsDecoded * 10);
-                for (uint32_t i = 0; i < recsDecoded; i++)
-                {
-                    irJson += (i==0 ? "" : ",") + String(deviceData[i].IR);
-                    redJson += (i==0 ? "" : ",") + String(deviceData[i].Red);
-                    timeJson += (i==0 ? "" : ",") + String(deviceData[i].timeMs);
-                }
-                if (RaftMutex_lock(_lastSamplesJSONMutex, 2))
-                {
-                    // Store JSON
-                    _lastSamplesJSON = "{\"t\":[" + timeJson + "],\"r\":[" + redJson + "],\"i\":[" + irJson + "]}";
-
-                    // Give back the semaphore
-                    RaftMutex_unlock(_lastSamplesJSONMutex);                    
-                }
-            
-#ifdef DEBUG_FIFO_DATA
-                LOG_I(MODULE_PREFIX, "loop samples time %s red %s IR %s", timeJson.c_str(), redJson.c_str(), irJson.c_str());
-#endif
-            }
-        },
-        50
-    );
+    // Short gaps are bridged with samples interpolated between the last sample and the next so the filter,
+    // zero crossing detector and PLL see the time that has passed
+    if ((numLost <= _gapBridgeMaxSamples) && (numLost < MAX30101Control::FIFO_OVF_COUNTER_MAX))
+    {
+        poll_MAX30101 bridgeSamples[GAP_BRIDGE_MAX_SAMPLES];
+        int32_t gapMs = (int32_t)(nextSample.timeMs - _lastSample.timeMs);
+        for (uint32_t i = 0; i < numLost; i++)
+        {
+            double frac = (i + 1.0) / (numLost + 1);
+            bridgeSamples[i] = nextSample;
+            bridgeSamples[i].timeMs = _lastSample.timeMs + (int32_t)(gapMs * frac);
+            bridgeSamples[i].Red = _lastSample.Red + (int32_t)(((double)nextSample.Red - _lastSample.Red) * frac);
+            bridgeSamples[i].IR = _lastSample.IR + (int32_t)(((double)nextSample.IR - _lastSample.IR) * frac);
+            setSampleGapInfo(bridgeSamples[i], 0, 0);
+        }
+        _hrmAnalysis.processBlock(bridgeSamples, numLost,
+                    [this](const HRMAnalysis::HRMBeat& beat) {
+                        _beatQueue.put(beat);
+                    });
+        _sensorGapsBridged.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
 
-    // Set initialized
-    _isInitialized = true;
+    // Longer gaps restart the analysis from the next sample (the PLL keeps its frequency)
+    _hrmAnalysis.restart(nextSample.Red);
+    _sensorGapsRestarted.fetch_add(1, std::memory_order_relaxed);
+    LOG_W(MODULE_PREFIX, "handleSampleGap %d samples lost - analysis restarted", (int)numLost);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @brief Loop - called frequently
 void HeartEarring::loop()
 {
-    // Check valid
-    if (!_isInitialized)
+    // All timed work is handled by scheduler timers apart from FIFO reads in FIFO interrupt mode
+    if (!_fifoInterruptEnabled.load(std::memory_order_relaxed))
         return;
 
+    // Start a FIFO read when the interrupt is active (INT is active low) unless falling back to polling
+    bool isSensorPolled = _isSensorPolled.load(std::memory_order_relaxed);
+    if (!isSensorPolled && (digitalRead(_fifoIntPin) == LOW) && !_hrmSensorControl.isFIFOReadInProgress())
+        _hrmSensorControl.readFIFO(fifoDataCB, this);
+
+    // Process samples read
+    const FIFOBlock* pBlock = nullptr;
+    while ((pBlock = _fifoBlocks.peek()) != nullptr)
+    {
+        uint32_t numSamples = std::min(pBlock->numSamples, MAX_SAMPLES_PER_BLOCK);
+        for (uint32_t i = 0; i < numSamples; i++)
+        {
+            const uint8_t* pSample = pBlock->data + i * MAX30101Control::FIFO_SAMPLE_BYTES;
+            _sampleDecodeBuf[i].timeMs = pBlock->timeMs;
+            _sampleDecodeBuf[i].Red = ((pSample[0] << 16) | (pSample[1] << 8) | pSample[2]) & MAX30101Control::FIFO_SAMPLE_MASK;
+            _sampleDecodeBuf[i].IR = ((pSample[3] << 16) | (pSample[4] << 8) | pSample[5]) & MAX30101Control::FIFO_SAMPLE_MASK;
+            setSampleGapInfo(_sampleDecodeBuf[i], i == 0 ? pBlock->numLost : 0, 0);
+        }
+        _fifoBlocks.discard();
+        processSamples(_sampleDecodeBuf, numSamples);
+    }
+
+    // Fall back to polling once the last FIFO read has been processed
+    if (isSensorPolled && !_hrmSensorControl.isFIFOReadInProgress() && (_fifoBlocks.count() == 0))
+        stopFIFOInterrupt();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Stop FIFO interrupt mode (the device type polls the sensor FIFO) - samples are then processed from
+/// the device data callback
+void HeartEarring::stopFIFOInterrupt()
+{
+    _hrmSensorControl.setFIFOInterrupt(false);
+    gpio_wakeup_disable((gpio_num_t)_fifoIntPin);
+    _fifoInterruptEnabled.store(false, std::memory_order_release);
+    LOG_W(MODULE_PREFIX, "FIFO interrupt mode stopped - the sensor device type polls the FIFO (remove its pollInfo)");
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief FIFO data callback (called from the bus task) - samples are queued for loop()
+/// @param pCallbackData HeartEarring
+/// @param pData sample data
+/// @param numSamples number of samples
+/// @param numLost number of samples lost before these samples
+/// @param timeMs time of the last sample
+void HeartEarring::fifoDataCB(void* pCallbackData, const uint8_t* pData, uint32_t numSamples, uint32_t numLost,
+            uint32_t timeMs)
+{
+    HeartEarring* pThis = (HeartEarring*)pCallbackData;
+    FIFOBlock block;
+    block.timeMs = timeMs;
+    block.numSamples = std::min(numSamples, MAX30101Control::FIFO_DEPTH);
+    block.numLost = numLost;
+    memcpy(block.data, pData, block.numSamples * MAX30101Control::FIFO_SAMPLE_BYTES);
+    pThis->_fifoBlocks.put(block);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update HRM result (timer)
+/// @param timeNowUs
+void HeartEarring::updateHRM(uint64_t timeNowUs)
+{
+    // Next update (based on the previous deadline so that updates don't drift)
+    _hrmUpdateDeadlineUs += _hrmUpdateIntervalUs;
+    if (_hrmUpdateDeadlineUs <= timeNowUs)
+        _hrmUpdateDeadlineUs = timeNowUs + _hrmUpdateIntervalUs;
+    _pScheduler->setDeadline(_hrmUpdateTimer, _hrmUpdateDeadlineUs);
+
+    // Get latest analysis result (the previous result is retained if a write was in progress)
+    _hrmResultSnapshot.read(_hrmAnalysisResult);
+
+    // Move beats from the queue into the history and the beat phase predictor
+    HRMAnalysis::HRMBeat beat;
+    bool isNewBeat = false;
+    while (_beatQueue.get(beat))
+    {
+        // Beat times are in ms (32 bit and wrapping) so convert relative to now - beats from before the time
+        // base started (e.g. samples left in the sensor FIFO by a restart) are ignored
+        int32_t beatAgeMs = (int32_t)((uint32_t)(timeNowUs / 1000) - beat.timeMs);
+        if ((int64_t)beatAgeMs * 1000 > (int64_t)timeNowUs)
+            continue;
+        uint64_t beatTimeUs = timeNowUs - (int64_t)beatAgeMs * 1000;
+        _beatPredictor.addBeat(beatTimeUs, beat.heartRateHz);
+        updateSensorLock(beat, beatTimeUs);
+        isNewBeat = true;
+        _beatHistory[_beatHistoryPos] = beat;
+        _beatHistoryPos = (_beatHistoryPos + 1) % BEAT_HISTORY_SIZE;
+        if (_beatHistoryCount < BEAT_HISTORY_SIZE)
+            _beatHistoryCount++;
+    }
+
+    // Beat phase predictor delays and stats
+    _beatPredictor.setSignalDelayUs(_sensorDelayUs + _filterDelayUs.load(std::memory_order_relaxed));
+    if (isNewBeat)
+    {
+        _beatPredictor.addSampleLatencyUs(_sampleLatencyUs.load(std::memory_order_relaxed));
+        _beatPredictorStatsSnapshot.write(_beatPredictor.getStats());
+    }
+
+    // Sensor profile
+    updateSensorProfile(timeNowUs);
+
     // Debug
 #ifdef DEBUG_HEART_RATE
     if (Raft::isTimeout(millis(), _lastDebugTimeMs, 1000))
     {
-        LOG_I(MODULE_PREFIX, "loop HR %.3fHz (%.3f BPM) timeOfNextPeakMs %d interval %dms",
+        LOG_I(MODULE_PREFIX, "updateHRM HR %.3fHz (%.3f BPM) timeOfNextPeakMs %d interval %dms confidence %.2f contact %s DC %.0f",
                     _hrmAnalysisResult.heartRateHz,
                     _hrmAnalysisResult.heartRateHz * 60,
                     (int)_hrmAnalysisResult.timeOfNextPeakMs,
-                    (int)_hrmAnalysisResult.heartRatePulseIntervalMs);
+                    (int)_hrmAnalysisResult.heartRatePulseIntervalMs,
+                    _hrmAnalysisResult.confidence,
+                    _hrmAnalysisResult.isSkinContact ? "Y" : "N",
+                    _hrmAnalysisResult.contactDC);
+        if (_beatHistoryCount > 0)
+        {
+            const HRMAnalysis::HRMBeat& lastBeat = _beatHistory[(_beatHistoryPos + BEAT_HISTORY_SIZE - 1) % BEAT_HISTORY_SIZE];
+            LOG_I(MODULE_PREFIX, "updateHRM beats %d lastBeatMs %d lastBeatHR %.3fHz dropped %d",
+                    (int)_beatHistoryCount, (int)lastBeat.timeMs, lastBeat.heartRateHz, 
+                    (int)_beatQueue.getDroppedCount());
+        }
+        const BeatPhasePredictor::Stats& stats = _beatPredictor.getStats();
+        LOG_I(MODULE_PREFIX, "updateHRM phase error beats %d mean %.1fms meanAbs %.1fms rms %.1fms max %.1fms "
+                    "signalDelay %.1fms sampleLatency %.1fms wakeLatency %.2fms",
+                    (int)stats.numBeats, stats.meanErrorMs, stats.meanAbsErrorMs, stats.rmsErrorMs, stats.maxAbsErrorMs,
+                    stats.signalDelayMs, stats.sampleLatencyMs, stats.wakeLatencyMs);
         _lastDebugTimeMs = millis();
     }
 #endif
+}
 
-#ifdef FEATURE_HEART_ANIMATIONS
-
-    // Check animation step
-    uint64_t timeNowUs = micros();
-    _nextSleepDurationUs = 0;
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Start pulse animation (timer)
+/// @param timeNowUs
+void HeartEarring::startPulse(uint64_t timeNowUs)
+{
+    // Lateness of the start (including any exit from light sleep) is compensated in later pulses
+    if (timeNowUs >= _pulseStartDeadlineUs)
+        _beatPredictor.addWakeLatencyUs(timeNowUs - _pulseStartDeadlineUs);
 
-    // Check state
-    if (_isPulseStart)
+    // No animation without skin contact (the heart rate isn't being measured)
+    if (!_hrmAnalysisResult.isSkinContact)
     {
-        _nextSleepDurationUs = Raft::timeToTimeout(timeNowUs, _timeOfLastStepUs, _timeToNextPulseAnimStartUs);
-        if (_nextSleepDurationUs == 0)
-        {
-            // Start pulse animation
-            _timeOfLastStepUs = timeNowUs;
-            _ledHeart.startPulseAnimation();
-            _isPulseStart = false;
-            uint64_t nextStepUs = _ledHeart.getTimeToNextAnimStepUs();
-            _nextSleepDurationUs = (nextStepUs == UINT32_MAX) ? 0 : Raft::timeToTimeout(timeNowUs, _timeOfLastStepUs, nextStepUs);
-        }
+        _pulseStartDeadlineUs = timeNowUs + NO_CONTACT_PULSE_RETRY_US;
+        _pScheduler->setDeadline(_pulseStartTimer, _pulseStartDeadlineUs);
+        return;
     }
+
+    // Start
+    _ledHeart.startPulseAnimation();
+    _pulseStartTimeUs = timeNowUs;
+    uint32_t nextEventOffsetUs = _ledHeart.getNextEventOffsetUs();
+    if (nextEventOffsetUs != UINT32_MAX)
+        _pScheduler->setDeadline(_ledTimelineTimer, _pulseStartTimeUs + nextEventOffsetUs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Play LED animation timeline event (timer)
+/// @param timeNowUs
+void HeartEarring::playLEDTimeline(uint64_t timeNowUs)
+{
+    // Event times are relative to the start of the pulse so they don't drift if an event is late
+    if (_ledHeart.playTimeline(timeNowUs - _pulseStartTimeUs))
+        _pScheduler->setDeadline(_ledTimelineTimer, _pulseStartTimeUs + _ledHeart.getNextEventOffsetUs());
     else
+        schedulePulse(timeNowUs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Schedule the next pulse animation
+/// @param timeNowUs
+void HeartEarring::schedulePulse(uint64_t timeNowUs)
+{
+    // Without prediction the animation starts at the time of the next peak in the last analysis result
+    if (!_beatPredictorEnabled || !_beatPredictor.isValid())
+    {
+        _pulseStartDeadlineUs = getTimeOfNextPeakUs(timeNowUs);
+        _pScheduler->setDeadline(_pulseStartTimer, _pulseStartDeadlineUs);
+        return;
+    }
+
+    // Start early enough for the visual peak of the animation to coincide with the predicted peak
+    // allowing for the usual lateness of the start
+    uint64_t leadUs = _ledHeart.getPeakOffsetUs() + (uint64_t)_beatPredictor.getWakeLatencyUs();
+    _pulseStartDeadlineUs = _beatPredictor.getNextPeakUs(timeNowUs + leadUs) - leadUs;
+    _pScheduler->setDeadline(_pulseStartTimer, _pulseStartDeadlineUs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update sensor profile - low power when locked and pilot (LEDs powered down) without skin contact
+/// @param timeNowUs
+void HeartEarring::updateSensorProfile(uint64_t timeNowUs)
+{
+    // Check the DC level and filter have settled since the last change
+    if (timeNowUs < _sensorChangeTimeUs + SENSOR_SETTLE_US)
+        return;
+    if (_hrmAnalysisResult.isSkinContact)
+        _lastContactTimeUs = timeNowUs;
+
+    switch (_sensorProfile)
     {
-        // Get time to next animation step
-        // UINT32_MAX means that animation has finished
-        uint64_t nextStepUs = _ledHeart.getTimeToNextAnimStepUs();
-        if (nextStepUs == UINT32_MAX)
+        case SENSOR_PROFILE_NORMAL:
         {
-            _isPulseStart = true;
-            _timeOfLastStepUs = timeNowUs;
-            uint64_t nextPeakUs = _hrmAnalysisResult.timeOfNextPeakMs * 1000;
-            _timeToNextPulseAnimStartUs = nextPeakUs > timeNowUs ? nextPeakUs - timeNowUs : 0;
-            _nextSleepDurationUs = _timeToNextPulseAnimStartUs;
+            // Pilot level when there has been no contact for a time, low power when locked
+            if (_sensorLEDPowerDownEnabled && !_hrmAnalysisResult.isSkinContact && 
+                        (timeNowUs >= _lastContactTimeUs + _noContactPowerDownUs))
+                setSensorProfile(SENSOR_PROFILE_PILOT, timeNowUs);
+            else if (_sensorLowPowerEnabled && (_lockedBeatCount >= _lowPowerLockBeats))
+                setSensorProfile(SENSOR_PROFILE_LOW_POWER, timeNowUs);
+            break;
         }
-        else
+        case SENSOR_PROFILE_LOW_POWER:
         {
-            _nextSleepDurationUs = Raft::timeToTimeout(timeNowUs, _timeOfLastStepUs, nextStepUs);
-            if (_nextSleepDurationUs == 0)
-            {
-                // Handle animation step
-                _ledHeart.loop();
-                _timeOfLastStepUs = timeNowUs;
-            }
+            // Normal when lock is lost - unlocked beats, no beats for several periods or no contact
+            double beatPeriodUs = _hrmAnalysisResult.heartRateHz > 0 ? 1e6 / _hrmAnalysisResult.heartRateHz : 1e6;
+            bool isBeatTimeout = timeNowUs > _lastBeatTimeUs + LOCK_LOST_BEAT_PERIODS * beatPeriodUs;
+            if (!_hrmAnalysisResult.isSkinContact || (_unlockedBeatCount >= LOCK_LOST_UNLOCKED_BEATS) || isBeatTimeout)
+                setSensorProfile(SENSOR_PROFILE_NORMAL, timeNowUs);
+            break;
+        }
+        case SENSOR_PROFILE_PILOT:
+        {
+            // Normal when the DC level shows contact
+            if ((_hrmAnalysisResult.contactDC >= _pilotContactMinDC) && setSensorProfile(SENSOR_PROFILE_NORMAL, timeNowUs))
+                _lastContactTimeUs = timeNowUs;
+            break;
         }
     }
-#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Set sensor profile
+/// @param profile
+/// @param timeNowUs
+/// @return true if the sensor settings were changed
+bool HeartEarring::setSensorProfile(SensorProfile profile, uint64_t timeNowUs)
+{
+    // Settings and the sample rate the filter is designed for
+    MAX30101Control::Settings settings = _sensorNormalSettings;
+    double sampleRateHz = _sensorNormalSampleRateHz;
+    if (profile == SENSOR_PROFILE_LOW_POWER)
+    {
+        settings = _sensorLowPowerSettings;
+        sampleRateHz = settings.getOutputRateHz();
+    }
+    else if (profile == SENSOR_PROFILE_PILOT)
+    {
+        settings.redPA = _sensorPilotLEDPA;
+        settings.irPA = 0;
+    }
+    if (!_hrmSensorControl.applySettings(settings))
+        return false;
+
+    // Lock is re-established at the new settings
+    _sensorProfile = profile;
+    _sensorChangeTimeUs = timeNowUs;
+    _lockedBeatCount = 0;
+    _unlockedBeatCount = 0;
+    _sensorSampleIntervalUs.store((uint32_t)(1e6 / sampleRateHz), std::memory_order_relaxed);
+    LOG_I(MODULE_PREFIX, "setSensorProfile %s sampleRate %.2fHz LED PA red 0x%02x IR 0x%02x confidence %.2f DC %.0f",
+                profile == SENSOR_PROFILE_LOW_POWER ? "lowPower" : profile == SENSOR_PROFILE_PILOT ? "pilot" : "normal",
+                sampleRateHz, settings.redPA, settings.irPA, _hrmAnalysisResult.confidence, _hrmAnalysisResult.contactDC);
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Update sensor lock with a beat
+/// @param beat
+/// @param beatTimeUs
+void HeartEarring::updateSensorLock(const HRMAnalysis::HRMBeat& beat, uint64_t beatTimeUs)
+{
+    // Beats while the sensor settles after a change are ignored
+    uint64_t lastBeatTimeUs = _lastBeatTimeUs;
+    _lastBeatTimeUs = beatTimeUs;
+    if ((beatTimeUs < _sensorChangeTimeUs + SENSOR_SETTLE_US) || (lastBeatTimeUs == 0) || (beat.heartRateHz <= 0))
+        return;
+
+    // Locked if the confidence is high and the beat interval is close to the PLL period
+    double periodUs = 1e6 / beat.heartRateHz;
+    bool isLocked = (_hrmAnalysisResult.confidence >= _lowPowerLockConfidence) &&
+                (fabs((double)(beatTimeUs - lastBeatTimeUs) - periodUs) <= _lowPowerLockTolerance * periodUs);
+    if (isLocked)
+    {
+        _lockedBeatCount++;
+        _unlockedBeatCount = 0;
+    }
+    else
+    {
+        _lockedBeatCount = 0;
+        _unlockedBeatCount++;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get time of next predicted heart beat peak
+/// @param timeNowUs
+/// @return time in us (timeNowUs if the peak is due or there is no prediction)
+uint64_t HeartEarring::getTimeOfNextPeakUs(uint64_t timeNowUs) const
+{
+    // Peak times are in ms (32 bit and wrapping) so convert relative to now
+    int32_t timeToPeakMs = (int32_t)(_hrmAnalysisResult.timeOfNextPeakMs - (uint32_t)(timeNowUs / 1000));
+    return timeToPeakMs > 0 ? timeNowUs + (uint64_t)timeToPeakMs * 1000 : timeNowUs;
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -212,6 +718,80 @@ void HeartEarring::shutdown()
     // Check valid
     if (!_isInitialized)
         return;
+
+    // Save the analysis state if samples are processed in this task (FIFO interrupt mode) - otherwise the
+    // last state saved by the device data callback is used
+    if (_hrmStateSaveEnabled && _fifoInterruptEnabled)
+        saveHRMState();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Save HRM analysis state to RTC memory (from the task that processes samples)
+void HeartEarring::saveHRMState()
+{
+    _hrmStateLastSaveMs = millis();
+    hrmStateSnapshot.save(_hrmAnalysis.getState(), esp_clk_rtc_time(), _hrmStateLastSaveMs);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Restore HRM analysis state from RTC memory (at setup before samples are processed)
+/// @param maxAgeUs maximum age of the saved state
+void HeartEarring::restoreHRMState(uint64_t maxAgeUs)
+{
+    HRMAnalysis::State state;
+    int32_t timeOffsetMs = 0;
+    uint64_t ageUs = 0;
+    if (!hrmStateSnapshot.restore(state, esp_clk_rtc_time(), millis(), maxAgeUs, timeOffsetMs, ageUs))
+        return;
+    _hrmAnalysis.setState(state, timeOffsetMs, ageUs <= (uint64_t)_hrmStateFilterMaxAgeMs * 1000);
+    _hrmStateRestoredAgeMs.store(ageUs / 1000, std::memory_order_relaxed);
+    LOG_I(MODULE_PREFIX, "restoreHRMState age %.1fs heartRate %.1fBPM sampleRate %.2fHz %s",
+                ageUs / 1e6, state.pll.beatFreqHz * 60, state.sampleRateHz, 
+                state.pll.isLocked ? "locked" : "unlocked");
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Add samples to binary sample frames (called from the device data callback)
+/// @param pSamples decoded samples
+/// @param numSamples number of samples
+void HeartEarring::addSampleFrames(const poll_MAX30101* pSamples, uint32_t numSamples)
+{
+    // A new frame is started if the current one is full or a time delta is too large
+    HRMSampleFrame frame;
+    uint32_t sampleIdx = 0;
+    while (sampleIdx < numSamples)
+    {
+        frame.start(_sampleFrameSeqNum++, pSamples[sampleIdx].timeMs);
+        while ((sampleIdx < numSamples) && 
+                frame.add(pSamples[sampleIdx].timeMs, pSamples[sampleIdx].Red, pSamples[sampleIdx].IR))
+            sampleIdx++;
+        _sampleFrames.put(frame);
+    }
+
+#ifdef DEBUG_FIFO_DATA
+    LOG_I(MODULE_PREFIX, "addSampleFrames samples %d framesDropped %d", 
+                (int)numSamples, (int)_sampleFrames.getDroppedCount());
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @brief Get sample frames
+/// @param pBuf buffer to copy frames into
+/// @param bufLen buffer length
+/// @return number of bytes copied (whole frames only)
+uint32_t HeartEarring::getSampleFrames(uint8_t* pBuf, uint32_t bufLen)
+{
+    uint32_t bytesCopied = 0;
+    const HRMSampleFrame* pFrame = nullptr;
+    while ((pFrame = _sampleFrames.peek()) != nullptr)
+    {
+        if (bytesCopied + pFrame->length() > bufLen)
+            break;
+        memcpy(pBuf + bytesCopied, pFrame->data(), pFrame->length());
+        bytesCopied += pFrame->length();
+        _sampleFrames.discard();
+    }
+    return bytesCopied;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -221,22 +801,81 @@ void HeartEarring::shutdown()
 /// @return double
 double HeartEarring::getNamedValue(const char* valueName, bool& isValid)
 {
-    // Assume heart rate required as that is all we have!
-    isValid = false;
-    double heartRateBPM = 0;
+    // Beat phase predictor stats
+    // This is called from other tasks so snapshots are read directly rather than using the loop() copies
+    String valueNameStr(valueName);
+    if (valueNameStr.startsWith("beat"))
+    {
+        BeatPhasePredictor::Stats stats;
+        isValid = _beatPredictorStatsSnapshot.read(stats);
+        if (valueNameStr.equalsIgnoreCase("beatPhaseErrorMs"))
+            return stats.meanAbsErrorMs;
+        if (valueNameStr.equalsIgnoreCase("beatPhaseErrorMeanMs"))
+            return stats.meanErrorMs;
+        if (valueNameStr.equalsIgnoreCase("beatPhaseErrorRMSMs"))
+            return stats.rmsErrorMs;
+        if (valueNameStr.equalsIgnoreCase("beatPhaseErrorMaxMs"))
+            return stats.maxAbsErrorMs;
+        if (valueNameStr.equalsIgnoreCase("beatCount"))
+            return stats.numBeats;
+        if (valueNameStr.equalsIgnoreCase("beatSignalDelayMs"))
+            return stats.signalDelayMs;
+        if (valueNameStr.equalsIgnoreCase("beatSampleLatencyMs"))
+            return stats.sampleLatencyMs;
+        if (valueNameStr.equalsIgnoreCase("beatWakeLatencyMs"))
+            return stats.wakeLatencyMs;
+        isValid = false;
+        return 0;
+    }
+
+    // Signal quality
+    HRMAnalysis::HRMResult hrmResult;
+    if (valueNameStr.equalsIgnoreCase("hrmConfidence"))
+    {
+        isValid = _hrmResultSnapshot.read(hrmResult);
+        return isValid ? hrmResult.confidence : 0;
+    }
+    if (valueNameStr.equalsIgnoreCase("skinContact"))
+    {
+        isValid = _hrmResultSnapshot.read(hrmResult);
+        return isValid && hrmResult.isSkinContact ? 1 : 0;
+    }
 
-    // Take the semaphore controlling access to heart rate value
-    if (RaftMutex_lock(_heartRateValueMutex, 10))
+    // Sensor clock drift (fitted sample period relative to nominal)
+    if (valueNameStr.equalsIgnoreCase("sensorDriftPPM"))
+    {
+        isValid = _sampleTimebaseEnabled;
+        return _sensorDriftPPM.load(std::memory_order_relaxed);
+    }
+
+    // Samples lost by the sensor (FIFO overflow) and gaps bridged or restarted
+    if (valueNameStr.equalsIgnoreCase("sensorSamplesLost"))
     {
-        // Get the heart rate
-        heartRateBPM = _hrmAnalysisResult.heartRateHz * 60;
         isValid = true;
+        return _sensorSamplesLost.load(std::memory_order_relaxed);
+    }
+    if (valueNameStr.equalsIgnoreCase("sensorGapsBridged"))
+    {
+        isValid = true;
+        return _sensorGapsBridged.load(std::memory_order_relaxed);
+    }
+    if (valueNameStr.equalsIgnoreCase("sensorGapsRestarted"))
+    {
+        isValid = true;
+        return _sensorGapsRestarted.load(std::memory_order_relaxed);
+    }
 
-        // Give back the semaphore
-        RaftMutex_unlock(_heartRateValueMutex);
+    // Age of the HRM analysis state restored at setup (invalid if not restored)
+    if (valueNameStr.equalsIgnoreCase("hrmStateRestoredAgeMs"))
+    {
+        int32_t ageMs = _hrmStateRestoredAgeMs.load(std::memory_order_relaxed);
+        isValid = ageMs >= 0;
+        return ageMs;
     }
 
-    return heartRateBPM;
+    // Otherwise assume heart rate required
+    isValid = _hrmResultSnapshot.read(hrmResult);
+    return isValid ? hrmResult.heartRateHz * 60 : 0;
 }
 
 
@@ -11,8 +11,26 @@
 #include "JewelryBase.h"
 #include "LEDHeart.h"
 #include "HRMAnalysis.h"
+#include "SeqLockSnapshot.h"
+#include "SPSCRing.h"
+#include "HRMSampleFrame.h"
+#include "HRMTrace.h"
+#include "BeatPhasePredictor.h"
+#include "HRMSampleTimebase.h"
+#include "MAX30101Control.h"
+#include "HRMStateSnapshot.h"
 #include "RaftBusDevicesIF.h"
-#include "RaftThreading.h"
+#include "DevicePollRecords_generated.h"
+#include <atomic>
+#include <type_traits>
+
+// Check if a sensor sample record has Lost and Pending members - these are added to the MAX30101 device type
+// by the systypes DevTypes.json (the built-in device type used by systypes without one doesn't have them)
+template<typename SampleRec, typename = void>
+struct HRMSampleHasGapInfo : std::false_type {};
+template<typename SampleRec>
+struct HRMSampleHasGapInfo<SampleRec, std::void_t<decltype(std::declval<SampleRec>().Lost), 
+            decltype(std::declval<SampleRec>().Pending)>> : std::true_type {};
 
 class HeartEarring : public JewelryBase
 {
@@ -23,55 +41,52 @@ public:
     virtual ~HeartEarring();
 
     // Setup
-    virtual void setup(const RaftJsonIF& config, DeviceManager& devMan) override final;
+    virtual void setup(const RaftJsonIF& config, DeviceManager& devMan, DeadlineScheduler& scheduler) override final;
 
     // Loop
     virtual void loop() override final;
 
-    // Get sleep duration in us
-    virtual uint32_t getSleepDurationUs() override final
+    // All timed work is scheduled so sleep is allowed once setup (apart from while a FIFO read is in progress
+    // or samples read are waiting to be processed)
+    virtual bool isSleepAllowed() override final
     {
-        return _nextSleepDurationUs;
+        return _isInitialized && !_hrmSensorControl.isFIFOReadInProgress() && (_fifoBlocks.count() == 0);
     }
 
     // Shutdown
     virtual void shutdown() override final;
 
-    // Check if we should wakeup on GPIO
-    bool wakeupOnGPIO()
+    // Wakeup on GPIO (sensor FIFO interrupt) in FIFO interrupt mode
+    virtual bool wakeupOnGPIO() override final
     {
-        return false;
+        return _fifoInterruptEnabled;
     }
 
-    // Debug check if samples available
-    virtual bool debugAreSamplesAvailable() override final
+    // Get sample frames - copies whole binary frames into pBuf and returns the number of bytes copied
+    virtual uint32_t getSampleFrames(uint8_t* pBuf, uint32_t bufLen) override final;
+
+    // Get count of sample frame changes (changes whenever frames are produced or consumed)
+    virtual uint32_t getSampleFramesChangeCount() override final
     {
-        bool isAvailable = false;
-        if (RaftMutex_lock(_lastSamplesJSONMutex, 2))
-        {
-            // Flag
-            isAvailable = _lastSamplesJSON.length() > 0;
+        return _sampleFrames.getPutCount() + _sampleFrames.getGetCount();
+    }
 
-            // Give back the semaphore
-            RaftMutex_unlock(_lastSamplesJSONMutex);
-        }
-        return isAvailable;       
+    // Enable / disable trace of HRM analysis
+    virtual void setTraceEnabled(bool enabled) override final
+    {
+        _hrmTrace.setEnabled(enabled);
     }
 
-    // Debug get last samples JSON
-    virtual String debugGetLastSamplesJSON() override final
+    // Get trace frames
+    virtual uint32_t getTraceFrames(uint8_t* pBuf, uint32_t bufLen) override final
     {
-        String samplesJSON;
-        if (RaftMutex_lock(_lastSamplesJSONMutex, 2))
-        {
-            // Flag
-            samplesJSON = _lastSamplesJSON;
-            _lastSamplesJSON = "";
-
-            // Give back the semaphore
-            RaftMutex_unlock(_lastSamplesJSONMutex);
-        }    
-        return samplesJSON;
+        return _hrmTrace.getFrame(pBuf, bufLen);
+    }
+
+    // Get count of trace changes
+    virtual uint32_t getTraceChangeCount() override final
+    {
+        return _hrmTrace.getChangeCount();
     }
 
     /// @brief Get named value
@@ -81,36 +96,235 @@ public:
     virtual double getNamedValue(const char* valueName, bool& isValid) override final;
 
 private:
-    // Time between heart pulses
-    uint32_t _timeToNextPulseAnimStartUs = 1000000;
+    // Scheduler and timers
+    DeadlineScheduler* _pScheduler = nullptr;
+    uint32_t _hrmUpdateTimer = DeadlineScheduler::INVALID_TIMER;
+    uint32_t _pulseStartTimer = DeadlineScheduler::INVALID_TIMER;
+    uint32_t _ledTimelineTimer = DeadlineScheduler::INVALID_TIMER;
+
+    // HRM result update interval - the device manager polls the sensor when the processor is awake so
+    // this is shorter than the sensor poll interval to ensure polls are not delayed by more than this
+    static const uint32_t HRM_UPDATE_INTERVAL_MS_DEFAULT = 100;
+    uint64_t _hrmUpdateIntervalUs = HRM_UPDATE_INTERVAL_MS_DEFAULT * 1000;
+    uint64_t _hrmUpdateDeadlineUs = 0;
 
     // Animation timing
-    uint64_t _timeOfLastStepUs = 0;
+    static const uint32_t FIRST_PULSE_DELAY_US = 1000000;
+    uint64_t _pulseStartTimeUs = 0;
+    uint64_t _pulseStartDeadlineUs = 0;
+
+    // Beat phase predictor - schedules pulses on the predicted (latency compensated) peak if enabled
+    // otherwise pulses start at the time of next peak in the last analysis result
+    bool _beatPredictorEnabled = true;
+    BeatPhasePredictor _beatPredictor;
+    static constexpr double SENSOR_DELAY_MS_DEFAULT = 35;
+    double _sensorDelayUs = SENSOR_DELAY_MS_DEFAULT * 1000;
 
-    // Sleep duration in us - this is continually updated (in the loop function) to account 
-    // for the time to the next pulse animation step
-    uint32_t _nextSleepDurationUs = 0;
+    // Latency from the last sample in a FIFO burst to its processing and the bandpass filter phase delay
+    // at the heart rate - written by the device data callback
+    std::atomic<uint32_t> _sampleLatencyUs = 0;
+    std::atomic<int32_t> _filterDelayUs = 0;
 
-    // Animation mode
-    bool _isPulseStart = true;
+    // Beat phase predictor stats - read by getNamedValue() from other tasks
+    SeqLockSnapshot<BeatPhasePredictor::Stats> _beatPredictorStatsSnapshot;
 
     // Raft bus device decode state
     RaftBusDeviceDecodeState _decodeState;
 
+    // HRM sensor (bus and address as in the device name used for device data)
+    static constexpr const char* HRM_SENSOR_BUS_NAME = "I2CA";
+    static const uint32_t HRM_SENSOR_ADDRESS = 0x57;
+    MAX30101Control _hrmSensorControl;
+
+    // Sensor profiles
+    //   Normal     settings made by the device type initValues
+    //   Low power  lower sample rate, shorter LED pulses and Red only (by default) - used once the PLL has been
+    //              locked with high confidence for a number of beats and left when lock is lost
+    //   Pilot      no skin contact for a time - Red LED reduced to a pilot level and IR off until the DC level
+    //              shows contact again (the normal profile is then restored)
+    enum SensorProfile
+    {
+        SENSOR_PROFILE_NORMAL,
+        SENSOR_PROFILE_LOW_POWER,
+        SENSOR_PROFILE_PILOT
+    };
+    SensorProfile _sensorProfile = SENSOR_PROFILE_NORMAL;
+    MAX30101Control::Settings _sensorNormalSettings;
+    MAX30101Control::Settings _sensorLowPowerSettings;
+    double _sensorNormalSampleRateHz = HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ;
+    bool _sensorLEDPowerDownEnabled = true;
+    bool _sensorLowPowerEnabled = true;
+    static const uint32_t SENSOR_PILOT_LED_PA_DEFAULT = 4;
+    uint8_t _sensorPilotLEDPA = SENSOR_PILOT_LED_PA_DEFAULT;
+    double _pilotContactMinDC = 0;
+    static constexpr double NO_CONTACT_SECS_DEFAULT = 5;
+    uint64_t _noContactPowerDownUs = NO_CONTACT_SECS_DEFAULT * 1000000;
+    uint64_t _lastContactTimeUs = 0;
+
+    // Lock - a beat is locked if the confidence is high enough and the interval from the previous beat is
+    // within a tolerance of the PLL period. Lock is lost on consecutive unlocked beats or when beats stop arriving
+    static const uint32_t LOW_POWER_LOCK_BEATS_DEFAULT = 10;
+    static constexpr double LOW_POWER_LOCK_CONFIDENCE_DEFAULT = 0.5;
+    static constexpr double LOW_POWER_LOCK_TOLERANCE_DEFAULT = 0.2;
+    static const uint32_t LOCK_LOST_BEAT_PERIODS = 3;
+    static const uint32_t LOCK_LOST_UNLOCKED_BEATS = 2;
+    uint32_t _lowPowerLockBeats = LOW_POWER_LOCK_BEATS_DEFAULT;
+    double _lowPowerLockConfidence = LOW_POWER_LOCK_CONFIDENCE_DEFAULT;
+    double _lowPowerLockTolerance = LOW_POWER_LOCK_TOLERANCE_DEFAULT;
+    uint32_t _lockedBeatCount = 0;
+    uint32_t _unlockedBeatCount = 0;
+    uint64_t _lastBeatTimeUs = 0;
+
+    // Interval between sensor output samples for the profile in use - written when the profile changes and
+    // read by the device data callback which re-designs the filter for the new rate and times the samples
+    std::atomic<uint32_t> _sensorSampleIntervalUs = 0;
+    uint32_t _hrmSampleIntervalUs = 0;
+
+    // Sample timebase - sample times are reconstructed from the arrival times of blocks of samples with the
+    // sensor sample period fitted (restarted from nominal when the profile changes) and the drift of the sensor
+    // clock from nominal is published for getNamedValue()
+    static constexpr double TIMEBASE_WINDOW_SAMPLES_DEFAULT = 1500;
+    static constexpr double TIMEBASE_PERIOD_PRIOR_WEIGHT_DEFAULT = 2000;
+    static constexpr double TIMEBASE_MAX_PERIOD_ERROR_DEFAULT = 0.05;
+    bool _sampleTimebaseEnabled = true;
+    HRMSampleTimebase _sampleTimebase;
+    std::atomic<int32_t> _sensorDriftPPM = 0;
+
+    // Sample gaps - samples lost by the sensor (FIFO overflow when reads are delayed) are reported with the
+    // first sample after them. Short gaps are bridged with samples interpolated between the samples either
+    // side and longer gaps (or an unknown number lost - the overflow counter saturates) restart the analysis.
+    // Counts are published for getNamedValue()
+    static const uint32_t GAP_BRIDGE_MAX_SAMPLES = 8;
+    static const uint32_t GAP_BRIDGE_MAX_SAMPLES_DEFAULT = 4;
+    bool _sampleGapHandlingEnabled = true;
+    uint32_t _gapBridgeMaxSamples = GAP_BRIDGE_MAX_SAMPLES_DEFAULT;
+    poll_MAX30101 _lastSample = {};
+    bool _isLastSampleValid = false;
+    std::atomic<uint32_t> _sensorSamplesLost = 0;
+    std::atomic<uint32_t> _sensorGapsBridged = 0;
+    std::atomic<uint32_t> _sensorGapsRestarted = 0;
+    void handleSampleGap(const poll_MAX30101& nextSample, uint32_t numLost);
+
+    // Samples lost before a sample and left in the sensor FIFO after it (0 if the sample record doesn't have
+    // them - gaps are then not detected and samples are timed back from the arrival of the last sample)
+    template<typename SampleRec>
+    static uint32_t getSampleLost(const SampleRec& sample)
+    {
+        if constexpr (HRMSampleHasGapInfo<SampleRec>::value)
+            return sample.Lost;
+        return 0;
+    }
+    template<typename SampleRec>
+    static uint32_t getSamplePending(const SampleRec& sample)
+    {
+        if constexpr (HRMSampleHasGapInfo<SampleRec>::value)
+            return sample.Pending;
+        return 0;
+    }
+    template<typename SampleRec>
+    static void setSampleGapInfo(SampleRec& sample, uint32_t numLost, uint32_t numPending)
+    {
+        if constexpr (HRMSampleHasGapInfo<SampleRec>::value)
+        {
+            sample.Lost = numLost;
+            sample.Pending = numPending;
+        }
+    }
+
+    // HRM analysis state snapshot - saved (at an interval) in memory that survives a restart or deep sleep by
+    // the task that processes samples and restored at setup if no older than the max age. The filter state is
+    // only kept after short breaks (the filter is otherwise settled to the first sample)
+    static const uint32_t HRM_STATE_SAVE_INTERVAL_MS_DEFAULT = 1000;
+    static constexpr double HRM_STATE_MAX_AGE_SECS_DEFAULT = 60;
+    static const uint32_t HRM_STATE_FILTER_MAX_AGE_MS_DEFAULT = 500;
+    bool _hrmStateSaveEnabled = true;
+    uint32_t _hrmStateFilterMaxAgeMs = HRM_STATE_FILTER_MAX_AGE_MS_DEFAULT;
+    uint32_t _hrmStateSaveIntervalMs = HRM_STATE_SAVE_INTERVAL_MS_DEFAULT;
+    uint32_t _hrmStateLastSaveMs = 0;
+    std::atomic<int32_t> _hrmStateRestoredAgeMs = -1;
+    void saveHRMState();
+    void restoreHRMState(uint64_t maxAgeUs);
+
+    // Time for the DC level and filter to settle after the sensor settings are changed (no further changes
+    // are made)
+    static const uint64_t SENSOR_SETTLE_US = 3000000;
+    uint64_t _sensorChangeTimeUs = 0;
+
+    // Time between checks for skin contact before starting a pulse animation
+    static const uint64_t NO_CONTACT_PULSE_RETRY_US = 500000;
+
+    // FIFO interrupt mode - the FIFO is read (from loop()) when the INT pin is active and blocks of samples
+    // read are passed from the bus task to loop() for processing. If device data arrives from polling the
+    // device data callback sets _isSensorPolled and loop() stops FIFO interrupt mode (after any read in
+    // progress) so samples are only processed by one task at a time
+    std::atomic<bool> _fifoInterruptEnabled = false;
+    std::atomic<bool> _isSensorPolled = false;
+    int _fifoIntPin = -1;
+    struct FIFOBlock
+    {
+        uint32_t timeMs;
+        uint32_t numSamples;
+        uint32_t numLost;
+        uint8_t data[MAX30101Control::FIFO_DEPTH * MAX30101Control::FIFO_SAMPLE_BYTES];
+    };
+    static const uint32_t FIFO_BLOCK_QUEUE_SIZE = 4;
+    SPSCRing<FIFOBlock, FIFO_BLOCK_QUEUE_SIZE> _fifoBlocks;
+    static void fifoDataCB(void* pCallbackData, const uint8_t* pData, uint32_t numSamples, uint32_t numLost,
+                uint32_t timeMs);
+    void stopFIFOInterrupt();
+
+    // Maximum samples processed as a block
+    static const uint32_t MAX_SAMPLES_PER_BLOCK = 50;
+
+    // Decoded samples - used by the device data callback (polling) or loop() (FIFO interrupt mode) but
+    // never both so a single buffer is owned here rather than on the stack of the calling task
+    poll_MAX30101 _sampleDecodeBuf[MAX_SAMPLES_PER_BLOCK];
+    void processSamples(poll_MAX30101* pSamples, uint32_t numSamples);
+    HRMAnalysis::HRMResult processSampleRun(poll_MAX30101* pSamples, uint32_t numSamples);
+
     // LED heart display
     LEDHeart _ledHeart;
 
     // HRM analysis
     HRMAnalysis _hrmAnalysis;
 
-    // Semaphore for access to heart rate anaylsis result
-    RaftMutex _heartRateValueMutex;
+    // HRM analysis trace (records are produced by the device data callback)
+    HRMTrace _hrmTrace;
+
+    // Heart rate analysis result - written by the device data callback and read by loop() and
+    // getNamedValue() without locking (the callback never waits for readers)
+    SeqLockSnapshot<HRMAnalysis::HRMResult> _hrmResultSnapshot;
+
+    // Last result read in loop()
     HRMAnalysis::HRMResult _hrmAnalysisResult;
 
-    // HRM samples
+    // Recent beats - produced by the device data callback and consumed by loop()
+    static const uint32_t BEAT_QUEUE_SIZE = 16;
+    SPSCRing<HRMAnalysis::HRMBeat, BEAT_QUEUE_SIZE> _beatQueue;
+
+    // Short history of recent beats (most recent at _beatHistoryPos - 1)
+    static const uint32_t BEAT_HISTORY_SIZE = 8;
+    HRMAnalysis::HRMBeat _beatHistory[BEAT_HISTORY_SIZE];
+    uint32_t _beatHistoryPos = 0;
+    uint32_t _beatHistoryCount = 0;
+
+    // HRM sample collection - binary frames are produced by the device data callback and consumed
+    // by the publisher (frames are dropped if the publisher falls behind)
     bool _collectHRM = false;
-    String _lastSamplesJSON;
-    RaftMutex _lastSamplesJSONMutex;
+    static const uint32_t SAMPLE_FRAME_QUEUE_SIZE = 8;
+    SPSCRing<HRMSampleFrame, SAMPLE_FRAME_QUEUE_SIZE> _sampleFrames;
+    uint8_t _sampleFrameSeqNum = 0;
+    void addSampleFrames(const poll_MAX30101* pSamples, uint32_t numSamples);
+
+    // Timer handlers
+    void updateHRM(uint64_t timeNowUs);
+    void startPulse(uint64_t timeNowUs);
+    void playLEDTimeline(uint64_t timeNowUs);
+    void schedulePulse(uint64_t timeNowUs);
+    void updateSensorProfile(uint64_t timeNowUs);
+    bool setSensorProfile(SensorProfile profile, uint64_t timeNowUs);
+    void updateSensorLock(const HRMAnalysis::HRMBeat& beat, uint64_t beatTimeUs);
+    uint64_t getTimeOfNextPeakUs(uint64_t timeNowUs) const;
 
     // Debug
     uint32_t _lastDebugTimeMs = 0;
@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Single producer single consumer ring buffer
+//
+// Wait-free for both the producer and the consumer. Storage is preallocated (SIZE must be a power of 2)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+template<typename T, uint32_t SIZE>
+class SPSCRing
+{
+public:
+    static_assert((SIZE >= 2) && ((SIZE & (SIZE - 1)) == 0), "SPSCRing SIZE must be a power of 2");
+
+    // Put an element (producer only) - returns false (and counts the drop) if full
+    bool put(const T& val)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) >= SIZE)
+        {
+            _droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _buffer[head & (SIZE - 1)] = val;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Get an element (consumer only) - returns false if empty
+    bool get(T& val)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail)
+            return false;
+        val = _buffer[tail & (SIZE - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Peek at the oldest element without removing it (consumer only) - returns nullptr if empty
+    const T* peek() const
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail)
+            return nullptr;
+        return &_buffer[tail & (SIZE - 1)];
+    }
+
+    // Remove the oldest element (consumer only - after peek() returned non-null)
+    void discard()
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Number of elements available (approximate if called by the producer)
+    uint32_t count() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    // Total number of elements put (changes whenever a new element is added)
+    uint32_t getPutCount() const
+    {
+        return _head.load(std::memory_order_acquire);
+    }
+
+    // Total number of elements removed
+    uint32_t getGetCount() const
+    {
+        return _tail.load(std::memory_order_acquire);
+    }
+
+    // Number of elements dropped because the ring was full
+    uint32_t getDroppedCount() const
+    {
+        return _droppedCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    T _buffer[SIZE];
+    std::atomic<uint32_t> _head = 0;
+    std::atomic<uint32_t> _tail = 0;
+    std::atomic<uint32_t> _droppedCount = 0;
+};
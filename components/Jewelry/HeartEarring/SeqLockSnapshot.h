@@ -0,0 +1,64 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Sequence lock snapshot
+//
+// Single writer, multiple reader snapshot of a trivially copyable value. The writer never blocks and
+// readers retry (a bounded number of times) if they overlap a write
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+template<typename T>
+class SeqLockSnapshot
+{
+public:
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLockSnapshot requires a trivially copyable type");
+
+    // Write value (single writer only)
+    void write(const T& val)
+    {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _value = val;
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Read value - returns false if a consistent value could not be read (val is unchanged)
+    bool read(T& val, uint32_t maxRetries = MAX_READ_RETRIES_DEFAULT) const
+    {
+        for (uint32_t i = 0; i <= maxRetries; i++)
+        {
+            // Odd sequence means a write is in progress
+            uint32_t seqBefore = _seq.load(std::memory_order_acquire);
+            if (seqBefore & 1)
+                continue;
+            T copy = _value;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_seq.load(std::memory_order_relaxed) == seqBefore)
+            {
+                val = copy;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Get the number of writes completed (can be used to detect changes)
+    uint32_t getWriteCount() const
+    {
+        return _seq.load(std::memory_order_acquire) / 2;
+    }
+
+private:
+    static const uint32_t MAX_READ_RETRIES_DEFAULT = 10;
+    std::atomic<uint32_t> _seq = 0;
+    T _value = T();
+};
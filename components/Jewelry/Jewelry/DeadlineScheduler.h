@@ -0,0 +1,190 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Deadline scheduler
+//
+// One-shot timers held in a min-heap ordered by deadline (absolute time in us) so that the time to the next
+// deadline - and hence how long the main loop can sleep - is known exactly. Timers are added at setup
+// and then (re)armed as needed; expired timers are run in deadline order by service() and a timer callback
+// may re-arm its own (or any other) timer. Storage is fixed size and nothing is allocated after setup
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+class DeadlineScheduler
+{
+public:
+    static const uint32_t MAX_TIMERS = 16;
+    static const uint32_t INVALID_TIMER = UINT32_MAX;
+    static const uint64_t NO_DEADLINE = UINT64_MAX;
+
+    // Timer callback - called with the time passed to service()
+    typedef std::function<void(uint64_t timeNowUs)> TimerFn;
+
+    // Add a timer (not armed) - returns INVALID_TIMER if there is no space
+    uint32_t addTimer(const char* pName, TimerFn timerFn)
+    {
+        if (_numTimers >= MAX_TIMERS)
+            return INVALID_TIMER;
+        uint32_t timerId = _numTimers++;
+        _timers[timerId].pName = pName;
+        _timers[timerId].timerFn = timerFn;
+        return timerId;
+    }
+
+    // Arm a timer to expire at an absolute time (re-arms if already armed)
+    void setDeadline(uint32_t timerId, uint64_t deadlineUs)
+    {
+        if (timerId >= _numTimers)
+            return;
+        Timer& timer = _timers[timerId];
+        uint64_t prevDeadlineUs = timer.deadlineUs;
+        timer.deadlineUs = deadlineUs;
+        if (timer.heapPos < 0)
+        {
+            timer.heapPos = _heapSize;
+            _heap[_heapSize++] = timerId;
+            siftUp(timer.heapPos);
+        }
+        else if (deadlineUs < prevDeadlineUs)
+        {
+            siftUp(timer.heapPos);
+        }
+        else
+        {
+            siftDown(timer.heapPos);
+        }
+    }
+
+    // Arm a timer to expire after a duration
+    void setTimeout(uint32_t timerId, uint64_t timeNowUs, uint64_t durationUs)
+    {
+        setDeadline(timerId, timeNowUs + durationUs);
+    }
+
+    // Disarm a timer
+    void cancel(uint32_t timerId)
+    {
+        if ((timerId >= _numTimers) || (_timers[timerId].heapPos < 0))
+            return;
+        removeAt(_timers[timerId].heapPos);
+    }
+
+    // Check if a timer is armed
+    bool isArmed(uint32_t timerId) const
+    {
+        return (timerId < _numTimers) && (_timers[timerId].heapPos >= 0);
+    }
+
+    // Deadline of a timer (NO_DEADLINE if not armed)
+    uint64_t getDeadlineUs(uint32_t timerId) const
+    {
+        return isArmed(timerId) ? _timers[timerId].deadlineUs : NO_DEADLINE;
+    }
+
+    // Earliest deadline of all armed timers (NO_DEADLINE if none are armed)
+    uint64_t getNextDeadlineUs() const
+    {
+        return _heapSize > 0 ? _timers[_heap[0]].deadlineUs : NO_DEADLINE;
+    }
+
+    // Time from now to the earliest deadline (0 if already expired, NO_DEADLINE if none are armed)
+    uint64_t getTimeToNextDeadlineUs(uint64_t timeNowUs) const
+    {
+        uint64_t nextDeadlineUs = getNextDeadlineUs();
+        if (nextDeadlineUs == NO_DEADLINE)
+            return NO_DEADLINE;
+        return nextDeadlineUs > timeNowUs ? nextDeadlineUs - timeNowUs : 0;
+    }
+
+    // Run expired timers in deadline order - returns the number run
+    // Each timer is disarmed before its callback is called. At most one run per timer is made in a call
+    // so a callback that re-arms its timer at or before timeNowUs is run on the next call
+    uint32_t service(uint64_t timeNowUs)
+    {
+        uint32_t numRun = 0;
+        while ((_heapSize > 0) && (_timers[_heap[0]].deadlineUs <= timeNowUs) && (numRun < _numTimers))
+        {
+            uint32_t timerId = _heap[0];
+            removeAt(0);
+            numRun++;
+            if (_timers[timerId].timerFn)
+                _timers[timerId].timerFn(timeNowUs);
+        }
+        return numRun;
+    }
+
+    // Name of a timer (for debugging)
+    const char* getTimerName(uint32_t timerId) const
+    {
+        return timerId < _numTimers ? _timers[timerId].pName : "";
+    }
+
+private:
+    struct Timer
+    {
+        const char* pName = "";
+        TimerFn timerFn;
+        uint64_t deadlineUs = NO_DEADLINE;
+        int32_t heapPos = -1;
+    };
+    Timer _timers[MAX_TIMERS];
+    uint32_t _numTimers = 0;
+
+    // Min-heap of armed timer ids ordered by deadline
+    uint32_t _heap[MAX_TIMERS] = {};
+    uint32_t _heapSize = 0;
+
+    void removeAt(uint32_t heapPos)
+    {
+        _timers[_heap[heapPos]].heapPos = -1;
+        _heapSize--;
+        if (heapPos == _heapSize)
+            return;
+        _heap[heapPos] = _heap[_heapSize];
+        _timers[_heap[heapPos]].heapPos = heapPos;
+        siftUp(heapPos);
+        siftDown(_timers[_heap[heapPos]].heapPos);
+    }
+    void siftUp(uint32_t heapPos)
+    {
+        while (heapPos > 0)
+        {
+            uint32_t parentPos = (heapPos - 1) / 2;
+            if (_timers[_heap[parentPos]].deadlineUs <= _timers[_heap[heapPos]].deadlineUs)
+                break;
+            swap(heapPos, parentPos);
+            heapPos = parentPos;
+        }
+    }
+    void siftDown(uint32_t heapPos)
+    {
+        while (true)
+        {
+            uint32_t minPos = heapPos;
+            uint32_t leftPos = 2 * heapPos + 1;
+            uint32_t rightPos = leftPos + 1;
+            if ((leftPos < _heapSize) && (_timers[_heap[leftPos]].deadlineUs < _timers[_heap[minPos]].deadlineUs))
+                minPos = leftPos;
+            if ((rightPos < _heapSize) && (_timers[_heap[rightPos]].deadlineUs < _timers[_heap[minPos]].deadlineUs))
+                minPos = rightPos;
+            if (minPos == heapPos)
+                break;
+            swap(heapPos, minPos);
+            heapPos = minPos;
+        }
+    }
+    void swap(uint32_t posA, uint32_t posB)
+    {
+        uint32_t timerId = _heap[posA];
+        _heap[posA] = _heap[posB];
+        _heap[posB] = timerId;
+        _timers[_heap[posA]].heapPos = posA;
+        _timers[_heap[posB]].heapPos = posB;
+    }
+};
@@ -13,6 +13,7 @@
 #include "GridEarring.h"
 #include "SysManager.h"
 #include "RestAPIEndpointManager.h"
+#include "CommsChannelMsg.h"
 #include "esp_private/esp_clk.h"
 #include "esp_sleep.h"
 
@@ -48,20 +49,34 @@ void Jewelry::setup()
     _powerControl.setup(powerControlConfig);
 #endif
 
+    // Power control timer
+    _powerControlIntervalUs = configGetConfig().getLong("PowerControl/loopIntervalMs", POWER_CONTROL_INTERVAL_MS_DEFAULT) * 1000;
+    _powerControlTimer = _scheduler.addTimer("powerControl", 
+        [this](uint64_t timeNowUs) {
+            _powerControl.loop();
+            _scheduler.setTimeout(_powerControlTimer, timeNowUs, _powerControlIntervalUs);
+        }
+    );
+    _scheduler.setTimeout(_powerControlTimer, micros(), _powerControlIntervalUs);
+
+    // Sleep settings
+    _sleepMinUs = configGetConfig().getLong("sleepMinUs", SLEEP_MIN_US_DEFAULT);
+    _sleepWakeupLatencyUs = configGetConfig().getLong("sleepWakeupLatencyUs", SLEEP_WAKEUP_LATENCY_US_DEFAULT);
+
 #if defined(FEATURE_HEART_JEWELRY)
     // Setup heart earring
     _pJewelry = new HeartEarring();
     RaftJsonPrefixed heartConfig(modConfig(), "HeartEarring");
     DeviceManager* pDevMan = getSysManager()->getDeviceManager();
     if (pDevMan)
-        _pJewelry->setup(heartConfig, *pDevMan);
+        _pJewelry->setup(heartConfig, *pDevMan, _scheduler);
 #elif defined(FEATURE_GRID_JEWELRY)
     // Setup grid earring
     _pJewelry = new GridEarring();
     RaftJsonPrefixed gridConfig(modConfig(), "GridEarring");
     DeviceManager* pDevMan = getSysManager()->getDeviceManager();
     if (pDevMan)
-        _pJewelry->setup(gridConfig, *pDevMan);
+        _pJewelry->setup(gridConfig, *pDevMan, _scheduler);
 #endif
 
     // Debug
@@ -72,56 +87,60 @@ void Jewelry::setup()
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-/// @brief Loop (called frequently)
-void Jewelry::loop()
+/// @brief Post setup - called after all SysMods are setup
+void Jewelry::postSetup()
 {
-    // Check jewelry valid
-    if (_pJewelry)
-    {
-        // Service jewelry
-        _pJewelry->loop();
-
-#ifdef FEATURE_ENABLE_SLEEP_MODE
-        // Get sleep duration
-        uint32_t timeToSleepUs = _pJewelry->getSleepDurationUs();
-        if (timeToSleepUs != 0)
-        {
-
-            // Set wakeup timer to worst case time
-            esp_sleep_enable_timer_wakeup(timeToSleepUs);
-
-            // If enabled, set to wakeup on GPIO pins (already setup in MAX30101 hardware init)
-#ifdef FEATURE_MAX30101_SENSOR    
-            if (_pJewelry->wakeupOnGPIO())
-            {
-                esp_sleep_enable_gpio_wakeup();
-            }
-#endif
-
-            // Enter light sleep
-            esp_light_sleep_start();
+    // Register binary HRM sample frames as a data source for publishing
+    getSysManager()->registerDataSource("Publish", "hrmbin", 
+        [this](const char* messageName, CommsChannelMsg& msg) {
+            if (!_pJewelry)
+                return false;
+            uint32_t msgLen = _pJewelry->getSampleFrames(_publishMsgBuf, sizeof(_publishMsgBuf));
+            if (msgLen == 0)
+                return false;
+            msg.setFromBuffer(_publishMsgBuf, msgLen);
+            return true;
+        },
+        [this](const char* messageName, std::vector<uint8_t>& stateHash) {
+            // State changes whenever frames are produced or consumed so that frames which didn't
+            // fit in the last message are published on the next check
+            uint32_t changeCount = _pJewelry ? _pJewelry->getSampleFramesChangeCount() : 0;
+            stateHash.clear();
+            stateHash.push_back(changeCount & 0xff);
+            stateHash.push_back((changeCount >> 8) & 0xff);
         }
-#endif
+    );
 
-        // Check if we have a sample collector
-        if (!_pSampleCollector)
-        {
-            if (_firstSampleCollection)
-            {
-                _firstSampleCollection = false;
-                _pSampleCollector = getSysManager()->getSysMod("SamplesJSON");
-            }
+    // Register HRM analysis trace frames as a data source for publishing
+    getSysManager()->registerDataSource("Publish", "hrmtrace", 
+        [this](const char* messageName, CommsChannelMsg& msg) {
+            if (!_pJewelry)
+                return false;
+            uint32_t msgLen = _pJewelry->getTraceFrames(_publishMsgBuf, sizeof(_publishMsgBuf));
+            if (msgLen == 0)
+                return false;
+            msg.setFromBuffer(_publishMsgBuf, msgLen);
+            return true;
+        },
+        [this](const char* messageName, std::vector<uint8_t>& stateHash) {
+            uint32_t changeCount = _pJewelry ? _pJewelry->getTraceChangeCount() : 0;
+            stateHash.clear();
+            stateHash.push_back(changeCount & 0xff);
+            stateHash.push_back((changeCount >> 8) & 0xff);
         }
+    );
+}
 
-        // Update data collection if enabled
-        if (_pSampleCollector && _pJewelry->debugAreSamplesAvailable())
-        {
-            _pSampleCollector->receiveCmdJSON(_pJewelry->debugGetLastSamplesJSON().c_str());
-        }
-    }
+///////////////////////////////////////////////////////////////////////////////
+/// @brief Loop (called frequently)
+void Jewelry::loop()
+{
+    // Service jewelry
+    if (_pJewelry)
+        _pJewelry->loop();
 
-    // Power control loop
-    _powerControl.loop();
+    // Run timers that are due
+    _scheduler.service(micros());
 
     // Check for shutdown
     if (_powerControl.isShutdownRequested())
@@ -138,6 +157,26 @@ void Jewelry::loop()
         _powerControl.shutdown();
     }
 
+#ifdef FEATURE_ENABLE_SLEEP_MODE
+    // Sleep until the next deadline
+    if (_pJewelry && _pJewelry->isSleepAllowed())
+    {
+        uint64_t timeToSleepUs = _scheduler.getTimeToNextDeadlineUs(micros());
+        if ((timeToSleepUs != DeadlineScheduler::NO_DEADLINE) && (timeToSleepUs >= _sleepMinUs + _sleepWakeupLatencyUs))
+        {
+            // Set wakeup timer
+            esp_sleep_enable_timer_wakeup(timeToSleepUs - _sleepWakeupLatencyUs);
+
+            // If enabled, set to wakeup on GPIO pins (setup by the jewelry, e.g. sensor FIFO interrupt)
+            if (_pJewelry->wakeupOnGPIO())
+                esp_sleep_enable_gpio_wakeup();
+
+            // Enter light sleep
+            esp_light_sleep_start();
+        }
+    }
+#endif
+
 #ifdef DEBUG_MAIN_LOOP
 
     if (Raft::isTimeout(millis(), _lastDebugTimeMs, 1000))
@@ -179,8 +218,17 @@ RaftRetCode Jewelry::apiControl(const String &reqStr, String &respStr, const API
     // Debug
     LOG_I(MODULE_PREFIX, "apiControl %s", reqStr.c_str());
 
-    // Check for grid setting
+    // Check for HRM trace enable/disable
     bool rslt = false;
+    if ((params.size() > 2) && params[1].equalsIgnoreCase("hrmtrace") && _pJewelry)
+    {
+        bool enable = params[2].equalsIgnoreCase("on");
+        _pJewelry->setTraceEnabled(enable);
+        LOG_I(MODULE_PREFIX, "apiControl hrmtrace %s", enable ? "on" : "off");
+        rslt = true;
+    }
+
+    // Check for grid setting
     if (params.size() > 3)
     {
         if (params[1].equalsIgnoreCase("grid"))
@@ -230,6 +278,11 @@ double Jewelry::getNamedValue(const char* valueName, bool& isValid)
 #endif
         return val;
     }
+    else if (_pJewelry)
+    {
+        // Other values are specific to the jewelry type
+        return _pJewelry->getNamedValue(valueName, isValid);
+    }
     isValid = false;
     return 0;
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include "RaftSysMod.h"
 #include "PowerControl.h"
 #include "JewelryBase.h"
+#include "DeadlineScheduler.h"
 
 class APISourceInfo;
 
@@ -30,6 +31,9 @@ protected:
     // Setup
     virtual void setup() override final;
 
+    // Post setup
+    virtual void postSetup() override final;
+
     // Loop (called frequently)
     virtual void loop() override final;
 
@@ -50,12 +54,27 @@ private:
     // Power control
     PowerControl _powerControl;
 
+    // Power control is serviced at this interval (button debounce and battery voltage averaging)
+    static const uint32_t POWER_CONTROL_INTERVAL_MS_DEFAULT = 50;
+    uint64_t _powerControlIntervalUs = POWER_CONTROL_INTERVAL_MS_DEFAULT * 1000;
+    uint32_t _powerControlTimer = DeadlineScheduler::INVALID_TIMER;
+
     // Jewelry
     JewelryBase* _pJewelry = nullptr;
 
-    // Sample collector SysMod
-    RaftSysMod* _pSampleCollector = nullptr;
-    bool _firstSampleCollection = true;
+    // Scheduler for timed work - the main loop light sleeps (if enabled) until the next deadline
+    DeadlineScheduler _scheduler;
+
+    // Sleep is only entered if the time to the next deadline is at least the minimum and the wakeup
+    // timer is set early by the wakeup latency so that the deadline is met
+    static const uint32_t SLEEP_MIN_US_DEFAULT = 2000;
+    static const uint32_t SLEEP_WAKEUP_LATENCY_US_DEFAULT = 500;
+    uint32_t _sleepMinUs = SLEEP_MIN_US_DEFAULT;
+    uint32_t _sleepWakeupLatencyUs = SLEEP_WAKEUP_LATENCY_US_DEFAULT;
+
+    // Buffer for publishing binary sample and trace frames (preallocated to avoid heap use when publishing)
+    static const uint32_t PUBLISH_MSG_MAX_BYTES = 500;
+    uint8_t _publishMsgBuf[PUBLISH_MSG_MAX_BYTES];
 
     // Helper functions
     RaftRetCode apiControl(const String &reqStr, String &respStr, const APISourceInfo& sourceInfo);
@@ -10,6 +10,7 @@
 
 #include "RaftArduino.h"
 #include "RaftJsonIF.h"
+#include "DeadlineScheduler.h"
 
 // Disable this when not debugging
 // #define DEBUG_USE_GPIO_PIN_FOR_TIMING 9
@@ -28,37 +29,55 @@ public:
     {
     }
 
-    // Setup
-    virtual void setup(const RaftJsonIF& config, DeviceManager& devMan) = 0;
+    // Setup - timed work (animation steps, etc) is registered with the scheduler
+    virtual void setup(const RaftJsonIF& config, DeviceManager& devMan, DeadlineScheduler& scheduler) = 0;
 
-    // Loop
+    // Loop (work that isn't scheduled)
     virtual void loop() = 0;
 
-    // Get sleep duration in us
-    virtual uint32_t getSleepDurationUs()
+    // Check if the main loop can light sleep until the next scheduler deadline - only return true
+    // if all timed work is registered with the scheduler
+    virtual bool isSleepAllowed()
     {
-        return 0;
+        return false;
     }
 
     // Shutdown
     virtual void shutdown() = 0;
 
-    // Check if we should wakeup on GPIO
-    bool wakeupOnGPIO()
+    // Check if light sleep should also end on GPIO (wakeup pins are setup by the jewelry)
+    virtual bool wakeupOnGPIO()
     {
         return false;
     }
 
-    // Debug check if samples available
-    virtual bool debugAreSamplesAvailable()
+    // Get sample frames - copies whole binary frames into pBuf and returns the number of bytes copied
+    virtual uint32_t getSampleFrames(uint8_t* pBuf, uint32_t bufLen)
     {
-        return false;
+        return 0;
+    }
+
+    // Get count of sample frame changes (changes whenever frames are produced or consumed)
+    virtual uint32_t getSampleFramesChangeCount()
+    {
+        return 0;
     }
 
-    // Debug get last samples JSON
-    virtual String debugGetLastSamplesJSON()
+    // Enable / disable trace of internal processing
+    virtual void setTraceEnabled(bool enabled)
     {
-        return "";
+    }
+
+    // Get trace frames - copies binary trace frames into pBuf and returns the number of bytes copied
+    virtual uint32_t getTraceFrames(uint8_t* pBuf, uint32_t bufLen)
+    {
+        return 0;
+    }
+
+    // Get count of trace changes (changes whenever trace records are produced or consumed)
+    virtual uint32_t getTraceChangeCount()
+    {
+        return 0;
     }
 
     /// @brief Get named value
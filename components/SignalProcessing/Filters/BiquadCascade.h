@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Cascade of second order sections (biquads)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <array>
+#include <complex>
+#include "FixedPoint.h"
+
+// Coefficients of a second order section normalised so that a0 = 1
+// H(z) = (b0 + b1*z^-1 + b2*z^-2) / (1 + a1*z^-1 + a2*z^-2)
+struct BiquadCoeffs
+{
+    double b0;
+    double b1;
+    double b2;
+    double a1;
+    double a2;
+
+    // Frequency response at a normalised angular frequency (radians per sample)
+    std::complex<double> response(double omega) const
+    {
+        std::complex<double> z1 = std::polar(1.0, -omega);
+        std::complex<double> z2 = z1 * z1;
+        std::complex<double> den = 1.0 + a1 * z1 + a2 * z2;
+        if (std::abs(den) < 1e-12)
+            return 0;
+        return (b0 + b1 * z1 + b2 * z2) / den;
+    }
+};
+
+// Second order section (transposed direct form II)
+// Coefficients of a stable biquad are always within +/-2 so a FixedQ<29> coefficient type is sufficient
+template<typename SampleT = double, typename CoeffT = SampleT>
+class Biquad
+{
+public:
+    Biquad()
+    {
+    }
+    Biquad(const BiquadCoeffs& coeffs)
+    {
+        setCoeffs(coeffs);
+    }
+
+    // Set coefficients
+    void setCoeffs(const BiquadCoeffs& coeffs)
+    {
+        _b0 = SampleConv<CoeffT>::fromDouble(coeffs.b0);
+        _b1 = SampleConv<CoeffT>::fromDouble(coeffs.b1);
+        _b2 = SampleConv<CoeffT>::fromDouble(coeffs.b2);
+        _a1 = SampleConv<CoeffT>::fromDouble(coeffs.a1);
+        _a2 = SampleConv<CoeffT>::fromDouble(coeffs.a2);
+    }
+
+    // Process one sample
+    SampleT process(SampleT x)
+    {
+        SampleT y = mul(_b0, x) + _z1;
+        _z1 = mul(_b1, x) - mul(_a1, y) + _z2;
+        _z2 = mul(_b2, x) - mul(_a2, y);
+        return y;
+    }
+
+    // Reset state
+    void reset(SampleT z1 = SampleT(), SampleT z2 = SampleT())
+    {
+        _z1 = z1;
+        _z2 = z2;
+    }
+
+    // Set state to the steady state for a constant input - returns the steady state output
+    double settle(double x)
+    {
+        double y = getDCGain() * x;
+        _z1 = SampleConv<SampleT>::fromDouble(y - SampleConv<CoeffT>::toDouble(_b0) * x);
+        _z2 = SampleConv<SampleT>::fromDouble(SampleConv<CoeffT>::toDouble(_b2) * x - SampleConv<CoeffT>::toDouble(_a2) * y);
+        return y;
+    }
+
+    // Shift the state by the change in the steady state for a step in a constant input (the response to the
+    // signal about the level is kept) - returns the change in the steady state output
+    double shiftLevel(double dx)
+    {
+        double dy = getDCGain() * dx;
+        _z1 = _z1 + SampleConv<SampleT>::fromDouble(dy - SampleConv<CoeffT>::toDouble(_b0) * dx);
+        _z2 = _z2 + SampleConv<SampleT>::fromDouble(SampleConv<CoeffT>::toDouble(_b2) * dx - SampleConv<CoeffT>::toDouble(_a2) * dy);
+        return dy;
+    }
+
+    // Get state
+    SampleT getZ1() const
+    {
+        return _z1;
+    }
+    SampleT getZ2() const
+    {
+        return _z2;
+    }
+
+private:
+    CoeffT _b0 = CoeffT();
+    CoeffT _b1 = CoeffT();
+    CoeffT _b2 = CoeffT();
+    CoeffT _a1 = CoeffT();
+    CoeffT _a2 = CoeffT();
+    SampleT _z1 = SampleT();
+    SampleT _z2 = SampleT();
+
+    // Gain at DC
+    double getDCGain() const
+    {
+        double den = 1 + SampleConv<CoeffT>::toDouble(_a1) + SampleConv<CoeffT>::toDouble(_a2);
+        return den != 0 ? (SampleConv<CoeffT>::toDouble(_b0) + SampleConv<CoeffT>::toDouble(_b1) + 
+                    SampleConv<CoeffT>::toDouble(_b2)) / den : 0;
+    }
+
+    // Multiply sample by coefficient giving a result in the sample type
+    static inline SampleT mul(CoeffT coeff, SampleT x)
+    {
+        return static_cast<SampleT>(coeff * x);
+    }
+};
+
+// Cascade of NUM_SECTIONS biquads giving a filter of order 2 * NUM_SECTIONS
+// Any overall gain should be folded into the b coefficients of the first section so that large DC
+// inputs are attenuated before reaching later sections
+template<uint32_t NUM_SECTIONS, typename SampleT = double, typename CoeffT = SampleT>
+class BiquadCascade
+{
+public:
+    static_assert(NUM_SECTIONS > 0, "BiquadCascade NUM_SECTIONS must be > 0");
+    static constexpr uint32_t ORDER = NUM_SECTIONS * 2;
+    typedef std::array<BiquadCoeffs, NUM_SECTIONS> CoeffsArray;
+
+    BiquadCascade()
+    {
+    }
+    BiquadCascade(const CoeffsArray& coeffs)
+    {
+        setCoeffs(coeffs);
+    }
+
+    // Set coefficients (state is not changed)
+    void setCoeffs(const CoeffsArray& coeffs)
+    {
+        for (uint32_t i = 0; i < NUM_SECTIONS; i++)
+            _sections[i].setCoeffs(coeffs[i]);
+    }
+
+    // Process one sample
+    SampleT process(SampleT x)
+    {
+        for (auto& section : _sections)
+            x = section.process(x);
+        return x;
+    }
+
+    // Reset state of all sections
+    void reset()
+    {
+        for (auto& section : _sections)
+            section.reset();
+    }
+
+    // Set state of all sections to the steady state for a constant input (e.g. the DC level of the signal)
+    // so that there is no step transient when starting or changing coefficients with a large DC input
+    void settle(double x)
+    {
+        for (auto& section : _sections)
+            x = section.settle(x);
+    }
+
+    // Shift the state of all sections for a step in a constant input (e.g. when the signal resumes at a
+    // different level after a break) so there is no step transient but the response to the signal is kept
+    void shiftLevel(double dx)
+    {
+        for (auto& section : _sections)
+            dx = section.shiftLevel(dx);
+    }
+
+    // Phase delay (in samples) of a cascade at a normalised angular frequency (radians per sample)
+    // This is the shift of a sinusoid (and so of its zero crossings) at that frequency - within +/- half a
+    // period as the phase is wrapped
+    static double phaseDelaySamples(const CoeffsArray& coeffs, double omega)
+    {
+        if (omega <= 0)
+            return 0;
+        std::complex<double> response = 1.0;
+        for (const BiquadCoeffs& sectionCoeffs : coeffs)
+            response *= sectionCoeffs.response(omega);
+        return -std::arg(response) / omega;
+    }
+
+    // Access sections
+    Biquad<SampleT, CoeffT>& getSection(uint32_t idx)
+    {
+        return _sections[idx];
+    }
+    const Biquad<SampleT, CoeffT>& getSection(uint32_t idx) const
+    {
+        return _sections[idx];
+    }
+
+private:
+    std::array<Biquad<SampleT, CoeffT>, NUM_SECTIONS> _sections;
+};
@@ -0,0 +1,165 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Butterworth filter design
+//
+// Designs bandpass filters as second order sections without allocation or library maths functions so
+// the design can be evaluated at compile time (constexpr) or at setup time on the target
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include "BiquadCascade.h"
+
+namespace ButterworthDesign
+{
+    // Minimal constexpr maths
+    static constexpr double DESIGN_PI = 3.14159265358979323846;
+
+    constexpr double cabs(double x)
+    {
+        return x < 0 ? -x : x;
+    }
+
+    constexpr double csqrt(double x)
+    {
+        if (x <= 0)
+            return 0;
+        double guess = x < 1 ? 1 : x;
+        for (int i = 0; i < 100; i++)
+        {
+            double next = 0.5 * (guess + x / guess);
+            if (cabs(next - guess) <= 1e-15 * next)
+                return next;
+            guess = next;
+        }
+        return guess;
+    }
+
+    // Sine and cosine for |x| <= DESIGN_PI/2 (all that is needed here) using Taylor series
+    constexpr double csin(double x)
+    {
+        double term = x;
+        double sum = x;
+        for (int n = 1; n < 15; n++)
+        {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+        return sum;
+    }
+    constexpr double ccos(double x)
+    {
+        double term = 1;
+        double sum = 1;
+        for (int n = 1; n < 15; n++)
+        {
+            term *= -x * x / ((2 * n - 1) * (2 * n));
+            sum += term;
+        }
+        return sum;
+    }
+    constexpr double ctan(double x)
+    {
+        return csin(x) / ccos(x);
+    }
+
+    // Minimal constexpr complex number
+    struct Complex
+    {
+        double re = 0;
+        double im = 0;
+        constexpr Complex operator+(const Complex& o) const { return {re + o.re, im + o.im}; }
+        constexpr Complex operator-(const Complex& o) const { return {re - o.re, im - o.im}; }
+        constexpr Complex operator*(const Complex& o) const { return {re * o.re - im * o.im, re * o.im + im * o.re}; }
+        constexpr Complex operator*(double k) const { return {re * k, im * k}; }
+        constexpr Complex operator/(const Complex& o) const
+        {
+            double d = o.re * o.re + o.im * o.im;
+            return {(re * o.re + im * o.im) / d, (im * o.re - re * o.im) / d};
+        }
+        constexpr double norm() const { return re * re + im * im; }
+    };
+
+    constexpr Complex complexSqrt(const Complex& z)
+    {
+        double mag = csqrt(z.norm());
+        double re = csqrt((mag + z.re) / 2);
+        double im = csqrt((mag - z.re) / 2);
+        return {re, z.im < 0 ? -im : im};
+    }
+
+    // Biquad with poles p1 and p2 (a conjugate pair or both real), one zero at z=+1 and one at z=-1
+    // scaled to unity gain at the band centre (zc = e^jw0) which keeps intermediate values in a cascade bounded
+    constexpr BiquadCoeffs bandpassSection(const Complex& p1, const Complex& p2, const Complex& zc)
+    {
+        double a1 = -(p1 + p2).re;
+        double a2 = (p1 * p2).re;
+        Complex zc2 = zc * zc;
+        Complex num = zc2 - Complex{1, 0};
+        Complex den = zc2 + zc * a1 + Complex{a2, 0};
+        double gain = csqrt((num / den).norm());
+        double b0 = gain > 0 ? 1 / gain : 1;
+        return {b0, 0, -b0, a1, a2};
+    }
+
+    // Bandpass filter of order 2 * NUM_SECTIONS (i.e. a lowpass prototype of order NUM_SECTIONS)
+    // The band edges (-3dB points) are exact in the digital domain (bilinear transform with prewarping)
+    // Returns sections with zero coefficients (which pass nothing) if the parameters are invalid
+    template<size_t NUM_SECTIONS>
+    constexpr std::array<BiquadCoeffs, NUM_SECTIONS> bandpass(double sampleRateHz, double lowerHz, double upperHz)
+    {
+        std::array<BiquadCoeffs, NUM_SECTIONS> sections = {};
+        if ((sampleRateHz <= 0) || (lowerHz <= 0) || (upperHz <= lowerHz) || (upperHz >= sampleRateHz / 2))
+            return sections;
+
+        // Prewarped band edges (bilinear transform s = (z-1)/(z+1))
+        double w1 = ctan(DESIGN_PI * lowerHz / sampleRateHz);
+        double w2 = ctan(DESIGN_PI * upperHz / sampleRateHz);
+        double bw = w2 - w1;
+        double w0sq = w1 * w2;
+
+        // Band centre on the unit circle z = (1+jw0)/(1-jw0)
+        Complex zc = {(1 - w0sq) / (1 + w0sq), 2 * csqrt(w0sq) / (1 + w0sq)};
+
+        // Each upper half-plane prototype pole maps to two bandpass poles (their conjugates come from
+        // the lower half-plane pole) and a real prototype pole (odd order) maps to one conjugate pair
+        const size_t N = NUM_SECTIONS;
+        size_t sectionIdx = 0;
+        for (size_t k = 0; k < (N + 1) / 2; k++)
+        {
+            double theta = DESIGN_PI * (2.0 * k + N + 1) / (2.0 * N);
+            Complex p = {-csin(theta - DESIGN_PI / 2), ccos(theta - DESIGN_PI / 2)};
+            if (2 * k + 1 == N)
+                p = {-1, 0};
+
+            // Lowpass to bandpass s = (p*bw/2) +/- sqrt((p*bw/2)^2 - w0^2)
+            // then bilinear transform z = (1+s)/(1-s)
+            Complex half = p * (bw / 2);
+            Complex root = complexSqrt(half * half - Complex{w0sq, 0});
+            Complex one = {1, 0};
+            Complex z1 = (one + half + root) / (one - half - root);
+            Complex z2 = (one + half - root) / (one - half + root);
+            if (sectionIdx >= N)
+                break;
+            if (2 * k + 1 == N)
+            {
+                // Real prototype pole - z1 and z2 are a conjugate pair or both real
+                sections[sectionIdx++] = bandpassSection(z1, z2, zc);
+            }
+            else
+            {
+                // Complex prototype pole - each of z1 and z2 forms a section with its conjugate
+                sections[sectionIdx++] = bandpassSection(z1, Complex{z1.re, -z1.im}, zc);
+                if (sectionIdx < N)
+                    sections[sectionIdx++] = bandpassSection(z2, Complex{z2.re, -z2.im}, zc);
+            }
+        }
+        return sections;
+    }
+}
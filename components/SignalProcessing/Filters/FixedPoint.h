@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Fixed point (Q format) arithmetic
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+// Fixed point value with FRAC_BITS fractional bits stored in a signed 32 bit integer
+// e.g. FixedQ<29> has a range of +/-4 with a resolution of ~1.9e-9 (suitable for filter coefficients)
+// and FixedQ<8> has a range of +/-8388608 with a resolution of 1/256 (suitable for 18..22 bit ADC samples)
+// All operations saturate rather than wrapping
+template<int FRAC_BITS>
+class FixedQ
+{
+public:
+    static_assert((FRAC_BITS >= 0) && (FRAC_BITS < 31), "FixedQ FRAC_BITS must be 0..30");
+
+    // Constructors
+    constexpr FixedQ() : _raw(0)
+    {
+    }
+    explicit constexpr FixedQ(double val) : _raw(saturate(val * (double)ONE + (val >= 0 ? 0.5 : -0.5)))
+    {
+    }
+
+    // Construct from an integer value (no floating point required)
+    static constexpr FixedQ fromInt(int32_t val)
+    {
+        return fromRaw(saturate((int64_t)val * ONE));
+    }
+
+    // Construct from raw Q value
+    static constexpr FixedQ fromRaw(int32_t raw)
+    {
+        FixedQ q;
+        q._raw = raw;
+        return q;
+    }
+
+    // Access
+    constexpr int32_t raw() const
+    {
+        return _raw;
+    }
+    explicit constexpr operator double() const
+    {
+        return (double)_raw / (double)ONE;
+    }
+    explicit constexpr operator float() const
+    {
+        return (float)_raw / (float)ONE;
+    }
+    explicit constexpr operator int32_t() const
+    {
+        // Round towards minus infinity (arithmetic shift)
+        return _raw >> FRAC_BITS;
+    }
+
+    // Arithmetic
+    constexpr FixedQ operator+(FixedQ other) const
+    {
+        return fromRaw(saturate((int64_t)_raw + other._raw));
+    }
+    constexpr FixedQ operator-(FixedQ other) const
+    {
+        return fromRaw(saturate((int64_t)_raw - other._raw));
+    }
+    constexpr FixedQ operator-() const
+    {
+        return fromRaw(saturate(-(int64_t)_raw));
+    }
+    FixedQ& operator+=(FixedQ other)
+    {
+        *this = *this + other;
+        return *this;
+    }
+    FixedQ& operator-=(FixedQ other)
+    {
+        *this = *this - other;
+        return *this;
+    }
+
+    // Multiply by a value in another Q format - the result is in this format
+    template<int OTHER_FRAC_BITS>
+    constexpr FixedQ mulBy(FixedQ<OTHER_FRAC_BITS> other) const
+    {
+        // Round to nearest
+        int64_t prod = (int64_t)_raw * other.raw();
+        if (OTHER_FRAC_BITS > 0)
+            prod = (prod + ((int64_t)1 << (OTHER_FRAC_BITS - 1))) >> OTHER_FRAC_BITS;
+        return fromRaw(saturate(prod));
+    }
+
+    // Comparison
+    constexpr bool operator<(FixedQ other) const { return _raw < other._raw; }
+    constexpr bool operator>(FixedQ other) const { return _raw > other._raw; }
+    constexpr bool operator<=(FixedQ other) const { return _raw <= other._raw; }
+    constexpr bool operator>=(FixedQ other) const { return _raw >= other._raw; }
+    constexpr bool operator==(FixedQ other) const { return _raw == other._raw; }
+    constexpr bool operator!=(FixedQ other) const { return _raw != other._raw; }
+
+    // Limits
+    static constexpr int64_t ONE = (int64_t)1 << FRAC_BITS;
+    static constexpr FixedQ maxVal() { return fromRaw(INT32_MAX); }
+    static constexpr FixedQ minVal() { return fromRaw(INT32_MIN); }
+
+private:
+    int32_t _raw;
+
+    // Saturation
+    static constexpr int32_t saturate(int64_t val)
+    {
+        return val > INT32_MAX ? INT32_MAX : (val < INT32_MIN ? INT32_MIN : (int32_t)val);
+    }
+    static constexpr int32_t saturate(double val)
+    {
+        return val >= (double)INT32_MAX ? INT32_MAX : (val <= (double)INT32_MIN ? INT32_MIN : (int32_t)val);
+    }
+};
+
+// Multiplication of a coefficient (in any format) by a sample gives a result in the sample format
+template<int COEFF_FRAC_BITS, int SAMPLE_FRAC_BITS>
+constexpr FixedQ<SAMPLE_FRAC_BITS> operator*(FixedQ<COEFF_FRAC_BITS> coeff, FixedQ<SAMPLE_FRAC_BITS> sample)
+{
+    return sample.mulBy(coeff);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Conversions used by templated filters so that they work with float, double or FixedQ types
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+struct SampleConv
+{
+    static constexpr T fromInt(int32_t val) { return static_cast<T>(val); }
+    static constexpr T fromDouble(double val) { return static_cast<T>(val); }
+    static constexpr double toDouble(T val) { return static_cast<double>(val); }
+};
+
+template<int FRAC_BITS>
+struct SampleConv<FixedQ<FRAC_BITS>>
+{
+    static constexpr FixedQ<FRAC_BITS> fromInt(int32_t val) { return FixedQ<FRAC_BITS>::fromInt(val); }
+    static constexpr FixedQ<FRAC_BITS> fromDouble(double val) { return FixedQ<FRAC_BITS>(val); }
+    static constexpr double toDouble(FixedQ<FRAC_BITS> val) { return static_cast<double>(val); }
+};
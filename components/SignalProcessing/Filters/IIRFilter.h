@@ -0,0 +1,74 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// IIR Filter (templated on order, sample type and coefficient type)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "FixedPoint.h"
+
+// ORDER is the filter order (number of delay elements)
+// SampleT is the type used for samples and filter state - double, float or FixedQ<N>
+// CoeffT is the type used for coefficients - double, float or FixedQ<N>
+// e.g. IIRFilter<4, FixedQ<8>, FixedQ<29>> is a 4th order filter for integer ADC samples on an FPU-less target
+template<uint32_t ORDER, typename SampleT = double, typename CoeffT = SampleT>
+class IIRFilter
+{
+public:
+    static_assert(ORDER > 0, "IIRFilter ORDER must be > 0");
+
+    // Constructor
+    // a0 + a1*z^-1 + ... + aN*z^-N = b0 + b1*z^-1 + ... + bN*z^-N
+    // a_coeffs and b_coeffs have ORDER+1 elements, zi_initial has ORDER elements (or is nullptr)
+    // Coefficients are normalised by a0
+    IIRFilter(const double* a_coeffs, const double* b_coeffs, const double* zi_initial = nullptr)
+    {
+        double a0 = a_coeffs[0] != 0 ? a_coeffs[0] : 1.0;
+        for (uint32_t i = 0; i <= ORDER; i++)
+        {
+            a[i] = SampleConv<CoeffT>::fromDouble(a_coeffs[i] / a0);
+            b[i] = SampleConv<CoeffT>::fromDouble(b_coeffs[i] / a0);
+        }
+        for (uint32_t i = 0; i < ORDER; i++)
+            z[i] = SampleConv<SampleT>::fromDouble(zi_initial ? zi_initial[i] : 0);
+    }
+    ~IIRFilter() {}
+
+    // Process one sample (transposed direct form II)
+    SampleT process(SampleT x)
+    {
+        SampleT y = mul(b[0], x) + z[0];
+        for (uint32_t i = 0; i < ORDER - 1; i++)
+            z[i] = mul(b[i + 1], x) + z[i + 1] - mul(a[i + 1], y);
+        z[ORDER - 1] = mul(b[ORDER], x) - mul(a[ORDER], y);
+        return y;
+    }
+
+    // Set filter state
+    void setState(const SampleT* pState)
+    {
+        for (uint32_t i = 0; i < ORDER; i++)
+            z[i] = pState[i];
+    }
+
+    // Get filter state
+    const SampleT* getState() const
+    {
+        return z;
+    }
+
+private:
+    CoeffT a[ORDER + 1];
+    CoeffT b[ORDER + 1];
+    SampleT z[ORDER];
+
+    // Multiply sample by coefficient giving a result in the sample type
+    static inline SampleT mul(CoeffT coeff, SampleT x)
+    {
+        return static_cast<SampleT>(coeff * x);
+    }
+};
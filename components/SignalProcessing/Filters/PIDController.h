@@ -24,13 +24,13 @@ public:
     ~PIDControl()
     {
     }
-    double process(double setPoint, double processVariable, uint32_t timeDeltaMs)
+    double process(double setPoint, double processVariable, double timeDeltaMs)
     {
         // Calculate error
         double error = setPoint - processVariable;
 
         // Time delta in seconds
-        if (timeDeltaMs == 0)
+        if (timeDeltaMs <= 0)
             return 0;
         double timeDeltaSecs = timeDeltaMs / 1000.0;
 
@@ -57,6 +57,11 @@ public:
         // Save error to previous error
         _lastError = error;
 
+        // Save terms (for tracing)
+        _lastP = pOut;
+        _lastI = iOut;
+        _lastD = dOut;
+
 #ifdef DEBUG_PID_CONTROLLER
         printf("PID: SP=%f PV=%f ΔT=%f Err=%f P=%f I=%f D=%f Out=%f Int=%f\n", 
                 setPoint, processVariable, timeDeltaSecs, error, pOut, iOut, dOut, output, _integral);
@@ -64,6 +69,44 @@ public:
 
         return output;
     }
+
+    // Reset the integral and derivative state (e.g. when the controller takes over from another loop)
+    void reset()
+    {
+        _integral = 0;
+        _lastError = 0;
+    }
+
+    // State (e.g. for saving and restoring across a restart)
+    struct State
+    {
+        float integral;
+        float lastError;
+    };
+    State getState() const
+    {
+        return State{(float)_integral, (float)_lastError};
+    }
+    void setState(const State& state)
+    {
+        _integral = state.integral;
+        _lastError = state.lastError;
+    }
+
+    // Get terms from the last call to process()
+    double getLastP() const
+    {
+        return _lastP;
+    }
+    double getLastI() const
+    {
+        return _lastI;
+    }
+    double getLastD() const
+    {
+        return _lastD;
+    }
+
 private:
     double _kp;
     double _ki;
@@ -72,4 +115,7 @@ private:
     double _min;
     double _lastError = 0;
     double _integral = 0;
+    double _lastP = 0;
+    double _lastI = 0;
+    double _lastD = 0;
 };
@@ -2,6 +2,12 @@
 //
 // Phase-Locked Loop
 //
+// The beat frequency is tracked by a PID loop (narrow gain) on the frequency measured from zero crossing
+// intervals. An optional acquisition mode (wide gain) moves the beat frequency a fraction of the way to each
+// measured frequency until a number of consecutive measurements are within a tolerance of it (locked) and
+// the PID loop then takes over. Lock is lost (and acquisition restarts) after a number of consecutive
+// measurements outside the tolerance
+//
 // Rob Dobson 2023
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -10,6 +16,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <math.h>
 #include "PIDController.h"
 
 // #define DEBUG_PLL
@@ -30,34 +37,67 @@ public:
     ~PhaseLockedLoop()
     {
     }
-    void processZeroCrossing(uint32_t sampleTimeMs)
+
+    // Set acquisition mode - acquisitionGain is the fraction of the difference between the measured and beat
+    // frequencies applied per crossing until locked (0 disables acquisition), lockTolerance is a fraction of
+    // the beat frequency
+    void setAcquisition(double acquisitionGain, double lockTolerance, uint32_t lockIntervals, uint32_t lockLossIntervals)
+    {
+        _acquisitionGain = acquisitionGain;
+        _lockTolerance = lockTolerance;
+        _lockIntervals = lockIntervals;
+        _lockLossIntervals = lockLossIntervals;
+        _isLocked = false;
+        _lockCount = 0;
+    }
+
+    // Process a zero crossing - returns true if the beat frequency was updated (PID loop or acquisition)
+    // The crossing time is in whole ms (wrapping) plus an optional fraction of a ms (e.g. interpolated)
+    bool processZeroCrossing(uint32_t sampleTimeMs, double sampleTimeFracMs = 0)
     {
         if (_zeroCrossingFirstMs == 0)
         {
             _zeroCrossingFirstMs = sampleTimeMs;
             _lastZeroCrossingMs = sampleTimeMs;
+            _lastZeroCrossingFracMs = sampleTimeFracMs;
             _beatFreqHz = _centreFreqHz;
-            return;
+            return false;
         }
 
-        // Check valid
-        if (sampleTimeMs <= _lastZeroCrossingMs + 1)
-            return;
-
         // Time between zero crossings
-        uint32_t intervalMs = sampleTimeMs - _lastZeroCrossingMs;
-        if (intervalMs == 0)
-            return;
+        double intervalMs = (double)(uint32_t)(sampleTimeMs - _lastZeroCrossingMs) + 
+                    sampleTimeFracMs - _lastZeroCrossingFracMs;
+
+        // Check valid
+        if (intervalMs <= 1)
+            return false;
 
         // Save last zero crossing
         _lastZeroCrossingMs = sampleTimeMs;
+        _lastZeroCrossingFracMs = sampleTimeFracMs;
 
         // Calculate frequency based on time between zero crossings
         double measuredFreqHz = 1000.0 / intervalMs;
         measuredFreqHz = std::clamp(measuredFreqHz, _minFreqHz, _maxFreqHz);
+        _lastMeasuredFreqHz = measuredFreqHz;
 
         // printf("PLL: %f %f %f %f\n", measuredFreqHz, _beatFreqHz, _frequencyPID.getMin(), _frequencyPID.getMax());
 
+        // Acquisition (wide gain) until locked - the PID loop starts from its reset state when lock is gained
+        bool isWithinTolerance = fabs(measuredFreqHz - _beatFreqHz) <= _lockTolerance * _beatFreqHz;
+        if ((_acquisitionGain > 0) && !_isLocked)
+        {
+            _beatFreqHz += _acquisitionGain * (measuredFreqHz - _beatFreqHz);
+            _lockCount = isWithinTolerance ? _lockCount + 1 : 0;
+            if (_lockCount >= _lockIntervals)
+            {
+                _isLocked = true;
+                _lockCount = 0;
+                _frequencyPID.reset();
+            }
+            return true;
+        }
+
         // Update PID
 #ifdef DEBUG_PLL
         double prevFreq = _beatFreqHz;
@@ -67,6 +107,31 @@ public:
 #ifdef DEBUG_PLL
         printf(" prev beatFreq %f beatFreq %f\n", prevFreq, _beatFreqHz);
 #endif
+
+        // Check for loss of lock
+        if (_acquisitionGain > 0)
+        {
+            _lockCount = isWithinTolerance ? 0 : _lockCount + 1;
+            if (_lockCount >= _lockLossIntervals)
+            {
+                _isLocked = false;
+                _lockCount = 0;
+            }
+        }
+        return true;
+    }
+
+    // Restart the zero crossing interval (e.g. after crossings have been held back) - the crossing is
+    // used as the new phase reference and the frequency is not changed
+    void restartInterval(uint32_t sampleTimeMs, double sampleTimeFracMs = 0)
+    {
+        if (_zeroCrossingFirstMs == 0)
+        {
+            processZeroCrossing(sampleTimeMs, sampleTimeFracMs);
+            return;
+        }
+        _lastZeroCrossingMs = sampleTimeMs;
+        _lastZeroCrossingFracMs = sampleTimeFracMs;
     }
 
     uint32_t timeToNextPeakMs(uint32_t curTimeMs)
@@ -90,13 +155,70 @@ public:
         return _beatFreqHz;
     }
 
+    // Check if locked (always true if acquisition is disabled)
+    bool isLocked() const
+    {
+        return _isLocked || (_acquisitionGain <= 0);
+    }
+
+    // Get measured frequency (clamped) from the last zero crossing interval
+    double getLastMeasuredFreqHz() const
+    {
+        return _lastMeasuredFreqHz;
+    }
+
+    // State (e.g. for saving and restoring across a restart) - the time of the last zero crossing is in whole
+    // ms (as passed to processZeroCrossing) and timeOffsetMs is added to it when the state is set (e.g. to move
+    // it to a new millis() timeline)
+    struct State
+    {
+        float beatFreqHz;
+        uint32_t lastZeroCrossingMs;
+        float lastZeroCrossingFracMs;
+        uint8_t isStarted;
+        uint8_t isLocked;
+        uint16_t lockCount;
+        PIDControl::State pid;
+    };
+    State getState() const
+    {
+        return State{(float)_beatFreqHz, _lastZeroCrossingMs, (float)_lastZeroCrossingFracMs, 
+                    (uint8_t)(_zeroCrossingFirstMs != 0), _isLocked, (uint16_t)_lockCount, _frequencyPID.getState()};
+    }
+    void setState(const State& state, int32_t timeOffsetMs = 0)
+    {
+        _beatFreqHz = std::clamp((double)state.beatFreqHz, _minFreqHz, _maxFreqHz);
+        _lastZeroCrossingMs = state.lastZeroCrossingMs + timeOffsetMs;
+        _lastZeroCrossingFracMs = state.lastZeroCrossingFracMs;
+        _zeroCrossingFirstMs = state.isStarted ? std::max(_lastZeroCrossingMs, (uint32_t)1) : 0;
+        _isLocked = state.isLocked;
+        _lockCount = state.lockCount;
+        _frequencyPID.setState(state.pid);
+    }
+
+    // Get frequency PID controller (e.g. for tracing the PID terms)
+    const PIDControl& getFrequencyPID() const
+    {
+        return _frequencyPID;
+    }
+
 private:
     uint32_t _zeroCrossingFirstMs = 0;
     uint32_t _lastZeroCrossingMs = 0;
+    double _lastZeroCrossingFracMs = 0;
     PIDControl _frequencyPID;
     double _maxFreqHz = 3.5;
     double _minFreqHz = 0.5;
     double _centreFreqHz;
     double _beatFreqHz = 1.0;
+    double _lastMeasuredFreqHz = 0;
     double _scalingFactor = 1.0;
+
+    // Acquisition
+    double _acquisitionGain = 0;
+    double _lockTolerance = 0.1;
+    uint32_t _lockIntervals = 4;
+    uint32_t _lockLossIntervals = 8;
+    bool _isLocked = false;
+    uint32_t _lockCount = 0;
 };
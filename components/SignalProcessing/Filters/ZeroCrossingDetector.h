@@ -2,6 +2,17 @@
 //
 // Zero crossing detector
 //
+// Detects falling zero crossings of a bandpass filtered (zero mean) signal:
+//   Hysteresis     A crossing is only confirmed once the signal has been above +threshold and then falls
+//                  below -threshold (Schmitt trigger) so noise around zero doesn't cause extra crossings. The
+//                  threshold is a fraction of the signal envelope (exponential average of the absolute level)
+//                  so it adapts to the signal amplitude
+//   Refractory     Confirmed crossings less than the refractory period after the last reported crossing are
+//                  ignored (faster than any heart rate of interest)
+//   Timing         The crossing time is linearly interpolated between the samples either side of zero so
+//                  intervals aren't quantised to the sample interval
+// The crossing time is reported as whole ms (wrapping as sample times do) plus a fraction of a ms
+//
 // Rob Dobson 2023
 //
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -9,46 +20,135 @@
 #pragma once
 
 #include <stdint.h>
+#include <math.h>
+
+struct ZeroCrossingDetectorParams
+{
+    double hysteresis = 0.2;
+    double envelopeTimeConstSecs = 0.5;
+    double refractoryMs = 250;
+};
 
 class ZeroCrossingDetector
 {
 public:
-    ZeroCrossingDetector()
+    typedef ZeroCrossingDetectorParams Params;
+
+    ZeroCrossingDetector(const Params& params = Params(), double sampleRateHz = 25.0) :
+        _params(params)
     {
+        setSampleRate(sampleRateHz);
     }
     ~ZeroCrossingDetector()
     {
     }
-    bool process(int sample, bool bothEdges)
+
+    // Set sample rate (envelope decay depends on it)
+    void setSampleRate(double sampleRateHz)
+    {
+        _envelopeDecay = (_params.envelopeTimeConstSecs > 0) && (sampleRateHz > 0) ?
+                    exp(-1 / (_params.envelopeTimeConstSecs * sampleRateHz)) : 0;
+    }
+
+    // Restart (e.g. after a gap in the samples) - the envelope can be set (e.g. from getEnvelope() before a
+    // restart) so the hysteresis threshold is right from the first sample
+    void reset(double envelope = 0)
     {
+        _isFirstSample = true;
+        _isArmed = false;
+        _isCandidate = false;
+        _isReported = false;
+        _envelope = envelope;
+    }
+
+    // Process a sample - returns true if a falling crossing is confirmed (the crossing time is then available
+    // from getCrossingTimeMs() and getCrossingFracMs() and is before the time of this sample)
+    bool process(double sample, uint32_t sampleTimeMs)
+    {
+        // Envelope and hysteresis threshold
+        double absSample = fabs(sample);
+        _envelope += (1 - _envelopeDecay) * (absSample - _envelope);
+        double threshold = _params.hysteresis * _envelope;
+
         // Check for first sample
         if (_isFirstSample)
         {
             _lastSample = sample;
+            _lastSampleTimeMs = sampleTimeMs;
             _isFirstSample = false;
             return false;
         }
 
-        // Check for zero crossing
-        bool result = false;
-        if (_lastSampleWasPositive && (sample < 0))
+        // Arm on a positive excursion and record the (latest) falling zero crossing while armed
+        if (sample > threshold)
+            _isArmed = true;
+        // (sample times can be out of order, e.g. at the boundary of re-timed sensor FIFO blocks, in which case the
+        // crossing is at the time of this sample)
+        if (_isArmed && (_lastSample >= 0) && (sample < 0))
         {
-            result = true;
+            int32_t sampleIntervalMs = (int32_t)(sampleTimeMs - _lastSampleTimeMs);
+            double offsetMs = sampleIntervalMs > 0 ? _lastSample / (_lastSample - sample) * sampleIntervalMs : 0;
+            double wholeMs = floor(offsetMs);
+            _candidateMs = (sampleIntervalMs > 0 ? _lastSampleTimeMs : sampleTimeMs) + (uint32_t)wholeMs;
+            _candidateFracMs = offsetMs - wholeMs;
+            _isCandidate = true;
         }
-        else if (bothEdges && (!_lastSampleWasPositive && (sample >= 0)))
+        _lastSample = sample;
+        _lastSampleTimeMs = sampleTimeMs;
+
+        // Confirm when the signal falls below the negative threshold
+        if (!_isCandidate || (sample >= -threshold))
+            return false;
+        _isArmed = false;
+        _isCandidate = false;
+
+        // Refractory period
+        if (_isReported)
         {
-            result = true;
+            double sinceLastMs = (double)(int32_t)(_candidateMs - _crossingMs) + _candidateFracMs - _crossingFracMs;
+            if (sinceLastMs < _params.refractoryMs)
+                return false;
         }
+        _crossingMs = _candidateMs;
+        _crossingFracMs = _candidateFracMs;
+        _isReported = true;
+        return true;
+    }
 
-        // Store last sample
-        _lastSampleWasPositive = sample >= 0;
-        _lastSample = sample;
-        return result;
+    // Time of the last reported crossing (whole ms and fraction of a ms)
+    uint32_t getCrossingTimeMs() const
+    {
+        return _crossingMs;
+    }
+    double getCrossingFracMs() const
+    {
+        return _crossingFracMs;
+    }
+
+    // Envelope (averaged absolute level)
+    double getEnvelope() const
+    {
+        return _envelope;
     }
 
 private:
-    int _lastSample = 0;
-    bool _lastSampleWasPositive = false;
+    Params _params;
+    double _envelopeDecay = 0;
+
+    // State
     bool _isFirstSample = true;
-    uint32_t _lastZeroCrossingTimeMs = 0;
+    double _lastSample = 0;
+    uint32_t _lastSampleTimeMs = 0;
+    double _envelope = 0;
+    bool _isArmed = false;
+
+    // Crossing waiting for confirmation
+    bool _isCandidate = false;
+    uint32_t _candidateMs = 0;
+    double _candidateFracMs = 0;
+
+    // Last reported crossing
+    bool _isReported = false;
+    uint32_t _crossingMs = 0;
+    double _crossingFracMs = 0;
 };
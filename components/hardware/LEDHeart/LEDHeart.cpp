@@ -10,10 +10,9 @@
 #include "Logger.h"
 #include "RaftUtils.h"
 #include "ConfigPinMap.h"
-#include "driver/gpio.h"
+#include <algorithm>
 
 #define DEBUG_LED_HEART_PINS
-// #define USE_FIXED_TIMER_FOR_LED_BRIGHTNESS
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Constructor / Destructor
@@ -38,6 +37,9 @@ void LEDHeart::setup(const RaftJsonIF& config)
 
     // Get time between animation steps
     _animStepTimeUs = config.getInt("animStepTimeUs", ANIM_STEP_TIME_US_DEFAULT);
+    _animTimeScale = config.getDouble("animTimeScale", 1.0);
+    if (_animTimeScale <= 0)
+        _animTimeScale = 1.0;
 
     // Get LED pins
     std::vector<String> ledPinStrs;
@@ -53,7 +55,7 @@ void LEDHeart::setup(const RaftJsonIF& config)
     for (int ledIdx = 0; ledIdx < ledPinStrs.size(); ledIdx++)
     {
         int ledPin = ConfigPinMap::getPinFromName(ledPinStrs[ledIdx].c_str());
-        if (ledPin > 0)
+        if ((ledPin > 0) && (_ledPins.size() < MAX_LEDS))
             _ledPins.push_back(ledPin);
     }
 
@@ -71,23 +73,19 @@ void LEDHeart::setup(const RaftJsonIF& config)
             _ledIntensityFactors[ledIdx] = 1;
     }
 
-    // Set size of animation off time array
-    _animationOffAfterUs.resize(_ledPins.size());
-    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
-        _animationOffAfterUs[ledIdx] = 0;
-
     // Get active level for LED pins
     _ledActiveLevel = config.getBool("ledActiveLevel", false);
 
-    // Set LED pins to output and off
-    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
-    {
-        pinMode(_ledPins[ledIdx], OUTPUT);
-        digitalWrite(_ledPins[ledIdx], !_ledActiveLevel);
-    }
+    // LED driver - GPIO is used if PWM is not selected or can't be setup
+    _pDriver = &_gpioDriver;
+    if (config.getString("ledDriver", "gpio").equalsIgnoreCase("pwm") && 
+                _pwmDriver.setup(config, _ledPins, _ledActiveLevel))
+        _pDriver = &_pwmDriver;
+    else
+        _gpioDriver.setup(config, _ledPins, _ledActiveLevel);
 
-    // Set animation step count
-    _animationCount = _animationStepLevels.size() + _ledPins.size() - 1;
+    // Compile the animation timeline
+    compileTimeline();
 
     // Log
 #ifdef DEBUG_LED_HEART_PINS
@@ -98,9 +96,12 @@ void LEDHeart::setup(const RaftJsonIF& config)
             ledPinsStr += ",";
         ledPinsStr += String(_ledPins[ledIdx]) + "(" + String(_ledIntensityFactors[ledIdx]) + ")";
     }
-    LOG_I(MODULE_PREFIX, "setup OK numLEDs %d activeLevel %d pin(intensity): %s", _ledPins.size(), _ledActiveLevel, ledPinsStr.c_str());
+    LOG_I(MODULE_PREFIX, "setup OK numLEDs %d activeLevel %d driver %s timeScale %.2f timelineEvents %d peakOffset %dus pin(intensity): %s", 
+                _ledPins.size(), _ledActiveLevel, _pDriver->getName(), _animTimeScale, _timeline.size(), _peakOffsetUs, 
+                ledPinsStr.c_str());
 #else
-    LOG_I(MODULE_PREFIX, "setup OK numLEDs %d activeLevel %d", _ledPins.size(), _ledActiveLevel);
+    LOG_I(MODULE_PREFIX, "setup OK numLEDs %d activeLevel %d driver %s timeScale %.2f timelineEvents %d peakOffset %dus", 
+                _ledPins.size(), _ledActiveLevel, _pDriver->getName(), _animTimeScale, _timeline.size(), _peakOffsetUs);
 #endif
 }
 
@@ -110,102 +111,126 @@ void LEDHeart::setup(const RaftJsonIF& config)
 
 void LEDHeart::loop()
 {
-    // Turn off any LEDs that need to be turned off
-    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
-    {
-        if (_animationOffAfterUs[ledIdx] > 0)
-        {
-            if (Raft::isTimeout(micros(), _lastAnimTimeUs, _animationOffAfterUs[ledIdx]))
-            {
-                gpio_hold_dis((gpio_num_t)_ledPins[ledIdx]);
-                digitalWrite(_ledPins[ledIdx], !_ledActiveLevel);
-                gpio_hold_en((gpio_num_t)_ledPins[ledIdx]);
-                _animationOffAfterUs[ledIdx] = 0;
-                // LOG_I(MODULE_PREFIX, "loop setLedOff ledIdx %d", ledIdx);
-            }
-        }
-    }
-
-    // Check if time for next step in sequence
-    if (Raft::isTimeout(micros(), _lastAnimTimeUs, _nextAnimStepAfterUs))
-    {
-        // Handle animation step
-        handleAnimationStep();
+    // Check if the next timeline event is due
+    uint32_t elapsedUs = micros() - _pulseStartTimeUs;
+    if (elapsedUs >= getNextEventOffsetUs())
+        playTimeline(elapsedUs);
+}
 
-        // Update animation step
-        _animationStepNum++;
-        if (_animationStepNum >= _animationCount)
-        {
-            _animationStepNum = 0;
-            _nextAnimStepAfterUs = UINT32_MAX;
-        }
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Start pulse animation
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-        // Set last animation step time
-        _lastAnimTimeUs = micros();
-    }
+void LEDHeart::startPulseAnimation()
+{
+    _pulseStartTimeUs = micros();
+    _timelinePos = 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Handle animation step
+// Play next timeline event if it is due
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void LEDHeart::handleAnimationStep()
+bool LEDHeart::playTimeline(uint32_t elapsedUs)
 {
-    // Set LEDs
-    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
+    // Only one event is played per call so that an LED turned on late isn't turned off in the same call
+    // (the following event is then played on the next call if it is already due)
+    if ((_timelinePos < _timeline.size()) && (_timeline[_timelinePos].timeOffsetUs <= elapsedUs))
     {
-        // Use animation step to determine LED state
-        int animStepIdx = (int)_animationStepNum - ledIdx;
-        if (animStepIdx >= 0)
-        {
-            if (animStepIdx < _animationStepLevels.size())
-            {
-                // Set animation off after time
-                int animOffTimeUs = _animationStepLevels[animStepIdx] * _ledIntensityFactors[ledIdx] * _displayBrightnessPC;
-
-                // Set LED state
 #ifdef FEATURE_HEART_ANIMATIONS
-                gpio_hold_dis((gpio_num_t)_ledPins[ledIdx]);
-                digitalWrite(_ledPins[ledIdx], animOffTimeUs != 0 ? _ledActiveLevel : !_ledActiveLevel);
-                gpio_hold_en((gpio_num_t)_ledPins[ledIdx]);
-#endif
-                _animationOffAfterUs[ledIdx] = animOffTimeUs;
-
-                // LOG_I(MODULE_PREFIX, "handleAnimationStep setLedOn ledIdx %d animStepIdx %d offTimeMs %d", 
-                //         ledIdx, animStepIdx, _animationOffAfterMs[ledIdx]);
-            }
+        const TimelineEvent& event = _timeline[_timelinePos];
+        for (uint32_t ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
+        {
+            if ((event.ledMask & (1u << ledIdx)) == 0)
+                continue;
+            if (event.isStep)
+                _pDriver->setLED(ledIdx, event.onTimeUs, _animStepTimeUs * _animTimeScale);
+            else
+                _pDriver->setLEDOff(ledIdx);
         }
-    }
-
-#ifdef USE_FIXED_TIMER_FOR_LED_BRIGHTNESS
-    delay(1);
-    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
-    {
-        digitalWrite(_ledPins[ledIdx], !_ledActiveLevel);
-        // gpio_hold_en((gpio_num_t)_ledPins[ledIdx]);
-    }
 #endif
+        _timelinePos++;
+    }
+    return _timelinePos < _timeline.size();
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Get time to next animation step
+// Get time to next animation event
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 uint32_t LEDHeart::getTimeToNextAnimStepUs()
 {
-    // Check if any LEDs need to be turned off
-    uint32_t animOffTimeUs = UINT32_MAX;
-    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
+    uint32_t nextEventOffsetUs = getNextEventOffsetUs();
+    if (nextEventOffsetUs == UINT32_MAX)
+        return UINT32_MAX;
+    uint32_t elapsedUs = micros() - _pulseStartTimeUs;
+    return nextEventOffsetUs > elapsedUs ? nextEventOffsetUs - elapsedUs : 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Compile animation timeline
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LEDHeart::compileTimeline()
+{
+    // Each LED runs through the step levels starting one step after the previous LED and the first
+    // step is one step time after the start of the pulse animation
+    uint32_t stepTimeUs = _animStepTimeUs * _animTimeScale;
+    uint32_t numSteps = _animationStepLevels.size() + _ledPins.size() - 1;
+    _timeline.clear();
+    double sumOnTimeUs = 0;
+    double sumWeightedOffsetUs = 0;
+    for (uint32_t stepIdx = 0; stepIdx < numSteps; stepIdx++)
     {
-        if (_animationOffAfterUs[ledIdx] > 0)
+        uint32_t stepOffsetUs = (stepIdx + 1) * stepTimeUs;
+        for (uint32_t ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
         {
-            if (_animationOffAfterUs[ledIdx] < animOffTimeUs)
-                animOffTimeUs = _animationOffAfterUs[ledIdx];
+            if ((stepIdx < ledIdx) || (stepIdx - ledIdx >= _animationStepLevels.size()))
+                continue;
+
+            // On time for the step (scaled with the step time so brightness is unchanged)
+            uint32_t onTimeUs = _animationStepLevels[stepIdx - ledIdx] * _ledIntensityFactors[ledIdx] * 
+                        _displayBrightnessPC * _animTimeScale;
+            if (onTimeUs > stepTimeUs)
+                onTimeUs = stepTimeUs;
+            _timeline.push_back(TimelineEvent{stepOffsetUs, 1u << ledIdx, onTimeUs, true});
+            sumOnTimeUs += onTimeUs;
+            sumWeightedOffsetUs += (double)onTimeUs * stepOffsetUs;
+
+            // LED off after the on time if the driver doesn't hold the brightness
+            if ((onTimeUs > 0) && _pDriver->isLEDOffRequired())
+                _timeline.push_back(TimelineEvent{stepOffsetUs + onTimeUs, 1u << ledIdx, 0, false});
         }
     }
 
-    uint32_t timeUs = _nextAnimStepAfterUs < animOffTimeUs ? _nextAnimStepAfterUs : animOffTimeUs;
-    // LOG_I(MODULE_PREFIX, "getTimeToNextAnimStepMs nextAnimStepTimeMs %d animOffTimeUs %d timeUs %d", 
-    //         _nextAnimStepAfterUs, (int)animOffTimeUs, (int)timeUs);
-    return timeUs;
+    // Visual peak
+    _peakOffsetUs = sumOnTimeUs > 0 ? sumWeightedOffsetUs / sumOnTimeUs : 0;
+
+    // Sort by time (LED off before steps at the same time)
+    std::stable_sort(_timeline.begin(), _timeline.end(), [](const TimelineEvent& a, const TimelineEvent& b) {
+        if (a.timeOffsetUs != b.timeOffsetUs)
+            return a.timeOffsetUs < b.timeOffsetUs;
+        return !a.isStep && b.isStep;
+    });
+
+    // Merge events with the same action at the same time
+    uint32_t numMerged = 0;
+    for (uint32_t eventIdx = 0; eventIdx < _timeline.size(); eventIdx++)
+    {
+        const TimelineEvent& event = _timeline[eventIdx];
+        if (numMerged > 0)
+        {
+            TimelineEvent& prevEvent = _timeline[numMerged - 1];
+            if ((prevEvent.timeOffsetUs == event.timeOffsetUs) && (prevEvent.isStep == event.isStep) &&
+                        (prevEvent.onTimeUs == event.onTimeUs))
+            {
+                prevEvent.ledMask |= event.ledMask;
+                continue;
+            }
+        }
+        _timeline[numMerged++] = event;
+    }
+    _timeline.resize(numMerged);
+    _timeline.shrink_to_fit();
+    _timelinePos = _timeline.size();
 }
@@ -10,6 +10,8 @@
 
 #include <vector>
 #include <RaftJsonIF.h>
+#include "LEDHeartDriverGPIO.h"
+#include "LEDHeartDriverPWM.h"
 
 class LEDHeart
 {
@@ -21,17 +23,37 @@ public:
     // Setup
     void setup(const RaftJsonIF& config);
 
-    // Loop
+    // Loop (only needed if the caller doesn't schedule timeline events itself)
     void loop();
 
-    // Get time to next animation step
+    // Get time to next animation event (UINT32_MAX if the animation isn't running)
     uint32_t getTimeToNextAnimStepUs();
 
-    // Start pulse animation
-    void startPulseAnimation()
+    // Start pulse animation - timeline event offsets are relative to this call
+    void startPulseAnimation();
+
+    // Scheduled operation - the caller times timeline events rather than calling loop()
+    // Play the next timeline event if it is due at elapsedUs (from the start of the pulse animation) and
+    // return false if the animation is complete
+    bool playTimeline(uint32_t elapsedUs);
+
+    // Offset (from the start of the pulse animation) of the next timeline event (UINT32_MAX if none)
+    uint32_t getNextEventOffsetUs() const
+    {
+        return _timelinePos < _timeline.size() ? _timeline[_timelinePos].timeOffsetUs : UINT32_MAX;
+    }
+
+    // Offset (from the start of the pulse animation) of the visual peak of the animation - the brightness
+    // weighted centre of the animation steps
+    uint32_t getPeakOffsetUs() const
+    {
+        return _peakOffsetUs;
+    }
+
+    // Number of LEDs
+    uint32_t getNumLEDs() const
     {
-        _nextAnimStepAfterUs = _animStepTimeUs;
-        _animationStepNum = 0;
+        return _ledPins.size();
     }
 
 private:
@@ -46,21 +68,39 @@ private:
     // Active level
     bool _ledActiveLevel = false;
 
-    // Timer for animation
-    uint64_t _lastAnimTimeUs = 0;
+    // LED drivers - PWM (if selected and channels are available) or GPIO
+    LEDHeartDriverGPIO _gpioDriver;
+    LEDHeartDriverPWM _pwmDriver;
+    LEDHeartDriverIF* _pDriver = &_gpioDriver;
 
     // Animation step timing
     static const uint32_t ANIM_STEP_TIME_US_DEFAULT = 25000;
     uint32_t _animStepTimeUs = ANIM_STEP_TIME_US_DEFAULT;
 
-    // Next animation step time
-    uint32_t _nextAnimStepAfterUs = ANIM_STEP_TIME_US_DEFAULT;
+    // Animation time scale (e.g. 10 for a slowed down animation for video) - on times are scaled too
+    // so brightness is unchanged
+    double _animTimeScale = 1.0;
+
+    // Animation timeline - compiled at setup from the step levels, LED stagger, intensity factors and
+    // brightness. Events are sorted by time offset from the start of the pulse animation and LEDs with the
+    // same action at the same time share an event
+    struct TimelineEvent
+    {
+        uint32_t timeOffsetUs;
+        uint32_t ledMask;
+        // LED on time for an animation step (isStep true) - LED off (isStep false)
+        uint32_t onTimeUs;
+        bool isStep;
+    };
+    std::vector<TimelineEvent> _timeline;
+    uint32_t _timelinePos = UINT32_MAX;
+    static const uint32_t MAX_LEDS = 32;
 
-    // Animation step number
-    uint32_t _animationStepNum = 0;
+    // Visual peak of the animation
+    uint32_t _peakOffsetUs = 0;
 
-    // Animation off times for LEDs
-    std::vector<uint32_t> _animationOffAfterUs;
+    // Start time of the pulse animation (used by loop())
+    uint64_t _pulseStartTimeUs = 0;
 
     // Animation step levels
     static const uint8_t OFF_LEVEL = 0;
@@ -72,11 +112,8 @@ private:
         LOW_LEVEL, MID_LEVEL, HIGH_LEVEL, MID_LEVEL, LOW_LEVEL, OFF_LEVEL
     };
 
-    // Animation level count
-    uint32_t _animationCount = 0;
-
     // Helpers
-    void handleAnimationStep();
+    void compileTimeline();
 
     // Debug
     static constexpr const char* MODULE_PREFIX = "LEDHeart";
@@ -0,0 +1,60 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// LED Heart GPIO Driver
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "LEDHeartDriverGPIO.h"
+#include "RaftArduino.h"
+#include "driver/gpio.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool LEDHeartDriverGPIO::setup(const RaftJsonIF& config, const std::vector<int>& ledPins, bool ledActiveLevel)
+{
+    _ledPins = ledPins;
+    _ledActiveLevel = ledActiveLevel;
+
+    // Set LED pins to output and off
+    for (int ledIdx = 0; ledIdx < _ledPins.size(); ledIdx++)
+    {
+        pinMode(_ledPins[ledIdx], OUTPUT);
+        digitalWrite(_ledPins[ledIdx], !_ledActiveLevel);
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set LED for an animation step
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LEDHeartDriverGPIO::setLED(uint32_t ledIdx, uint32_t onTimeUs, uint32_t stepTimeUs)
+{
+    setLevel(ledIdx, onTimeUs != 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Turn LED off
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LEDHeartDriverGPIO::setLEDOff(uint32_t ledIdx)
+{
+    setLevel(ledIdx, false);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set pin level (held through light sleep)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LEDHeartDriverGPIO::setLevel(uint32_t ledIdx, bool isOn)
+{
+    if (ledIdx >= _ledPins.size())
+        return;
+    gpio_hold_dis((gpio_num_t)_ledPins[ledIdx]);
+    digitalWrite(_ledPins[ledIdx], isOn ? _ledActiveLevel : !_ledActiveLevel);
+    gpio_hold_en((gpio_num_t)_ledPins[ledIdx]);
+}
@@ -0,0 +1,44 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// LED Heart GPIO Driver
+//
+// LEDs are switched on at the start of an animation step and off again after the on time for the step.
+// Pin levels are held through light sleep
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "LEDHeartDriverIF.h"
+
+class LEDHeartDriverGPIO : public LEDHeartDriverIF
+{
+public:
+    // Setup
+    virtual bool setup(const RaftJsonIF& config, const std::vector<int>& ledPins, bool ledActiveLevel) override final;
+
+    // Set LED for an animation step
+    virtual void setLED(uint32_t ledIdx, uint32_t onTimeUs, uint32_t stepTimeUs) override final;
+
+    // Turn LED off
+    virtual void setLEDOff(uint32_t ledIdx) override final;
+
+    // LEDs must be turned off after the on time
+    virtual bool isLEDOffRequired() const override final
+    {
+        return true;
+    }
+
+    // Driver name
+    virtual const char* getName() const override final
+    {
+        return "gpio";
+    }
+
+private:
+    std::vector<int> _ledPins;
+    bool _ledActiveLevel = false;
+    void setLevel(uint32_t ledIdx, bool isOn);
+};
@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// LED Heart Driver Interface
+//
+// Output stage for LEDHeart animations. Brightness for an animation step is expressed as the time the LED
+// would be on in each step time (as the original GPIO driver works) so drivers can be swapped without
+// changing the animation
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class RaftJsonIF;
+
+class LEDHeartDriverIF
+{
+public:
+    virtual ~LEDHeartDriverIF()
+    {
+    }
+
+    // Setup - returns false if the driver can't drive the LEDs (e.g. not enough PWM channels)
+    virtual bool setup(const RaftJsonIF& config, const std::vector<int>& ledPins, bool ledActiveLevel) = 0;
+
+    // Set LED brightness for an animation step (onTimeUs of 0 is off)
+    virtual void setLED(uint32_t ledIdx, uint32_t onTimeUs, uint32_t stepTimeUs) = 0;
+
+    // Turn LED off
+    virtual void setLEDOff(uint32_t ledIdx) = 0;
+
+    // Check if setLEDOff() must be called once the on time has elapsed - false if the driver holds the
+    // brightness itself and no further calls are needed until the next step
+    virtual bool isLEDOffRequired() const = 0;
+
+    // Driver name
+    virtual const char* getName() const = 0;
+};
@@ -0,0 +1,124 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// LED Heart PWM Driver
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "LEDHeartDriverPWM.h"
+#include "Logger.h"
+#include "RaftJsonIF.h"
+#include "driver/ledc.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool LEDHeartDriverPWM::setup(const RaftJsonIF& config, const std::vector<int>& ledPins, bool ledActiveLevel)
+{
+    // Settings
+    _pwmFreqHz = config.getLong("pwmFreqHz", PWM_FREQ_HZ_DEFAULT);
+    _pwmResolutionBits = config.getLong("pwmResolutionBits", PWM_RESOLUTION_BITS_DEFAULT);
+    _ledcTimer = config.getLong("pwmTimer", 0);
+    _firstChannel = config.getLong("pwmFirstChannel", 0);
+    _fadeEnabled = config.getBool("pwmFade", true);
+    _maxDuty = (1 << _pwmResolutionBits) - 1;
+
+    // Check there are enough channels
+    if (_firstChannel + ledPins.size() > LEDC_CHANNEL_MAX)
+    {
+        LOG_W(MODULE_PREFIX, "setup not enough PWM channels for %d LEDs (first channel %d)", 
+                    ledPins.size(), _firstChannel);
+        return false;
+    }
+
+    // Timer - RC_FAST clock so that PWM continues in light sleep
+    ledc_timer_config_t timerConfig = {};
+    timerConfig.speed_mode = LEDC_LOW_SPEED_MODE;
+    timerConfig.duty_resolution = (ledc_timer_bit_t)_pwmResolutionBits;
+    timerConfig.timer_num = (ledc_timer_t)_ledcTimer;
+    timerConfig.freq_hz = _pwmFreqHz;
+    timerConfig.clk_cfg = LEDC_USE_RC_FAST_CLK;
+    esp_err_t err = ledc_timer_config(&timerConfig);
+    if (err != ESP_OK)
+    {
+        LOG_W(MODULE_PREFIX, "setup timer config failed freq %dHz resolution %d bits err %d", 
+                    _pwmFreqHz, _pwmResolutionBits, err);
+        return false;
+    }
+
+    // Channels
+    for (uint32_t ledIdx = 0; ledIdx < ledPins.size(); ledIdx++)
+    {
+        ledc_channel_config_t channelConfig = {};
+        channelConfig.gpio_num = ledPins[ledIdx];
+        channelConfig.speed_mode = LEDC_LOW_SPEED_MODE;
+        channelConfig.channel = (ledc_channel_t)(_firstChannel + ledIdx);
+        channelConfig.timer_sel = (ledc_timer_t)_ledcTimer;
+        channelConfig.duty = 0;
+        channelConfig.hpoint = 0;
+        channelConfig.sleep_mode = LEDC_SLEEP_MODE_KEEP_ALIVE;
+        channelConfig.flags.output_invert = ledActiveLevel ? 0 : 1;
+        err = ledc_channel_config(&channelConfig);
+        if (err != ESP_OK)
+        {
+            LOG_W(MODULE_PREFIX, "setup channel config failed pin %d channel %d err %d", 
+                        ledPins[ledIdx], _firstChannel + ledIdx, err);
+            return false;
+        }
+    }
+    _numLEDs = ledPins.size();
+
+    // Hardware fade (the fade service may already be installed)
+    if (_fadeEnabled)
+    {
+        err = ledc_fade_func_install(0);
+        if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE))
+        {
+            LOG_W(MODULE_PREFIX, "setup fade install failed err %d - fade disabled", err);
+            _fadeEnabled = false;
+        }
+    }
+
+    LOG_I(MODULE_PREFIX, "setup OK numLEDs %d freq %dHz resolution %d bits timer %d firstChannel %d fade %s",
+                _numLEDs, _pwmFreqHz, _pwmResolutionBits, _ledcTimer, _firstChannel, _fadeEnabled ? "Y" : "N");
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set LED for an animation step
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LEDHeartDriverPWM::setLED(uint32_t ledIdx, uint32_t onTimeUs, uint32_t stepTimeUs)
+{
+    if ((ledIdx >= _numLEDs) || (stepTimeUs == 0))
+        return;
+
+    // Duty equivalent to the on time in each step
+    uint64_t duty = (uint64_t)onTimeUs * _maxDuty / stepTimeUs;
+    if (duty > _maxDuty)
+        duty = _maxDuty;
+
+    // Fade to the duty over the step - the fade ends 1ms early as a new fade waits for the current one to complete
+    ledc_channel_t channel = (ledc_channel_t)(_firstChannel + ledIdx);
+    uint32_t fadeTimeMs = stepTimeUs / 1000;
+    fadeTimeMs = fadeTimeMs > 1 ? fadeTimeMs - 1 : 0;
+    if (_fadeEnabled && (fadeTimeMs > 0))
+        ledc_set_fade_time_and_start(LEDC_LOW_SPEED_MODE, channel, duty, fadeTimeMs, LEDC_FADE_NO_WAIT);
+    else
+        ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, channel, duty, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Turn LED off
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void LEDHeartDriverPWM::setLEDOff(uint32_t ledIdx)
+{
+    if (ledIdx >= _numLEDs)
+        return;
+    if (_fadeEnabled)
+        ledc_fade_stop(LEDC_LOW_SPEED_MODE, (ledc_channel_t)(_firstChannel + ledIdx));
+    ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, (ledc_channel_t)(_firstChannel + ledIdx), 0, 0);
+}
@@ -0,0 +1,62 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// LED Heart PWM Driver
+//
+// LEDs are driven by LEDC PWM channels with the duty for an animation step equal to the fraction of the
+// step time that the GPIO driver would have the LED on. The duty is faded by hardware over the step time
+// (if enabled) so no calls are needed between animation steps. The LEDC timer is clocked from RC_FAST and
+// channels are kept alive in light sleep so the processor can sleep between steps
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "LEDHeartDriverIF.h"
+
+class LEDHeartDriverPWM : public LEDHeartDriverIF
+{
+public:
+    // Setup
+    virtual bool setup(const RaftJsonIF& config, const std::vector<int>& ledPins, bool ledActiveLevel) override final;
+
+    // Set LED for an animation step
+    virtual void setLED(uint32_t ledIdx, uint32_t onTimeUs, uint32_t stepTimeUs) override final;
+
+    // Turn LED off
+    virtual void setLEDOff(uint32_t ledIdx) override final;
+
+    // Brightness is held by the PWM channel
+    virtual bool isLEDOffRequired() const override final
+    {
+        return false;
+    }
+
+    // Driver name
+    virtual const char* getName() const override final
+    {
+        return "pwm";
+    }
+
+private:
+    // PWM frequency and resolution (frequency * 2^resolution must not exceed the RC_FAST clock ~17.5MHz)
+    static const uint32_t PWM_FREQ_HZ_DEFAULT = 2000;
+    static const uint32_t PWM_RESOLUTION_BITS_DEFAULT = 13;
+    uint32_t _pwmFreqHz = PWM_FREQ_HZ_DEFAULT;
+    uint32_t _pwmResolutionBits = PWM_RESOLUTION_BITS_DEFAULT;
+    uint32_t _maxDuty = 0;
+
+    // LEDC timer and first channel used (channels are allocated consecutively)
+    uint32_t _ledcTimer = 0;
+    uint32_t _firstChannel = 0;
+
+    // Hardware fade between animation steps
+    bool _fadeEnabled = true;
+
+    // Number of LEDs
+    uint32_t _numLEDs = 0;
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "LEDHeartPWM";
+};
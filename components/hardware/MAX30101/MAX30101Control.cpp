@@ -0,0 +1,263 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MAX30101 Control
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include "MAX30101Control.h"
+#include "Logger.h"
+#include "RaftArduino.h"
+#include "RaftBusSystem.h"
+#include "BusRequestInfo.h"
+#include "BusRequestResult.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MAX30101Control::setup(const char* pBusName, uint32_t address)
+{
+    _pBusName = pBusName;
+    _address = address;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Apply settings
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::applySettings(const Settings& settings)
+{
+    // Check the settings are supported
+    uint8_t avgCode = 0, rateCode = 0, pulseWidthCode = 0;
+    if (!getSampleAvgCode(settings.sampleAvg, avgCode) || 
+                !getSampleRateCode(settings.adcSampleRateHz, rateCode) ||
+                !getPulseWidthCode(settings.pulseWidthUs, pulseWidthCode))
+    {
+        LOG_W(MODULE_PREFIX, "applySettings unsupported rate %dHz avg %d pulseWidth %dus",
+                    (int)settings.adcSampleRateHz, (int)settings.sampleAvg, (int)settings.pulseWidthUs);
+        return false;
+    }
+
+    // Averaging (FIFO rollover and almost full threshold are unchanged)
+    if (settings.sampleAvg != _settings.sampleAvg)
+    {
+        if (!writeReg(REG_FIFO_CONFIG, getFIFOConfigValue(avgCode)))
+            return false;
+        _settings.sampleAvg = settings.sampleAvg;
+    }
+
+    // ADC sample rate and pulse width (ADC range is unchanged)
+    if ((settings.adcSampleRateHz != _settings.adcSampleRateHz) || (settings.pulseWidthUs != _settings.pulseWidthUs))
+    {
+        if (!writeReg(REG_SPO2_CONFIG, (SPO2_CONFIG_INIT & 0x60) | (rateCode << 2) | pulseWidthCode))
+            return false;
+        _settings.adcSampleRateHz = settings.adcSampleRateHz;
+        _settings.pulseWidthUs = settings.pulseWidthUs;
+    }
+
+    // LED pulse amplitudes
+    return setLEDPulseAmplitudes(settings.redPA, settings.irPA);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Set LED pulse amplitudes
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::setLEDPulseAmplitudes(uint8_t redPA, uint8_t irPA)
+{
+    if ((redPA != _settings.redPA) && !writeReg(REG_LED1_PA, redPA))
+        return false;
+    _settings.redPA = redPA;
+    if ((irPA != _settings.irPA) && !writeReg(REG_LED2_PA, irPA))
+        return false;
+    _settings.irPA = irPA;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FIFO almost full interrupt
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::setFIFOInterrupt(bool enable, uint32_t almostFullSamples)
+{
+    // Threshold
+    uint8_t avgCode = 0;
+    getSampleAvgCode(_settings.sampleAvg, avgCode);
+    _fifoAlmostFullSamples = std::clamp(almostFullSamples, (uint32_t)(FIFO_DEPTH - 15), (uint32_t)FIFO_DEPTH);
+    if (!writeReg(REG_FIFO_CONFIG, getFIFOConfigValue(avgCode)))
+        return false;
+
+    // Interrupt enable
+    return writeReg(REG_INT_ENABLE_1, enable ? INT_A_FULL_EN : 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FIFO read - pointers are read first
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::readFIFO(FIFODataCB fifoDataCB, void* pCallbackData)
+{
+    bool isInProgress = false;
+    if (!_isFIFOReadInProgress.compare_exchange_strong(isInProgress, true, std::memory_order_acq_rel))
+        return false;
+    _fifoDataCB = fifoDataCB;
+    _pFIFODataCBData = pCallbackData;
+    _fifoReadTimeMs = millis();
+    if (!readReg(REG_FIFO_WR_PTR, 3, fifoPointersCB))
+    {
+        _isFIFOReadInProgress.store(false, std::memory_order_release);
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FIFO pointers read (bus task) - the samples in the FIFO are then read in one burst
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MAX30101Control::fifoPointersCB(void* pCallbackData, BusRequestResult& reqResult)
+{
+    MAX30101Control* pThis = (MAX30101Control*)pCallbackData;
+    if (!reqResult.isResultOk() || (reqResult.getReadDataLen() < 3))
+    {
+        pThis->_isFIFOReadInProgress.store(false, std::memory_order_release);
+        return;
+    }
+
+    // Samples in the FIFO (write pointer, overflow counter, read pointer) - equal pointers are a full FIFO
+    // if samples have overflowed
+    const uint8_t* pPtrs = reqResult.getReadData();
+    uint32_t numSamples = (pPtrs[0] + FIFO_DEPTH - pPtrs[2]) % FIFO_DEPTH;
+    if ((numSamples == 0) && (pPtrs[1] != 0))
+        numSamples = FIFO_DEPTH;
+    pThis->_fifoReadLost = pPtrs[1] & FIFO_OVF_COUNTER_MAX;
+    if (numSamples == 0)
+        pThis->readIntStatus();
+    else if (!pThis->readReg(REG_FIFO_DATA, numSamples * FIFO_SAMPLE_BYTES, fifoDataCB))
+        pThis->_isFIFOReadInProgress.store(false, std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// FIFO data read (bus task) - the interrupt status is then read
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MAX30101Control::fifoDataCB(void* pCallbackData, BusRequestResult& reqResult)
+{
+    MAX30101Control* pThis = (MAX30101Control*)pCallbackData;
+    if (reqResult.isResultOk())
+    {
+        uint32_t numSamples = reqResult.getReadDataLen() / FIFO_SAMPLE_BYTES;
+        pThis->_fifoReadCount++;
+        pThis->_fifoSamplesRead += numSamples;
+        pThis->_fifoSamplesLost += pThis->_fifoReadLost;
+        if (pThis->_fifoDataCB && (numSamples > 0))
+            pThis->_fifoDataCB(pThis->_pFIFODataCBData, reqResult.getReadData(), numSamples, pThis->_fifoReadLost,
+                        pThis->_fifoReadTimeMs);
+    }
+    pThis->readIntStatus();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Interrupt status read (bus task) - reading INT_STATUS_1 clears A_FULL (and releases INT) so it is read after
+// each FIFO read (including when the FIFO was empty) and the FIFO read is then complete
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void MAX30101Control::readIntStatus()
+{
+    if (!readReg(REG_INT_STATUS_1, 1, intStatusCB))
+        _isFIFOReadInProgress.store(false, std::memory_order_release);
+}
+
+void MAX30101Control::intStatusCB(void* pCallbackData, BusRequestResult& reqResult)
+{
+    MAX30101Control* pThis = (MAX30101Control*)pCallbackData;
+    pThis->_isFIFOReadInProgress.store(false, std::memory_order_release);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queue a register write
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::writeReg(uint8_t regAddr, uint8_t value)
+{
+    // Get the bus
+    RaftBus* pBus = raftBusSystem.getBusByName(_pBusName);
+    if (!pBus)
+    {
+        LOG_W(MODULE_PREFIX, "writeReg bus %s not found", _pBusName);
+        return false;
+    }
+
+    // Queue the write (it is made between device polls)
+    std::vector<uint8_t> writeData = { regAddr, value };
+    HWElemReq hwElemReq = { writeData, 0, HWElemReq::UNNUM, "MAX30101Ctrl", 0 };
+    BusRequestInfo busReqInfo("", _address);
+    busReqInfo.set(BUS_REQ_TYPE_STD, hwElemReq, 0, nullptr, nullptr);
+    if (!pBus->addRequest(busReqInfo))
+    {
+        LOG_W(MODULE_PREFIX, "writeReg failed reg 0x%02x value 0x%02x", regAddr, value);
+        return false;
+    }
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Register field codes
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::getSampleAvgCode(uint32_t sampleAvg, uint8_t& code)
+{
+    for (code = 0; code <= 5; code++)
+        if (sampleAvg == (1u << code))
+            return true;
+    return false;
+}
+
+bool MAX30101Control::getSampleRateCode(uint32_t adcSampleRateHz, uint8_t& code)
+{
+    static const uint32_t SAMPLE_RATES_HZ[] = { 50, 100, 200, 400, 800, 1000, 1600, 3200 };
+    for (code = 0; code < sizeof(SAMPLE_RATES_HZ) / sizeof(SAMPLE_RATES_HZ[0]); code++)
+        if (adcSampleRateHz == SAMPLE_RATES_HZ[code])
+            return true;
+    return false;
+}
+
+bool MAX30101Control::getPulseWidthCode(uint32_t pulseWidthUs, uint8_t& code)
+{
+    static const uint32_t PULSE_WIDTHS_US[] = { 69, 118, 215, 411 };
+    for (code = 0; code < sizeof(PULSE_WIDTHS_US) / sizeof(PULSE_WIDTHS_US[0]); code++)
+        if (pulseWidthUs == PULSE_WIDTHS_US[code])
+            return true;
+    return false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Queue a register read
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool MAX30101Control::readReg(uint8_t regAddr, uint32_t readLen, void (*busReqCallback)(void*, BusRequestResult&))
+{
+    // Get the bus
+    RaftBus* pBus = raftBusSystem.getBusByName(_pBusName);
+    if (!pBus)
+    {
+        LOG_W(MODULE_PREFIX, "readReg bus %s not found", _pBusName);
+        return false;
+    }
+
+    // Queue the read (register address written then data read in one transaction)
+    std::vector<uint8_t> writeData = { regAddr };
+    HWElemReq hwElemReq = { writeData, readLen, HWElemReq::UNNUM, "MAX30101Ctrl", 0 };
+    BusRequestInfo busReqInfo("", _address);
+    busReqInfo.set(BUS_REQ_TYPE_STD, hwElemReq, 0, busReqCallback, this);
+    if (!pBus->addRequest(busReqInfo))
+    {
+        LOG_W(MODULE_PREFIX, "readReg failed reg 0x%02x len %d", regAddr, (int)readLen);
+        return false;
+    }
+    return true;
+}
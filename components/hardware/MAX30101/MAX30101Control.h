@@ -0,0 +1,196 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// MAX30101 Control
+//
+// Changes MAX30101 heart rate sensor settings at runtime by queueing register writes on the I2C bus that the
+// device manager polls the sensor on. The initial register values are those set by the device type
+// initValues (DevTypes.json) and the settings are tracked here so only changes are written
+//
+// In FIFO interrupt mode the FIFO almost full interrupt is enabled (the INT pin can then wake the processor)
+// and the FIFO is read on request rather than by device polling - the FIFO pointers are read first and then
+// only the samples in the FIFO are read in one burst. The interrupt status is read after each FIFO read as
+// A_FULL (and so INT) stays asserted until it is read. The device type must then have no pollInfo as a poll
+// of the FIFO would take the samples
+//
+// The sensor stays in SpO2 mode (Red and IR in each FIFO sample) so the poll decoding is unchanged - Red
+// only operation is obtained by turning the IR LED off. The output sample rate is the ADC sample rate
+// divided by the number of samples averaged
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+class BusRequestResult;
+
+class MAX30101Control
+{
+public:
+    // Registers
+    static const uint8_t REG_INT_STATUS_1 = 0x00;
+    static const uint8_t REG_INT_ENABLE_1 = 0x02;
+    static const uint8_t REG_FIFO_WR_PTR = 0x04;
+    static const uint8_t REG_FIFO_DATA = 0x07;
+    static const uint8_t REG_FIFO_CONFIG = 0x08;
+    static const uint8_t REG_SPO2_CONFIG = 0x0a;
+    static const uint8_t REG_LED1_PA = 0x0c;
+    static const uint8_t REG_LED2_PA = 0x0d;
+
+    // Settings made by the device type initValues - FIFO_CONFIG 0x5f (4 sample averaging, rollover, almost
+    // full at 17 samples), SPO2_CONFIG 0x27 (4096nA range, 100sps, 411us pulse) and LED PA 0x40 (12.8mA)
+    static const uint8_t FIFO_CONFIG_INIT = 0x5f;
+    static const uint8_t SPO2_CONFIG_INIT = 0x27;
+    static const uint8_t LED_PA_INIT = 0x40;
+    static const uint32_t ADC_SAMPLE_RATE_HZ_INIT = 100;
+    static const uint32_t SAMPLE_AVG_INIT = 4;
+    static const uint32_t PULSE_WIDTH_US_INIT = 411;
+
+    // FIFO
+    static const uint8_t INT_A_FULL_EN = 0x80;
+    static const uint32_t FIFO_DEPTH = 32;
+    static const uint32_t FIFO_SAMPLE_BYTES = 6;
+    static const uint32_t FIFO_SAMPLE_MASK = 0x3ffff;
+    static const uint32_t FIFO_OVF_COUNTER_MAX = 0x1f;
+    static const uint32_t FIFO_ALMOST_FULL_SAMPLES_INIT = 17;
+
+    // Sensor settings (trivially copyable so they can be passed between tasks in a snapshot)
+    struct Settings
+    {
+        // ADC sample rate (50, 100, 200, 400, 800, 1000, 1600 or 3200)
+        uint32_t adcSampleRateHz = ADC_SAMPLE_RATE_HZ_INIT;
+        // Samples averaged for each FIFO sample (1, 2, 4, 8, 16 or 32)
+        uint32_t sampleAvg = SAMPLE_AVG_INIT;
+        // LED pulse width (69, 118, 215 or 411us - the ADC resolution is 15 to 18 bits)
+        uint32_t pulseWidthUs = PULSE_WIDTH_US_INIT;
+        // LED pulse amplitudes (register values in 0.2mA steps, 0 is off) - Red is LED1 and IR is LED2
+        uint8_t redPA = LED_PA_INIT;
+        uint8_t irPA = LED_PA_INIT;
+
+        // Output (FIFO) sample rate
+        double getOutputRateHz() const
+        {
+            return sampleAvg > 0 ? (double)adcSampleRateHz / sampleAvg : 0;
+        }
+        bool operator==(const Settings& other) const
+        {
+            return (adcSampleRateHz == other.adcSampleRateHz) && (sampleAvg == other.sampleAvg) &&
+                    (pulseWidthUs == other.pulseWidthUs) && (redPA == other.redPA) && (irPA == other.irPA);
+        }
+        bool operator!=(const Settings& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    // Setup - bus name and I2C address of the sensor
+    void setup(const char* pBusName, uint32_t address);
+
+    // Apply settings - only registers that change are written
+    // Returns false if a setting is not supported by the sensor or a write could not be queued
+    bool applySettings(const Settings& settings);
+
+    // Set LED pulse amplitudes (other settings unchanged)
+    // Returns false if a write could not be queued
+    bool setLEDPulseAmplitudes(uint8_t redPA, uint8_t irPA);
+
+    // Enable / disable the FIFO almost full interrupt - almostFullSamples is the number of samples in the
+    // FIFO when the interrupt is asserted (17 to 32)
+    // Returns false if a write could not be queued
+    bool setFIFOInterrupt(bool enable, uint32_t almostFullSamples = FIFO_ALMOST_FULL_SAMPLES_INIT);
+
+    // FIFO read - the callback is called from the bus task with the samples (FIFO_SAMPLE_BYTES each) read,
+    // the number of samples lost (FIFO overflow counter - saturates at FIFO_OVF_COUNTER_MAX) before them
+    // and the millis() time of the pointer read (the time of the last sample). The read is in progress until
+    // the interrupt status has been read (clearing the interrupt)
+    // Returns false if a read is already in progress or could not be queued
+    typedef void (*FIFODataCB)(void* pCallbackData, const uint8_t* pData, uint32_t numSamples, uint32_t numLost,
+                uint32_t timeMs);
+    bool readFIFO(FIFODataCB fifoDataCB, void* pCallbackData);
+
+    // Check if a FIFO read is in progress
+    bool isFIFOReadInProgress() const
+    {
+        return _isFIFOReadInProgress.load(std::memory_order_acquire);
+    }
+
+    // FIFO read stats
+    uint32_t getFIFOReadCount() const
+    {
+        return _fifoReadCount;
+    }
+    uint32_t getFIFOSamplesRead() const
+    {
+        return _fifoSamplesRead;
+    }
+    uint32_t getFIFOSamplesLost() const
+    {
+        return _fifoSamplesLost;
+    }
+
+    // Get current settings
+    const Settings& getSettings() const
+    {
+        return _settings;
+    }
+    uint8_t getRedPA() const
+    {
+        return _settings.redPA;
+    }
+    uint8_t getIRPA() const
+    {
+        return _settings.irPA;
+    }
+
+    // LED current for a pulse amplitude register value
+    static double pulseAmplitudeToMA(uint8_t pa)
+    {
+        return pa * 0.2;
+    }
+
+private:
+    // Bus and address
+    const char* _pBusName = "";
+    uint32_t _address = 0;
+
+    // Current settings
+    Settings _settings;
+    uint32_t _fifoAlmostFullSamples = FIFO_ALMOST_FULL_SAMPLES_INIT;
+
+    // FIFO read state (the read completes in the bus task)
+    std::atomic<bool> _isFIFOReadInProgress = false;
+    FIFODataCB _fifoDataCB = nullptr;
+    void* _pFIFODataCBData = nullptr;
+    uint32_t _fifoReadTimeMs = 0;
+    uint32_t _fifoReadCount = 0;
+    uint32_t _fifoSamplesRead = 0;
+    uint32_t _fifoReadLost = 0;
+    uint32_t _fifoSamplesLost = 0;
+    static void fifoPointersCB(void* pCallbackData, BusRequestResult& reqResult);
+    static void fifoDataCB(void* pCallbackData, BusRequestResult& reqResult);
+    static void intStatusCB(void* pCallbackData, BusRequestResult& reqResult);
+    void readIntStatus();
+
+    // Queue a register write
+    bool writeReg(uint8_t regAddr, uint8_t value);
+
+    // Queue a register read (result passed to the callback from the bus task)
+    bool readReg(uint8_t regAddr, uint32_t readLen, void (*busReqCallback)(void*, BusRequestResult&));
+
+    // FIFO_CONFIG value for the averaging and almost full threshold (rollover enabled)
+    uint8_t getFIFOConfigValue(uint8_t avgCode) const
+    {
+        return (avgCode << 5) | 0x10 | ((FIFO_DEPTH - _fifoAlmostFullSamples) & 0x0f);
+    }
+
+    // Register field codes - return false if the value is not supported
+    static bool getSampleAvgCode(uint32_t sampleAvg, uint8_t& code);
+    static bool getSampleRateCode(uint32_t adcSampleRateHz, uint8_t& code);
+    static bool getPulseWidthCode(uint32_t pulseWidthUs, uint8_t& code);
+
+    // Debug
+    static constexpr const char* MODULE_PREFIX = "MAX30101Ctrl";
+};
@@ -0,0 +1,403 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM session loader
+//
+// Loads recorded HRM sessions (CSV with a "Time (s),Red,IR" header) into struct-of-arrays buffers.
+// The file is memory mapped and parsed in place without per-line allocation. A UTF-8 BOM, repeated header
+// time columns (e.g. "Time (s)Time (s),Red,IR" where two time columns were joined without a separator) and
+// malformed lines are handled - malformed lines are skipped and counted. Columns are located by name (so
+// "Time (ms)" also loads) and data following a header without Time, Red and IR columns is skipped
+//
+// An optional binary cache (<file>.hrmcache) holds the parsed columns so that repeated runs over long
+// recordings don't need to parse the CSV again. The cache is only used if the CSV size and modification
+// time match those recorded in the cache
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <string_view>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Session data (struct of arrays)
+struct HRMSessionData
+{
+    std::vector<uint32_t> timeMs;
+    std::vector<int32_t> red;
+    std::vector<int32_t> ir;
+    uint32_t malformedLines = 0;
+
+    size_t size() const
+    {
+        return timeMs.size();
+    }
+    void clear()
+    {
+        timeMs.clear();
+        red.clear();
+        ir.clear();
+        malformedLines = 0;
+    }
+};
+
+class HRMSessionLoader
+{
+public:
+    // Load a session - uses (and creates if useCache is set) the binary cache
+    static bool load(const std::string& fileName, HRMSessionData& data, bool useCache = true)
+    {
+        struct stat srcStat;
+        if (stat(fileName.c_str(), &srcStat) != 0)
+            return false;
+        std::string cacheFileName = fileName + CACHE_FILE_SUFFIX;
+        if (useCache && loadCache(cacheFileName, srcStat, data))
+            return true;
+        if (!loadCSV(fileName, data))
+            return false;
+        if (useCache)
+            saveCache(cacheFileName, srcStat, data);
+        return true;
+    }
+
+    // Load a session from CSV (memory mapped)
+    static bool loadCSV(const std::string& fileName, HRMSessionData& data)
+    {
+        data.clear();
+        MappedFile file;
+        if (!file.open(fileName))
+            return false;
+        const char* p = (const char*)file.data();
+        const char* pEnd = p + file.size();
+
+        // Skip BOM
+        if ((pEnd - p >= 3) && (memcmp(p, "\xEF\xBB\xBF", 3) == 0))
+            p += 3;
+
+        // Reserve using the line count (one allocation per column)
+        size_t numLines = 0;
+        for (const char* q = p; (q = (const char*)memchr(q, '\n', pEnd - q)) != nullptr; q++)
+            numLines++;
+        data.timeMs.reserve(numLines + 1);
+        data.red.reserve(numLines + 1);
+        data.ir.reserve(numLines + 1);
+
+        // Default column layout is Time (s),Red,IR
+        Columns cols;
+        while (p < pEnd)
+        {
+            const char* pLineEnd = (const char*)memchr(p, '\n', pEnd - p);
+            if (!pLineEnd)
+                pLineEnd = pEnd;
+            const char* pLineStop = pLineEnd;
+            if ((pLineStop > p) && (pLineStop[-1] == '\r'))
+                pLineStop--;
+
+            // Header lines start with a non-numeric character
+            if (pLineStop > p)
+            {
+                if (isNumericStart(*p))
+                    parseDataLine(p, pLineStop, cols, data);
+                else
+                    parseHeaderLine(p, pLineStop, cols);
+            }
+            p = pLineEnd + 1;
+        }
+        return true;
+    }
+
+    // Save binary cache
+    static bool saveCache(const std::string& cacheFileName, const struct stat& srcStat, const HRMSessionData& data)
+    {
+        FILE* pFile = fopen(cacheFileName.c_str(), "wb");
+        if (!pFile)
+            return false;
+        CacheHeader header = makeCacheHeader(srcStat, data.size());
+        header.malformedLines = data.malformedLines;
+        bool isOk = fwrite(&header, sizeof(header), 1, pFile) == 1;
+        if (data.size() > 0)
+        {
+            isOk = isOk && (fwrite(data.timeMs.data(), sizeof(uint32_t), data.size(), pFile) == data.size());
+            isOk = isOk && (fwrite(data.red.data(), sizeof(int32_t), data.size(), pFile) == data.size());
+            isOk = isOk && (fwrite(data.ir.data(), sizeof(int32_t), data.size(), pFile) == data.size());
+        }
+        isOk = (fclose(pFile) == 0) && isOk;
+        if (!isOk)
+            unlink(cacheFileName.c_str());
+        return isOk;
+    }
+
+    // Load binary cache - fails if the cache doesn't match the source file
+    static bool loadCache(const std::string& cacheFileName, const struct stat& srcStat, HRMSessionData& data)
+    {
+        MappedFile file;
+        if (!file.open(cacheFileName) || (file.size() < sizeof(CacheHeader)))
+            return false;
+        CacheHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        CacheHeader expected = makeCacheHeader(srcStat, header.numSamples);
+        if ((memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) || 
+                (header.version != expected.version) ||
+                (header.srcSize != expected.srcSize) || 
+                (header.srcModTimeNs != expected.srcModTimeNs) ||
+                (file.size() != sizeof(CacheHeader) + (size_t)header.numSamples * 3 * sizeof(uint32_t)))
+            return false;
+        const uint8_t* pCols = file.data() + sizeof(CacheHeader);
+        size_t colBytes = (size_t)header.numSamples * sizeof(uint32_t);
+        data.clear();
+        data.timeMs.resize(header.numSamples);
+        data.red.resize(header.numSamples);
+        data.ir.resize(header.numSamples);
+        if (header.numSamples > 0)
+        {
+            memcpy(data.timeMs.data(), pCols, colBytes);
+            memcpy(data.red.data(), pCols + colBytes, colBytes);
+            memcpy(data.ir.data(), pCols + 2 * colBytes, colBytes);
+        }
+        data.malformedLines = header.malformedLines;
+        return true;
+    }
+
+    static constexpr const char* CACHE_FILE_SUFFIX = ".hrmcache";
+
+private:
+    // Column positions
+    struct Columns
+    {
+        int timeCol = 0;
+        int redCol = 1;
+        int irCol = 2;
+        bool timeIsMs = false;
+        bool timeIsRepeated = false;
+        bool isValid = true;
+    };
+
+    // Binary cache header
+    struct CacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t srcSize;
+        int64_t srcModTimeNs;
+        uint32_t numSamples;
+        uint32_t malformedLines;
+    };
+    static CacheHeader makeCacheHeader(const struct stat& srcStat, uint32_t numSamples)
+    {
+        CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "HRMC", 4);
+        header.version = 1;
+        header.srcSize = srcStat.st_size;
+#ifdef __APPLE__
+        header.srcModTimeNs = (int64_t)srcStat.st_mtimespec.tv_sec * 1000000000 + srcStat.st_mtimespec.tv_nsec;
+#else
+        header.srcModTimeNs = (int64_t)srcStat.st_mtim.tv_sec * 1000000000 + srcStat.st_mtim.tv_nsec;
+#endif
+        header.numSamples = numSamples;
+        return header;
+    }
+
+    // Read-only memory mapped file
+    class MappedFile
+    {
+    public:
+        ~MappedFile()
+        {
+            if (_pData && (_size > 0))
+                munmap((void*)_pData, _size);
+            if (_fd >= 0)
+                close(_fd);
+        }
+        bool open(const std::string& fileName)
+        {
+            _fd = ::open(fileName.c_str(), O_RDONLY);
+            if (_fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(_fd, &st) != 0)
+                return false;
+            _size = st.st_size;
+            if (_size == 0)
+            {
+                _pData = (const uint8_t*)"";
+                return true;
+            }
+            void* pMap = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (pMap == MAP_FAILED)
+            {
+                _size = 0;
+                return false;
+            }
+            _pData = (const uint8_t*)pMap;
+            return true;
+        }
+        const uint8_t* data() const
+        {
+            return _pData;
+        }
+        size_t size() const
+        {
+            return _size;
+        }
+    private:
+        int _fd = -1;
+        const uint8_t* _pData = nullptr;
+        size_t _size = 0;
+    };
+
+    static bool isNumericStart(char c)
+    {
+        return ((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') || (c == '.');
+    }
+
+    // Header - columns are located by name
+    static void parseHeaderLine(const char* p, const char* pEnd, Columns& cols)
+    {
+        Columns newCols;
+        newCols.timeCol = newCols.redCol = newCols.irCol = -1;
+        int colIdx = 0;
+        while (p <= pEnd)
+        {
+            const char* pFieldEnd = (const char*)memchr(p, ',', pEnd - p);
+            if (!pFieldEnd)
+                pFieldEnd = pEnd;
+            std::string_view field(p, pFieldEnd - p);
+            while (!field.empty() && (field.front() == ' '))
+                field.remove_prefix(1);
+            while (!field.empty() && (field.back() == ' '))
+                field.remove_suffix(1);
+            if ((newCols.timeCol < 0) && (field.find("Time") != std::string_view::npos))
+            {
+                newCols.timeCol = colIdx;
+                newCols.timeIsMs = field.find("(ms)") != std::string_view::npos;
+                newCols.timeIsRepeated = field.find("Time", field.find("Time") + 1) != std::string_view::npos;
+            }
+            else if ((newCols.redCol < 0) && ((field == "Red") || (field == "Red LED ADC")))
+                newCols.redCol = colIdx;
+            else if ((newCols.irCol < 0) && ((field == "IR") || (field == "IR LED ADC")))
+                newCols.irCol = colIdx;
+            colIdx++;
+            p = pFieldEnd + 1;
+        }
+        newCols.isValid = (newCols.timeCol >= 0) && (newCols.redCol >= 0) && (newCols.irCol >= 0);
+        cols = newCols;
+    }
+
+    // Data line - all fields must parse completely or the line is counted as malformed
+    static void parseDataLine(const char* p, const char* pEnd, const Columns& cols, HRMSessionData& data)
+    {
+        if (!cols.isValid)
+        {
+            data.malformedLines++;
+            return;
+        }
+        int64_t timeMs = 0;
+        int64_t red = 0;
+        int64_t ir = 0;
+        int found = 0;
+        int colIdx = 0;
+        while (p <= pEnd)
+        {
+            const char* pFieldEnd = (const char*)memchr(p, ',', pEnd - p);
+            if (!pFieldEnd)
+                pFieldEnd = pEnd;
+            bool isOk = true;
+            if (colIdx == cols.timeCol)
+            {
+                // Repeated time columns are concatenated without a separator (e.g. 1110.2521249.873) - the first
+                // time is used and the split is after its third decimal place
+                const char* pTimeEnd = pFieldEnd;
+                if (cols.timeIsRepeated)
+                {
+                    const char* pPoint = (const char*)memchr(p, '.', pFieldEnd - p);
+                    pTimeEnd = pPoint && (pFieldEnd - pPoint > 4) ? pPoint + 4 : p;
+                    int64_t repeatedTimeMs = 0;
+                    isOk = parseDecimal(pTimeEnd, pFieldEnd, 3, repeatedTimeMs);
+                }
+                isOk = isOk && parseDecimal(p, pTimeEnd, cols.timeIsMs ? 0 : 3, timeMs);
+            }
+            else if (colIdx == cols.redCol)
+                isOk = parseDecimal(p, pFieldEnd, 0, red);
+            else if (colIdx == cols.irCol)
+                isOk = parseDecimal(p, pFieldEnd, 0, ir);
+            else
+                found--;
+            if (!isOk)
+            {
+                data.malformedLines++;
+                return;
+            }
+            found++;
+            colIdx++;
+            p = pFieldEnd + 1;
+        }
+        if ((found < 3) || (timeMs < 0) || (timeMs > UINT32_MAX) || (red < INT32_MIN) || (red > INT32_MAX) ||
+                (ir < INT32_MIN) || (ir > INT32_MAX))
+        {
+            data.malformedLines++;
+            return;
+        }
+        data.timeMs.push_back(timeMs);
+        data.red.push_back(red);
+        data.ir.push_back(ir);
+    }
+
+    // Parse a decimal number scaled by 10^scaleDigits (rounded) - e.g. seconds to ms with scaleDigits = 3
+    static bool parseDecimal(const char* p, const char* pEnd, int scaleDigits, int64_t& val)
+    {
+        while ((p < pEnd) && (*p == ' '))
+            p++;
+        while ((pEnd > p) && (pEnd[-1] == ' '))
+            pEnd--;
+        bool isNeg = false;
+        if ((p < pEnd) && ((*p == '-') || (*p == '+')))
+            isNeg = *p++ == '-';
+        int64_t result = 0;
+        int numDigits = 0;
+        int fracDigits = -1;
+        bool roundUp = false;
+        for (; p < pEnd; p++)
+        {
+            if ((*p == '.') && (fracDigits < 0))
+            {
+                fracDigits = 0;
+                continue;
+            }
+            if ((*p < '0') || (*p > '9') || (numDigits > 15))
+                return false;
+            numDigits++;
+            if (fracDigits >= 0)
+            {
+                if (fracDigits == scaleDigits)
+                {
+                    // Round on the first extra digit and ignore the rest
+                    if (fracDigits++ == scaleDigits)
+                        roundUp = *p >= '5';
+                    continue;
+                }
+                if (fracDigits > scaleDigits)
+                    continue;
+                fracDigits++;
+            }
+            result = result * 10 + (*p - '0');
+        }
+        if (numDigits == 0)
+            return false;
+        for (int i = fracDigits < 0 ? 0 : fracDigits; i < scaleDigits; i++)
+            result *= 10;
+        if (roundUp)
+            result++;
+        val = isNeg ? -result : result;
+        return true;
+    }
+};
@@ -0,0 +1,104 @@
+import csv
+import re
+import argparse
+from pathlib import Path
+
+# Frame format (see components/Jewelry/HeartEarring/HRMSampleFrame.h)
+FRAME_MAGIC = 0xA5
+HEADER_BYTES = 7
+BYTES_PER_SAMPLE = 6
+SAMPLE_VALUE_MASK = 0x3ffff
+
+def decode_frames(data):
+    """Decodes concatenated binary sample frames. Returns (samples, frames_decoded, frames_missing)."""
+    samples = []
+    frames_decoded = 0
+    frames_missing = 0
+    last_seq = None
+    pos = 0
+
+    while pos + HEADER_BYTES <= len(data):
+        # Resynchronise on the magic byte
+        if data[pos] != FRAME_MAGIC:
+            pos += 1
+            continue
+        seq = data[pos + 1]
+        num_samples = data[pos + 2]
+        frame_len = HEADER_BYTES + num_samples * BYTES_PER_SAMPLE
+        if pos + frame_len > len(data):
+            break
+
+        # Check for missing frames using the sequence number
+        if last_seq is not None:
+            frames_missing += (seq - last_seq - 1) % 256
+        last_seq = seq
+
+        # Samples
+        time_ms = int.from_bytes(data[pos + 3:pos + 7], "little")
+        k = pos + HEADER_BYTES
+        for i in range(num_samples):
+            time_ms += data[k]
+            packed = int.from_bytes(data[k + 1:k + 6], "little")
+            samples.append({"Time (s)": time_ms / 1000.0,
+                            "Red": packed & SAMPLE_VALUE_MASK,
+                            "IR": (packed >> 18) & SAMPLE_VALUE_MASK})
+            k += BYTES_PER_SAMPLE
+
+        frames_decoded += 1
+        pos += frame_len
+
+    return samples, frames_decoded, frames_missing
+
+def read_input(input_file, is_hex):
+    """Reads raw frame bytes from a binary file or from hex strings (one or more per line) in a text file."""
+    if not is_hex:
+        return Path(input_file).read_bytes()
+    data = bytearray()
+    with open(input_file, 'r') as file:
+        for line in file:
+            for hex_str in re.findall(r'\b(?:[0-9a-fA-F]{2})+\b', line):
+                if hex_str.lower().startswith("a5"):
+                    data.extend(bytes.fromhex(hex_str))
+    return bytes(data)
+
+def process_frames_file(input_file, output_file, is_hex):
+    """Decodes the frames and writes to CSV (same format as ProcLogWithHRMPollData.py)."""
+    try:
+        samples, frames_decoded, frames_missing = decode_frames(read_input(input_file, is_hex))
+        with open(output_file, 'w', newline='') as csvfile:
+            writer = csv.writer(csvfile)
+            writer.writerow(["Time (s)", "Red", "IR"])  # Write header
+            for sample in samples:
+                writer.writerow([f"{sample['Time (s)']:.2f}", sample["Red"], sample["IR"]])
+
+        print(f"CSV file created: {output_file} samples {len(samples)} frames {frames_decoded} missing frames {frames_missing}")
+        return 0  # Success exit code
+
+    except Exception as e:
+        print(f"Error processing file: {e}")
+        return 1  # Failure exit code
+
+def main():
+    """Parses command-line arguments and runs the script."""
+    parser = argparse.ArgumentParser(description="Decode binary HRM sample frames (hrmbin topic) to CSV.")
+    parser.add_argument("input_file", type=str, help="Path to the input file (binary frames or hex text with --hex)")
+    parser.add_argument("output_file", type=str, nargs="?", help="Path to the output CSV file (optional)")
+    parser.add_argument("--hex", action="store_true", help="Input is text containing frames as hex strings")
+
+    args = parser.parse_args()
+
+    # Resolve absolute paths
+    input_path = Path(args.input_file).resolve()
+    output_path = Path(args.output_file).resolve() if args.output_file else input_path.with_suffix(".csv")
+
+    # Check if input file exists
+    if not input_path.is_file():
+        print(f"Error: Input file '{input_path}' not found!")
+        exit(1)
+
+    # Process the file and exit with the appropriate status code
+    exit_code = process_frames_file(input_path, output_path, args.hex)
+    exit(exit_code)
+
+if __name__ == "__main__":
+    main()
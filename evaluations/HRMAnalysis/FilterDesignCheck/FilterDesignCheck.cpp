@@ -0,0 +1,100 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Filter design check
+//
+// Verifies the Butterworth bandpass designer used by HRMAnalysis against the IIR1 library reference design
+// at several sample rates and orders and checks that the BiquadCascade output matches the IIR1 cascade
+// on recorded HRM data
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <complex>
+
+#include "IIR1/Butterworth.h"
+#include "ReadAnalogValues.h"
+#include "HRMAnalysis.h"
+
+// Band of the HRMAnalysis bandpass filter
+static const double BAND_LOWER_HZ = 0.75;
+static const double BAND_UPPER_HZ = 3.0;
+
+// Tolerances
+static const double MAX_RESPONSE_ERROR = 1e-9;
+static const double MAX_OUTPUT_ERROR = 1e-3;
+
+template<int PROTO_ORDER>
+bool checkDesign(double sampleRateHz, const std::vector<int>& samples)
+{
+    // Reference design
+    Iir::Butterworth::BandPass<PROTO_ORDER, Iir::TransposedDirectFormII> refFilter;
+    refFilter.setup(sampleRateHz, (BAND_LOWER_HZ + BAND_UPPER_HZ) / 2, BAND_UPPER_HZ - BAND_LOWER_HZ);
+
+    // Design under test - sections are grouped differently from IIR1 so compare the overall response
+    auto coeffs = ButterworthDesign::bandpass<PROTO_ORDER>(sampleRateHz, BAND_LOWER_HZ, BAND_UPPER_HZ);
+    double maxResponseError = 0;
+    for (double freqHz = 0.05; freqHz < sampleRateHz / 2; freqHz += 0.05)
+    {
+        std::complex<double> z = std::polar(1.0, 2 * M_PI * freqHz / sampleRateHz);
+        std::complex<double> response = 1;
+        for (const auto& c : coeffs)
+            response *= (c.b0 + c.b1 / z + c.b2 / (z * z)) / (1.0 + c.a1 / z + c.a2 / (z * z));
+        std::complex<double> refResponse = refFilter.response(freqHz / sampleRateHz);
+        maxResponseError = std::max(maxResponseError, std::abs(response - refResponse));
+    }
+
+    // Compare outputs
+    BiquadCascade<PROTO_ORDER> filter(coeffs);
+    double maxOutputError = 0;
+    for (int sample : samples)
+    {
+        double refOut = refFilter.filter((double)sample);
+        double out = filter.process(sample);
+        maxOutputError = std::max(maxOutputError, fabs(refOut - out));
+    }
+
+    bool isOk = (maxResponseError <= MAX_RESPONSE_ERROR) && (maxOutputError <= MAX_OUTPUT_ERROR);
+    std::cout << "Order " << PROTO_ORDER * 2 << " sampleRate " << sampleRateHz << "Hz maxResponseError " << maxResponseError 
+            << " maxOutputError " << maxOutputError << " over " << samples.size() << " samples " << (isOk ? "OK" : "FAIL") << std::endl;
+    return isOk;
+}
+
+int main(int argc, char **argv)
+{
+    // Check args
+    if (argc <= 1)
+    {
+        std::cout << "Usage: FilterDesignCheck <input_filename>" << std::endl;
+        return 1;
+    }
+
+    // Read file data
+    auto hrmDataRead = readHRMAnalogValues(argv[1]);
+
+    // Check designs
+    bool allOk = true;
+    for (double sampleRateHz : {12.5, 25.0, 50.0, 100.0})
+    {
+        allOk &= checkDesign<2>(sampleRateHz, hrmDataRead.red_led_adc_values);
+        allOk &= checkDesign<3>(sampleRateHz, hrmDataRead.red_led_adc_values);
+        allOk &= checkDesign<4>(sampleRateHz, hrmDataRead.red_led_adc_values);
+    }
+
+    // Check the compile time design used by HRMAnalysis matches the same design made at run time
+    auto runTimeDesign = HRMAnalysis::designBandpass(HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ, BAND_LOWER_HZ, BAND_UPPER_HZ);
+    bool defaultOk = memcmp(runTimeDesign.data(), HRMAnalysis::_butterSOSDefault.data(), sizeof(runTimeDesign)) == 0;
+    std::cout << "HRMAnalysis compile time design " << (defaultOk ? "OK" : "FAIL") << std::endl;
+    allOk &= defaultOk;
+    std::cout << (allOk ? "PASSED" : "FAILED") << std::endl;
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Filter precision check
+//
+// Runs the HRMAnalysis bandpass filter in double, float and fixed point over recorded HRM data files
+// and checks that the reduced precision outputs track the double reference within an error bound
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include <math.h>
+
+#include "ReadAnalogValues.h"
+#include "HRMAnalysis.h"
+
+// Samples to skip at the start while the filter settles (10s at 25Hz)
+static const uint32_t SETTLING_SAMPLES = 250;
+
+// Error bound (in ADC counts) for the fixed point filter output after settling
+static const double FIXED_POINT_MAX_ERROR_DEFAULT = 1.0;
+
+struct FilterErrorStats
+{
+    double maxAbsError = 0;
+    double sumSqError = 0;
+    uint32_t zeroCrossingMismatches = 0;
+    uint32_t numSamples = 0;
+    double rmsError() const
+    {
+        return numSamples > 0 ? sqrt(sumSqError / numSamples) : 0;
+    }
+};
+
+template<size_t NUM_SECTIONS, typename SampleT, typename CoeffT>
+std::vector<double> runFilter(const std::vector<int>& samples, const std::array<BiquadCoeffs, NUM_SECTIONS>& coeffs)
+{
+    BiquadCascade<NUM_SECTIONS, SampleT, CoeffT> filter(coeffs);
+    std::vector<double> out;
+    out.reserve(samples.size());
+    for (int sample : samples)
+        out.push_back(SampleConv<SampleT>::toDouble(filter.process(SampleConv<SampleT>::fromInt(sample))));
+    return out;
+}
+
+FilterErrorStats compare(const std::vector<double>& ref, const std::vector<double>& test)
+{
+    FilterErrorStats stats;
+    for (uint32_t i = SETTLING_SAMPLES; i < ref.size(); i++)
+    {
+        double err = fabs(test[i] - ref[i]);
+        if (err > stats.maxAbsError)
+            stats.maxAbsError = err;
+        stats.sumSqError += err * err;
+        stats.numSamples++;
+        bool refCross = (ref[i-1] >= 0) && (ref[i] < 0);
+        bool testCross = (test[i-1] >= 0) && (test[i] < 0);
+        if (refCross != testCross)
+            stats.zeroCrossingMismatches++;
+    }
+    return stats;
+}
+
+template<size_t NUM_SECTIONS>
+bool checkFile(const std::string& fileName, const std::vector<int>& samples, const std::array<BiquadCoeffs, NUM_SECTIONS>& coeffs,
+            double maxFixedPointError)
+{
+    // Reference and reduced precision filters
+    auto refOut = runFilter<NUM_SECTIONS, double, double>(samples, coeffs);
+    auto floatOut = runFilter<NUM_SECTIONS, float, float>(samples, coeffs);
+    auto fixedOut = runFilter<NUM_SECTIONS, FixedQ<8>, FixedQ<29>>(samples, coeffs);
+
+    // Signal level after settling
+    double sumSq = 0;
+    for (uint32_t i = SETTLING_SAMPLES; i < refOut.size(); i++)
+        sumSq += refOut[i] * refOut[i];
+    double signalRMS = sqrt(sumSq / (refOut.size() - SETTLING_SAMPLES));
+
+    // Compare
+    FilterErrorStats floatStats = compare(refOut, floatOut);
+    FilterErrorStats fixedStats = compare(refOut, fixedOut);
+    bool isOk = fixedStats.maxAbsError <= maxFixedPointError;
+    std::cout << "\"" << fileName << "\"," << NUM_SECTIONS * 2 << "," << refOut.size() << "," << signalRMS << ","
+            << floatStats.maxAbsError << "," << floatStats.rmsError() << "," << floatStats.zeroCrossingMismatches << ","
+            << fixedStats.maxAbsError << "," << fixedStats.rmsError() << "," << fixedStats.zeroCrossingMismatches << ","
+            << (isOk ? "OK" : "FAIL") << std::endl;
+    return isOk;
+}
+
+bool isSampleFile(const std::filesystem::path& path)
+{
+    // Sample files have a header line of the form Time (s),Red,IR (possibly preceded by a BOM)
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line))
+        return false;
+    return (line.find("Time (s)") != std::string::npos) && (line.find("Red,IR") != std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+    // Check args
+    if (argc <= 1)
+    {
+        std::cout << "Usage: FilterPrecisionCLI <data_folder_or_file> [max_fixed_point_error]" << std::endl;
+        return 1;
+    }
+    std::filesystem::path dataPath = argv[1];
+    double maxFixedPointError = argc > 2 ? atof(argv[2]) : FIXED_POINT_MAX_ERROR_DEFAULT;
+
+    // Get files
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(dataPath))
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(dataPath))
+            if (entry.path().extension() == ".csv" && isSampleFile(entry.path()))
+                files.push_back(entry.path());
+        std::sort(files.begin(), files.end());
+    }
+    else
+    {
+        files.push_back(dataPath);
+    }
+
+    // Process files
+    bool allOk = true;
+    std::cout << "File,Order,Samples,SignalRMS,FloatMaxErr,FloatRMSErr,FloatZCMismatch,FixedMaxErr,FixedRMSErr,FixedZCMismatch,Result" << std::endl;
+    for (const auto& file : files)
+    {
+        auto hrmDataRead = readHRMAnalogValues(file.string());
+        if (hrmDataRead.red_led_adc_values.size() <= SETTLING_SAMPLES)
+            continue;
+
+        // Check both filter orders
+        std::string fileName = file.filename().string();
+        allOk &= checkFile(fileName, hrmDataRead.red_led_adc_values, 
+                    ButterworthDesign::bandpass<2>(HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ, 0.75, 3.0), maxFixedPointError);
+        allOk &= checkFile(fileName, hrmDataRead.red_led_adc_values, 
+                    ButterworthDesign::bandpass<4>(HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ, 0.75, 3.0), maxFixedPointError);
+    }
+
+    std::cout << (allOk ? "PASSED" : "FAILED") << " fixed point error bound " << maxFixedPointError << " counts" << std::endl;
+    return allOk ? 0 : 1;
+}
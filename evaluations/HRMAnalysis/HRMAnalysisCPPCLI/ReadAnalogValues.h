@@ -2,8 +2,8 @@
 
 #include <string>
 #include <vector>
-#include <fstream>
-#include <filesystem>
+#include <sstream>
+#include "../Common/HRMSessionLoader.h"
 
 std::vector<std::string> split(const std::string &str, char delimiter)
 {
@@ -32,37 +32,16 @@ HRMAnalogValues readHRMAnalogValues(std::string logfile, bool relative_time = fa
 
     HRMAnalogValues hrm_data_read;
 
-    int first_sample_line_time_ms = 0;
-
-    std::ifstream file(logfile);
-    std::string line;
-
-    while (std::getline(file, line))
-    {
-        std::vector<std::string> words = split(line, ',');
-
-        // Check for header line
-        if (words[0].find("Time") != std::string::npos)
-        {
-            continue;
-        }
-
-        // Extract the values
-        int line_time_ms = std::stof(words[0]) * 1000;
-        int red_led_adc_value = std::stoi(words[1]);
-        int ir_led_adc_value = std::stoi(words[2]);
-
-        // Check for first sample time
-        if (first_sample_line_time_ms == 0)
-        {
-            first_sample_line_time_ms = line_time_ms;
-        }
-
-        hrm_data_read.timestamps.push_back(relative_time ? line_time_ms - first_sample_line_time_ms : line_time_ms);
-        hrm_data_read.red_led_adc_values.push_back(red_led_adc_value);
-        hrm_data_read.ir_led_adc_values.push_back(ir_led_adc_value);
-    }
-
+    // Parse using the shared session loader (no binary cache as these files are normally read once)
+    HRMSessionData session;
+    if (!HRMSessionLoader::load(logfile, session, false))
+        return hrm_data_read;
+
+    int first_sample_line_time_ms = session.size() > 0 ? session.timeMs[0] : 0;
+    hrm_data_read.timestamps.reserve(session.size());
+    for (uint32_t timeMs : session.timeMs)
+        hrm_data_read.timestamps.push_back(relative_time ? timeMs - first_sample_line_time_ms : timeMs);
+    hrm_data_read.red_led_adc_values.assign(session.red.begin(), session.red.end());
+    hrm_data_read.ir_led_adc_values.assign(session.ir.begin(), session.ir.end());
     return hrm_data_read;
 }
-
@@ -0,0 +1,266 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM evaluation data index and reference heart rate readings
+//
+// Reads data/data_index.json and the chest strap HRM reference files (*_HRM_Data.csv) and aligns the
+// reference readings to the ADC sample times in the same way as HRM_PLL_Analysis.ipynb
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Entry in data_index.json
+struct DataIndexEntry
+{
+    std::string adcFile;
+    std::string hrmFile;
+    std::string waypointName;
+    double waypointRelTimeSecs = 0;
+    uint32_t comparisonStartIdx = 0;
+    uint32_t comparisonEndIdx = UINT32_MAX;
+};
+
+// Reference heart rate reading (time in seconds on the ADC sample timebase)
+struct HRMReference
+{
+    double timeSecs;
+    double heartRateBPM;
+};
+
+// Minimal JSON reader sufficient for data_index.json (an array of flat objects with string, number
+// and number array values)
+class DataIndexReader
+{
+public:
+    static bool read(const std::string& fileName, std::vector<DataIndexEntry>& entries)
+    {
+        std::ifstream file(fileName);
+        if (!file)
+            return false;
+        std::stringstream ss;
+        ss << file.rdbuf();
+        std::string json = ss.str();
+        size_t pos = json.find('[');
+        if (pos == std::string::npos)
+            return false;
+        pos++;
+        while (true)
+        {
+            skipSpace(json, pos);
+            if ((pos >= json.size()) || (json[pos] == ']'))
+                break;
+            if (json[pos] == ',')
+            {
+                pos++;
+                continue;
+            }
+            if (json[pos] != '{')
+                return false;
+            pos++;
+            DataIndexEntry entry;
+            while (true)
+            {
+                skipSpace(json, pos);
+                if ((pos >= json.size()) || (json[pos] == '}'))
+                {
+                    pos++;
+                    break;
+                }
+                if (json[pos] == ',')
+                {
+                    pos++;
+                    continue;
+                }
+                std::string key = readString(json, pos);
+                skipSpace(json, pos);
+                if ((pos >= json.size()) || (json[pos] != ':'))
+                    return false;
+                pos++;
+                skipSpace(json, pos);
+                if (json[pos] == '"')
+                {
+                    std::string val = readString(json, pos);
+                    if (key == "adc_file")
+                        entry.adcFile = val;
+                    else if (key == "hrm_file")
+                        entry.hrmFile = val;
+                    else if (key == "waypoint_name")
+                        entry.waypointName = val;
+                }
+                else if (json[pos] == '[')
+                {
+                    std::vector<double> vals = readNumberArray(json, pos);
+                    if ((key == "comparison_analysis") && (vals.size() == 2))
+                    {
+                        entry.comparisonStartIdx = vals[0] < 0 ? 0 : (uint32_t)vals[0];
+                        entry.comparisonEndIdx = (uint32_t)vals[1];
+                    }
+                }
+                else
+                {
+                    double val = readNumber(json, pos);
+                    if (key == "waypoint_rel_time")
+                        entry.waypointRelTimeSecs = val;
+                }
+            }
+            entries.push_back(entry);
+        }
+        return true;
+    }
+
+private:
+    static void skipSpace(const std::string& json, size_t& pos)
+    {
+        while ((pos < json.size()) && isspace((unsigned char)json[pos]))
+            pos++;
+    }
+    static std::string readString(const std::string& json, size_t& pos)
+    {
+        std::string str;
+        if ((pos >= json.size()) || (json[pos] != '"'))
+            return str;
+        pos++;
+        while ((pos < json.size()) && (json[pos] != '"'))
+        {
+            if ((json[pos] == '\\') && (pos + 1 < json.size()))
+                pos++;
+            str += json[pos++];
+        }
+        pos++;
+        return str;
+    }
+    static double readNumber(const std::string& json, size_t& pos)
+    {
+        const char* pStart = json.c_str() + pos;
+        char* pEnd = nullptr;
+        double val = strtod(pStart, &pEnd);
+        pos += (pEnd > pStart) ? (pEnd - pStart) : 1;
+        return val;
+    }
+    static std::vector<double> readNumberArray(const std::string& json, size_t& pos)
+    {
+        std::vector<double> vals;
+        pos++;
+        while (true)
+        {
+            skipSpace(json, pos);
+            if ((pos >= json.size()) || (json[pos] == ']'))
+            {
+                pos++;
+                break;
+            }
+            if (json[pos] == ',')
+            {
+                pos++;
+                continue;
+            }
+            vals.push_back(readNumber(json, pos));
+        }
+        return vals;
+    }
+};
+
+// Reference HRM readings
+class HRMReferenceReader
+{
+public:
+    // Read a chest strap HRM file - lines are ISO8601 UTC timestamp, BPM and optional waypoint name, e.g.
+    // 2024-05-19T17:04:55.834Z,64,Waypoint1
+    // The times are converted to the ADC sample timebase using the waypoint (as in HRM_PLL_Analysis.ipynb)
+    static bool read(const std::string& fileName, const std::string& waypointName, double waypointRelTimeSecs,
+                std::vector<HRMReference>& refs)
+    {
+        std::ifstream file(fileName);
+        if (!file)
+            return false;
+        std::vector<HRMReference> readings;
+        double waypointTimeSecs = 0;
+        bool waypointFound = false;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            // Remove BOM and line ending
+            if ((line.size() >= 3) && (line.compare(0, 3, "\xEF\xBB\xBF") == 0))
+                line.erase(0, 3);
+            while (!line.empty() && ((line.back() == '\r') || (line.back() == '\n')))
+                line.pop_back();
+            size_t comma1 = line.find(',');
+            if (comma1 == std::string::npos)
+                continue;
+            size_t comma2 = line.find(',', comma1 + 1);
+            double timeSecs = 0;
+            if (!parseISOTime(line.substr(0, comma1), timeSecs))
+                continue;
+            std::string bpmStr = line.substr(comma1 + 1, comma2 == std::string::npos ? std::string::npos : comma2 - comma1 - 1);
+            if (bpmStr.empty())
+                continue;
+            readings.push_back(HRMReference{timeSecs, atof(bpmStr.c_str())});
+            if (!waypointFound && (comma2 != std::string::npos) && (line.substr(comma2 + 1) == waypointName))
+            {
+                waypointTimeSecs = timeSecs;
+                waypointFound = true;
+            }
+        }
+        if (!waypointFound)
+            return false;
+
+        // Convert to ADC timebase (readings before the start of the ADC timebase are discarded)
+        refs.clear();
+        for (const HRMReference& reading : readings)
+        {
+            double secs = reading.timeSecs - waypointTimeSecs + waypointRelTimeSecs;
+            if (secs < 0)
+                continue;
+            refs.push_back(HRMReference{secs, reading.heartRateBPM});
+        }
+        return true;
+    }
+
+    // Get the first reference reading at or after a time (searching forward from idx which is updated)
+    // Returns false if there is no such reading
+    static bool getAtOrAfter(const std::vector<HRMReference>& refs, double timeSecs, uint32_t& idx, double& heartRateBPM)
+    {
+        for (uint32_t i = idx; i < refs.size(); i++)
+        {
+            if (refs[i].timeSecs >= timeSecs)
+            {
+                idx = i;
+                heartRateBPM = refs[i].heartRateBPM;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    // Parse YYYY-MM-DDTHH:MM:SS.sssZ to seconds since the epoch
+    static bool parseISOTime(const std::string& str, double& secs)
+    {
+        int year = 0, month = 0, day = 0, hour = 0, minute = 0;
+        double second = 0;
+        if (sscanf(str.c_str(), "%d-%d-%dT%d:%d:%lfZ", &year, &month, &day, &hour, &minute, &second) != 6)
+            return false;
+        secs = daysFromCivil(year, month, day) * 86400.0 + hour * 3600 + minute * 60 + second;
+        return true;
+    }
+
+    // Days since 1970-01-01 for a proleptic Gregorian date
+    static int64_t daysFromCivil(int y, int m, int d)
+    {
+        y -= m <= 2;
+        int64_t era = (y >= 0 ? y : y - 399) / 400;
+        int64_t yoe = y - era * 400;
+        int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + doe - 719468;
+    }
+};
@@ -0,0 +1,107 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM accuracy scoring
+//
+// Scores heart rate estimates against reference readings (see DataIndex.h)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <math.h>
+#include "DataIndex.h"
+
+struct HRMAccuracyStats
+{
+    uint32_t numCompared = 0;
+    double bpmMeanAbsError = 0;
+    double bpmRMSError = 0;
+    double bpmMaxAbsError = 0;
+    double pcWithin5BPM = 0;
+
+    // Time from the first sample until the estimate is first within LOCK_BPM of the reference (negative if
+    // this never happens)
+    double within5BPMSecs = -1;
+
+    // Time from the first sample until the estimate is within LOCK_BPM of the reference and stays there
+    // for LOCK_HOLD_SECS (negative if this never happens)
+    double lockTimeSecs = -1;
+};
+
+class HRMAccuracy
+{
+public:
+    static constexpr double LOCK_BPM = 5.0;
+    static constexpr double LOCK_HOLD_SECS = 10.0;
+
+    // Score estimates (heartRateBPM[i] is the estimate after samples[i]) - SampleRec must have a timeMs member
+    // Errors are over the comparison range of the data index entry and lock time is over all samples
+    template<typename SampleRec>
+    static HRMAccuracyStats score(const DataIndexEntry& entry, const std::vector<SampleRec>& samples,
+                const std::vector<double>& heartRateBPM, const std::vector<HRMReference>& refs)
+    {
+        HRMAccuracyStats stats;
+        if (samples.empty())
+            return stats;
+
+        // Errors over the comparison range (end exclusive and limited as in HRM_PLL_Analysis.ipynb)
+        double sumAbsErr = 0;
+        double sumSqErr = 0;
+        uint32_t numWithin = 0;
+        uint32_t refIdx = 0;
+        uint32_t endIdx = std::min<uint32_t>(entry.comparisonEndIdx, samples.size() - 1);
+        for (uint32_t i = entry.comparisonStartIdx; i < endIdx; i++)
+        {
+            double refBPM = 0;
+            if (!HRMReferenceReader::getAtOrAfter(refs, samples[i].timeMs / 1000.0, refIdx, refBPM))
+                break;
+            double err = fabs(heartRateBPM[i] - refBPM);
+            sumAbsErr += err;
+            sumSqErr += err * err;
+            stats.bpmMaxAbsError = std::max(stats.bpmMaxAbsError, err);
+            if (err <= LOCK_BPM)
+                numWithin++;
+            stats.numCompared++;
+        }
+        if (stats.numCompared > 0)
+        {
+            stats.bpmMeanAbsError = sumAbsErr / stats.numCompared;
+            stats.bpmRMSError = sqrt(sumSqErr / stats.numCompared);
+            stats.pcWithin5BPM = 100.0 * numWithin / stats.numCompared;
+        }
+
+        // Lock time
+        refIdx = 0;
+        bool inLock = false;
+        uint32_t lockStartMs = 0;
+        for (uint32_t i = 0; i < samples.size(); i++)
+        {
+            double refBPM = 0;
+            if (!HRMReferenceReader::getAtOrAfter(refs, samples[i].timeMs / 1000.0, refIdx, refBPM))
+                break;
+            if (fabs(heartRateBPM[i] - refBPM) > LOCK_BPM)
+            {
+                inLock = false;
+                continue;
+            }
+            if (stats.within5BPMSecs < 0)
+                stats.within5BPMSecs = (samples[i].timeMs - samples[0].timeMs) / 1000.0;
+            if (!inLock)
+            {
+                inLock = true;
+                lockStartMs = samples[i].timeMs;
+            }
+            if (samples[i].timeMs - lockStartMs >= LOCK_HOLD_SECS * 1000)
+            {
+                stats.lockTimeSecs = (lockStartMs - samples[0].timeMs) / 1000.0;
+                break;
+            }
+        }
+        return stats;
+    }
+};
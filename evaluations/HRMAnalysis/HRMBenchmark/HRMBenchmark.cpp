@@ -0,0 +1,514 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM benchmark
+//
+// Runs HRMAnalysis over every file in data/data_index.json and reports
+//   - processing time per sample (sensor FIFO sized blocks as on the device)
+//   - peak stack and heap use of the analysis
+//   - heart rate error against the chest strap HRM reference readings (aligned as in HRM_PLL_Analysis.ipynb)
+//   - beat to beat heart rate error (from the intervals between beats passed to the PLL) - this shows the
+//     precision of the beat times independently of the PLL tracking
+// Samples can be decimated to check accuracy at lower sensor sample rates and re-timed by HRMSampleTimebase (as on
+// the device) from the arrival times of the bursts of samples in the recorded times. Filter warm start and PLL
+// acquisition can be disabled (or the acquisition gain changed) to check the time to the first estimate within
+// 5 BPM of the reference and the lock time
+// and writes a JSON summary. Optional limits make the run fail on speed or accuracy regressions
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <cstddef>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "HRMSessionLoader.h"
+#include "DataIndex.h"
+#include "HRMAccuracy.h"
+#include "HRMAnalysis.h"
+#include "HRMSampleTimebase.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Heap use tracking (global operator new/delete)
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<bool> heapTrackingEnabled(false);
+static std::atomic<int64_t> heapCurBytes(0);
+static std::atomic<int64_t> heapPeakBytes(0);
+static std::atomic<uint64_t> heapAllocCount(0);
+
+// Each allocation is prefixed with its size
+static const size_t HEAP_HEADER_BYTES = alignof(std::max_align_t);
+
+void* operator new(size_t size)
+{
+    uint8_t* p = (uint8_t*)malloc(size + HEAP_HEADER_BYTES);
+    if (!p)
+        throw std::bad_alloc();
+    *(size_t*)p = size;
+    if (heapTrackingEnabled)
+    {
+        int64_t cur = heapCurBytes += size;
+        int64_t peak = heapPeakBytes;
+        while ((cur > peak) && !heapPeakBytes.compare_exchange_weak(peak, cur))
+            ;
+        heapAllocCount++;
+    }
+    return p + HEAP_HEADER_BYTES;
+}
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+void operator delete(void* ptr) noexcept
+{
+    if (!ptr)
+        return;
+    uint8_t* p = (uint8_t*)ptr - HEAP_HEADER_BYTES;
+    if (heapTrackingEnabled)
+        heapCurBytes -= *(size_t*)p;
+    free(p);
+}
+void operator delete[](void* ptr) noexcept
+{
+    operator delete(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmark
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Sample record with the members used by HRMAnalysis::processBlock
+struct SampleRec
+{
+    int32_t Red;
+    uint32_t timeMs;
+};
+
+// Settings
+struct BenchSettings
+{
+    std::string dataDir = "../data";
+    std::string jsonOutFile;
+    uint32_t blockSize = 5;
+    uint32_t timingRepeats = 5;
+    uint32_t decimate = 1;
+    bool restamp = false;
+    bool warmStart = true;
+    double acquisitionGain = HRMAnalysis::PLLParams().acquisitionGain;
+    double maxNsPerSample = 0;
+    double maxBPMMeanAbsError = 0;
+    bool useCache = true;
+};
+
+// Results for a file
+struct FileResult
+{
+    std::string adcFile;
+    uint32_t numSamples = 0;
+    double nsPerSample = 0;
+    HRMAccuracyStats accuracy;
+    size_t peakStackBytes = 0;
+    int64_t peakHeapBytes = 0;
+    uint64_t heapAllocs = 0;
+    uint32_t numBeatIntervals = 0;
+    double beatBPMMeanAbsError = 0;
+};
+
+// Sample rate of the data (before decimation)
+static const double DATA_SAMPLE_RATE_HZ = 25.0;
+
+// Re-time samples with the sample timebase (settings as HeartEarring defaults) - recorded times are at the
+// nominal interval within each burst read from the sensor so bursts end where the interval isn't nominal
+void restampBursts(HRMSessionData& data)
+{
+    struct TimedSample
+    {
+        uint32_t timeMs;
+    };
+    const double nominalPeriodMs = 1000 / DATA_SAMPLE_RATE_HZ;
+    HRMSampleTimebase timebase;
+    timebase.setup(1500, 2000, 0.05);
+    timebase.reset(nominalPeriodMs);
+    std::vector<TimedSample> burst;
+    for (size_t i = 0; i < data.size(); i++)
+    {
+        burst.push_back(TimedSample{data.timeMs[i]});
+        if ((i + 1 < data.size()) && (data.timeMs[i+1] - data.timeMs[i] == (uint32_t)nominalPeriodMs))
+            continue;
+        timebase.restamp(burst.data(), burst.size());
+        for (size_t j = 0; j < burst.size(); j++)
+            data.timeMs[i + 1 - burst.size() + j] = burst[j].timeMs;
+        burst.clear();
+    }
+}
+
+// Create analysis for the settings
+HRMAnalysis createAnalysis(const BenchSettings& settings)
+{
+    HRMAnalysis::PLLParams pllParams;
+    pllParams.acquisitionGain = settings.acquisitionGain;
+    HRMAnalysis hrmAnalysis(0.75, 3.0, 1.0, DATA_SAMPLE_RATE_HZ / settings.decimate, pllParams);
+    hrmAnalysis.setWarmStartEnabled(settings.warmStart);
+    return hrmAnalysis;
+}
+
+// Time processing of all samples in blocks (best of several repeats to reduce scheduling noise)
+double timeProcessing(const std::vector<SampleRec>& samples, const BenchSettings& settings)
+{
+    double bestNs = 0;
+    for (uint32_t rep = 0; rep < settings.timingRepeats; rep++)
+    {
+        HRMAnalysis hrmAnalysis = createAnalysis(settings);
+        volatile double sink = 0;
+        auto startTime = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < samples.size(); i += settings.blockSize)
+        {
+            uint32_t numInBlock = std::min<size_t>(settings.blockSize, samples.size() - i);
+            sink = sink + hrmAnalysis.processBlock(samples.data() + i, numInBlock).heartRateHz;
+        }
+        double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+        if ((rep == 0) || (elapsedNs < bestNs))
+            bestNs = elapsedNs;
+    }
+    return samples.empty() ? 0 : bestNs / samples.size();
+}
+
+// Run per-sample analysis (as HRMAnalysisCPPCLI) - returns the heart rate in BPM after each sample and the
+// times of beats (the beat times vector must have capacity for a beat per sample so it doesn't allocate)
+struct AnalysisRun
+{
+    const std::vector<SampleRec>* pSamples = nullptr;
+    std::vector<double>* pHeartRateBPM = nullptr;
+    std::vector<uint32_t>* pBeatTimesMs = nullptr;
+    const BenchSettings* pSettings = nullptr;
+};
+static void* runAnalysis(void* pArg)
+{
+    AnalysisRun* pRun = (AnalysisRun*)pArg;
+    HRMAnalysis hrmAnalysis = createAnalysis(*pRun->pSettings);
+    for (const SampleRec& sample : *pRun->pSamples)
+    {
+        HRMAnalysis::HRMResult result = hrmAnalysis.processBlock(&sample, 1, 
+                    [pRun](const HRMAnalysis::HRMBeat& beat) {
+                        pRun->pBeatTimesMs->push_back(beat.timeMs);
+                    });
+        (*pRun->pHeartRateBPM)[&sample - pRun->pSamples->data()] = result.heartRateHz * 60;
+    }
+    return nullptr;
+}
+
+// Beat to beat heart rate error over the comparison range (intervals longer than the lowest heart rate are
+// gaps in the beats passed to the PLL and are skipped)
+void scoreBeatIntervals(const DataIndexEntry& entry, const std::vector<SampleRec>& samples,
+            const std::vector<uint32_t>& beatTimesMs, const std::vector<HRMReference>& refs, FileResult& result)
+{
+    if (samples.empty())
+        return;
+    uint32_t startMs = samples[std::min<size_t>(entry.comparisonStartIdx, samples.size() - 1)].timeMs;
+    uint32_t endMs = samples[std::min<size_t>(entry.comparisonEndIdx, samples.size() - 1)].timeMs;
+    double sumAbsErr = 0;
+    uint32_t refIdx = 0;
+    for (size_t i = 1; i < beatTimesMs.size(); i++)
+    {
+        uint32_t intervalMs = beatTimesMs[i] - beatTimesMs[i-1];
+        if ((beatTimesMs[i] < startMs) || (beatTimesMs[i] >= endMs) || (intervalMs == 0) || (intervalMs > 1000 / 0.75))
+            continue;
+        double refBPM = 0;
+        if (!HRMReferenceReader::getAtOrAfter(refs, beatTimesMs[i] / 1000.0, refIdx, refBPM))
+            break;
+        sumAbsErr += fabs(60000.0 / intervalMs - refBPM);
+        result.numBeatIntervals++;
+    }
+    result.beatBPMMeanAbsError = result.numBeatIntervals > 0 ? sumAbsErr / result.numBeatIntervals : 0;
+}
+
+// Run analysis on a thread with a pre-filled stack to measure peak stack use and track heap use
+bool runInstrumented(const std::vector<SampleRec>& samples, const BenchSettings& settings, 
+            std::vector<double>& heartRateBPM, std::vector<uint32_t>& beatTimesMs, FileResult& result)
+{
+    static const size_t STACK_SIZE = 256 * 1024;
+    static const uint8_t STACK_FILL = 0xA5;
+    heartRateBPM.assign(samples.size(), 0);
+    beatTimesMs.clear();
+    beatTimesMs.reserve(samples.size());
+    void* pStack = nullptr;
+    if (posix_memalign(&pStack, 4096, STACK_SIZE) != 0)
+        return false;
+    memset(pStack, STACK_FILL, STACK_SIZE);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, pStack, STACK_SIZE);
+
+    // Heap tracking
+    heapCurBytes = 0;
+    heapPeakBytes = 0;
+    heapAllocCount = 0;
+    heapTrackingEnabled = true;
+
+    AnalysisRun run{&samples, &heartRateBPM, &beatTimesMs, &settings};
+    pthread_t thread;
+    bool isOk = pthread_create(&thread, &attr, runAnalysis, &run) == 0;
+    if (isOk)
+        pthread_join(thread, nullptr);
+    heapTrackingEnabled = false;
+    pthread_attr_destroy(&attr);
+
+    // Stack grows down so unused stack is at the lowest addresses (this includes thread start-up use)
+    size_t untouched = 0;
+    while ((untouched < STACK_SIZE) && (((uint8_t*)pStack)[untouched] == STACK_FILL))
+        untouched++;
+    result.peakStackBytes = STACK_SIZE - untouched;
+    result.peakHeapBytes = heapPeakBytes;
+    result.heapAllocs = heapAllocCount;
+    free(pStack);
+    return isOk;
+}
+
+std::string accuracyJSON(const HRMAccuracyStats& stats)
+{
+    std::ostringstream out;
+    out << "\"compared\": " << stats.numCompared << ", \"bpmMeanAbsError\": " << stats.bpmMeanAbsError
+        << ", \"bpmRMSError\": " << stats.bpmRMSError << ", \"bpmMaxAbsError\": " << stats.bpmMaxAbsError
+        << ", \"pcWithin5BPM\": " << stats.pcWithin5BPM << ", \"within5BPMSecs\": " << stats.within5BPMSecs
+        << ", \"lockTimeSecs\": " << stats.lockTimeSecs;
+    return out.str();
+}
+
+std::string beatJSON(const FileResult& result)
+{
+    std::ostringstream out;
+    out << "\"beatIntervals\": " << result.numBeatIntervals << ", \"beatBPMMeanAbsError\": " << result.beatBPMMeanAbsError;
+    return out.str();
+}
+
+void writeJSON(const BenchSettings& settings, const std::vector<FileResult>& results, const FileResult& overall)
+{
+    std::ofstream out(settings.jsonOutFile);
+    out << "{\n";
+    out << "  \"filterFixedPoint\": " <<
+#ifdef HRM_FILTER_FIXED_POINT
+            "true"
+#else
+            "false"
+#endif
+            << ",\n";
+    out << "  \"bandpassOrder\": " << HRM_BANDPASS_ORDER << ",\n";
+    out << "  \"blockSize\": " << settings.blockSize << ",\n";
+    out << "  \"decimate\": " << settings.decimate << ",\n";
+    out << "  \"restamp\": " << (settings.restamp ? "true" : "false") << ",\n";
+    out << "  \"warmStart\": " << (settings.warmStart ? "true" : "false") << ",\n";
+    out << "  \"acquisitionGain\": " << settings.acquisitionGain << ",\n";
+    out << "  \"files\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const FileResult& r = results[i];
+        out << "    {\"adcFile\": \"" << r.adcFile << "\", \"samples\": " << r.numSamples
+            << ", \"nsPerSample\": " << r.nsPerSample
+            << ", \"peakStackBytes\": " << r.peakStackBytes << ", \"peakHeapBytes\": " << r.peakHeapBytes
+            << ", \"heapAllocs\": " << r.heapAllocs
+            << ", " << accuracyJSON(r.accuracy) << ", " << beatJSON(r) << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n";
+    out << "  \"overall\": {\"samples\": " << overall.numSamples << ", \"nsPerSample\": " << overall.nsPerSample
+        << ", \"peakStackBytes\": " << overall.peakStackBytes << ", \"peakHeapBytes\": " << overall.peakHeapBytes
+        << ", \"heapAllocs\": " << overall.heapAllocs
+        << ", " << accuracyJSON(overall.accuracy) << ", " << beatJSON(overall) << "}\n";
+    out << "}\n";
+}
+
+int main(int argc, char **argv)
+{
+    // Args
+    BenchSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if ((arg == "--data") && hasVal)
+            settings.dataDir = argv[++i];
+        else if ((arg == "--json") && hasVal)
+            settings.jsonOutFile = argv[++i];
+        else if ((arg == "--block") && hasVal)
+            settings.blockSize = std::max(1, atoi(argv[++i]));
+        else if ((arg == "--repeats") && hasVal)
+            settings.timingRepeats = std::max(1, atoi(argv[++i]));
+        else if ((arg == "--decimate") && hasVal)
+            settings.decimate = std::max(1, atoi(argv[++i]));
+        else if (arg == "--restamp")
+            settings.restamp = true;
+        else if (arg == "--no-warm-start")
+            settings.warmStart = false;
+        else if ((arg == "--acquisition-gain") && hasVal)
+            settings.acquisitionGain = atof(argv[++i]);
+        else if ((arg == "--max-ns-per-sample") && hasVal)
+            settings.maxNsPerSample = atof(argv[++i]);
+        else if ((arg == "--max-bpm-mae") && hasVal)
+            settings.maxBPMMeanAbsError = atof(argv[++i]);
+        else if (arg == "--no-cache")
+            settings.useCache = false;
+        else
+        {
+            std::cout << "Usage: HRMBenchmark [--data <dir>] [--json <summary_file>] [--block <samples>] [--repeats <n>]" << std::endl;
+            std::cout << "                    [--decimate <n>] [--restamp] [--no-warm-start] [--acquisition-gain <gain>]" << std::endl;
+            std::cout << "                    [--max-ns-per-sample <ns>] [--max-bpm-mae <bpm>] [--no-cache]" << std::endl;
+            std::cout << "  --acquisition-gain 0 disables PLL acquisition (PID loop only)" << std::endl;
+            return 1;
+        }
+    }
+
+    // Data index
+    std::vector<DataIndexEntry> entries;
+    if (!DataIndexReader::read(settings.dataDir + "/data_index.json", entries) || entries.empty())
+    {
+        std::cout << "Failed to read " << settings.dataDir << "/data_index.json" << std::endl;
+        return 1;
+    }
+
+    // Process files
+    std::vector<FileResult> results;
+    FileResult overall;
+    double overallNs = 0;
+    double sumAbsErr = 0;
+    double sumSqErr = 0;
+    double sumWithin5 = 0;
+    double sumLockTimeSecs = 0;
+    uint32_t numNotLocked = 0;
+    double sumWithin5BPMSecs = 0;
+    uint32_t numNotWithin5BPM = 0;
+    double sumBeatAbsErr = 0;
+    printf("%-28s %8s %10s %8s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "File", "Samples", "ns/sample", "Stack", "Heap", 
+                "Compared", "MAE", "RMSE", "<=5BPM%", "To5(s)", "Lock(s)", "Beats", "BeatMAE");
+    for (const DataIndexEntry& entry : entries)
+    {
+        // Read samples
+        HRMSessionData adcData;
+        if (!HRMSessionLoader::load(settings.dataDir + "/" + entry.adcFile, adcData, settings.useCache))
+        {
+            std::cout << "Failed to read " << entry.adcFile << std::endl;
+            return 1;
+        }
+        if (settings.restamp)
+            restampBursts(adcData);
+        std::vector<SampleRec> samples;
+        for (size_t i = 0; i < adcData.size(); i += settings.decimate)
+            samples.push_back(SampleRec{adcData.red[i], adcData.timeMs[i]});
+        std::vector<HRMReference> refs;
+        if (!HRMReferenceReader::read(settings.dataDir + "/" + entry.hrmFile, entry.waypointName, 
+                    entry.waypointRelTimeSecs, refs))
+        {
+            std::cout << "Failed to read reference " << entry.hrmFile << std::endl;
+            return 1;
+        }
+
+        // Benchmark
+        FileResult result;
+        result.adcFile = entry.adcFile;
+        result.numSamples = samples.size();
+        result.nsPerSample = timeProcessing(samples, settings);
+        std::vector<double> heartRateBPM;
+        std::vector<uint32_t> beatTimesMs;
+        if (!runInstrumented(samples, settings, heartRateBPM, beatTimesMs, result))
+        {
+            std::cout << "Failed to run analysis thread" << std::endl;
+            return 1;
+        }
+        DataIndexEntry decimatedEntry = entry;
+        decimatedEntry.comparisonStartIdx /= settings.decimate;
+        decimatedEntry.comparisonEndIdx /= settings.decimate;
+        result.accuracy = HRMAccuracy::score(decimatedEntry, samples, heartRateBPM, refs);
+        scoreBeatIntervals(decimatedEntry, samples, beatTimesMs, refs, result);
+        printf("%-28s %8u %10.1f %8zu %8lld %8u %8.2f %8.2f %8.1f %8.1f %8.1f %8u %8.2f\n", result.adcFile.c_str(), 
+                    result.numSamples, result.nsPerSample, result.peakStackBytes, (long long)result.peakHeapBytes, 
+                    result.accuracy.numCompared, result.accuracy.bpmMeanAbsError, result.accuracy.bpmRMSError, 
+                    result.accuracy.pcWithin5BPM, result.accuracy.within5BPMSecs, result.accuracy.lockTimeSecs, 
+                    result.numBeatIntervals, result.beatBPMMeanAbsError);
+
+        // Overall
+        overall.numSamples += result.numSamples;
+        overallNs += result.nsPerSample * result.numSamples;
+        overall.peakStackBytes = std::max(overall.peakStackBytes, result.peakStackBytes);
+        overall.peakHeapBytes = std::max(overall.peakHeapBytes, result.peakHeapBytes);
+        overall.heapAllocs += result.heapAllocs;
+        const HRMAccuracyStats& acc = result.accuracy;
+        overall.accuracy.numCompared += acc.numCompared;
+        sumAbsErr += acc.bpmMeanAbsError * acc.numCompared;
+        sumSqErr += acc.bpmRMSError * acc.bpmRMSError * acc.numCompared;
+        sumWithin5 += acc.pcWithin5BPM * acc.numCompared;
+        overall.accuracy.bpmMaxAbsError = std::max(overall.accuracy.bpmMaxAbsError, acc.bpmMaxAbsError);
+        overall.numBeatIntervals += result.numBeatIntervals;
+        sumBeatAbsErr += result.beatBPMMeanAbsError * result.numBeatIntervals;
+        if (acc.lockTimeSecs < 0)
+            numNotLocked++;
+        else
+            sumLockTimeSecs += acc.lockTimeSecs;
+        if (acc.within5BPMSecs < 0)
+            numNotWithin5BPM++;
+        else
+            sumWithin5BPMSecs += acc.within5BPMSecs;
+        results.push_back(result);
+    }
+    overall.adcFile = "overall";
+    overall.nsPerSample = overall.numSamples > 0 ? overallNs / overall.numSamples : 0;
+    if (overall.accuracy.numCompared > 0)
+    {
+        overall.accuracy.bpmMeanAbsError = sumAbsErr / overall.accuracy.numCompared;
+        overall.accuracy.bpmRMSError = sqrt(sumSqErr / overall.accuracy.numCompared);
+        overall.accuracy.pcWithin5BPM = sumWithin5 / overall.accuracy.numCompared;
+    }
+    overall.beatBPMMeanAbsError = overall.numBeatIntervals > 0 ? sumBeatAbsErr / overall.numBeatIntervals : 0;
+
+    // Overall times to within 5 BPM and to lock are the mean over files (negative if any file doesn't get there)
+    overall.accuracy.lockTimeSecs = (numNotLocked > 0) || results.empty() ? -1 : sumLockTimeSecs / results.size();
+    overall.accuracy.within5BPMSecs = (numNotWithin5BPM > 0) || results.empty() ? -1 : sumWithin5BPMSecs / results.size();
+    printf("%-28s %8u %10.1f %8zu %8lld %8u %8.2f %8.2f %8.1f %8.1f %8.1f %8u %8.2f\n", "overall", overall.numSamples, 
+                overall.nsPerSample, overall.peakStackBytes, (long long)overall.peakHeapBytes,
+                overall.accuracy.numCompared, overall.accuracy.bpmMeanAbsError, overall.accuracy.bpmRMSError, 
+                overall.accuracy.pcWithin5BPM, overall.accuracy.within5BPMSecs, overall.accuracy.lockTimeSecs, 
+                overall.numBeatIntervals, overall.beatBPMMeanAbsError);
+
+    // Summary
+    if (!settings.jsonOutFile.empty())
+    {
+        writeJSON(settings, results, overall);
+        std::cout << "Summary written to " << settings.jsonOutFile << std::endl;
+    }
+
+    // Check limits
+    bool isOk = true;
+    if ((settings.maxNsPerSample > 0) && (overall.nsPerSample > settings.maxNsPerSample))
+    {
+        std::cout << "FAIL ns/sample " << overall.nsPerSample << " > " << settings.maxNsPerSample << std::endl;
+        isOk = false;
+    }
+    if ((settings.maxBPMMeanAbsError > 0) && (overall.accuracy.bpmMeanAbsError > settings.maxBPMMeanAbsError))
+    {
+        std::cout << "FAIL BPM mean abs error " << overall.accuracy.bpmMeanAbsError << " > " << settings.maxBPMMeanAbsError << std::endl;
+        isOk = false;
+    }
+    if (overall.peakHeapBytes > 0)
+    {
+        std::cout << "FAIL HRMAnalysis used heap (" << overall.peakHeapBytes << " bytes)" << std::endl;
+        isOk = false;
+    }
+    return isOk ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM parameter sweep
+//
+// Loads every file in data/data_index.json once and evaluates HRMAnalysis over all combinations of the
+// PLL PID gains, PLL acquisition gain and lock tolerance and band/centre frequencies in parallel, ranking the
+// combinations by BPM error and lock time
+//
+// Each parameter is given as a single value, a comma separated list or a range min:max:steps[:log], e.g.
+//   HRMParamSweep --kP 1e-5:1e-3:9:log --kI 1e-6:1e-4:9:log --kD 0,0.0005 --centre 1.0,1.25
+//
+// The PID gains only act while the PLL is locked - acquisition (--acqGain, 0 disables it) moves the beat
+// frequency until lock and again after lock is lost (consecutive crossings more than --lockTol from the beat
+// frequency) - so with the default acquisition gain the PID gains make little difference (BPM MAE 10.7 to
+// 11.6 over kP 1e-7:0.1 and kI 1e-7:1e-3) and should be swept together with --acqGain and --lockTol
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "ReadAnalogValues.h"
+#include "DataIndex.h"
+#include "HRMAccuracy.h"
+#include "HRMAnalysis.h"
+#include "WorkStealingPool.h"
+
+// Sample record with the members used by HRMAnalysis::processBlock
+struct SampleRec
+{
+    int32_t Red;
+    uint32_t timeMs;
+};
+
+// Recorded data file with reference readings
+struct DataFile
+{
+    DataIndexEntry entry;
+    std::vector<SampleRec> samples;
+    std::vector<HRMReference> refs;
+    double durationSecs = 0;
+};
+
+// Parameter set
+struct ParamSet
+{
+    double freqBandLowerHz;
+    double freqBandUpperHz;
+    double freqCentreHz;
+    HRMPLLParams pllParams;
+};
+
+// Score for a parameter set over all files
+struct ParamScore
+{
+    uint32_t paramIdx = 0;
+    double bpmMeanAbsError = 0;
+    double meanLockTimeSecs = 0;
+    uint32_t numNotLocked = 0;
+    double score = 0;
+};
+
+// Parse a parameter spec (value, list or min:max:steps[:log])
+static bool parseSpec(const std::string& spec, std::vector<double>& vals)
+{
+    vals.clear();
+    if (spec.find(':') != std::string::npos)
+    {
+        std::vector<std::string> parts = split(spec, ':');
+        if (parts.size() < 3)
+            return false;
+        double minVal = atof(parts[0].c_str());
+        double maxVal = atof(parts[1].c_str());
+        int steps = atoi(parts[2].c_str());
+        bool isLog = (parts.size() > 3) && (parts[3] == "log");
+        if ((steps < 1) || (isLog && ((minVal <= 0) || (maxVal <= 0))))
+            return false;
+        for (int i = 0; i < steps; i++)
+        {
+            double frac = steps > 1 ? (double)i / (steps - 1) : 0;
+            vals.push_back(isLog ? minVal * pow(maxVal / minVal, frac) : minVal + (maxVal - minVal) * frac);
+        }
+        return true;
+    }
+    for (const std::string& part : split(spec, ','))
+        vals.push_back(atof(part.c_str()));
+    return !vals.empty();
+}
+
+int main(int argc, char **argv)
+{
+    // Defaults are the HRMAnalysis defaults
+    HRMPLLParams defaultPLL;
+    std::string dataDir = "../data";
+    std::string csvOutFile;
+    uint32_t numThreads = std::thread::hardware_concurrency();
+    uint32_t topN = 20;
+    double lockWeight = 0.1;
+    bool useCache = true;
+    std::vector<double> kPVals = {defaultPLL.kP};
+    std::vector<double> kIVals = {defaultPLL.kI};
+    std::vector<double> kDVals = {defaultPLL.kD};
+    std::vector<double> maxPIDVals = {defaultPLL.maxPIDOutput};
+    std::vector<double> acqGainVals = {defaultPLL.acquisitionGain};
+    std::vector<double> lockTolVals = {defaultPLL.lockTolerance};
+    std::vector<double> lowerVals = {0.75};
+    std::vector<double> upperVals = {3.0};
+    std::vector<double> centreVals = {1.0};
+
+    // Args
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        bool isOk = true;
+        if (arg == "--no-cache")
+            useCache = false;
+        else if (!hasVal)
+            isOk = false;
+        else if (arg == "--data")
+            dataDir = argv[++i];
+        else if (arg == "--csv")
+            csvOutFile = argv[++i];
+        else if (arg == "--threads")
+            numThreads = std::max(1, atoi(argv[++i]));
+        else if (arg == "--top")
+            topN = std::max(1, atoi(argv[++i]));
+        else if (arg == "--lock-weight")
+            lockWeight = atof(argv[++i]);
+        else if (arg == "--kP")
+            isOk = parseSpec(argv[++i], kPVals);
+        else if (arg == "--kI")
+            isOk = parseSpec(argv[++i], kIVals);
+        else if (arg == "--kD")
+            isOk = parseSpec(argv[++i], kDVals);
+        else if (arg == "--maxPID")
+            isOk = parseSpec(argv[++i], maxPIDVals);
+        else if (arg == "--acqGain")
+            isOk = parseSpec(argv[++i], acqGainVals);
+        else if (arg == "--lockTol")
+            isOk = parseSpec(argv[++i], lockTolVals);
+        else if (arg == "--lower")
+            isOk = parseSpec(argv[++i], lowerVals);
+        else if (arg == "--upper")
+            isOk = parseSpec(argv[++i], upperVals);
+        else if (arg == "--centre")
+            isOk = parseSpec(argv[++i], centreVals);
+        else
+            isOk = false;
+        if (!isOk)
+        {
+            std::cout << "Usage: HRMParamSweep [--data <dir>] [--csv <results_file>] [--threads <n>] [--top <n>] [--lock-weight <bpm_per_sec>]" << std::endl;
+            std::cout << "                     [--no-cache]" << std::endl;
+            std::cout << "                     [--kP <spec>] [--kI <spec>] [--kD <spec>] [--maxPID <spec>]" << std::endl;
+            std::cout << "                     [--acqGain <spec>] [--lockTol <spec>]" << std::endl;
+            std::cout << "                     [--lower <spec>] [--upper <spec>] [--centre <spec>]" << std::endl;
+            std::cout << "  <spec> is a value, a comma separated list or min:max:steps[:log]" << std::endl;
+            return 1;
+        }
+    }
+
+    // Load all data once
+    std::vector<DataIndexEntry> entries;
+    if (!DataIndexReader::read(dataDir + "/data_index.json", entries) || entries.empty())
+    {
+        std::cout << "Failed to read " << dataDir << "/data_index.json" << std::endl;
+        return 1;
+    }
+    std::vector<DataFile> files;
+    for (const DataIndexEntry& entry : entries)
+    {
+        DataFile file;
+        file.entry = entry;
+        HRMSessionData adcData;
+        HRMSessionLoader::load(dataDir + "/" + entry.adcFile, adcData, useCache);
+        file.samples.resize(adcData.size());
+        for (size_t i = 0; i < adcData.size(); i++)
+            file.samples[i] = SampleRec{adcData.red[i], adcData.timeMs[i]};
+        if (file.samples.empty() || 
+                !HRMReferenceReader::read(dataDir + "/" + entry.hrmFile, entry.waypointName, entry.waypointRelTimeSecs, file.refs))
+        {
+            std::cout << "Failed to read " << entry.adcFile << " or " << entry.hrmFile << std::endl;
+            return 1;
+        }
+        file.durationSecs = (file.samples.back().timeMs - file.samples.front().timeMs) / 1000.0;
+        files.push_back(std::move(file));
+    }
+
+    // Parameter sets (invalid band/centre combinations are skipped)
+    std::vector<ParamSet> paramSets;
+    for (double lower : lowerVals)
+        for (double upper : upperVals)
+            for (double centre : centreVals)
+                for (double maxPID : maxPIDVals)
+                    for (double kP : kPVals)
+                        for (double kI : kIVals)
+                            for (double kD : kDVals)
+                                for (double acqGain : acqGainVals)
+                                    for (double lockTol : lockTolVals)
+                                    {
+                                        if ((lower <= 0) || (upper <= lower) || (centre < lower) || (centre > upper) || 
+                                                    (kI <= 0) || (acqGain < 0) || (acqGain > 1) || (lockTol <= 0))
+                                            continue;
+                                        HRMPLLParams pllParams = defaultPLL;
+                                        pllParams.maxPIDOutput = maxPID;
+                                        pllParams.kP = kP;
+                                        pllParams.kI = kI;
+                                        pllParams.kD = kD;
+                                        pllParams.acquisitionGain = acqGain;
+                                        pllParams.lockTolerance = lockTol;
+                                        paramSets.push_back(ParamSet{lower, upper, centre, pllParams});
+                                    }
+    if (paramSets.empty())
+    {
+        std::cout << "No valid parameter sets" << std::endl;
+        return 1;
+    }
+
+    // Evaluate files x parameter sets
+    uint32_t numFiles = files.size();
+    uint32_t numTasks = paramSets.size() * numFiles;
+    std::vector<HRMAccuracyStats> taskStats(numTasks);
+    std::vector<std::vector<double>> threadHeartRateBPM(numThreads);
+    std::cout << "Evaluating " << paramSets.size() << " parameter sets over " << numFiles << " files using " 
+              << numThreads << " threads" << std::endl;
+    auto startTime = std::chrono::steady_clock::now();
+    WorkStealingPool::run(numTasks, numThreads, [&](uint32_t taskIdx, uint32_t threadIdx) {
+        const ParamSet& params = paramSets[taskIdx / numFiles];
+        const DataFile& file = files[taskIdx % numFiles];
+        std::vector<double>& heartRateBPM = threadHeartRateBPM[threadIdx];
+        heartRateBPM.resize(file.samples.size());
+        HRMAnalysis hrmAnalysis(params.freqBandLowerHz, params.freqBandUpperHz, params.freqCentreHz,
+                    HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ, params.pllParams);
+        for (size_t i = 0; i < file.samples.size(); i++)
+            heartRateBPM[i] = hrmAnalysis.processBlock(&file.samples[i], 1).heartRateHz * 60;
+        taskStats[taskIdx] = HRMAccuracy::score(file.entry, file.samples, heartRateBPM, file.refs);
+    });
+    double elapsedSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // Score parameter sets - files which never lock count as locking at the end of the file
+    std::vector<ParamScore> scores;
+    for (uint32_t paramIdx = 0; paramIdx < paramSets.size(); paramIdx++)
+    {
+        ParamScore score;
+        score.paramIdx = paramIdx;
+        uint32_t numCompared = 0;
+        for (uint32_t fileIdx = 0; fileIdx < numFiles; fileIdx++)
+        {
+            const HRMAccuracyStats& stats = taskStats[paramIdx * numFiles + fileIdx];
+            score.bpmMeanAbsError += stats.bpmMeanAbsError * stats.numCompared;
+            numCompared += stats.numCompared;
+            if (stats.lockTimeSecs < 0)
+                score.numNotLocked++;
+            score.meanLockTimeSecs += stats.lockTimeSecs < 0 ? files[fileIdx].durationSecs : stats.lockTimeSecs;
+        }
+        score.bpmMeanAbsError = numCompared > 0 ? score.bpmMeanAbsError / numCompared : 0;
+        score.meanLockTimeSecs /= numFiles;
+        score.score = score.bpmMeanAbsError + lockWeight * score.meanLockTimeSecs;
+        scores.push_back(score);
+    }
+    std::sort(scores.begin(), scores.end(), [](const ParamScore& a, const ParamScore& b) {
+        return a.score < b.score;
+    });
+
+    // Report
+    std::cout << "Evaluated " << numTasks << " runs in " << elapsedSecs << "s" << std::endl;
+    printf("%4s %8s %8s %8s %10s %10s %10s %8s %8s %8s %8s %8s %8s %9s\n", "Rank", "Score", "MAE", "Lock(s)", 
+                "kP", "kI", "kD", "maxPID", "acqGain", "lockTol", "lowerHz", "upperHz", "centreHz", "NotLocked");
+    for (uint32_t i = 0; (i < topN) && (i < scores.size()); i++)
+    {
+        const ParamScore& s = scores[i];
+        const ParamSet& p = paramSets[s.paramIdx];
+        printf("%4u %8.2f %8.2f %8.1f %10.3g %10.3g %10.3g %8.3g %8.3g %8.3g %8.3g %8.3g %8.3g %9u\n", i + 1, s.score, 
+                    s.bpmMeanAbsError, s.meanLockTimeSecs, p.pllParams.kP, p.pllParams.kI, p.pllParams.kD, 
+                    p.pllParams.maxPIDOutput, p.pllParams.acquisitionGain, p.pllParams.lockTolerance,
+                    p.freqBandLowerHz, p.freqBandUpperHz, p.freqCentreHz, s.numNotLocked);
+    }
+
+    // All results
+    if (!csvOutFile.empty())
+    {
+        std::ofstream out(csvOutFile);
+        out << "Rank,Score,BPM MAE,Mean lock time (s),Not locked,kP,kI,kD,maxPIDOutput,acquisitionGain,lockTolerance,freqBandLowerHz,freqBandUpperHz,freqCentreHz" << std::endl;
+        for (uint32_t i = 0; i < scores.size(); i++)
+        {
+            const ParamScore& s = scores[i];
+            const ParamSet& p = paramSets[s.paramIdx];
+            out << i + 1 << "," << s.score << "," << s.bpmMeanAbsError << "," << s.meanLockTimeSecs << "," 
+                << s.numNotLocked << "," << p.pllParams.kP << "," << p.pllParams.kI << "," << p.pllParams.kD << "," 
+                << p.pllParams.maxPIDOutput << "," << p.pllParams.acquisitionGain << "," << p.pllParams.lockTolerance << "," 
+                << p.freqBandLowerHz << "," << p.freqBandUpperHz << "," 
+                << p.freqCentreHz << std::endl;
+        }
+        std::cout << "Results written to " << csvOutFile << std::endl;
+    }
+    return 0;
+}
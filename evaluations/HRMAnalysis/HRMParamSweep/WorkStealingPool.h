@@ -0,0 +1,82 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Work stealing thread pool
+//
+// Runs a fixed set of tasks (identified by index) over a number of threads. Each thread starts with a
+// contiguous share of the tasks and takes from the front of its own queue - when that is empty it steals
+// from the back of the other queues
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <functional>
+
+class WorkStealingPool
+{
+public:
+    // Run taskFn(taskIdx, threadIdx) for every taskIdx in 0..numTasks-1 and wait for completion
+    static void run(uint32_t numTasks, uint32_t numThreads, const std::function<void(uint32_t, uint32_t)>& taskFn)
+    {
+        if (numThreads == 0)
+            numThreads = 1;
+        std::vector<std::unique_ptr<TaskQueue>> queues;
+        for (uint32_t i = 0; i < numThreads; i++)
+            queues.emplace_back(new TaskQueue());
+        for (uint32_t taskIdx = 0; taskIdx < numTasks; taskIdx++)
+            queues[(uint64_t)taskIdx * numThreads / numTasks]->tasks.push_back(taskIdx);
+
+        std::vector<std::thread> threads;
+        for (uint32_t threadIdx = 0; threadIdx < numThreads; threadIdx++)
+        {
+            threads.emplace_back([&queues, &taskFn, threadIdx, numThreads]() {
+                uint32_t taskIdx = 0;
+                while (true)
+                {
+                    // Own queue first then steal
+                    bool gotTask = queues[threadIdx]->popFront(taskIdx);
+                    for (uint32_t i = 1; !gotTask && (i < numThreads); i++)
+                        gotTask = queues[(threadIdx + i) % numThreads]->popBack(taskIdx);
+                    if (!gotTask)
+                        break;
+                    taskFn(taskIdx, threadIdx);
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+private:
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> tasks;
+        bool popFront(uint32_t& taskIdx)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+            taskIdx = tasks.front();
+            tasks.pop_front();
+            return true;
+        }
+        bool popBack(uint32_t& taskIdx)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+            taskIdx = tasks.back();
+            tasks.pop_back();
+            return true;
+        }
+    };
+};
@@ -0,0 +1,297 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM sample timebase check
+//
+// Checks the HRMSampleTimebase reconstruction of sample times:
+//   Recorded       The Time (s) columns of recorded HRM data files were stamped at the nominal 40ms within
+//                  each burst of samples read from the sensor so the intervals at burst boundaries carry the
+//                  drift and jitter. Bursts are split where the recorded interval isn't nominal, the samples
+//                  are restamped from the burst arrival (last sample) times and the tracked period is compared
+//                  with the least squares fit of arrival time against sample index. Residuals against the fit
+//                  (less their mean) and the standard deviation of the sample intervals are compared with
+//                  those of the recorded times
+//   Synthetic      Samples are produced at a known period (drifting from nominal) and read in bursts at
+//                  jittered poll times so the reconstructed times can be compared with the true sample times
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "HRMSessionLoader.h"
+#include "HRMSampleTimebase.h"
+
+// Nominal sample period and timebase settings (as HeartEarring)
+static const double NOMINAL_PERIOD_MS = 40;
+static const double TIMEBASE_WINDOW_SAMPLES_DEFAULT = 1500;
+static const double TIMEBASE_PERIOD_PRIOR_WEIGHT_DEFAULT = 2000;
+static const double TIMEBASE_MAX_PERIOD_ERROR = 0.05;
+
+// Synthetic reads - poll interval (host clock) and samples in the FIFO at the almost full interrupt
+static const double POLL_INTERVAL_MS = 200;
+static const uint32_t FIFO_READ_SAMPLES = 17;
+
+// Samples in the first part of each segment (while the timebase converges) are not included in the statistics
+static const double CONVERGENCE_MS = 20000;
+
+// Recorded intervals longer than this split the data into segments (e.g. a gap in the recording)
+static const uint32_t SEGMENT_GAP_MS = 500;
+
+// Bounds - error of the timebase period against the fitted period of recorded data (the recorded arrival
+// times wander by tens of ms over tens of seconds so the timebase period, which is fitted over a shorter window,
+// differs from the fit over the whole recording) and errors of the timebase period and of reconstructed
+// sample times (standard deviation) against the true values for synthetic data
+static const double MAX_RECORDED_PERIOD_ERROR_PPM = 1000;
+static const double MAX_SYNTHETIC_PERIOD_ERROR_PPM = 100;
+static const double MAX_SYNTHETIC_ERROR_MS = 3;
+
+struct TimedSample
+{
+    uint32_t timeMs;
+};
+
+// Running statistics
+struct ErrorStats
+{
+    uint32_t num = 0;
+    double sum = 0;
+    double sumSq = 0;
+    void add(double val)
+    {
+        num++;
+        sum += val;
+        sumSq += val * val;
+    }
+    double sd() const
+    {
+        if (num < 2)
+            return 0;
+        double mean = sum / num;
+        return sqrt(std::max(sumSq / num - mean * mean, 0.0));
+    }
+};
+
+static double timebaseWindowSamples = TIMEBASE_WINDOW_SAMPLES_DEFAULT;
+static double timebasePeriodPriorWeight = TIMEBASE_PERIOD_PRIOR_WEIGHT_DEFAULT;
+
+HRMSampleTimebase makeTimebase()
+{
+    HRMSampleTimebase timebase;
+    timebase.setup(timebaseWindowSamples, timebasePeriodPriorWeight, TIMEBASE_MAX_PERIOD_ERROR);
+    timebase.reset(NOMINAL_PERIOD_MS);
+    return timebase;
+}
+
+bool checkRecorded(const std::string& fileName, const HRMSessionData& data)
+{
+    // Split into bursts (recorded intervals within a burst are nominal) and restamp
+    const std::vector<uint32_t>& recTimes = data.timeMs;
+    uint32_t numSamples = recTimes.size();
+    std::vector<TimedSample> stamped(numSamples);
+    std::vector<double> periodAfterSample(numSamples);
+    HRMSampleTimebase timebase = makeTimebase();
+    uint32_t numBursts = 0;
+    uint32_t burstStart = 0;
+    for (uint32_t i = 0; i < numSamples; i++)
+    {
+        stamped[i].timeMs = recTimes[i];
+        bool isBurstEnd = (i + 1 == numSamples) || (recTimes[i+1] - recTimes[i] != (uint32_t)NOMINAL_PERIOD_MS);
+        if (!isBurstEnd)
+            continue;
+        timebase.restamp(stamped.data() + burstStart, i + 1 - burstStart);
+        for (uint32_t j = burstStart; j <= i; j++)
+            periodAfterSample[j] = timebase.getPeriodMs();
+        burstStart = i + 1;
+        numBursts++;
+    }
+
+    // Segments
+    ErrorStats recResidual, stampedResidual, recInterval, stampedInterval;
+    double longestSegMs = 0, refPeriodMs = 0, trackedPeriodMs = 0;
+    uint32_t numSegments = 0;
+    uint32_t segStart = 0;
+    for (uint32_t i = 0; i < numSamples; i++)
+    {
+        bool isSegEnd = (i + 1 == numSamples) || (recTimes[i+1] - recTimes[i] > SEGMENT_GAP_MS);
+        if (!isSegEnd)
+            continue;
+        uint32_t segEnd = i;
+        uint32_t segFirst = segStart;
+        segStart = i + 1;
+        numSegments++;
+
+        // Least squares fit of burst arrival (last sample) times against sample index
+        double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+        uint32_t numArrivals = 0;
+        for (uint32_t j = segFirst; j <= segEnd; j++)
+        {
+            if ((j != segEnd) && (recTimes[j+1] - recTimes[j] == (uint32_t)NOMINAL_PERIOD_MS))
+                continue;
+            double x = j - segFirst;
+            double y = (double)(recTimes[j] - recTimes[segFirst]);
+            sumX += x;
+            sumY += y;
+            sumXX += x * x;
+            sumXY += x * y;
+            numArrivals++;
+        }
+        double denom = numArrivals * sumXX - sumX * sumX;
+        if ((numArrivals < 10) || (denom <= 0))
+            continue;
+        double slope = (numArrivals * sumXY - sumX * sumY) / denom;
+        double intercept = (sumY - slope * sumX) / numArrivals;
+
+        // Residuals and intervals after convergence
+        for (uint32_t j = segFirst; j <= segEnd; j++)
+        {
+            double sinceStartMs = (double)(recTimes[j] - recTimes[segFirst]);
+            if (sinceStartMs < CONVERGENCE_MS)
+                continue;
+            double fitMs = intercept + slope * (j - segFirst);
+            recResidual.add(sinceStartMs - fitMs);
+            stampedResidual.add((double)(int32_t)(stamped[j].timeMs - recTimes[segFirst]) - fitMs);
+            recInterval.add((double)(recTimes[j] - recTimes[j-1]));
+            stampedInterval.add((double)(int32_t)(stamped[j].timeMs - stamped[j-1].timeMs));
+        }
+
+        // Period of the longest segment
+        double segMs = (double)(recTimes[segEnd] - recTimes[segFirst]);
+        if (segMs > longestSegMs)
+        {
+            longestSegMs = segMs;
+            refPeriodMs = slope;
+            trackedPeriodMs = periodAfterSample[segEnd];
+        }
+    }
+    if ((refPeriodMs <= 0) || (recInterval.num == 0))
+        return true;
+
+    // Results (residuals are reported but not checked)
+    double periodErrorPPM = (trackedPeriodMs / refPeriodMs - 1) * 1e6;
+    bool isOk = (fabs(periodErrorPPM) <= MAX_RECORDED_PERIOD_ERROR_PPM) && (stampedInterval.sd() < recInterval.sd());
+    printf("\"%s\",%u,%u,%u,%.4f,%.4f,%.0f,%.2f,%.2f,%.2f,%.2f,%u,%s\n",
+            fileName.c_str(), numSamples, numBursts, numSegments, refPeriodMs, trackedPeriodMs, periodErrorPPM,
+            recInterval.sd(), stampedInterval.sd(), recResidual.sd(), stampedResidual.sd(),
+            timebase.getNumRestarts(), isOk ? "OK" : "FAIL");
+    return isOk;
+}
+
+bool checkSynthetic(double driftPPM, uint32_t fifoReadSamples, double pollJitterMs)
+{
+    // Samples produced at the true period and read with jitter at poll times (host clock) or when the FIFO
+    // holds fifoReadSamples (interrupt)
+    const double durationMs = 300000;
+    double truePeriodMs = NOMINAL_PERIOD_MS * (1 + driftPPM * 1e-6);
+    double pollIntervalMs = fifoReadSamples > 0 ? fifoReadSamples * truePeriodMs : POLL_INTERVAL_MS;
+    HRMSampleTimebase timebase = makeTimebase();
+    uint32_t randState = 12345;
+    uint32_t nextSampleIdx = 0;
+    const double firstSampleMs = 1000.3;
+    ErrorStats stampedError, fixedError;
+    std::vector<TimedSample> burst;
+    for (double pollMs = 1000; pollMs < durationMs; pollMs += pollIntervalMs)
+    {
+        randState = randState * 1664525 + 1013904223;
+        double arrivalMs = pollMs + pollJitterMs * (randState >> 8) / (double)(1 << 24);
+        burst.clear();
+        while (firstSampleMs + nextSampleIdx * truePeriodMs <= arrivalMs)
+        {
+            burst.push_back(TimedSample{(uint32_t)arrivalMs});
+            nextSampleIdx++;
+        }
+        if (burst.empty())
+            continue;
+        timebase.restamp(burst.data(), burst.size());
+        if (arrivalMs < CONVERGENCE_MS)
+            continue;
+        uint32_t burstFirstIdx = nextSampleIdx - burst.size();
+        for (uint32_t i = 0; i < burst.size(); i++)
+        {
+            double trueMs = firstSampleMs + (burstFirstIdx + i) * truePeriodMs;
+            stampedError.add(burst[i].timeMs - trueMs);
+            fixedError.add((uint32_t)arrivalMs - (burst.size() - 1 - i) * NOMINAL_PERIOD_MS - trueMs);
+        }
+    }
+
+    // Results (errors less their mean as stamped times include the average arrival latency)
+    double periodErrorPPM = (timebase.getPeriodMs() / truePeriodMs - 1) * 1e6;
+    bool isOk = (fabs(periodErrorPPM) <= MAX_SYNTHETIC_PERIOD_ERROR_PPM) && (stampedError.sd() <= MAX_SYNTHETIC_ERROR_MS);
+    printf("%.0f,%.0f,%.0f,%.4f,%.4f,%.0f,%.2f,%.2f,%u,%s\n",
+            driftPPM, pollIntervalMs, pollJitterMs, truePeriodMs, timebase.getPeriodMs(), periodErrorPPM,
+            fixedError.sd(), stampedError.sd(), timebase.getNumRestarts(), isOk ? "OK" : "FAIL");
+    return isOk;
+}
+
+bool isSampleFile(const std::filesystem::path& path)
+{
+    // Sample files have a header line of the form Time (s),Red,IR (possibly preceded by a BOM)
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line))
+        return false;
+    return (line.find("Time (s)") != std::string::npos) && (line.find("Red,IR") != std::string::npos);
+}
+
+int main(int argc, char **argv)
+{
+    // Check args
+    if (argc <= 1)
+    {
+        std::cout << "Usage: HRMTimebaseCheck <data_folder_or_file> [window_samples] [period_prior_weight]" << std::endl;
+        return 1;
+    }
+    std::filesystem::path dataPath = argv[1];
+    if (argc > 2)
+        timebaseWindowSamples = atof(argv[2]);
+    if (argc > 3)
+        timebasePeriodPriorWeight = atof(argv[3]);
+
+    // Get files
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(dataPath))
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(dataPath))
+            if (entry.path().extension() == ".csv" && isSampleFile(entry.path()))
+                files.push_back(entry.path());
+        std::sort(files.begin(), files.end());
+    }
+    else
+    {
+        files.push_back(dataPath);
+    }
+
+    // Recorded files
+    bool allOk = true;
+    std::cout << "File,Samples,Bursts,Segments,FitPeriodMs,TrackedPeriodMs,PeriodErrPPM,RecIntervalSD,StampedIntervalSD,"
+                "RecResidualSD,StampedResidualSD,Restarts,Result" << std::endl;
+    for (const auto& file : files)
+    {
+        HRMSessionData data;
+        if (!HRMSessionLoader::load(file.string(), data, false))
+            continue;
+        allOk &= checkRecorded(file.filename().string(), data);
+    }
+
+    // Synthetic - sensor clock drift with polled (200ms) and FIFO interrupt (17 samples) reads
+    std::cout << std::endl << "DriftPPM,ReadIntervalMs,JitterMs,TruePeriodMs,TrackedPeriodMs,PeriodErrPPM,"
+                "FixedStampErrSD,StampedErrSD,Restarts,Result" << std::endl;
+    for (double driftPPM : { -20000.0, -3000.0, 0.0, 3000.0, 20000.0 })
+    {
+        allOk &= checkSynthetic(driftPPM, 0, 10);
+        allOk &= checkSynthetic(driftPPM, FIFO_READ_SAMPLES, 5);
+    }
+
+    std::cout << (allOk ? "PASSED" : "FAILED") << " period error bounds " << MAX_RECORDED_PERIOD_ERROR_PPM << " ppm (recorded) "
+                << MAX_SYNTHETIC_PERIOD_ERROR_PPM << " ppm (synthetic), synthetic sample time error bound "
+                << MAX_SYNTHETIC_ERROR_MS << " ms" << std::endl;
+    return allOk ? 0 : 1;
+}
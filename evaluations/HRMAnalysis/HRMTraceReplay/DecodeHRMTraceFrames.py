@@ -0,0 +1,105 @@
+import csv
+import re
+import struct
+import argparse
+from pathlib import Path
+
+# Frame format (see components/Jewelry/HeartEarring/HRMTrace.h)
+FRAME_MAGIC = 0xA6
+HEADER_BYTES = 4
+RECORD_BYTES = 33
+FLAG_ZERO_CROSSING = 0x01
+FLAG_PLL_UPDATED = 0x02
+FLAG_QUALITY_GATE_OPEN = 0x04
+RECORD_FORMAT = "<Iiffffff"
+
+def decode_frames(data):
+    """Decodes concatenated binary trace frames. Returns (records, frames_decoded, records_dropped)."""
+    records = []
+    frames_decoded = 0
+    records_dropped = 0
+    pos = 0
+
+    while pos + HEADER_BYTES <= len(data):
+        # Resynchronise on the magic byte
+        if data[pos] != FRAME_MAGIC:
+            pos += 1
+            continue
+        num_recs = data[pos + 1]
+        frame_len = HEADER_BYTES + num_recs * RECORD_BYTES
+        if num_recs == 0 or pos + frame_len > len(data):
+            pos += 1
+            continue
+        records_dropped += data[pos + 2] | (data[pos + 3] << 8)
+
+        # Records
+        k = pos + HEADER_BYTES
+        for i in range(num_recs):
+            time_ms, sample, filtered, measured_hz, beat_hz, pid_p, pid_i, pid_d = struct.unpack_from(RECORD_FORMAT, data, k)
+            flags = data[k + 32]
+            records.append([time_ms, sample, f"{filtered:.9g}",
+                            1 if flags & FLAG_ZERO_CROSSING else 0,
+                            1 if flags & FLAG_PLL_UPDATED else 0,
+                            f"{measured_hz:.9g}", f"{beat_hz:.9g}",
+                            f"{pid_p:.9g}", f"{pid_i:.9g}", f"{pid_d:.9g}",
+                            1 if flags & FLAG_QUALITY_GATE_OPEN else 0])
+            k += RECORD_BYTES
+
+        frames_decoded += 1
+        pos += frame_len
+
+    return records, frames_decoded, records_dropped
+
+def read_input(input_file, is_hex):
+    """Reads raw frame bytes from a binary file or from hex strings (one or more per line) in a text file."""
+    if not is_hex:
+        return Path(input_file).read_bytes()
+    data = bytearray()
+    with open(input_file, 'r') as file:
+        for line in file:
+            for hex_str in re.findall(r'\b(?:[0-9a-fA-F]{2})+\b', line):
+                if hex_str.lower().startswith("a6"):
+                    data.extend(bytes.fromhex(hex_str))
+    return bytes(data)
+
+def process_frames_file(input_file, output_file, is_hex):
+    """Decodes the trace frames and writes to CSV (as read by HRMTraceReplay)."""
+    try:
+        records, frames_decoded, records_dropped = decode_frames(read_input(input_file, is_hex))
+        with open(output_file, 'w', newline='') as csvfile:
+            writer = csv.writer(csvfile)
+            writer.writerow(["Time (ms)", "Red", "Filtered", "ZeroCross", "PLLUpdated", "Measured HR (Hz)",
+                             "Estimated HR (Hz)", "PID P", "PID I", "PID D", "QualityGate"])  # Write header
+            writer.writerows(records)
+
+        print(f"CSV file created: {output_file} records {len(records)} frames {frames_decoded} dropped records {records_dropped}")
+        return 0  # Success exit code
+
+    except Exception as e:
+        print(f"Error processing file: {e}")
+        return 1  # Failure exit code
+
+def main():
+    """Parses command-line arguments and runs the script."""
+    parser = argparse.ArgumentParser(description="Decode binary HRM trace frames (hrmtrace topic) to CSV.")
+    parser.add_argument("input_file", type=str, help="Path to the input file (binary frames or hex text with --hex)")
+    parser.add_argument("output_file", type=str, nargs="?", help="Path to the output CSV file (optional)")
+    parser.add_argument("--hex", action="store_true", help="Input is text containing frames as hex strings")
+
+    args = parser.parse_args()
+
+    # Resolve absolute paths
+    input_path = Path(args.input_file).resolve()
+    output_path = Path(args.output_file).resolve() if args.output_file else input_path.with_suffix(".csv")
+
+    # Check if input file exists
+    if not input_path.is_file():
+        print(f"Error: Input file '{input_path}' not found!")
+        exit(1)
+
+    # Process the file and exit with the appropriate status code
+    exit_code = process_frames_file(input_path, output_path, args.hex)
+    exit(exit_code)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,268 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// HRM trace replay
+//
+// generate - runs HRMAnalysis over a recorded HRM data file in sensor FIFO sized blocks (as on the device)
+//            with the trace enabled and writes the binary trace frames (as published on the hrmtrace topic)
+// replay   - replays the raw samples from a decoded trace (DecodeHRMTraceFrames.py) through HRMAnalysis
+//            and checks each stage against the trace, optionally also comparing with HRMAnalysisCPPCLI output
+//
+// Build with the same HRM_FILTER_FIXED_POINT setting as the device that produced the trace
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <stdint.h>
+#include <math.h>
+
+#include "ReadAnalogValues.h"
+#include "HRMAnalysis.h"
+
+// Publish message buffer size (as used by Jewelry)
+static const uint32_t PUBLISH_MSG_MAX_BYTES = 500;
+
+// Tolerances for comparison with the trace (values in the trace are single precision)
+static const double FLOAT_REL_TOLERANCE = 1e-5;
+static const double FILTERED_ABS_TOLERANCE = 0.01;
+
+// Tolerance for comparison of filter output with HRMAnalysisCPPCLI output (which may use a double filter)
+static const double CLI_FILTERED_ABS_TOLERANCE = 1.0;
+static const double CLI_HR_ABS_TOLERANCE = 1e-3;
+
+// Sample record with the members used by HRMAnalysis::processBlock
+struct SampleRec
+{
+    int32_t Red;
+    uint32_t timeMs;
+};
+
+// Trace record as decoded on the host
+struct TraceRec
+{
+    uint32_t timeMs = 0;
+    int32_t sample = 0;
+    double filtered = 0;
+    bool isZeroCrossing = false;
+    bool isPLLUpdated = false;
+    double measuredFreqHz = 0;
+    double beatFreqHz = 0;
+    double pidP = 0;
+    double pidI = 0;
+    double pidD = 0;
+};
+
+// Stage mismatch counts
+struct StageStats
+{
+    const char* name;
+    uint32_t mismatches = 0;
+    int32_t firstMismatchIdx = -1;
+    void check(bool isMatch, uint32_t idx)
+    {
+        if (isMatch)
+            return;
+        if (firstMismatchIdx < 0)
+            firstMismatchIdx = idx;
+        mismatches++;
+    }
+};
+
+static bool isClose(double a, double b, double absTol, double relTol = FLOAT_REL_TOLERANCE)
+{
+    return fabs(a - b) <= absTol + relTol * fmax(fabs(a), fabs(b));
+}
+
+int generate(const std::string& inFile, const std::string& outFile, uint32_t blockSize)
+{
+    auto hrmData = readHRMAnalogValues(inFile);
+    if (hrmData.timestamps.empty())
+    {
+        std::cout << "No samples in " << inFile << std::endl;
+        return 1;
+    }
+
+    // Analysis with trace enabled
+    HRMAnalysis hrmAnalysis;
+    HRMTrace hrmTrace;
+    hrmAnalysis.setTrace(&hrmTrace);
+    hrmTrace.setEnabled(true);
+
+    // Process in blocks and drain the trace after each block
+    std::ofstream outfile(outFile, std::ios::binary);
+    std::vector<SampleRec> block;
+    uint8_t msgBuf[PUBLISH_MSG_MAX_BYTES];
+    uint32_t numFrames = 0;
+    for (size_t i = 0; i < hrmData.timestamps.size(); i += blockSize)
+    {
+        block.clear();
+        for (size_t j = i; (j < i + blockSize) && (j < hrmData.timestamps.size()); j++)
+            block.push_back(SampleRec{hrmData.red_led_adc_values[j], (uint32_t)hrmData.timestamps[j]});
+        hrmAnalysis.processBlock(block.data(), block.size());
+        uint32_t frameLen = 0;
+        while ((frameLen = hrmTrace.getFrame(msgBuf, sizeof(msgBuf))) > 0)
+        {
+            outfile.write((const char*)msgBuf, frameLen);
+            numFrames++;
+        }
+    }
+    std::cout << "Trace frames " << numFrames << " records dropped " << hrmTrace.getDroppedCount() 
+              << " written to " << outFile << std::endl;
+    return 0;
+}
+
+std::vector<TraceRec> readTrace(const std::string& traceFile)
+{
+    // Format of header and data line is:
+    // Time (ms),Red,Filtered,ZeroCross,PLLUpdated,Measured HR (Hz),Estimated HR (Hz),PID P,PID I,PID D
+    std::vector<TraceRec> trace;
+    std::ifstream file(traceFile);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::vector<std::string> words = split(line, ',');
+        if ((words.size() < 10) || (words[0].find("Time") != std::string::npos))
+            continue;
+        TraceRec rec;
+        rec.timeMs = std::stoul(words[0]);
+        rec.sample = std::stol(words[1]);
+        rec.filtered = std::stod(words[2]);
+        rec.isZeroCrossing = std::stoi(words[3]) != 0;
+        rec.isPLLUpdated = std::stoi(words[4]) != 0;
+        rec.measuredFreqHz = std::stod(words[5]);
+        rec.beatFreqHz = std::stod(words[6]);
+        rec.pidP = std::stod(words[7]);
+        rec.pidI = std::stod(words[8]);
+        rec.pidD = std::stod(words[9]);
+        trace.push_back(rec);
+    }
+    return trace;
+}
+
+int replay(const std::string& traceFile, const std::string& cliFile)
+{
+    std::vector<TraceRec> trace = readTrace(traceFile);
+    if (trace.empty())
+    {
+        std::cout << "No records in " << traceFile << std::endl;
+        return 1;
+    }
+
+    // Replay the raw samples with tracing enabled on the host
+    HRMAnalysis hrmAnalysis;
+    HRMTrace hrmTrace;
+    hrmAnalysis.setTrace(&hrmTrace);
+    hrmTrace.setEnabled(true);
+    StageStats filterStats{"filter"};
+    StageStats zcdStats{"zero crossing"};
+    StageStats pllStats{"PLL"};
+    StageStats pidStats{"PID"};
+    uint32_t timeGaps = 0;
+    uint8_t frameBuf[HRMTrace::HEADER_BYTES + HRMTrace::RECORD_BYTES];
+    for (uint32_t i = 0; i < trace.size(); i++)
+    {
+        const TraceRec& rec = trace[i];
+        if ((i > 0) && (rec.timeMs - trace[i-1].timeMs > 2 * (1000 / HRMAnalysis::DEFAULT_SAMPLE_RATE_HZ)))
+            timeGaps++;
+
+        // Process and get the host trace record (serialized and parsed so the same float rounding applies)
+        hrmAnalysis.process(rec.sample, rec.timeMs);
+        if (hrmTrace.getFrame(frameBuf, sizeof(frameBuf)) == 0)
+            return 1;
+        auto getFloat = [&frameBuf](uint32_t pos) {
+            uint32_t bits = frameBuf[pos] | (frameBuf[pos+1] << 8) | (frameBuf[pos+2] << 16) | ((uint32_t)frameBuf[pos+3] << 24);
+            float val = 0;
+            memcpy(&val, &bits, sizeof(val));
+            return (double)val;
+        };
+        const uint32_t p = HRMTrace::HEADER_BYTES;
+        uint8_t flags = frameBuf[p + 32];
+
+        // Check stages
+        filterStats.check(isClose(getFloat(p + 8), rec.filtered, FILTERED_ABS_TOLERANCE), i);
+        zcdStats.check(((flags & HRMTrace::FLAG_ZERO_CROSSING) != 0) == rec.isZeroCrossing, i);
+        pllStats.check((((flags & HRMTrace::FLAG_PLL_UPDATED) != 0) == rec.isPLLUpdated) &&
+                        isClose(getFloat(p + 12), rec.measuredFreqHz, 0) &&
+                        isClose(getFloat(p + 16), rec.beatFreqHz, 0), i);
+        pidStats.check(isClose(getFloat(p + 20), rec.pidP, 1e-12) &&
+                        isClose(getFloat(p + 24), rec.pidI, 1e-12) &&
+                        isClose(getFloat(p + 28), rec.pidD, 1e-12), i);
+    }
+
+    // Report
+    std::cout << "Replayed " << trace.size() << " trace records (" << timeGaps << " time gaps)" << std::endl;
+    bool isOk = true;
+    for (const StageStats* pStats : {&filterStats, &zcdStats, &pllStats, &pidStats})
+    {
+        std::cout << "  " << pStats->name << " mismatches " << pStats->mismatches;
+        if (pStats->firstMismatchIdx >= 0)
+            std::cout << " first at " << trace[pStats->firstMismatchIdx].timeMs << "ms";
+        std::cout << std::endl;
+        if (pStats->mismatches > 0)
+            isOk = false;
+    }
+    if ((timeGaps > 0) && !isOk)
+        std::cout << "  trace has gaps (dropped records) so divergence is expected after the first gap" << std::endl;
+
+    // Compare with HRMAnalysisCPPCLI output
+    if (!cliFile.empty())
+    {
+        // Format of header is:
+        // Time (ms),Estimated HR (Hz),Estimated HR (bpm),Time to next peak (ms),Heart rate pulse interval (ms),Red LED ADC,IR LED ADC,Filtered,ZeroCross
+        std::map<uint32_t, std::vector<std::string>> cliRows;
+        std::ifstream file(cliFile);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::vector<std::string> words = split(line, ',');
+            if ((words.size() < 9) || (words[0].find("Time") != std::string::npos))
+                continue;
+            cliRows[std::stoul(words[0])] = words;
+        }
+        uint32_t numCompared = 0;
+        StageStats cliFilterStats{"filter"};
+        StageStats cliZcdStats{"zero crossing"};
+        StageStats cliHRStats{"heart rate"};
+        for (uint32_t i = 0; i < trace.size(); i++)
+        {
+            auto it = cliRows.find(trace[i].timeMs);
+            if (it == cliRows.end())
+                continue;
+            const std::vector<std::string>& words = it->second;
+            cliFilterStats.check(isClose(std::stod(words[7]), trace[i].filtered, CLI_FILTERED_ABS_TOLERANCE), i);
+            cliZcdStats.check((std::stoi(words[8]) != 0) == trace[i].isZeroCrossing, i);
+            cliHRStats.check(isClose(std::stod(words[1]), trace[i].beatFreqHz, CLI_HR_ABS_TOLERANCE), i);
+            numCompared++;
+        }
+        std::cout << "Compared " << numCompared << " records with " << cliFile << std::endl;
+        for (const StageStats* pStats : {&cliFilterStats, &cliZcdStats, &cliHRStats})
+        {
+            std::cout << "  " << pStats->name << " differences " << pStats->mismatches;
+            if (pStats->firstMismatchIdx >= 0)
+                std::cout << " first at " << trace[pStats->firstMismatchIdx].timeMs << "ms";
+            std::cout << std::endl;
+        }
+    }
+
+    std::cout << (isOk ? "PASS" : "FAIL") << std::endl;
+    return isOk ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    // Check args
+    std::string mode = argc > 1 ? argv[1] : "";
+    if ((mode == "generate") && (argc > 3))
+        return generate(argv[2], argv[3], argc > 4 ? std::stoul(argv[4]) : 5);
+    if ((mode == "replay") && (argc > 2))
+        return replay(argv[2], argc > 3 ? argv[3] : "");
+    std::cout << "Usage: HRMTraceReplay generate <input_filename> <trace_bin_filename> [<block_size>]" << std::endl;
+    std::cout << "       HRMTraceReplay replay <trace_csv_filename> [<cli_output_filename>]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,70 @@
+import json
+import argparse
+import itertools
+import subprocess
+import tempfile
+from pathlib import Path
+
+# Runs the jewelry simulation for each combination of settings and tabulates energy use
+# Settings are either Jewelry config values (e.g. HeartEarring/LEDHeart/animStepTimeUs) or energy profile
+# values prefixed with energy: (e.g. energy:sensorSampleRateHz)
+
+DEFAULT_SIM = Path(__file__).resolve().parent / "build" / "JewelrySim"
+DEFAULT_ENERGY_PROFILE = Path(__file__).resolve().parent / "energy" / "Heart1.7.json"
+ENERGY_PREFIX = "energy:"
+
+def parse_vary(vary_str):
+    """Parses name=v1,v2,... into (name, [values])."""
+    name, _, values = vary_str.partition("=")
+    if not name or not values:
+        raise argparse.ArgumentTypeError(f"Expected name=value1,value2,... got '{vary_str}'")
+    return name, values.split(",")
+
+def run_sim(sim_path, energy_profile, settings, extra_args):
+    """Runs the simulation with settings (list of (name, value)) and returns the JSON summary."""
+    with tempfile.TemporaryDirectory() as tmp_dir:
+        json_path = Path(tmp_dir) / "summary.json"
+        args = [str(sim_path), "--energy", str(energy_profile), "--json", str(json_path)] + extra_args
+        for name, value in settings:
+            if name.startswith(ENERGY_PREFIX):
+                args += ["--energy-set", f"{name[len(ENERGY_PREFIX):]}={value}"]
+            else:
+                args += ["--set", f"{name}={value}"]
+        subprocess.run(args, check=True, stdout=subprocess.DEVNULL)
+        return json.loads(json_path.read_text())
+
+def main():
+    """Parses command-line arguments and runs the comparison."""
+    parser = argparse.ArgumentParser(description="Compare simulated energy use of jewelry configurations.")
+    parser.add_argument("--vary", type=parse_vary, action="append", required=True,
+                        help="Setting and values to compare, e.g. HeartEarring/LEDHeart/brightnessPC=20,50,100 (repeat for combinations)")
+    parser.add_argument("--sim", type=Path, default=DEFAULT_SIM, help="Path to the JewelrySim executable")
+    parser.add_argument("--energy", type=Path, default=DEFAULT_ENERGY_PROFILE, help="Energy profile JSON")
+    parser.add_argument("--csv", type=Path, help="Also write the results to a CSV file")
+    args, extra_args = parser.parse_known_args()
+
+    # Run each combination
+    names = [name for name, _ in args.vary]
+    header = names + ["mAh/hour", "Awake %", "LED pulses", "Awake ms/pulse", "Pulse err ms", "Samples lost"]
+    rows = []
+    for values in itertools.product(*[values for _, values in args.vary]):
+        summary = run_sim(args.sim, args.energy, list(zip(names, values)), extra_args)
+        sim_secs = summary["simSecs"]
+        rows.append(list(values) + [f"{summary['mAhPerHour']:.3f}",
+                                    f"{summary['awakeSecs'] * 100 / sim_secs if sim_secs > 0 else 0:.1f}",
+                                    str(summary["ledPulses"]),
+                                    f"{summary['awakeMsPerPulse']:.2f}",
+                                    f"{summary['pulseIntervalErrorMeanMs']:.1f}",
+                                    str(summary.get("samplesLost", 0))])
+
+    # Output
+    widths = [max(len(row[i]) for row in [header] + rows) for i in range(len(header))]
+    for row in [header] + rows:
+        print("  ".join(val.rjust(width) for val, width in zip(row, widths)))
+    if args.csv:
+        with open(args.csv, "w") as csv_file:
+            for row in [header] + rows:
+                csv_file.write(",".join(row) + "\n")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,567 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Jewelry host simulation
+//
+// Runs the Jewelry SysMod (with the HeartEarring or GridEarring built in as on the device) against stub Raft
+// and ESP-IDF interfaces. Time is virtual - it advances by a fixed cost for each loop and sensor poll, through
+// delays and through light sleeps - so runs are deterministic and much faster than real time.
+// For the heart earring a recorded HRM session is replayed through a simulated MAX30101 FIFO and LED GPIO
+// changes are recorded to report awake time per displayed heartbeat and LED timing accuracy. Periods without
+// skin contact can be added to the replayed session (e.g. to check sensor LED power down) and the firmware can
+// be restarted after a period in reset or deep sleep (state in RTC memory is kept). The energy used
+// is estimated from the activity in the run using an energy profile (see SimEnergyModel.h). Heap allocations
+// made by the sensor data callback are counted and --check-heap fails the run if there are any. The copy of
+// the poll data that Raft allocates for each callback (RaftDeviceDataChangeCB takes it by value) is reported
+// separately and isn't checked
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#include "Jewelry.h"
+#include "SysManager.h"
+#include "DeviceManager.h"
+#include "RaftBusSystem.h"
+#include "SimClock.h"
+#include "SimGPIO.h"
+#include "SimMAX30101.h"
+#include "SimLEDC.h"
+#include "SimLEDAnalysis.h"
+#include "SimEnergyModel.h"
+#include "SimBeatTruth.h"
+#include "SimHeap.h"
+#include "HRMSessionLoader.h"
+#include "ConfigPinMap.h"
+
+bool simLogVerbose = false;
+
+// Count heap operations - all forms of the global operator new and delete are replaced (allocating with malloc
+// and freeing with free). GCC warns when it inlines the replacement delete and sees free() called on memory
+// from operator new (-Wmismatched-new-delete) so the warning is suppressed for the replacements
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(size_t size)
+{
+    SimHeap::allocCount()++;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    SimHeap::allocCount()++;
+    return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& nothrow) noexcept
+{
+    return operator new(size, nothrow);
+}
+void operator delete(void* p) noexcept
+{
+    if (p)
+        SimHeap::freeCount()++;
+    free(p);
+}
+void operator delete[](void* p) noexcept
+{
+    operator delete(p);
+}
+void operator delete(void* p, size_t size) noexcept
+{
+    operator delete(p);
+}
+void operator delete[](void* p, size_t size) noexcept
+{
+    operator delete(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    operator delete(p);
+}
+#pragma GCC diagnostic pop
+
+// Settings
+struct SimSettings
+{
+    std::string sysTypesFile = JEWELRY_SIM_DEFAULT_SYSTYPES;
+    std::string variant;
+    std::string dataFile = JEWELRY_SIM_DEFAULT_DATA;
+    std::vector<std::string> configOverrides;
+    std::vector<std::string> apiRequests;
+    double durationSecs = 0;
+    uint64_t loopCostUs = 100;
+    int64_t pollCostUs = -1;
+    uint64_t wakeupLatencyUs = 500;
+    uint32_t vsenseADC = 1650;
+    std::string gpioCSVFile;
+    std::string jsonOutFile;
+    std::string energyProfileFile;
+    std::vector<std::string> energyOverrides;
+    std::vector<std::pair<double, double>> noContactSecs;
+    std::vector<std::pair<double, double>> pollStallSecs;
+    std::vector<std::pair<double, double>> restartSecs;
+    bool checkHeap = false;
+};
+
+static bool readFile(const std::string& fileName, std::string& contents)
+{
+    std::ifstream file(fileName);
+    if (!file)
+        return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+static void usage()
+{
+    std::cout << "Usage: JewelrySim [--systypes <SysTypes.json>] [--variant <hardware_type>] [--data <hrm_csv>]" << std::endl;
+    std::cout << "                  [--duration <secs>] [--set <path>=<json_value>]... [--api <request>]..." << std::endl;
+    std::cout << "                  [--loop-cost-us <us>] [--poll-cost-us <us>] [--wake-latency-us <us>]" << std::endl;
+    std::cout << "                  [--vsense-adc <value>] [--energy <profile.json>] [--energy-set <name>=<json_value>]..." << std::endl;
+    std::cout << "                  [--no-contact <start_secs>-<end_secs>]... [--poll-stall <start_secs>-<end_secs>]..." << std::endl;
+    std::cout << "                  [--restart <start_secs>-<end_secs>]... [--gpio-csv <file>] [--json <summary_file>]" << std::endl;
+    std::cout << "                  [--check-heap] [--verbose]" << std::endl;
+    std::cout << "  --set paths are relative to the Jewelry config, e.g. HeartEarring/LEDHeart/brightnessPC=50" << std::endl;
+    std::cout << "  --energy-set names are energy profile values, e.g. sensorSampleRateHz=50" << std::endl;
+    std::cout << "  --api requests are made after setup, e.g. jewelry/hrmtrace/on" << std::endl;
+    std::cout << "  --no-contact periods are times (from the start of the run) when the sensor is not on the skin" << std::endl;
+    std::cout << "  --poll-stall periods are times when sensor polls are delayed (samples are lost if the FIFO overflows)" << std::endl;
+    std::cout << "  --restart periods are times when the processor is in reset or deep sleep - the firmware then restarts" << std::endl;
+    std::cout << "    (firmware stats reported are from the last start)" << std::endl;
+    std::cout << "  --check-heap fails the run if the sensor data callback allocates from the heap (Raft's copy of the" << std::endl;
+    std::cout << "    poll data passed to the callback is reported but not checked)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    // Args
+    SimSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasVal = i + 1 < argc;
+        if ((arg == "--systypes") && hasVal)
+            settings.sysTypesFile = argv[++i];
+        else if ((arg == "--variant") && hasVal)
+            settings.variant = argv[++i];
+        else if ((arg == "--data") && hasVal)
+            settings.dataFile = argv[++i];
+        else if ((arg == "--duration") && hasVal)
+            settings.durationSecs = atof(argv[++i]);
+        else if ((arg == "--set") && hasVal)
+            settings.configOverrides.push_back(argv[++i]);
+        else if ((arg == "--api") && hasVal)
+            settings.apiRequests.push_back(argv[++i]);
+        else if ((arg == "--loop-cost-us") && hasVal)
+            settings.loopCostUs = strtoull(argv[++i], nullptr, 10);
+        else if ((arg == "--poll-cost-us") && hasVal)
+            settings.pollCostUs = strtoll(argv[++i], nullptr, 10);
+        else if ((arg == "--wake-latency-us") && hasVal)
+            settings.wakeupLatencyUs = strtoull(argv[++i], nullptr, 10);
+        else if ((arg == "--vsense-adc") && hasVal)
+            settings.vsenseADC = strtoul(argv[++i], nullptr, 10);
+        else if ((arg == "--gpio-csv") && hasVal)
+            settings.gpioCSVFile = argv[++i];
+        else if ((arg == "--json") && hasVal)
+            settings.jsonOutFile = argv[++i];
+        else if ((arg == "--energy") && hasVal)
+            settings.energyProfileFile = argv[++i];
+        else if ((arg == "--energy-set") && hasVal)
+            settings.energyOverrides.push_back(argv[++i]);
+        else if ((arg == "--no-contact") && hasVal)
+        {
+            double startSecs = 0, endSecs = 0;
+            if (sscanf(argv[++i], "%lf-%lf", &startSecs, &endSecs) != 2)
+            {
+                usage();
+                return 1;
+            }
+            settings.noContactSecs.push_back(std::make_pair(startSecs, endSecs));
+        }
+        else if ((arg == "--poll-stall") && hasVal)
+        {
+            double startSecs = 0, endSecs = 0;
+            if (sscanf(argv[++i], "%lf-%lf", &startSecs, &endSecs) != 2)
+            {
+                usage();
+                return 1;
+            }
+            settings.pollStallSecs.push_back(std::make_pair(startSecs, endSecs));
+        }
+        else if ((arg == "--restart") && hasVal)
+        {
+            double startSecs = 0, endSecs = 0;
+            if ((sscanf(argv[++i], "%lf-%lf", &startSecs, &endSecs) != 2) || (endSecs < startSecs))
+            {
+                usage();
+                return 1;
+            }
+            settings.restartSecs.push_back(std::make_pair(startSecs, endSecs));
+        }
+        else if (arg == "--check-heap")
+            settings.checkHeap = true;
+        else if (arg == "--verbose")
+            simLogVerbose = true;
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    // System configuration (with overrides)
+    std::string sysTypesJson;
+    if (!readFile(settings.sysTypesFile, sysTypesJson))
+    {
+        std::cout << "Failed to read " << settings.sysTypesFile << std::endl;
+        return 1;
+    }
+    RaftJson sysConfig(sysTypesJson.c_str(), settings.variant.c_str());
+    for (const std::string& configOverride : settings.configOverrides)
+    {
+        size_t eqPos = configOverride.find('=');
+        if (eqPos == std::string::npos)
+        {
+            usage();
+            return 1;
+        }
+        sysConfig.setFromJSON(("Jewelry/" + configOverride.substr(0, eqPos)).c_str(), configOverride.substr(eqPos + 1).c_str());
+    }
+    RaftJsonPrefixed jewelryConfig(sysConfig, "Jewelry");
+
+    // Energy profile (with overrides)
+    std::string energyProfileJson = "{}";
+    if (!settings.energyProfileFile.empty() && !readFile(settings.energyProfileFile, energyProfileJson))
+    {
+        std::cout << "Failed to read " << settings.energyProfileFile << std::endl;
+        return 1;
+    }
+    RaftJson energyConfig(energyProfileJson.c_str());
+    for (const std::string& energyOverride : settings.energyOverrides)
+    {
+        size_t eqPos = energyOverride.find('=');
+        if (eqPos == std::string::npos)
+        {
+            usage();
+            return 1;
+        }
+        energyConfig.setFromJSON(energyOverride.substr(0, eqPos).c_str(), energyOverride.substr(eqPos + 1).c_str());
+    }
+    SimEnergyModel::Profile energyProfile;
+    energyProfile.setFromJSON(energyConfig);
+
+    // Simulated hardware
+    SimClock& clock = SimClock::get();
+    clock.setWakeupLatencyUs(settings.wakeupLatencyUs);
+    SimGPIO::get().setAnalogValue(ConfigPinMap::getPinFromName(jewelryConfig.getString("PowerControl/vsensePin", "").c_str()), 
+                settings.vsenseADC);
+    DeviceManager deviceManager;
+    clock.setGPIOWakeupEventFn([&deviceManager]() { return deviceManager.getNextInterruptUs(); });
+
+    // Heart rate sensor replaying a recorded session
+    uint64_t durationUs = settings.durationSecs * 1000000;
+#ifdef FEATURE_HEART_JEWELRY
+    HRMSessionData session;
+    if (!HRMSessionLoader::load(settings.dataFile, session, false) || (session.size() == 0))
+    {
+        std::cout << "Failed to read HRM data " << settings.dataFile << std::endl;
+        return 1;
+    }
+
+    // Poll cost defaults to the I2C transfer time (address, register and response bytes) plus processing
+    double i2cFreqHz = sysConfig.getDouble("DevMan/Buses/buslist[0]/i2cFreq", 100000);
+    uint32_t i2cBytes = 3 + DeviceTypeRecords::MAX30101_POLL_RESP_BYTES;
+    uint64_t i2cTransferUs = i2cBytes * 9 * 1000000 / i2cFreqHz;
+    uint64_t pollCostUs = settings.pollCostUs < 0 ? i2cTransferUs + 200 : settings.pollCostUs;
+
+    // The sensor is polled by the device manager if its device type has pollInfo - the DevTypes.json next to
+    // the SysTypes.json (if there is one) or the built-in device type (polled every 200ms)
+    std::string devTypesFile = settings.sysTypesFile.substr(0, settings.sysTypesFile.find_last_of("/\\") + 1) + "DevTypes.json";
+    std::string devTypesJson;
+    uint64_t pollIntervalUs = 200000;
+    if (readFile(devTypesFile, devTypesJson))
+        pollIntervalUs = RaftJson(devTypesJson.c_str()).getLong("devTypes/MAX30101/pollInfo/i", 0) * 1000;
+    SimMAX30101 hrmSensor(session, 0, pollIntervalUs, pollCostUs);
+    for (const auto& noContact : settings.noContactSecs)
+        hrmSensor.addNoContactPeriod(noContact.first * 1000000, noContact.second * 1000000);
+    for (const auto& pollStall : settings.pollStallSecs)
+        hrmSensor.addPollStallPeriod(pollStall.first * 1000000, pollStall.second * 1000000);
+    raftBusSystem.getBusByName("I2CA")->addDevice(&hrmSensor);
+    raftBusSystem.getBusByName("I2CA")->setFreqHz(i2cFreqHz);
+
+    // In FIFO interrupt mode the sensor is also read by the heart earring when its INT pin (active low) is
+    // asserted
+    if (pollIntervalUs > 0)
+        deviceManager.addDevice(&hrmSensor);
+    int fifoIntPin = jewelryConfig.getLong("HeartEarring/HRMSensor/fifoInterrupt/intPin", -1);
+    if (jewelryConfig.getBool("HeartEarring/HRMSensor/fifoInterrupt/enable", false) && (fifoIntPin >= 0))
+    {
+        SimGPIO::get().setInputFn(fifoIntPin, [&hrmSensor, &clock]() { return !hrmSensor.isInterruptActive(clock.nowUs()); });
+        clock.setGPIOWakeupEventFn([&hrmSensor]() { return hrmSensor.getNextInterruptUs(); });
+    }
+    if (durationUs == 0)
+        durationUs = hrmSensor.getSessionDurationUs();
+#endif
+    if (durationUs == 0)
+        durationUs = 60000000;
+
+    // SysManager with the Jewelry SysMod (created again when the firmware restarts)
+    std::unique_ptr<SysManager> pSysManager;
+    std::unique_ptr<RaftSysMod> pJewelry;
+    auto startFirmware = [&]() {
+        pSysManager.reset(new SysManager());
+        pSysManager->setDeviceManager(&deviceManager);
+        pJewelry.reset(Jewelry::create("Jewelry", sysConfig));
+        pSysManager->add(pJewelry.get());
+        pSysManager->setup();
+        for (const std::string& apiRequest : settings.apiRequests)
+        {
+            String respStr;
+            if (!pSysManager->getRestAPIEndpointManager().handleApiRequest(apiRequest.c_str(), respStr))
+                std::cout << "API request not handled " << apiRequest << std::endl;
+        }
+    };
+    startFirmware();
+
+    // Run
+    std::vector<SimLEDAnalysis::HeartRateSample> heartRates;
+    uint64_t numLoops = 0;
+    uint32_t restartIdx = 0;
+    while ((clock.nowUs() < durationUs) && !clock.isPoweredDown())
+    {
+        // Restart the firmware after a period in reset or deep sleep
+        if ((restartIdx < settings.restartSecs.size()) && (clock.nowUs() >= settings.restartSecs[restartIdx].first * 1000000))
+        {
+            pJewelry.reset();
+            pSysManager.reset();
+            deviceManager.clearDeviceDataCallbacks();
+            uint64_t restartUs = settings.restartSecs[restartIdx].second * 1000000;
+            if (restartUs > clock.nowUs())
+                clock.deepSleep(restartUs - clock.nowUs());
+#ifdef FEATURE_HEART_JEWELRY
+            hrmSensor.restoreInitSettings(clock.nowUs());
+#endif
+            startFirmware();
+            restartIdx++;
+        }
+
+        // Device polling (as DeviceManager does when awake)
+        deviceManager.service();
+
+        // Main loop
+        clock.awake(settings.loopCostUs);
+        pSysManager->loop();
+        numLoops++;
+
+        // Heart rate as reported by the firmware
+        bool isValid = false;
+        double heartRateBPM = pJewelry->getNamedValue("heartRate", isValid);
+        if (isValid && (heartRates.empty() || (heartRates.back().heartRateBPM != heartRateBPM)))
+            heartRates.push_back(SimLEDAnalysis::HeartRateSample{clock.nowUs(), heartRateBPM});
+    }
+    uint64_t endUs = clock.nowUs();
+
+    // LED timing
+    std::vector<String> ledPinStrs;
+    jewelryConfig.getArrayElems("HeartEarring/LEDHeart/ledPins", ledPinStrs);
+    std::vector<int> ledPins;
+    for (const String& pinStr : ledPinStrs)
+        ledPins.push_back(ConfigPinMap::getPinFromName(pinStr.c_str()));
+    SimLEDAnalysis ledAnalysis;
+    ledAnalysis.analyse(SimGPIO::get().getEvents(), ledPins, jewelryConfig.getBool("HeartEarring/LEDHeart/ledActiveLevel", false),
+                jewelryConfig.getLong("HeartEarring/LEDHeart/animStepTimeUs", 25000) * 
+                        jewelryConfig.getDouble("HeartEarring/LEDHeart/animTimeScale", 1.0), heartRates, endUs);
+
+    // Displayed pulse peaks against the reference beat peaks (positive errors are late) and the time from the last
+    // restart until the pulses are back in phase (RELOCK_PULSES consecutive peaks within RELOCK_ERROR_MS)
+    SimLEDAnalysis::ErrorStats beatPhaseErrorMs;
+    double beatPhaseErrorSumMs = 0;
+#ifdef FEATURE_HEART_JEWELRY
+    static const uint32_t RELOCK_PULSES = 5;
+    static constexpr double RELOCK_ERROR_MS = 100;
+    uint64_t lastRestartUs = settings.restartSecs.empty() ? 0 : settings.restartSecs.back().second * 1000000;
+    double relockSecs = -1;
+    uint32_t relockCount = 0;
+    SimBeatTruth beatTruth;
+    beatTruth.analyse(session, jewelryConfig.getDouble("HeartEarring/HRMSensor/sampleRateHz", 25),
+                jewelryConfig.getDouble("HeartEarring/HRMFilter/freqBandLowerHz", 0.75),
+                jewelryConfig.getDouble("HeartEarring/HRMFilter/freqBandUpperHz", 3.0));
+    for (uint64_t pulsePeakUs : ledAnalysis.pulsePeakTimesUs)
+    {
+        double errorMs = 0;
+        if (!beatTruth.getErrorMs(pulsePeakUs / 1000.0, errorMs))
+            continue;
+        beatPhaseErrorMs.add(errorMs);
+        beatPhaseErrorSumMs += errorMs;
+        if ((relockSecs >= 0) || (pulsePeakUs < lastRestartUs))
+            continue;
+        relockCount = fabs(errorMs) <= RELOCK_ERROR_MS ? relockCount + 1 : 0;
+        if (relockCount >= RELOCK_PULSES)
+            relockSecs = (pulsePeakUs - lastRestartUs) / 1e6;
+    }
+#endif
+    double beatPhaseErrorMeanMs = beatPhaseErrorMs.count > 0 ? beatPhaseErrorSumMs / beatPhaseErrorMs.count : 0;
+
+    // Firmware beat phase predictor stats
+    bool isPredictorValid = false;
+    double predictorErrorMs = pJewelry->getNamedValue("beatPhaseErrorMs", isPredictorValid);
+
+    // Energy
+    SimEnergyModel::Activity activity;
+    activity.durationUs = endUs;
+    activity.awakeUs = clock.getAwakeUs();
+    activity.sleepUs = clock.getSleepUs();
+#ifdef FEATURE_HEART_JEWELRY
+    activity.i2cActiveUs = hrmSensor.getI2CBytes() * 9 * 1000000 / i2cFreqHz;
+    activity.sensorActiveUs = endUs;
+    activity.sensorLEDUs = hrmSensor.getLEDInitEquivUs(endUs);
+#endif
+    // LEDs driven by PWM are on (at full current) for the duty weighted time rather than the time the pin is active
+    if (SimLEDC::get().isInUse())
+        ledAnalysis.onTimeUsByPin = SimLEDC::get().getOnTimeUsByPin(endUs);
+    for (int ledPin : ledPins)
+        activity.ledOnUs.push_back(ledAnalysis.onTimeUsByPin.count(ledPin) ? ledAnalysis.onTimeUsByPin[ledPin] : 0);
+    SimEnergyModel::Result energy = SimEnergyModel::calculate(energyProfile, activity);
+
+    // Report
+    double simSecs = endUs / 1e6;
+    double awakeSecs = clock.getAwakeUs() / 1e6;
+    double awakeMsPerPulse = ledAnalysis.numPulses > 0 ? clock.getAwakeUs() / 1000.0 / ledAnalysis.numPulses : 0;
+    printf("Simulated %.1fs loops %llu awake %.2fs (%.1f%%) sleeps %u%s\n", simSecs, (unsigned long long)numLoops,
+                awakeSecs, simSecs > 0 ? awakeSecs * 100 / simSecs : 0, clock.getSleepCount(),
+                clock.isPoweredDown() ? " POWERED DOWN" : "");
+#ifdef FEATURE_HEART_JEWELRY
+    printf("Sensor polls %u reads %u I2C bytes %llu samples read %u lost (FIFO overflow) %u unreported (FIFO full) %u\n", 
+                hrmSensor.getNumPolls(), hrmSensor.getNumReads(), (unsigned long long)hrmSensor.getI2CBytes(), 
+                hrmSensor.getSamplesRead(), hrmSensor.getSamplesLost(), hrmSensor.getSamplesUnreported());
+    printf("Sensor data callbacks %u heap allocations %llu (Raft poll data copies %llu)\n", deviceManager.getNumCallbacks(), 
+                (unsigned long long)deviceManager.getCallbackHeapAllocs(), 
+                (unsigned long long)deviceManager.getPollDataCopyHeapAllocs());
+    bool isGapCountValid = false;
+    printf("Sensor samples lost (reported) %.0f gaps bridged %.0f restarted %.0f\n", 
+                pJewelry->getNamedValue("sensorSamplesLost", isGapCountValid),
+                pJewelry->getNamedValue("sensorGapsBridged", isGapCountValid),
+                pJewelry->getNamedValue("sensorGapsRestarted", isGapCountValid));
+    bool isRestoredValid = false;
+    double hrmStateRestoredAgeMs = pJewelry->getNamedValue("hrmStateRestoredAgeMs", isRestoredValid);
+    if (!settings.restartSecs.empty())
+        printf("Restarts %u HRM state restored at last start %s age %.1fs pulses in phase after %.1fs\n", 
+                    (unsigned)settings.restartSecs.size(), isRestoredValid ? "Y" : "N", 
+                    isRestoredValid ? hrmStateRestoredAgeMs / 1000 : 0, relockSecs);
+    bool isConfidenceValid = false;
+    double hrmConfidence = pJewelry->getNamedValue("hrmConfidence", isConfidenceValid);
+    printf("Sensor setting changes %u reduced rate %.1fs LED reduced %.1fs LED charge %.1f%% final confidence %.2f\n", 
+                hrmSensor.getNumSettingChanges(), hrmSensor.getReducedRateUs(endUs) / 1e6, hrmSensor.getLEDReducedUs(endUs) / 1e6,
+                endUs > 0 ? hrmSensor.getLEDInitEquivUs(endUs) * 100.0 / endUs : 0,
+                isConfidenceValid ? hrmConfidence : 0);
+#endif
+    printf("LED pulses %u steps %u awake per pulse %.2fms\n", ledAnalysis.numPulses, ledAnalysis.numSteps, awakeMsPerPulse);
+    printf("LED step interval error mean %.1fus max %.1fus\n", 
+                ledAnalysis.stepIntervalErrorUs.meanAbs(), ledAnalysis.stepIntervalErrorUs.maxAbs);
+    printf("LED pulse interval error vs heart rate mean %.1fms max %.1fms\n", 
+                ledAnalysis.pulseIntervalErrorMs.meanAbs(), ledAnalysis.pulseIntervalErrorMs.maxAbs);
+    printf("LED pulse peak vs beat peak (zero phase reference) mean %.1fms meanAbs %.1fms max %.1fms pulses %u\n",
+                beatPhaseErrorMeanMs, beatPhaseErrorMs.meanAbs(), beatPhaseErrorMs.maxAbs, beatPhaseErrorMs.count);
+    if (isPredictorValid)
+    {
+        bool isValid = false;
+        printf("Beat predictor phase error meanAbs %.1fms mean %.1fms rms %.1fms beats %.0f signal delay %.1fms "
+                "sample latency %.1fms wake latency %.2fms\n", predictorErrorMs,
+                pJewelry->getNamedValue("beatPhaseErrorMeanMs", isValid), pJewelry->getNamedValue("beatPhaseErrorRMSMs", isValid),
+                pJewelry->getNamedValue("beatCount", isValid), pJewelry->getNamedValue("beatSignalDelayMs", isValid),
+                pJewelry->getNamedValue("beatSampleLatencyMs", isValid), pJewelry->getNamedValue("beatWakeLatencyMs", isValid));
+    }
+    for (const auto& onTime : ledAnalysis.onTimeUsByPin)
+        printf("LED pin %d on %.2fms\n", onTime.first, onTime.second / 1000.0);
+    for (const SysManager::PublishStats& pubStats : pSysManager->getPublishStats())
+        printf("Publish %s msgs %u bytes %llu\n", pubStats.topic.c_str(), pubStats.numMsgs, (unsigned long long)pubStats.numBytes);
+    if (!heartRates.empty())
+        printf("Final heart rate %.1f BPM\n", heartRates.back().heartRateBPM);
+    printf("Energy %.3fmAh/hour (avg %.3fmA) CPU awake %.1f%% CPU sleep %.1f%% I2C %.1f%% LEDs %.1f%% sensor %.1f%% BLE %.1f%%\n",
+                energy.mAhPerHour(), energy.avgMA(), energy.pc(energy.cpuAwakeMAs), energy.pc(energy.cpuSleepMAs), 
+                energy.pc(energy.i2cMAs), energy.pc(energy.ledMAs), energy.pc(energy.sensorMAs), energy.pc(energy.bleMAs));
+    if ((energyProfile.batteryMAh > 0) && (energy.avgMA() > 0))
+        printf("Battery %.0fmAh life %.1f hours\n", energyProfile.batteryMAh, energyProfile.batteryMAh / energy.avgMA());
+
+    // GPIO events
+    if (!settings.gpioCSVFile.empty())
+    {
+        std::ofstream gpioFile(settings.gpioCSVFile);
+        gpioFile << "Time (us),Pin,Level" << std::endl;
+        for (const SimGPIO::Event& event : SimGPIO::get().getEvents())
+            gpioFile << event.timeUs << "," << event.pin << "," << (event.level ? 1 : 0) << std::endl;
+    }
+
+    // JSON summary
+    if (!settings.jsonOutFile.empty())
+    {
+        std::ofstream out(settings.jsonOutFile);
+        out << "{\n";
+        out << "  \"simSecs\": " << simSecs << ",\n";
+        out << "  \"awakeSecs\": " << awakeSecs << ",\n";
+        out << "  \"sleepSecs\": " << clock.getSleepUs() / 1e6 << ",\n";
+        out << "  \"sleepCount\": " << clock.getSleepCount() << ",\n";
+        out << "  \"poweredDown\": " << (clock.isPoweredDown() ? "true" : "false") << ",\n";
+#ifdef FEATURE_HEART_JEWELRY
+        out << "  \"sensorPolls\": " << hrmSensor.getNumPolls() << ",\n";
+        out << "  \"sensorReads\": " << hrmSensor.getNumReads() << ",\n";
+        out << "  \"sensorI2CBytes\": " << hrmSensor.getI2CBytes() << ",\n";
+        out << "  \"sensorCallbacks\": " << deviceManager.getNumCallbacks() << ",\n";
+        out << "  \"sensorCallbackHeapAllocs\": " << deviceManager.getCallbackHeapAllocs() << ",\n";
+        out << "  \"sensorPollDataCopyHeapAllocs\": " << deviceManager.getPollDataCopyHeapAllocs() << ",\n";
+        out << "  \"samplesRead\": " << hrmSensor.getSamplesRead() << ",\n";
+        out << "  \"samplesLost\": " << hrmSensor.getSamplesLost() << ",\n";
+        bool isGapCountValid = false;
+        out << "  \"samplesLostReported\": " << pJewelry->getNamedValue("sensorSamplesLost", isGapCountValid) << ",\n";
+        out << "  \"sampleGapsBridged\": " << pJewelry->getNamedValue("sensorGapsBridged", isGapCountValid) << ",\n";
+        out << "  \"sampleGapsRestarted\": " << pJewelry->getNamedValue("sensorGapsRestarted", isGapCountValid) << ",\n";
+        if (!settings.restartSecs.empty())
+            out << "  \"restartRelockSecs\": " << relockSecs << ",\n";
+        out << "  \"sensorLEDReducedSecs\": " << hrmSensor.getLEDReducedUs(endUs) / 1e6 << ",\n";
+        out << "  \"sensorReducedRateSecs\": " << hrmSensor.getReducedRateUs(endUs) / 1e6 << ",\n";
+#endif
+        out << "  \"ledPulses\": " << ledAnalysis.numPulses << ",\n";
+        out << "  \"awakeMsPerPulse\": " << awakeMsPerPulse << ",\n";
+        out << "  \"stepIntervalErrorMeanUs\": " << ledAnalysis.stepIntervalErrorUs.meanAbs() << ",\n";
+        out << "  \"stepIntervalErrorMaxUs\": " << ledAnalysis.stepIntervalErrorUs.maxAbs << ",\n";
+        out << "  \"pulseIntervalErrorMeanMs\": " << ledAnalysis.pulseIntervalErrorMs.meanAbs() << ",\n";
+        out << "  \"pulseIntervalErrorMaxMs\": " << ledAnalysis.pulseIntervalErrorMs.maxAbs << ",\n";
+        out << "  \"beatPhaseErrorMeanMs\": " << beatPhaseErrorMeanMs << ",\n";
+        out << "  \"beatPhaseErrorMeanAbsMs\": " << beatPhaseErrorMs.meanAbs() << ",\n";
+        out << "  \"mAhPerHour\": " << energy.mAhPerHour() << ",\n";
+        out << "  \"energyMAs\": {\"cpuAwake\": " << energy.cpuAwakeMAs << ", \"cpuSleep\": " << energy.cpuSleepMAs
+                << ", \"i2c\": " << energy.i2cMAs << ", \"leds\": " << energy.ledMAs << ", \"sensor\": " << energy.sensorMAs
+                << ", \"ble\": " << energy.bleMAs << "}\n";
+        out << "}\n";
+    }
+
+    // Heap check
+    if (settings.checkHeap && (deviceManager.getCallbackHeapAllocs() > 0))
+    {
+        std::cout << "Heap check failed - sensor data callback heap allocations " << deviceManager.getCallbackHeapAllocs() << std::endl;
+        return 1;
+    }
+    return 0;
+}
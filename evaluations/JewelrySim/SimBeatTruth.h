@@ -0,0 +1,87 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Reference beat peaks for a recorded HRM session
+//
+// The session is bandpass filtered forwards and backwards (zero phase so there is no filter delay) and
+// the peak of each beat is the interpolated maximum of the filtered signal between falling zero crossings.
+// Displayed LED pulse peaks are compared against these to measure how far the display lags (or leads)
+// the actual heart beat
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "BiquadCascade.h"
+#include "ButterworthDesign.h"
+#include "HRMSessionLoader.h"
+
+class SimBeatTruth
+{
+public:
+    // Find peaks (times in ms relative to the first sample) - peaks within settleMs of either end are ignored
+    // as the filter has not settled
+    void analyse(const HRMSessionData& session, double sampleRateHz, double freqBandLowerHz, double freqBandUpperHz,
+                double settleMs = 5000)
+    {
+        peakTimesMs.clear();
+        if (session.size() < 3)
+            return;
+
+        // Zero phase bandpass filter
+        typedef BiquadCascade<2, double> Filter;
+        Filter filter(ButterworthDesign::bandpass<2>(sampleRateHz, freqBandLowerHz, freqBandUpperHz));
+        std::vector<double> filtered(session.size());
+        for (size_t i = 0; i < session.size(); i++)
+            filtered[i] = filter.process(session.red[i]);
+        filter.reset();
+        for (size_t i = session.size(); i-- > 0;)
+            filtered[i] = filter.process(filtered[i]);
+
+        // Maximum between falling zero crossings
+        double lastTimeMs = session.timeMs.back() - session.timeMs[0];
+        size_t segStart = 0;
+        for (size_t i = 1; i < session.size(); i++)
+        {
+            if (!((filtered[i - 1] >= 0) && (filtered[i] < 0)))
+                continue;
+            size_t maxIdx = std::max_element(filtered.begin() + segStart, filtered.begin() + i) - filtered.begin();
+            segStart = i;
+            if ((maxIdx == 0) || (maxIdx + 1 >= session.size()) || (filtered[maxIdx] <= 0))
+                continue;
+
+            // Parabolic interpolation of the peak
+            double y0 = filtered[maxIdx - 1], y1 = filtered[maxIdx], y2 = filtered[maxIdx + 1];
+            double denom = y0 - 2 * y1 + y2;
+            double offset = denom != 0 ? 0.5 * (y0 - y2) / denom : 0;
+            double t0 = session.timeMs[maxIdx] - session.timeMs[0];
+            double tNext = session.timeMs[offset >= 0 ? maxIdx + 1 : maxIdx - 1] - session.timeMs[0];
+            double peakMs = t0 + offset * fabs(tNext - t0);
+            if ((peakMs >= settleMs) && (peakMs <= lastTimeMs - settleMs))
+                peakTimesMs.push_back(peakMs);
+        }
+    }
+
+    // Signed error of a time against the nearest peak (wrapped to +/- half the local beat period)
+    // Returns false if there is no peak near the time
+    bool getErrorMs(double timeMs, double& errorMs) const
+    {
+        if (peakTimesMs.size() < 2)
+            return false;
+        auto it = std::lower_bound(peakTimesMs.begin(), peakTimesMs.end(), timeMs);
+        if ((it == peakTimesMs.begin()) || (it == peakTimesMs.end()))
+            return false;
+        double nextMs = *it;
+        double prevMs = *(it - 1);
+        errorMs = (timeMs - prevMs) < (nextMs - timeMs) ? timeMs - prevMs : timeMs - nextMs;
+        return true;
+    }
+
+    // Peak times
+    std::vector<double> peakTimesMs;
+};
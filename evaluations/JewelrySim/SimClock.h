@@ -0,0 +1,138 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Simulation virtual clock
+//
+// Deterministic time base for the host simulation. Time only advances when the simulated firmware does work
+// (a fixed cost per loop, poll, etc), blocks in delay() or enters light sleep. Light sleep advances the clock
+// to the earliest enabled wakeup source and the time spent awake and asleep is accumulated
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+class SimClock
+{
+public:
+    // Get the clock (there is one per simulation)
+    static SimClock& get()
+    {
+        static SimClock clock;
+        return clock;
+    }
+
+    // Current time
+    uint64_t nowUs() const
+    {
+        return _nowUs;
+    }
+
+    // Time since the firmware started (micros() and millis() restart from 0 when the firmware restarts)
+    uint64_t firmwareUs() const
+    {
+        return _nowUs - _firmwareStartUs;
+    }
+
+    // Advance time while awake (CPU running or blocked in a busy delay)
+    void awake(uint64_t durationUs)
+    {
+        _nowUs += durationUs;
+        _awakeUs += durationUs;
+    }
+
+    // Wakeup sources
+    void enableTimerWakeup(uint64_t durationUs)
+    {
+        _timerWakeupUs = durationUs;
+        _timerWakeupEnabled = true;
+    }
+    void enableGPIOWakeup()
+    {
+        _gpioWakeupEnabled = true;
+    }
+    void disableWakeupSources()
+    {
+        _timerWakeupEnabled = false;
+        _gpioWakeupEnabled = false;
+    }
+
+    // Time of next GPIO wakeup event (e.g. sensor FIFO interrupt) - UINT64_MAX if none
+    void setGPIOWakeupEventFn(std::function<uint64_t()> nextGPIOEventUsFn)
+    {
+        _nextGPIOEventUsFn = nextGPIOEventUsFn;
+    }
+
+    // Light sleep - returns false if there is no wakeup source (the device is then powered down)
+    bool lightSleep()
+    {
+        uint64_t wakeUs = UINT64_MAX;
+        if (_timerWakeupEnabled)
+            wakeUs = _nowUs + _timerWakeupUs;
+        if (_gpioWakeupEnabled && _nextGPIOEventUsFn)
+        {
+            uint64_t gpioEventUs = _nextGPIOEventUsFn();
+            if (gpioEventUs < wakeUs)
+                wakeUs = gpioEventUs > _nowUs ? gpioEventUs : _nowUs;
+        }
+        if (wakeUs == UINT64_MAX)
+        {
+            _isPoweredDown = true;
+            return false;
+        }
+        _sleepUs += wakeUs - _nowUs;
+        _nowUs = wakeUs;
+        _sleepCount++;
+        awake(_wakeupLatencyUs);
+        return true;
+    }
+
+    // Deep sleep or held in reset for a time (counted as sleep) - the firmware then restarts
+    void deepSleep(uint64_t durationUs)
+    {
+        _sleepUs += durationUs;
+        _nowUs += durationUs;
+        _sleepCount++;
+        _firmwareStartUs = _nowUs;
+    }
+
+    // Wakeup latency (time awake after each light sleep before code runs)
+    void setWakeupLatencyUs(uint64_t latencyUs)
+    {
+        _wakeupLatencyUs = latencyUs;
+    }
+
+    // Stats
+    uint64_t getAwakeUs() const
+    {
+        return _awakeUs;
+    }
+    uint64_t getSleepUs() const
+    {
+        return _sleepUs;
+    }
+    uint32_t getSleepCount() const
+    {
+        return _sleepCount;
+    }
+    bool isPoweredDown() const
+    {
+        return _isPoweredDown;
+    }
+
+private:
+    uint64_t _nowUs = 0;
+    uint64_t _firmwareStartUs = 0;
+    uint64_t _awakeUs = 0;
+    uint64_t _sleepUs = 0;
+    uint32_t _sleepCount = 0;
+    uint64_t _wakeupLatencyUs = 0;
+    uint64_t _timerWakeupUs = 0;
+    bool _timerWakeupEnabled = false;
+    bool _gpioWakeupEnabled = false;
+    bool _isPoweredDown = false;
+    std::function<uint64_t()> _nextGPIOEventUsFn;
+};
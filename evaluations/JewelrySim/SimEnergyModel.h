@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Simulation energy model
+//
+// Integrates supply current over a simulated run using per-component current figures from an energy
+// profile (JSON). Each component is charged for the time it is active:
+//   CPU         awake time at cpuAwakeMA and light sleep time at lightSleepMA
+//   I2C         sensor poll (bus transfer) time at i2cActiveMA (in addition to the CPU)
+//   LEDs        on time of each LED pin at ledOnMA (a single value or an array indexed by LED)
+//   Sensor      supply current plus the average of its LED pulses, which depends on the sample rate
+//               (sensorSampleRateHz * sensorSampleAvg conversions per second, each pulsing
+//               sensorLEDsPerSample LEDs at sensorLEDMA for sensorPulseWidthUs). The LED part is charged
+//               for the time equivalent to the LEDs being at sensorLEDMA (less if the LED current is reduced)
+//   Radio       bleAvgMA as a constant average (BLE connection / advertising)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include "RaftJson.h"
+
+class SimEnergyModel
+{
+public:
+    // Profile
+    struct Profile
+    {
+        double cpuAwakeMA = 22.0;
+        double lightSleepMA = 0.13;
+        double i2cActiveMA = 0.7;
+        std::vector<double> ledOnMA = { 5.0 };
+        double sensorSupplyMA = 0.6;
+        double sensorLEDMA = 12.6;
+        uint32_t sensorLEDsPerSample = 2;
+        double sensorPulseWidthUs = 411;
+        double sensorSampleRateHz = 25;
+        uint32_t sensorSampleAvg = 4;
+        double bleAvgMA = 0;
+        double batteryMAh = 0;
+
+        // Set values from JSON (values not present are unchanged)
+        void setFromJSON(const RaftJsonIF& config)
+        {
+            cpuAwakeMA = config.getDouble("cpuAwakeMA", cpuAwakeMA);
+            lightSleepMA = config.getDouble("lightSleepMA", lightSleepMA);
+            i2cActiveMA = config.getDouble("i2cActiveMA", i2cActiveMA);
+            std::vector<String> ledOnMAStrs;
+            if (config.getArrayElems("ledOnMA", ledOnMAStrs) && !ledOnMAStrs.empty())
+            {
+                ledOnMA.clear();
+                for (const String& ledOnMAStr : ledOnMAStrs)
+                    ledOnMA.push_back(ledOnMAStr.toDouble());
+            }
+            else
+            {
+                ledOnMA = { config.getDouble("ledOnMA", ledOnMA[0]) };
+            }
+            sensorSupplyMA = config.getDouble("sensorSupplyMA", sensorSupplyMA);
+            sensorLEDMA = config.getDouble("sensorLEDMA", sensorLEDMA);
+            sensorLEDsPerSample = config.getLong("sensorLEDsPerSample", sensorLEDsPerSample);
+            sensorPulseWidthUs = config.getDouble("sensorPulseWidthUs", sensorPulseWidthUs);
+            sensorSampleRateHz = config.getDouble("sensorSampleRateHz", sensorSampleRateHz);
+            sensorSampleAvg = config.getLong("sensorSampleAvg", sensorSampleAvg);
+            bleAvgMA = config.getDouble("bleAvgMA", bleAvgMA);
+            batteryMAh = config.getDouble("batteryMAh", batteryMAh);
+        }
+
+        // LED current for an LED index (the last value applies to LEDs beyond the end of the list)
+        double getLEDOnMA(uint32_t ledIdx) const
+        {
+            if (ledOnMA.empty())
+                return 0;
+            return ledIdx < ledOnMA.size() ? ledOnMA[ledIdx] : ledOnMA.back();
+        }
+
+        // Average sensor LED current when sampling
+        double getSensorLEDAvgMA() const
+        {
+            double ledDuty = sensorSampleRateHz * sensorSampleAvg * sensorLEDsPerSample * sensorPulseWidthUs / 1e6;
+            return sensorLEDMA * ledDuty;
+        }
+
+        // Average sensor current when sampling
+        double getSensorAvgMA() const
+        {
+            return sensorSupplyMA + getSensorLEDAvgMA();
+        }
+    };
+
+    // Activity during the run
+    struct Activity
+    {
+        uint64_t durationUs = 0;
+        uint64_t awakeUs = 0;
+        uint64_t sleepUs = 0;
+        uint64_t i2cActiveUs = 0;
+        uint64_t sensorActiveUs = 0;
+        uint64_t sensorLEDUs = 0;
+        std::vector<uint64_t> ledOnUs;
+    };
+
+    // Charge (mAs) by component
+    struct Result
+    {
+        double cpuAwakeMAs = 0;
+        double cpuSleepMAs = 0;
+        double i2cMAs = 0;
+        double ledMAs = 0;
+        double sensorMAs = 0;
+        double bleMAs = 0;
+        double durationSecs = 0;
+        double totalMAs() const
+        {
+            return cpuAwakeMAs + cpuSleepMAs + i2cMAs + ledMAs + sensorMAs + bleMAs;
+        }
+        double avgMA() const
+        {
+            return durationSecs > 0 ? totalMAs() / durationSecs : 0;
+        }
+        // mAh per hour of operation is numerically the average current in mA
+        double mAhPerHour() const
+        {
+            return avgMA();
+        }
+        // Share of the total for a component (%)
+        double pc(double componentMAs) const
+        {
+            return totalMAs() > 0 ? componentMAs * 100 / totalMAs() : 0;
+        }
+    };
+
+    static Result calculate(const Profile& profile, const Activity& activity)
+    {
+        Result result;
+        result.durationSecs = activity.durationUs / 1e6;
+        result.cpuAwakeMAs = profile.cpuAwakeMA * activity.awakeUs / 1e6;
+        result.cpuSleepMAs = profile.lightSleepMA * activity.sleepUs / 1e6;
+        result.i2cMAs = profile.i2cActiveMA * activity.i2cActiveUs / 1e6;
+        for (uint32_t ledIdx = 0; ledIdx < activity.ledOnUs.size(); ledIdx++)
+            result.ledMAs += profile.getLEDOnMA(ledIdx) * activity.ledOnUs[ledIdx] / 1e6;
+        result.sensorMAs = (profile.sensorSupplyMA * activity.sensorActiveUs + 
+                    profile.getSensorLEDAvgMA() * activity.sensorLEDUs) / 1e6;
+        result.bleMAs = profile.bleAvgMA * activity.durationUs / 1e6;
+        return result;
+    }
+};
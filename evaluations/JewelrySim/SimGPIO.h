@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Simulation GPIO recorder
+//
+// Records every output level change with the virtual time at which it happened so that LED timing can be
+// analysed after a run. Inputs (e.g. the battery VSENSE ADC or a sensor interrupt) return configurable values
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <functional>
+#include "SimClock.h"
+
+class SimGPIO
+{
+public:
+    // GPIO level change
+    struct Event
+    {
+        uint64_t timeUs;
+        int pin;
+        bool level;
+    };
+
+    // Get the recorder (there is one per simulation)
+    static SimGPIO& get()
+    {
+        static SimGPIO gpio;
+        return gpio;
+    }
+
+    // Output - only changes of level are recorded
+    void write(int pin, bool level)
+    {
+        if (pin < 0)
+            return;
+        auto it = _levels.find(pin);
+        if ((it != _levels.end()) && (it->second == level))
+            return;
+        _levels[pin] = level;
+        _events.push_back(Event{SimClock::get().nowUs(), pin, level});
+    }
+    bool read(int pin) const
+    {
+        auto inputIt = _inputFns.find(pin);
+        if (inputIt != _inputFns.end())
+            return inputIt->second();
+        auto it = _levels.find(pin);
+        return (it != _levels.end()) && it->second;
+    }
+
+    // Input driven by a simulated device (e.g. an interrupt pin)
+    void setInputFn(int pin, std::function<bool()> inputFn)
+    {
+        _inputFns[pin] = inputFn;
+    }
+
+    // Hold (level is retained through light sleep) - counted but otherwise not modelled
+    void hold(int pin, bool enable)
+    {
+        _holdChanges++;
+    }
+
+    // Analog input
+    void setAnalogValue(int pin, uint32_t value)
+    {
+        _analogValues[pin] = value;
+    }
+    uint32_t analogRead(int pin) const
+    {
+        auto it = _analogValues.find(pin);
+        return it != _analogValues.end() ? it->second : 0;
+    }
+
+    // Recorded events
+    const std::vector<Event>& getEvents() const
+    {
+        return _events;
+    }
+    uint32_t getHoldChanges() const
+    {
+        return _holdChanges;
+    }
+
+private:
+    std::map<int, bool> _levels;
+    std::map<int, uint32_t> _analogValues;
+    std::map<int, std::function<bool()>> _inputFns;
+    std::vector<Event> _events;
+    uint32_t _holdChanges = 0;
+};
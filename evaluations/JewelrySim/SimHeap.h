@@ -0,0 +1,31 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Simulation heap operation counter
+//
+// Counts heap allocations and frees (the global operator new and delete are replaced in JewelrySim.cpp) so
+// that paths which should not allocate (e.g. the sensor data callback) can be checked
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+class SimHeap
+{
+public:
+    // Counts since the start of the run - take the difference between two reads to count the operations on
+    // a path
+    static uint64_t& allocCount()
+    {
+        static uint64_t count = 0;
+        return count;
+    }
+    static uint64_t& freeCount()
+    {
+        static uint64_t count = 0;
+        return count;
+    }
+};
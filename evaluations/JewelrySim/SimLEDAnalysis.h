@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// LED timing analysis of recorded GPIO events
+//
+// LED on edges that occur together form an animation step, and steps closer together than twice the
+// animation step time form a pulse (one displayed heartbeat). Step timing is checked against the configured
+// step time and pulse intervals against the heart rate reported by the firmware at the start of each pulse.
+// The displayed peak of each pulse is the on time weighted centre of the LED on periods in the pulse
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <math.h>
+#include "SimGPIO.h"
+
+class SimLEDAnalysis
+{
+public:
+    // Heart rate reported by the firmware at a time
+    struct HeartRateSample
+    {
+        uint64_t timeUs;
+        double heartRateBPM;
+    };
+
+    // Error stats
+    struct ErrorStats
+    {
+        uint32_t count = 0;
+        double sumAbs = 0;
+        double maxAbs = 0;
+        void add(double err)
+        {
+            count++;
+            sumAbs += fabs(err);
+            if (fabs(err) > maxAbs)
+                maxAbs = fabs(err);
+        }
+        double meanAbs() const
+        {
+            return count > 0 ? sumAbs / count : 0;
+        }
+    };
+
+    // Results
+    uint32_t numPulses = 0;
+    uint32_t numSteps = 0;
+    ErrorStats stepIntervalErrorUs;
+    ErrorStats pulseIntervalErrorMs;
+    std::map<int, uint64_t> onTimeUsByPin;
+    std::vector<uint64_t> pulsePeakTimesUs;
+
+    void analyse(const std::vector<SimGPIO::Event>& events, const std::vector<int>& ledPins, bool activeLevel,
+                uint64_t animStepTimeUs, const std::vector<HeartRateSample>& heartRates, uint64_t endTimeUs)
+    {
+        // Steps (times of groups of on edges)
+        std::vector<uint64_t> stepTimesUs;
+        std::map<int, uint64_t> onSinceUs;
+        struct OnPeriod
+        {
+            uint64_t startUs;
+            uint64_t endUs;
+        };
+        std::vector<OnPeriod> onPeriods;
+        for (const SimGPIO::Event& event : events)
+        {
+            bool isLED = false;
+            for (int pin : ledPins)
+                isLED |= pin == event.pin;
+            if (!isLED)
+                continue;
+            if (event.level == activeLevel)
+            {
+                onSinceUs[event.pin] = event.timeUs;
+                if (stepTimesUs.empty() || (event.timeUs - stepTimesUs.back() > animStepTimeUs / 2))
+                    stepTimesUs.push_back(event.timeUs);
+            }
+            else if (onSinceUs.count(event.pin))
+            {
+                onTimeUsByPin[event.pin] += event.timeUs - onSinceUs[event.pin];
+                onPeriods.push_back(OnPeriod{onSinceUs[event.pin], event.timeUs});
+                onSinceUs.erase(event.pin);
+            }
+        }
+        for (const auto& onSince : onSinceUs)
+            onTimeUsByPin[onSince.first] += endTimeUs - onSince.second;
+        numSteps = stepTimesUs.size();
+
+        // Pulses
+        std::vector<uint64_t> pulseStartTimesUs;
+        uint64_t lastPulseStartUs = 0;
+        for (uint32_t i = 0; i < stepTimesUs.size(); i++)
+        {
+            bool isPulseStart = (i == 0) || (stepTimesUs[i] - stepTimesUs[i - 1] >= 2 * animStepTimeUs);
+            if (!isPulseStart)
+            {
+                stepIntervalErrorUs.add((double)(stepTimesUs[i] - stepTimesUs[i - 1]) - (double)animStepTimeUs);
+                continue;
+            }
+            double heartRateBPM = getHeartRateAt(heartRates, stepTimesUs[i]);
+            if ((numPulses > 0) && (heartRateBPM > 0))
+                pulseIntervalErrorMs.add((stepTimesUs[i] - lastPulseStartUs) / 1000.0 - 60000.0 / heartRateBPM);
+            lastPulseStartUs = stepTimesUs[i];
+            pulseStartTimesUs.push_back(stepTimesUs[i]);
+            numPulses++;
+        }
+
+        // Displayed peak of each pulse
+        std::vector<double> sumOnUs(pulseStartTimesUs.size()), sumWeightedUs(pulseStartTimesUs.size());
+        for (const OnPeriod& onPeriod : onPeriods)
+        {
+            auto it = std::upper_bound(pulseStartTimesUs.begin(), pulseStartTimesUs.end(), onPeriod.startUs);
+            if (it == pulseStartTimesUs.begin())
+                continue;
+            size_t pulseIdx = it - pulseStartTimesUs.begin() - 1;
+            double durUs = onPeriod.endUs - onPeriod.startUs;
+            sumOnUs[pulseIdx] += durUs;
+            sumWeightedUs[pulseIdx] += durUs * (onPeriod.startUs + durUs / 2);
+        }
+        pulsePeakTimesUs.clear();
+        for (size_t pulseIdx = 0; pulseIdx < pulseStartTimesUs.size(); pulseIdx++)
+            if (sumOnUs[pulseIdx] > 0)
+                pulsePeakTimesUs.push_back(sumWeightedUs[pulseIdx] / sumOnUs[pulseIdx]);
+    }
+
+private:
+    static double getHeartRateAt(const std::vector<HeartRateSample>& heartRates, uint64_t timeUs)
+    {
+        auto it = std::upper_bound(heartRates.begin(), heartRates.end(), timeUs,
+                    [](uint64_t t, const HeartRateSample& sample) { return t < sample.timeUs; });
+        return it == heartRates.begin() ? 0 : (it - 1)->heartRateBPM;
+    }
+};
@@ -0,0 +1,129 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Simulation LEDC (PWM) model
+//
+// Models LEDC channel duty including linear hardware fades. The equivalent on time of each channel's pin
+// (duty integrated over time) is accumulated for the energy model and the pin level (on whenever the duty
+// is non-zero) is recorded via SimGPIO so that LED timing analysis works as for GPIO driven LEDs
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include "SimClock.h"
+#include "SimGPIO.h"
+
+class SimLEDC
+{
+public:
+    // Get the model (there is one per simulation)
+    static SimLEDC& get()
+    {
+        static SimLEDC ledc;
+        return ledc;
+    }
+
+    // Timer and channel configuration
+    void configTimer(uint32_t timerIdx, uint32_t resolutionBits)
+    {
+        _timerMaxDuty[timerIdx] = (1u << resolutionBits) - 1;
+    }
+    void configChannel(uint32_t channelIdx, int pin, uint32_t timerIdx, uint32_t duty, bool invert)
+    {
+        Channel& channel = _channels[channelIdx];
+        channel.pin = pin;
+        channel.timerIdx = timerIdx;
+        channel.invert = invert;
+        setDuty(channelIdx, duty, 0);
+    }
+
+    // Set duty - faded linearly from the current duty over fadeUs (0 for immediate)
+    void setDuty(uint32_t channelIdx, uint32_t duty, uint64_t fadeUs)
+    {
+        auto it = _channels.find(channelIdx);
+        if (it == _channels.end())
+            return;
+        Channel& channel = it->second;
+        uint64_t nowUs = SimClock::get().nowUs();
+        accumulate(channel, nowUs);
+        channel.startDuty = getDutyAt(channel, nowUs);
+        channel.targetDuty = duty;
+        channel.fadeStartUs = nowUs;
+        channel.fadeEndUs = nowUs + fadeUs;
+        SimGPIO::get().write(channel.pin, (duty != 0) != channel.invert);
+    }
+
+    // Stop a fade at the current duty
+    void stopFade(uint32_t channelIdx)
+    {
+        auto it = _channels.find(channelIdx);
+        if (it == _channels.end())
+            return;
+        uint64_t nowUs = SimClock::get().nowUs();
+        setDuty(channelIdx, (uint32_t)getDutyAt(it->second, nowUs), 0);
+    }
+
+    // Equivalent on time of each pin (at full duty) up to a time
+    std::map<int, uint64_t> getOnTimeUsByPin(uint64_t endTimeUs)
+    {
+        std::map<int, uint64_t> onTimeUsByPin;
+        for (auto& channel : _channels)
+        {
+            accumulate(channel.second, endTimeUs);
+            onTimeUsByPin[channel.second.pin] += (uint64_t)channel.second.onTimeUs;
+        }
+        return onTimeUsByPin;
+    }
+
+    // Check if any channels are in use
+    bool isInUse() const
+    {
+        return !_channels.empty();
+    }
+
+private:
+    struct Channel
+    {
+        int pin = -1;
+        uint32_t timerIdx = 0;
+        bool invert = false;
+        double startDuty = 0;
+        double targetDuty = 0;
+        uint64_t fadeStartUs = 0;
+        uint64_t fadeEndUs = 0;
+        uint64_t accumulatedToUs = 0;
+        double onTimeUs = 0;
+    };
+    std::map<uint32_t, Channel> _channels;
+    std::map<uint32_t, uint32_t> _timerMaxDuty;
+
+    double getDutyAt(const Channel& channel, uint64_t timeUs) const
+    {
+        if (timeUs >= channel.fadeEndUs)
+            return channel.targetDuty;
+        double frac = (double)(timeUs - channel.fadeStartUs) / (channel.fadeEndUs - channel.fadeStartUs);
+        return channel.startDuty + (channel.targetDuty - channel.startDuty) * frac;
+    }
+
+    // Integrate duty (as a fraction of max) from the last accumulated time - linear during the fade
+    void accumulate(Channel& channel, uint64_t toUs)
+    {
+        if (toUs <= channel.accumulatedToUs)
+            return;
+        auto maxIt = _timerMaxDuty.find(channel.timerIdx);
+        double maxDuty = (maxIt != _timerMaxDuty.end()) && (maxIt->second > 0) ? maxIt->second : 1;
+        uint64_t fromUs = channel.accumulatedToUs;
+        uint64_t fadeToUs = toUs < channel.fadeEndUs ? toUs : channel.fadeEndUs;
+        if (fadeToUs > fromUs)
+        {
+            channel.onTimeUs += (getDutyAt(channel, fromUs) + getDutyAt(channel, fadeToUs)) / 2 / maxDuty * (fadeToUs - fromUs);
+            fromUs = fadeToUs;
+        }
+        channel.onTimeUs += channel.targetDuty / maxDuty * (toUs - fromUs);
+        channel.accumulatedToUs = toUs;
+    }
+};
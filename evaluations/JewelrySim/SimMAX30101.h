@@ -0,0 +1,468 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Simulated MAX30101 heart rate sensor
+//
+// Replays a recorded HRM session (Red and IR values at their recorded times) through a model of the sensor
+// FIFO. Each poll reads the FIFO pointers and pops up to 8 samples (the 51 byte poll read in DevTypes.json).
+// The FIFO pointers and data can also be read through the bus (FIFO interrupt mode). Samples are lost if the
+// FIFO (32 samples) overflows, e.g. when polls are delayed by light sleep. As in the datasheet the A_FULL
+// status is set when a sample takes the FIFO to the almost full threshold and stays set (INT asserted when
+// the interrupt is enabled) until INT_STATUS_1 is read - reading FIFO data doesn't clear it. The time INT is
+// next asserted is available as a GPIO wakeup source
+//
+// Register writes change the sensor settings from the time of the write. LED pulse amplitudes scale the
+// replayed values and the output sample rate (ADC sample rate divided by averaging) selects which recorded
+// samples are written to the FIFO (the recording rate is the highest rate that can be replayed). The LED
+// charge (relative to the initial settings) is integrated for the energy model. Periods without skin
+// contact can be added - samples in these periods are a low level (light reaching the photodiode without
+// skin) scaled by the LED pulse amplitude plus noise. Periods when polls are stalled (e.g. by BLE or logging)
+// can also be added - polls due in these periods happen at the end of the period. The sensor keeps sampling
+// while the firmware restarts and its initial settings are then restored
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "DeviceManager.h"
+#include "DeviceTypeRecords.h"
+#include "HRMSessionLoader.h"
+#include <vector>
+#include <deque>
+
+class SimMAX30101 : public SimDeviceIF
+{
+public:
+    static const uint32_t FIFO_DEPTH = 32;
+    static const uint32_t MAX_SAMPLES_PER_POLL = (DeviceTypeRecords::MAX30101_POLL_RESP_BYTES - 3) / 6;
+    static const uint32_t FIFO_ALMOST_FULL_SAMPLES_DEFAULT = 17;
+    static const uint32_t I2C_ADDRESS = 0x57;
+    static const uint8_t REG_INT_STATUS_1 = 0x00;
+    static const uint8_t INT_A_FULL = 0x80;
+    static const uint8_t REG_INT_ENABLE_1 = 0x02;
+    static const uint8_t REG_FIFO_WR_PTR = 0x04;
+    static const uint8_t REG_FIFO_DATA = 0x07;
+    static const uint8_t REG_FIFO_CONFIG = 0x08;
+    static const uint8_t INT_A_FULL_EN = 0x80;
+    static const uint8_t REG_SPO2_CONFIG = 0x0a;
+    static const uint8_t REG_LED1_PA = 0x0c;
+    static const uint8_t REG_LED2_PA = 0x0d;
+    static const uint8_t LED_PA_INIT = 0x40;
+    static const uint32_t ADC_SAMPLE_RATE_HZ_INIT = 100;
+    static const uint32_t SAMPLE_AVG_INIT = 4;
+    static const uint32_t PULSE_WIDTH_US_INIT = 411;
+    static const uint64_t SAMPLE_TIME_TOLERANCE_US = 10000;
+    static const int32_t NO_CONTACT_LEVEL_DEFAULT = 5000;
+    static const int32_t NO_CONTACT_NOISE = 50;
+
+    SimMAX30101(const HRMSessionData& session, uint64_t startUs, uint64_t pollIntervalUs, uint64_t pollCostUs) :
+        _session(session), _startUs(startUs), _pollIntervalUs(pollIntervalUs), _pollCostUs(pollCostUs),
+        _nextPollUs(startUs)
+    {
+        _settings.push_back(Setting{0, LED_PA_INIT, LED_PA_INIT, ADC_SAMPLE_RATE_HZ_INIT, SAMPLE_AVG_INIT, PULSE_WIDTH_US_INIT});
+    }
+
+    // SimDeviceIF
+    virtual const char* getDeviceName() const override
+    {
+        return "I2CA_0x57@0";
+    }
+    virtual uint32_t getDeviceTypeIdx() const override
+    {
+        return DeviceTypeRecords::DEVICE_TYPE_IDX_MAX30101;
+    }
+    virtual uint64_t getNextPollUs() const override
+    {
+        for (const auto& period : _pollStallPeriods)
+        {
+            if ((_nextPollUs >= period.first) && (_nextPollUs < period.second))
+                return period.second;
+        }
+        return _nextPollUs;
+    }
+    virtual uint64_t getPollCostUs() const override
+    {
+        return _pollCostUs;
+    }
+    virtual bool poll(uint64_t nowUs, std::vector<uint8_t>& pollData) override
+    {
+        _nextPollUs = nowUs + _pollIntervalUs;
+        _numPolls++;
+        _i2cBytes += 3 + DeviceTypeRecords::MAX30101_POLL_RESP_BYTES;
+
+        // Poll timestamp and FIFO pointers (a full FIFO has equal read and write pointers)
+        updateFIFO(nowUs);
+        uint32_t numInFIFO = _fifo.size();
+        uint32_t timestampMs = (SimClock::get().firmwareUs() / 1000) & 0xffff;
+        pollData.push_back(timestampMs >> 8);
+        pollData.push_back(timestampMs & 0xff);
+        getPointers(pollData);
+
+        // FIFO data (the read pops samples whether or not the decoder uses them)
+        uint32_t numPopped = numInFIFO < MAX_SAMPLES_PER_POLL ? numInFIFO : MAX_SAMPLES_PER_POLL;
+        popSamples(MAX_SAMPLES_PER_POLL, pollData);
+        if (numInFIFO == FIFO_DEPTH)
+            _samplesUnreported += numPopped;
+        return true;
+    }
+    virtual uint64_t getNextInterruptUs() const override
+    {
+        if (!_isInterruptEnabled)
+            return UINT64_MAX;
+        if (_isAlmostFull)
+            return _almostFullUs;
+
+        // Time of the sample that will take the FIFO to the threshold (none if it is already above it)
+        uint32_t numInFIFO = _fifo.size();
+        uint64_t nextOutputUs = _nextOutputUs;
+        for (uint32_t sampleIdx = _writeIdx; sampleIdx < _session.size(); sampleIdx++)
+        {
+            if (numInFIFO >= _fifoAlmostFullSamples)
+                break;
+            if (isSampleOutput(sampleIdx, nextOutputUs) && (++numInFIFO >= _fifoAlmostFullSamples))
+                return getSampleTimeUs(sampleIdx);
+        }
+        return UINT64_MAX;
+    }
+
+    // FIFO almost full interrupt (INT pin is active low) - cleared by reading INT_STATUS_1
+    bool isInterruptActive(uint64_t nowUs) const
+    {
+        return _isInterruptEnabled && (getNextInterruptUs() <= nowUs);
+    }
+
+    virtual uint32_t getAddress() const override
+    {
+        return I2C_ADDRESS;
+    }
+    virtual bool write(uint64_t nowUs, const std::vector<uint8_t>& writeData) override
+    {
+        // Sample rate, averaging, pulse width and LED pulse amplitude registers (other registers are
+        // accepted but have no effect)
+        if (writeData.size() != 2)
+            return false;
+        if (writeData[0] == REG_INT_ENABLE_1)
+        {
+            _isInterruptEnabled = (writeData[1] & INT_A_FULL_EN) != 0;
+            return true;
+        }
+        if (writeData[0] == REG_FIFO_CONFIG)
+            _fifoAlmostFullSamples = FIFO_DEPTH - (writeData[1] & 0x0f);
+        Setting setting = _settings.back();
+        setting.timeUs = nowUs;
+        static const uint32_t SAMPLE_RATES_HZ[] = { 50, 100, 200, 400, 800, 1000, 1600, 3200 };
+        static const uint32_t PULSE_WIDTHS_US[] = { 69, 118, 215, 411 };
+        if (writeData[0] == REG_FIFO_CONFIG)
+            setting.sampleAvg = 1 << std::min((writeData[1] >> 5) & 0x07, 5);
+        else if (writeData[0] == REG_SPO2_CONFIG)
+        {
+            setting.adcSampleRateHz = SAMPLE_RATES_HZ[(writeData[1] >> 2) & 0x07];
+            setting.pulseWidthUs = PULSE_WIDTHS_US[writeData[1] & 0x03];
+        }
+        else if (writeData[0] == REG_LED1_PA)
+            setting.redPA = writeData[1];
+        else if (writeData[0] == REG_LED2_PA)
+            setting.irPA = writeData[1];
+        else
+            return true;
+        _settings.push_back(setting);
+        return true;
+    }
+
+    virtual bool read(uint64_t nowUs, const std::vector<uint8_t>& writeData, uint32_t readLen, 
+                std::vector<uint8_t>& readData) override
+    {
+        // FIFO pointers, FIFO data (the register address doesn't advance past the data register) or
+        // interrupt status (clears the status)
+        if (writeData.size() != 1)
+            return false;
+        _numReads++;
+        _i2cBytes += 3 + readLen;
+        updateFIFO(nowUs);
+        if ((writeData[0] == REG_INT_STATUS_1) && (readLen == 1))
+        {
+            readData.push_back(_isAlmostFull ? INT_A_FULL : 0);
+            _isAlmostFull = false;
+            return true;
+        }
+        if ((writeData[0] == REG_FIFO_WR_PTR) && (readLen == 3))
+        {
+            getPointers(readData);
+            return true;
+        }
+        if ((writeData[0] == REG_FIFO_DATA) && (readLen % 6 == 0))
+        {
+            popSamples(readLen / 6, readData);
+            return true;
+        }
+        return false;
+    }
+
+    // Restore the initial settings (the device type initValues are written when the firmware restarts) - the
+    // FIFO is not cleared
+    void restoreInitSettings(uint64_t nowUs)
+    {
+        _settings.push_back(Setting{nowUs, LED_PA_INIT, LED_PA_INIT, ADC_SAMPLE_RATE_HZ_INIT, SAMPLE_AVG_INIT, PULSE_WIDTH_US_INIT});
+        _isInterruptEnabled = false;
+        _isAlmostFull = false;
+        _fifoAlmostFullSamples = FIFO_ALMOST_FULL_SAMPLES_DEFAULT;
+    }
+
+    // Add a period without skin contact
+    void addNoContactPeriod(uint64_t startUs, uint64_t endUs)
+    {
+        _noContactPeriods.push_back(std::make_pair(startUs, endUs));
+    }
+
+    // Add a period when polls are stalled
+    void addPollStallPeriod(uint64_t startUs, uint64_t endUs)
+    {
+        _pollStallPeriods.push_back(std::make_pair(startUs, endUs));
+    }
+
+    // Time with the LEDs at the initial settings that uses the same LED charge as the run to endUs (LED charge
+    // is proportional to conversions per second, pulse width and pulse amplitude)
+    uint64_t getLEDInitEquivUs(uint64_t endUs) const
+    {
+        double equivUs = 0;
+        for (size_t i = 0; i < _settings.size(); i++)
+        {
+            uint64_t segEndUs = i + 1 < _settings.size() ? _settings[i + 1].timeUs : endUs;
+            if (segEndUs > _settings[i].timeUs)
+                equivUs += (double)(segEndUs - _settings[i].timeUs) * _settings[i].getLEDChargeRatio();
+        }
+        return (uint64_t)equivUs;
+    }
+
+    // Time with the LED charge below the initial settings (e.g. low power or powered down without skin contact)
+    uint64_t getLEDReducedUs(uint64_t endUs) const
+    {
+        uint64_t reducedUs = 0;
+        for (size_t i = 0; i < _settings.size(); i++)
+        {
+            uint64_t segEndUs = i + 1 < _settings.size() ? _settings[i + 1].timeUs : endUs;
+            if ((segEndUs > _settings[i].timeUs) && (_settings[i].getLEDChargeRatio() < 1))
+                reducedUs += segEndUs - _settings[i].timeUs;
+        }
+        return reducedUs;
+    }
+
+    // Number of register writes that changed the settings
+    uint32_t getNumSettingChanges() const
+    {
+        return _settings.size() - 1;
+    }
+
+    // Time with the output sample rate below the initial rate
+    uint64_t getReducedRateUs(uint64_t endUs) const
+    {
+        uint64_t reducedUs = 0;
+        for (size_t i = 0; i < _settings.size(); i++)
+        {
+            uint64_t segEndUs = i + 1 < _settings.size() ? _settings[i + 1].timeUs : endUs;
+            if ((segEndUs > _settings[i].timeUs) && 
+                        (_settings[i].getOutputIntervalUs() > 1000000 * SAMPLE_AVG_INIT / ADC_SAMPLE_RATE_HZ_INIT))
+                reducedUs += segEndUs - _settings[i].timeUs;
+        }
+        return reducedUs;
+    }
+
+    // FIFO almost full interrupt threshold
+    void setFIFOAlmostFullSamples(uint32_t numSamples)
+    {
+        _fifoAlmostFullSamples = numSamples;
+    }
+
+    // Time of a sample
+    uint64_t getSampleTimeUs(uint32_t sampleIdx) const
+    {
+        return _startUs + (uint64_t)(_session.timeMs[sampleIdx] - _session.timeMs[0]) * 1000;
+    }
+
+    // Duration of the recorded session
+    uint64_t getSessionDurationUs() const
+    {
+        return _session.size() > 0 ? getSampleTimeUs(_session.size() - 1) - _startUs : 0;
+    }
+
+    // Stats
+    uint64_t getI2CBytes() const
+    {
+        return _i2cBytes;
+    }
+    uint32_t getNumPolls() const
+    {
+        return _numPolls;
+    }
+    uint32_t getNumReads() const
+    {
+        return _numReads;
+    }
+    uint32_t getSamplesRead() const
+    {
+        return _samplesRead;
+    }
+    uint32_t getSamplesLost() const
+    {
+        return _samplesLost;
+    }
+    uint32_t getSamplesUnreported() const
+    {
+        return _samplesUnreported;
+    }
+
+private:
+    const HRMSessionData& _session;
+    uint64_t _startUs;
+    uint64_t _pollIntervalUs;
+    uint64_t _pollCostUs;
+    uint64_t _nextPollUs;
+    uint32_t _fifoAlmostFullSamples = FIFO_ALMOST_FULL_SAMPLES_DEFAULT;
+
+    // FIFO state - recorded samples up to _writeIdx have been taken and the FIFO holds the indices of those
+    // that were output at the sample rate
+    uint32_t _writeIdx = 0;
+    std::deque<uint32_t> _fifo;
+    uint32_t _fifoRdPtr = 0;
+    uint32_t _ovfCounter = 0;
+    uint64_t _nextOutputUs = 0;
+
+    // Settings (in time order - the first is the initial setting)
+    struct Setting
+    {
+        uint64_t timeUs;
+        uint8_t redPA;
+        uint8_t irPA;
+        uint32_t adcSampleRateHz;
+        uint32_t sampleAvg;
+        uint32_t pulseWidthUs;
+        uint64_t getOutputIntervalUs() const
+        {
+            return (uint64_t)1000000 * sampleAvg / adcSampleRateHz;
+        }
+        double getLEDChargeRatio() const
+        {
+            return ((double)adcSampleRateHz / ADC_SAMPLE_RATE_HZ_INIT) * ((double)pulseWidthUs / PULSE_WIDTH_US_INIT) *
+                        (redPA + irPA) / (2.0 * LED_PA_INIT);
+        }
+    };
+    std::vector<Setting> _settings;
+
+    // FIFO almost full interrupt - A_FULL status and the time it was set
+    bool _isInterruptEnabled = false;
+    bool _isAlmostFull = false;
+    uint64_t _almostFullUs = 0;
+
+    // Write samples taken up to a time to the FIFO (the oldest are overwritten on overflow)
+    void updateFIFO(uint64_t nowUs)
+    {
+        while ((_writeIdx < _session.size()) && (getSampleTimeUs(_writeIdx) <= nowUs))
+        {
+            if (isSampleOutput(_writeIdx, _nextOutputUs))
+            {
+                _fifo.push_back(_writeIdx);
+                if ((_fifo.size() == _fifoAlmostFullSamples) && !_isAlmostFull)
+                {
+                    _isAlmostFull = true;
+                    _almostFullUs = getSampleTimeUs(_writeIdx);
+                }
+            }
+            _writeIdx++;
+            if (_fifo.size() > FIFO_DEPTH)
+            {
+                _fifo.pop_front();
+                _fifoRdPtr = (_fifoRdPtr + 1) % FIFO_DEPTH;
+                _ovfCounter++;
+                _samplesLost++;
+            }
+        }
+    }
+
+    // FIFO pointers (write pointer, overflow counter and read pointer)
+    void getPointers(std::vector<uint8_t>& data) const
+    {
+        data.push_back((_fifoRdPtr + _fifo.size()) % FIFO_DEPTH);
+        data.push_back(_ovfCounter > 0x1f ? 0x1f : _ovfCounter);
+        data.push_back(_fifoRdPtr);
+    }
+
+    // Read FIFO data - samples are popped (zeros are read if the FIFO is empty)
+    void popSamples(uint32_t numSamples, std::vector<uint8_t>& data)
+    {
+        uint32_t numPopped = numSamples < _fifo.size() ? numSamples : _fifo.size();
+        for (uint32_t i = 0; i < numSamples; i++)
+        {
+            uint32_t red = 0;
+            uint32_t ir = 0;
+            if (i < numPopped)
+                getSampleValues(_fifo[i], red, ir);
+            data.push_back((red >> 16) & 0xff);
+            data.push_back((red >> 8) & 0xff);
+            data.push_back(red & 0xff);
+            data.push_back((ir >> 16) & 0xff);
+            data.push_back((ir >> 8) & 0xff);
+            data.push_back(ir & 0xff);
+        }
+        _fifo.erase(_fifo.begin(), _fifo.begin() + numPopped);
+        _fifoRdPtr = (_fifoRdPtr + numPopped) % FIFO_DEPTH;
+        _samplesRead += numPopped;
+        if (numPopped > 0)
+            _ovfCounter = 0;
+    }
+
+    // Setting in effect at a time
+    const Setting& getSetting(uint64_t timeUs) const
+    {
+        size_t settingIdx = _settings.size() - 1;
+        while ((settingIdx > 0) && (_settings[settingIdx].timeUs > timeUs))
+            settingIdx--;
+        return _settings[settingIdx];
+    }
+
+    // Check if a recorded sample is output at the sample rate in effect when it was taken (nextOutputUs is
+    // the time the next output is due and is updated)
+    bool isSampleOutput(uint32_t sampleIdx, uint64_t& nextOutputUs) const
+    {
+        uint64_t sampleTimeUs = getSampleTimeUs(sampleIdx);
+        if (sampleTimeUs + SAMPLE_TIME_TOLERANCE_US < nextOutputUs)
+            return false;
+        uint64_t outputIntervalUs = getSetting(sampleTimeUs).getOutputIntervalUs();
+        nextOutputUs = std::max(nextOutputUs, sampleTimeUs) + outputIntervalUs;
+        return true;
+    }
+
+    // Periods without skin contact (start and end times)
+    std::vector<std::pair<uint64_t, uint64_t>> _noContactPeriods;
+    std::vector<std::pair<uint64_t, uint64_t>> _pollStallPeriods;
+
+    // Sample values (scaled by the LED pulse amplitude when the sample was taken)
+    void getSampleValues(uint32_t sampleIdx, uint32_t& red, uint32_t& ir) const
+    {
+        uint64_t sampleTimeUs = getSampleTimeUs(sampleIdx);
+        const Setting& setting = getSetting(sampleTimeUs);
+        double redVal = _session.red[sampleIdx];
+        double irVal = _session.ir[sampleIdx];
+        for (const auto& period : _noContactPeriods)
+        {
+            if ((sampleTimeUs >= period.first) && (sampleTimeUs < period.second))
+            {
+                // Deterministic noise so that runs are repeatable
+                int32_t noise = (int32_t)(((sampleIdx * 2654435761u) >> 16) % (2 * NO_CONTACT_NOISE + 1)) - NO_CONTACT_NOISE;
+                redVal = NO_CONTACT_LEVEL_DEFAULT + noise;
+                irVal = NO_CONTACT_LEVEL_DEFAULT - noise;
+                break;
+            }
+        }
+        red = (uint32_t)(redVal * setting.redPA / LED_PA_INIT);
+        ir = (uint32_t)(irVal * setting.irPA / LED_PA_INIT);
+    }
+
+    // Stats
+    uint64_t _i2cBytes = 0;
+    uint32_t _numPolls = 0;
+    uint32_t _numReads = 0;
+    uint32_t _samplesRead = 0;
+    uint32_t _samplesLost = 0;
+    uint32_t _samplesUnreported = 0;
+};
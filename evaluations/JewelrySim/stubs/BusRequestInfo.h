@@ -0,0 +1,80 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - bus request
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "RaftArduino.h"
+
+enum BusReqType
+{
+    BUS_REQ_TYPE_STD,
+    BUS_REQ_TYPE_POLL,
+};
+
+class BusRequestResult;
+typedef void (*BusRequestCallbackType)(void* pCallbackData, BusRequestResult& reqResult);
+
+// Hardware element request (data to write and number of bytes to read)
+class HWElemReq
+{
+public:
+    static const uint32_t UNNUM = UINT32_MAX;
+    std::vector<uint8_t> _writeData;
+    uint32_t _readReqLen = 0;
+    uint32_t _cmdId = UNNUM;
+    const char* _pName = "";
+    uint32_t _barAccessForMsAfterSend = 0;
+};
+
+class BusRequestInfo
+{
+public:
+    BusRequestInfo(const String& elemName, uint32_t address) :
+        _address(address)
+    {
+    }
+    void set(BusReqType busReqType, const HWElemReq& hwElemReq, double pollFreqHz, 
+                BusRequestCallbackType busReqCallback, void* pCallbackData)
+    {
+        _busReqType = busReqType;
+        _writeData = hwElemReq._writeData;
+        _readReqLen = hwElemReq._readReqLen;
+        _busReqCallback = busReqCallback;
+        _pCallbackData = pCallbackData;
+    }
+    uint32_t getAddress() const
+    {
+        return _address;
+    }
+    const std::vector<uint8_t>& getWriteData() const
+    {
+        return _writeData;
+    }
+    uint32_t getReadReqLen() const
+    {
+        return _readReqLen;
+    }
+    BusRequestCallbackType getCallback() const
+    {
+        return _busReqCallback;
+    }
+    void* getCallbackData() const
+    {
+        return _pCallbackData;
+    }
+
+private:
+    uint32_t _address = 0;
+    BusReqType _busReqType = BUS_REQ_TYPE_STD;
+    std::vector<uint8_t> _writeData;
+    uint32_t _readReqLen = 0;
+    BusRequestCallbackType _busReqCallback = nullptr;
+    void* _pCallbackData = nullptr;
+};
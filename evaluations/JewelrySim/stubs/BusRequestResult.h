@@ -0,0 +1,42 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - bus request result
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class BusRequestResult
+{
+public:
+    BusRequestResult(uint32_t address, const std::vector<uint8_t>& readData, bool isResultOk) :
+        _address(address), _readData(readData), _isResultOk(isResultOk)
+    {
+    }
+    uint32_t getAddress() const
+    {
+        return _address;
+    }
+    const uint8_t* getReadData() const
+    {
+        return _readData.data();
+    }
+    uint32_t getReadDataLen() const
+    {
+        return _readData.size();
+    }
+    bool isResultOk() const
+    {
+        return _isResultOk;
+    }
+
+private:
+    uint32_t _address;
+    const std::vector<uint8_t>& _readData;
+    bool _isResultOk;
+};
@@ -0,0 +1,32 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - comms channel message
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+class CommsChannelMsg
+{
+public:
+    void setFromBuffer(const uint8_t* pBuf, uint32_t bufLen)
+    {
+        _msg.assign(pBuf, pBuf + bufLen);
+    }
+    const uint8_t* getBuf() const
+    {
+        return _msg.data();
+    }
+    uint32_t getBufLen() const
+    {
+        return _msg.size();
+    }
+
+private:
+    std::vector<uint8_t> _msg;
+};
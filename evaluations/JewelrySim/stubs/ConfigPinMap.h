@@ -0,0 +1,26 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - pin names
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdlib.h>
+#include <ctype.h>
+
+class ConfigPinMap
+{
+public:
+    // Pin names are numbers, optionally prefixed (e.g. GPIO5) - returns -1 if not valid
+    static int getPinFromName(const char* pinName)
+    {
+        if (!pinName)
+            return -1;
+        while (*pinName && !isdigit((unsigned char)*pinName))
+            pinName++;
+        return *pinName ? atoi(pinName) : -1;
+    }
+};
@@ -0,0 +1,155 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - device manager
+//
+// Simulated devices are polled at their poll interval while the CPU is awake (polls that fall due during
+// light sleep happen on wakeup) and the poll data is passed to callbacks registered for the device. Heap
+// allocations made by the callbacks are counted. RaftDeviceDataChangeCB passes the poll data by value so, as
+// on the device, a copy is allocated for each callback - this is counted separately as it can't be avoided
+// without changing Raft
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "RaftCore.h"
+#include "SimHeap.h"
+
+typedef std::function<void(uint32_t deviceTypeIdx, std::vector<uint8_t> data, const void* pCallbackInfo)> RaftDeviceDataChangeCB;
+
+// Simulated device
+class SimDeviceIF
+{
+public:
+    virtual ~SimDeviceIF()
+    {
+    }
+
+    // Device name (as used in registerForDeviceData)
+    virtual const char* getDeviceName() const = 0;
+    virtual uint32_t getDeviceTypeIdx() const = 0;
+
+    // Time the next poll is due
+    virtual uint64_t getNextPollUs() const = 0;
+
+    // Awake time taken by a poll (bus transfer and processing)
+    virtual uint64_t getPollCostUs() const = 0;
+
+    // Poll - appends poll data (if any) and schedules the next poll
+    virtual bool poll(uint64_t nowUs, std::vector<uint8_t>& pollData) = 0;
+
+    // Time of next interrupt (e.g. FIFO almost full) - UINT64_MAX if none
+    virtual uint64_t getNextInterruptUs() const
+    {
+        return UINT64_MAX;
+    }
+
+    // Bus address (for requests made through the bus system stub)
+    virtual uint32_t getAddress() const
+    {
+        return 0;
+    }
+
+    // Write (e.g. register address and value) - returns false if not accepted
+    virtual bool write(uint64_t nowUs, const std::vector<uint8_t>& writeData)
+    {
+        return false;
+    }
+
+    // Read (e.g. register address written then readLen bytes read) - returns false if not accepted
+    virtual bool read(uint64_t nowUs, const std::vector<uint8_t>& writeData, uint32_t readLen, std::vector<uint8_t>& readData)
+    {
+        return false;
+    }
+};
+
+class DeviceManager
+{
+public:
+    // Register for device data
+    void registerForDeviceData(const char* pDeviceName, RaftDeviceDataChangeCB dataChangeCB, 
+                uint32_t minTimeBetweenReportsMs, const void* pCallbackInfo = nullptr)
+    {
+        _callbacks.push_back(Callback{pDeviceName, dataChangeCB, pCallbackInfo});
+    }
+
+    // Remove all device data callbacks (e.g. when the firmware restarts)
+    void clearDeviceDataCallbacks()
+    {
+        _callbacks.clear();
+    }
+
+    // Add simulated device
+    void addDevice(SimDeviceIF* pDevice)
+    {
+        _devices.push_back(pDevice);
+    }
+
+    // Poll devices that are due and pass data to callbacks
+    void service()
+    {
+        SimClock& clock = SimClock::get();
+        for (SimDeviceIF* pDevice : _devices)
+        {
+            if (clock.nowUs() < pDevice->getNextPollUs())
+                continue;
+            clock.awake(pDevice->getPollCostUs());
+            std::vector<uint8_t> pollData;
+            if (!pDevice->poll(clock.nowUs(), pollData))
+                continue;
+            for (const Callback& callback : _callbacks)
+            {
+                if (callback.deviceName != pDevice->getDeviceName())
+                    continue;
+                uint64_t allocsBefore = SimHeap::allocCount();
+                std::vector<uint8_t> callbackData(pollData);
+                _pollDataCopyHeapAllocs += SimHeap::allocCount() - allocsBefore;
+                allocsBefore = SimHeap::allocCount();
+                callback.dataChangeCB(pDevice->getDeviceTypeIdx(), std::move(callbackData), callback.pCallbackInfo);
+                _callbackHeapAllocs += SimHeap::allocCount() - allocsBefore;
+                _numCallbacks++;
+            }
+        }
+    }
+
+    // Callbacks made, heap allocations made by them and by the copies of the poll data passed to them
+    uint32_t getNumCallbacks() const
+    {
+        return _numCallbacks;
+    }
+    uint64_t getCallbackHeapAllocs() const
+    {
+        return _callbackHeapAllocs;
+    }
+    uint64_t getPollDataCopyHeapAllocs() const
+    {
+        return _pollDataCopyHeapAllocs;
+    }
+
+    // Time of next device interrupt
+    uint64_t getNextInterruptUs() const
+    {
+        uint64_t nextUs = UINT64_MAX;
+        for (const SimDeviceIF* pDevice : _devices)
+            if (pDevice->getNextInterruptUs() < nextUs)
+                nextUs = pDevice->getNextInterruptUs();
+        return nextUs;
+    }
+
+private:
+    struct Callback
+    {
+        String deviceName;
+        RaftDeviceDataChangeCB dataChangeCB;
+        const void* pCallbackInfo;
+    };
+    std::vector<Callback> _callbacks;
+    std::vector<SimDeviceIF*> _devices;
+    uint32_t _numCallbacks = 0;
+    uint64_t _callbackHeapAllocs = 0;
+    uint64_t _pollDataCopyHeapAllocs = 0;
+};
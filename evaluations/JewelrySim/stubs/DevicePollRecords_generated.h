@@ -0,0 +1,20 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - decoded device poll records (generated from DevTypes.json on the device build)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+struct poll_MAX30101
+{
+    uint32_t timeMs;
+    uint32_t Red;
+    uint32_t IR;
+    uint8_t Lost;
+    uint8_t Pending;
+};
@@ -0,0 +1,71 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - device type records
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "DeviceTypeRecords.h"
+#include "DevicePollRecords_generated.h"
+
+DeviceTypeRecords deviceTypeRecords;
+
+// MAX30101 decode - follows the custom decode in DevTypes.json (number of samples from the FIFO pointers - full
+// if they are equal with samples lost - 18 bit values, the overflow counter as Lost on the first sample and
+// the samples left in the FIFO as Pending) but
+// only decodes samples that are present in the poll response. Sample times step back from the poll timestamp
+// at the sample interval
+static uint32_t decodeMAX30101(const uint8_t* pPollBuf, uint32_t pollBufLen, void* pStructOut, 
+                uint32_t structOutSize, uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState)
+{
+    static const uint32_t RECORD_BYTES = DeviceTypeRecords::POLL_TIMESTAMP_BYTES + DeviceTypeRecords::MAX30101_POLL_RESP_BYTES;
+    static const uint32_t MAX_SAMPLES_PER_POLL = (DeviceTypeRecords::MAX30101_POLL_RESP_BYTES - 3) / 6;
+    poll_MAX30101* pOut = (poll_MAX30101*)pStructOut;
+    uint32_t maxRecs = structOutSize / sizeof(poll_MAX30101);
+    if (maxRecs > maxRecCount)
+        maxRecs = maxRecCount;
+    uint32_t numRecs = 0;
+    for (uint32_t pos = 0; pos + RECORD_BYTES <= pollBufLen; pos += RECORD_BYTES)
+    {
+        // Timestamp (extended to 64 bits using the decode state)
+        const uint8_t* pRec = pPollBuf + pos;
+        uint64_t timestampUs = (((uint32_t)pRec[0] << 8) | pRec[1]) * 1000ULL;
+        if (timestampUs < decodeState.lastReportTimestampUs)
+            decodeState.reportTimestampOffsetUs += 65536000ULL;
+        decodeState.lastReportTimestampUs = timestampUs;
+        timestampUs += decodeState.reportTimestampOffsetUs;
+
+        // Samples
+        const uint8_t* buf = pRec + DeviceTypeRecords::POLL_TIMESTAMP_BYTES;
+        uint32_t numSamples = (buf[0] + 32 - buf[2]) % 32;
+        uint8_t numLost = buf[1] & 0x1f;
+        if ((numSamples == 0) && (numLost != 0))
+            numSamples = 32;
+        uint8_t numPending = 0;
+        if (numSamples > MAX_SAMPLES_PER_POLL)
+        {
+            numPending = numSamples - MAX_SAMPLES_PER_POLL;
+            numSamples = MAX_SAMPLES_PER_POLL;
+        }
+        for (uint32_t i = 0; (i < numSamples) && (numRecs < maxRecs); i++)
+        {
+            const uint8_t* pSample = buf + 3 + i * 6;
+            pOut[numRecs].Red = (((uint32_t)pSample[0] << 16) | (pSample[1] << 8) | pSample[2]) & 0x3ffff;
+            pOut[numRecs].IR = (((uint32_t)pSample[3] << 16) | (pSample[4] << 8) | pSample[5]) & 0x3ffff;
+            pOut[numRecs].Lost = i == 0 ? numLost : 0;
+            pOut[numRecs].Pending = numPending;
+            pOut[numRecs].timeMs = (timestampUs - (uint64_t)(numSamples - 1 - i) * 
+                        DeviceTypeRecords::MAX30101_SAMPLE_INTERVAL_US) / 1000;
+            numRecs++;
+        }
+    }
+    return numRecs;
+}
+
+DeviceTypeRecordDecodeFn DeviceTypeRecords::getPollDecodeFn(uint32_t deviceTypeIdx) const
+{
+    if (deviceTypeIdx == DEVICE_TYPE_IDX_MAX30101)
+        return decodeMAX30101;
+    return nullptr;
+}
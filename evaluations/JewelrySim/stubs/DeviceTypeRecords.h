@@ -0,0 +1,35 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - device type records
+//
+// Poll data is a sequence of records, each a 16 bit big-endian poll timestamp (ms) followed by the poll
+// response bytes. Only the MAX30101 is simulated - see DeviceTypeRecords.cpp for the decode
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftBusDevicesIF.h"
+
+typedef uint32_t (*DeviceTypeRecordDecodeFn)(const uint8_t* pPollBuf, uint32_t pollBufLen, void* pStructOut, 
+                uint32_t structOutSize, uint16_t maxRecCount, RaftBusDeviceDecodeState& decodeState);
+
+class DeviceTypeRecords
+{
+public:
+    // Device type indices
+    static const uint32_t DEVICE_TYPE_IDX_MAX30101 = 0;
+
+    // MAX30101 poll response (FIFO_WR_PTR, OVF_COUNTER, FIFO_RD_PTR then 8 samples of Red and IR, 3 bytes each)
+    static const uint32_t MAX30101_POLL_RESP_BYTES = 51;
+    static const uint32_t MAX30101_SAMPLE_INTERVAL_US = 40000;
+    static const uint32_t POLL_TIMESTAMP_BYTES = 2;
+
+    // Get decode function for a device type (nullptr if not known)
+    DeviceTypeRecordDecodeFn getPollDecodeFn(uint32_t deviceTypeIdx) const;
+};
+
+extern DeviceTypeRecords deviceTypeRecords;
@@ -0,0 +1,22 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - LED pixels (no pixel output is simulated)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RaftJsonPrefixed.h"
+
+class LEDPixels
+{
+public:
+    void loop()
+    {
+    }
+    void waitUntilShowComplete()
+    {
+    }
+};
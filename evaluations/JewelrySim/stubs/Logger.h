@@ -0,0 +1,25 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - logging
+//
+// Log output goes to stderr (prefixed with the virtual time) when verbose logging is enabled
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdio.h>
+#include "SimClock.h"
+
+extern bool simLogVerbose;
+
+#define SIM_LOG(level, tag, fmt, ...) \
+    do { if (simLogVerbose) fprintf(stderr, "%c (%llu) %s: " fmt "\n", level, \
+            (unsigned long long)(SimClock::get().nowUs() / 1000), tag, ##__VA_ARGS__); } while (0)
+#define LOG_E(tag, fmt, ...) SIM_LOG('E', tag, fmt, ##__VA_ARGS__)
+#define LOG_W(tag, fmt, ...) SIM_LOG('W', tag, fmt, ##__VA_ARGS__)
+#define LOG_I(tag, fmt, ...) SIM_LOG('I', tag, fmt, ##__VA_ARGS__)
+#define LOG_D(tag, fmt, ...) SIM_LOG('D', tag, fmt, ##__VA_ARGS__)
+#define LOG_V(tag, fmt, ...) SIM_LOG('V', tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - Arduino compatibility (String, GPIO and timing)
+//
+// Timing and GPIO are routed to the simulation virtual clock and GPIO recorder
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <string>
+#include "SimClock.h"
+#include "SimGPIO.h"
+
+// String (subset of the Arduino String used by the jewelry code)
+class String : public std::string
+{
+public:
+    String() {}
+    String(const char* pStr) : std::string(pStr ? pStr : "") {}
+    String(const std::string& str) : std::string(str) {}
+    explicit String(int val) : std::string(std::to_string(val)) {}
+    explicit String(unsigned int val) : std::string(std::to_string(val)) {}
+    explicit String(long val) : std::string(std::to_string(val)) {}
+    explicit String(unsigned long val) : std::string(std::to_string(val)) {}
+    explicit String(double val, int decimalPlaces = 2)
+    {
+        char buf[40];
+        snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, val);
+        assign(buf);
+    }
+    bool equalsIgnoreCase(const String& other) const
+    {
+        return strcasecmp(c_str(), other.c_str()) == 0;
+    }
+    bool startsWith(const String& prefix) const
+    {
+        return compare(0, prefix.size(), prefix) == 0;
+    }
+    long toInt() const
+    {
+        return strtol(c_str(), nullptr, 0);
+    }
+    double toDouble() const
+    {
+        return strtod(c_str(), nullptr);
+    }
+    String& operator+=(const String& other)
+    {
+        append(other);
+        return *this;
+    }
+    String& operator+=(const char* pStr)
+    {
+        append(pStr);
+        return *this;
+    }
+    String& operator+=(char c)
+    {
+        push_back(c);
+        return *this;
+    }
+};
+inline String operator+(const String& a, const String& b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+inline String operator+(const String& a, const char* b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+inline String operator+(const char* a, const String& b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+
+// GPIO
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define LOW 0
+#define HIGH 1
+inline void pinMode(int pin, int mode)
+{
+}
+inline void digitalWrite(int pin, int level)
+{
+    SimGPIO::get().write(pin, level != 0);
+}
+inline int digitalRead(int pin)
+{
+    return SimGPIO::get().read(pin) ? HIGH : LOW;
+}
+inline uint32_t analogRead(int pin)
+{
+    return SimGPIO::get().analogRead(pin);
+}
+
+// Timing
+inline uint64_t micros()
+{
+    return SimClock::get().firmwareUs();
+}
+inline uint32_t millis()
+{
+    return SimClock::get().firmwareUs() / 1000;
+}
+inline void delay(uint32_t ms)
+{
+    SimClock::get().awake((uint64_t)ms * 1000);
+}
+inline void delayMicroseconds(uint32_t us)
+{
+    SimClock::get().awake(us);
+}
@@ -0,0 +1,19 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - bus device decode state
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+// State retained between decodes of poll data (used to extend the 16 bit poll timestamps)
+class RaftBusDeviceDecodeState
+{
+public:
+    uint64_t lastReportTimestampUs = 0;
+    uint64_t reportTimestampOffsetUs = 0;
+};
@@ -0,0 +1,78 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - bus system
+//
+// A single bus on which requests are passed straight to the simulated device at the request address. Reads
+// are made immediately and the result callback is called before addRequest() returns - the transfer time
+// (at the bus frequency) is spent awake
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "BusRequestInfo.h"
+#include "BusRequestResult.h"
+#include "DeviceManager.h"
+
+class RaftBus
+{
+public:
+    // Add a request - returns false if there is no device at the address or it doesn't accept the request
+    bool addRequest(BusRequestInfo& busReqInfo)
+    {
+        for (SimDeviceIF* pDevice : _devices)
+        {
+            if (pDevice->getAddress() != busReqInfo.getAddress())
+                continue;
+            if (busReqInfo.getReadReqLen() == 0)
+                return pDevice->write(SimClock::get().nowUs(), busReqInfo.getWriteData());
+
+            // Read (address and register write then address and data read)
+            SimClock::get().awake(getTransferUs(3 + busReqInfo.getReadReqLen()));
+            std::vector<uint8_t> readData;
+            bool isOk = pDevice->read(SimClock::get().nowUs(), busReqInfo.getWriteData(), busReqInfo.getReadReqLen(), readData);
+            BusRequestResult reqResult(busReqInfo.getAddress(), readData, isOk);
+            if (busReqInfo.getCallback())
+                busReqInfo.getCallback()(busReqInfo.getCallbackData(), reqResult);
+            return isOk;
+        }
+        return false;
+    }
+
+    // Bus frequency (for transfer times)
+    void setFreqHz(double freqHz)
+    {
+        _freqHz = freqHz;
+    }
+    uint64_t getTransferUs(uint32_t numBytes) const
+    {
+        return _freqHz > 0 ? (uint64_t)(numBytes * 9 * 1000000 / _freqHz) : 0;
+    }
+
+    // Add simulated device
+    void addDevice(SimDeviceIF* pDevice)
+    {
+        _devices.push_back(pDevice);
+    }
+
+private:
+    std::vector<SimDeviceIF*> _devices;
+    double _freqHz = 100000;
+};
+
+class RaftBusSystem
+{
+public:
+    RaftBus* getBusByName(const String& busName)
+    {
+        return &_bus;
+    }
+
+private:
+    RaftBus _bus;
+};
+
+inline RaftBusSystem raftBusSystem;
@@ -0,0 +1,15 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - Raft core
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RaftArduino.h"
+#include "Logger.h"
+#include "RaftUtils.h"
+#include "RaftJson.h"
+#include "RaftJsonPrefixed.h"
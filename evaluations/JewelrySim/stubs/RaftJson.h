@@ -0,0 +1,228 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - JSON document
+//
+// The document is flattened on construction into scalar values and arrays keyed by path (elements separated
+// by / and array elements addressed as name[idx]). Keys of the form name##variant1##variant2 are only
+// included (as name) when the selected hardware variant matches
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <ctype.h>
+#include "RaftJsonIF.h"
+
+class RaftJson : public RaftJsonIF
+{
+public:
+    RaftJson(const char* pJsonStr = "{}", const char* pVariant = "")
+    {
+        _variant = pVariant ? pVariant : "";
+        setFromJSON("", pJsonStr);
+    }
+
+    // Name value pairs
+    struct NameValuePair
+    {
+        NameValuePair(const String& name, const String& value) : name(name), value(value) {}
+        String name;
+        String value;
+    };
+    static RaftJson getJSONFromNVPairs(const std::vector<NameValuePair>& nameValuePairs, bool includeOuterBraces)
+    {
+        String json = "{";
+        for (uint32_t i = 0; i < nameValuePairs.size(); i++)
+            json += String(i > 0 ? "," : "") + "\"" + nameValuePairs[i].name + "\":\"" + nameValuePairs[i].value + "\"";
+        json += "}";
+        return RaftJson(json.c_str());
+    }
+
+    // Set value(s) at a path from JSON text (text that isn't valid JSON is set as a string)
+    void setFromJSON(const String& path, const char* pJsonText)
+    {
+        const char* p = pJsonText;
+        if (!parseValue(p, path, true))
+            _values[path] = pJsonText;
+    }
+
+    // RaftJsonIF
+    virtual String getString(const char* dataPath, const char* defaultValue) const override
+    {
+        auto it = _values.find(dataPath);
+        return it != _values.end() ? String(it->second) : String(defaultValue);
+    }
+    virtual double getDouble(const char* dataPath, double defaultValue) const override
+    {
+        auto it = _values.find(dataPath);
+        if (it == _values.end())
+            return defaultValue;
+        return it->second == "true" ? 1 : strtod(it->second.c_str(), nullptr);
+    }
+    virtual long getLong(const char* dataPath, long defaultValue) const override
+    {
+        auto it = _values.find(dataPath);
+        if (it == _values.end())
+            return defaultValue;
+        return it->second == "true" ? 1 : strtol(it->second.c_str(), nullptr, 0);
+    }
+    virtual bool getBool(const char* dataPath, bool defaultValue) const override
+    {
+        auto it = _values.find(dataPath);
+        if (it == _values.end())
+            return defaultValue;
+        return (it->second == "true") || (strtod(it->second.c_str(), nullptr) != 0);
+    }
+    virtual bool getArrayElems(const char* dataPath, std::vector<String>& strList) const override
+    {
+        strList.clear();
+        auto it = _arrays.find(dataPath);
+        if (it == _arrays.end())
+            return false;
+        strList = it->second;
+        return true;
+    }
+
+private:
+    String _variant;
+    std::map<String, String> _values;
+    std::map<String, std::vector<String>> _arrays;
+
+    static void skipSpace(const char*& p)
+    {
+        while (*p && isspace((unsigned char)*p))
+            p++;
+    }
+    static String joinPath(const String& path, const String& key)
+    {
+        return path.empty() ? key : path + "/" + key;
+    }
+
+    // Select keys for the hardware variant (returns false if the key doesn't apply)
+    bool applyVariant(String& key) const
+    {
+        size_t pos = key.find("##");
+        if (pos == std::string::npos)
+            return true;
+        String variants = key.substr(pos) + "##";
+        key.resize(pos);
+        return !_variant.empty() && (variants.find("##" + _variant + "##") != std::string::npos);
+    }
+
+    bool parseString(const char*& p, String& str)
+    {
+        if (*p != '"')
+            return false;
+        p++;
+        str.clear();
+        while (*p && (*p != '"'))
+        {
+            if ((*p == '\\') && p[1])
+            {
+                p++;
+                switch (*p)
+                {
+                    case 'n': str += '\n'; break;
+                    case 't': str += '\t'; break;
+                    case 'u':
+                        str += '?';
+                        for (int i = 0; (i < 4) && p[1]; i++)
+                            p++;
+                        break;
+                    default: str += *p; break;
+                }
+                p++;
+                continue;
+            }
+            str += *p++;
+        }
+        if (*p != '"')
+            return false;
+        p++;
+        return true;
+    }
+
+    // Parse a value - scalars and arrays are stored at path
+    bool parseValue(const char*& p, const String& path, bool store, String* pRaw = nullptr)
+    {
+        skipSpace(p);
+        const char* pStart = p;
+        bool isOk = true;
+        if (*p == '{')
+        {
+            p++;
+            skipSpace(p);
+            while (isOk && (*p != '}'))
+            {
+                String key;
+                isOk = parseString(p, key);
+                skipSpace(p);
+                isOk = isOk && (*p++ == ':');
+                bool keyApplies = applyVariant(key);
+                isOk = isOk && parseValue(p, joinPath(path, key), store && keyApplies);
+                skipSpace(p);
+                if (isOk && (*p == ','))
+                {
+                    p++;
+                    skipSpace(p);
+                }
+                else if (*p != '}')
+                    isOk = false;
+            }
+            if (isOk)
+                p++;
+        }
+        else if (*p == '[')
+        {
+            p++;
+            skipSpace(p);
+            std::vector<String> elems;
+            while (isOk && (*p != ']'))
+            {
+                String raw;
+                isOk = parseValue(p, path + "[" + String((int)elems.size()) + "]", store, &raw);
+                elems.push_back(raw);
+                skipSpace(p);
+                if (isOk && (*p == ','))
+                {
+                    p++;
+                    skipSpace(p);
+                }
+                else if (*p != ']')
+                    isOk = false;
+            }
+            if (isOk)
+            {
+                p++;
+                if (store)
+                    _arrays[path] = elems;
+            }
+        }
+        else if (*p == '"')
+        {
+            String str;
+            isOk = parseString(p, str);
+            if (isOk && store)
+                _values[path] = str;
+            if (pRaw)
+                *pRaw = str;
+            return isOk;
+        }
+        else
+        {
+            while (*p && (isalnum((unsigned char)*p) || (*p == '-') || (*p == '+') || (*p == '.')))
+                p++;
+            String token(std::string(pStart, p - pStart));
+            isOk = !token.empty();
+            if (isOk && store)
+                _values[path] = token;
+        }
+        if (pRaw)
+            *pRaw = std::string(pStart, p - pStart);
+        return isOk;
+    }
+};
@@ -0,0 +1,31 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - JSON configuration interface
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+#include "RaftArduino.h"
+
+class RaftJsonIF
+{
+public:
+    virtual ~RaftJsonIF()
+    {
+    }
+
+    // Get values (dataPath elements are separated by /)
+    virtual String getString(const char* dataPath, const char* defaultValue) const = 0;
+    virtual double getDouble(const char* dataPath, double defaultValue) const = 0;
+    virtual long getLong(const char* dataPath, long defaultValue) const = 0;
+    virtual bool getBool(const char* dataPath, bool defaultValue) const = 0;
+    virtual bool getArrayElems(const char* dataPath, std::vector<String>& strList) const = 0;
+    int getInt(const char* dataPath, int defaultValue) const
+    {
+        return getLong(dataPath, defaultValue);
+    }
+};
@@ -0,0 +1,51 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - JSON configuration with a path prefix
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RaftJsonIF.h"
+
+class RaftJsonPrefixed : public RaftJsonIF
+{
+public:
+    RaftJsonPrefixed(const RaftJsonIF& baseJson, const char* pPrefix) :
+        _baseJson(baseJson), _prefix(pPrefix ? pPrefix : "")
+    {
+    }
+
+    virtual String getString(const char* dataPath, const char* defaultValue) const override
+    {
+        return _baseJson.getString(fullPath(dataPath).c_str(), defaultValue);
+    }
+    virtual double getDouble(const char* dataPath, double defaultValue) const override
+    {
+        return _baseJson.getDouble(fullPath(dataPath).c_str(), defaultValue);
+    }
+    virtual long getLong(const char* dataPath, long defaultValue) const override
+    {
+        return _baseJson.getLong(fullPath(dataPath).c_str(), defaultValue);
+    }
+    virtual bool getBool(const char* dataPath, bool defaultValue) const override
+    {
+        return _baseJson.getBool(fullPath(dataPath).c_str(), defaultValue);
+    }
+    virtual bool getArrayElems(const char* dataPath, std::vector<String>& strList) const override
+    {
+        return _baseJson.getArrayElems(fullPath(dataPath).c_str(), strList);
+    }
+
+private:
+    const RaftJsonIF& _baseJson;
+    String _prefix;
+    String fullPath(const char* dataPath) const
+    {
+        if (_prefix.empty())
+            return dataPath;
+        return (dataPath && *dataPath) ? _prefix + "/" + dataPath : _prefix;
+    }
+};
@@ -0,0 +1,82 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - system module base class
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "RaftCore.h"
+
+class SysManager;
+class RestAPIEndpointManager;
+
+class RaftSysMod
+{
+public:
+    RaftSysMod(const char* pModuleName, RaftJsonIF& sysConfig) :
+        _moduleName(pModuleName), _modConfig(sysConfig, pModuleName)
+    {
+    }
+    virtual ~RaftSysMod()
+    {
+    }
+
+    // Module name
+    const char* modName() const
+    {
+        return _moduleName.c_str();
+    }
+
+    // Status
+    virtual String getStatusJSON() const
+    {
+        return "{}";
+    }
+
+    // Get named value
+    virtual double getNamedValue(const char* valueName, bool& isValid)
+    {
+        isValid = false;
+        return 0;
+    }
+
+protected:
+    // Called by the SysManager
+    virtual void setup()
+    {
+    }
+    virtual void postSetup()
+    {
+    }
+    virtual void loop()
+    {
+    }
+    virtual void addRestAPIEndpoints(RestAPIEndpointManager& endpointManager)
+    {
+    }
+
+    // Configuration
+    RaftJsonIF& configGetConfig()
+    {
+        return _modConfig;
+    }
+    const RaftJsonIF& modConfig() const
+    {
+        return _modConfig;
+    }
+
+    // SysManager
+    SysManager* getSysManager() const
+    {
+        return _pSysManager;
+    }
+
+private:
+    friend class SysManager;
+    String _moduleName;
+    RaftJsonPrefixed _modConfig;
+    SysManager* _pSysManager = nullptr;
+};
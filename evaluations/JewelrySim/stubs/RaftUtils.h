@@ -0,0 +1,55 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - Raft utilities
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "RaftArduino.h"
+#include "Logger.h"
+
+enum RaftRetCode
+{
+    RAFT_OK = 0,
+    RAFT_BUSY,
+    RAFT_POS_MISMATCH,
+    RAFT_NOT_XFERING,
+    RAFT_NOT_ENOUGH_BUFFER,
+    RAFT_OTHER_FAILURE,
+    RAFT_INVALID_DATA,
+    RAFT_INVALID_OPERATION,
+};
+
+namespace Raft
+{
+    // Time elapsed (handles wrap)
+    inline uint64_t timeElapsed(uint64_t curTime, uint64_t lastTime)
+    {
+        return curTime >= lastTime ? curTime - lastTime : (UINT64_MAX - lastTime) + curTime + 1;
+    }
+
+    // Check for timeout
+    inline bool isTimeout(uint64_t curTime, uint64_t lastTime, uint64_t maxDuration)
+    {
+        return timeElapsed(curTime, lastTime) > maxDuration;
+    }
+
+    // Time remaining before timeout (0 if timed out)
+    inline uint64_t timeToTimeout(uint64_t curTime, uint64_t lastTime, uint64_t maxDuration)
+    {
+        uint64_t elapsed = timeElapsed(curTime, lastTime);
+        return elapsed >= maxDuration ? 0 : maxDuration - elapsed;
+    }
+
+    // Set JSON bool result
+    inline RaftRetCode setJsonBoolResult(const char* pReqStr, String& respStr, bool rslt, const char* otherJson = nullptr)
+    {
+        respStr = String("{\"req\":\"") + pReqStr + "\",\"rslt\":\"" + (rslt ? "ok" : "fail") + "\"" + 
+                    (otherJson ? String(",") + otherJson : String()) + "}";
+        return rslt ? RAFT_OK : RAFT_INVALID_OPERATION;
+    }
+}
@@ -0,0 +1,113 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - REST API endpoints
+//
+// Requests can be made from the simulation (e.g. jewelry/hrmtrace/on) using handleApiRequest()
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "RaftUtils.h"
+#include "RaftJson.h"
+
+class APISourceInfo
+{
+public:
+    APISourceInfo(uint32_t channelID = 0) : channelID(channelID) {}
+    uint32_t channelID;
+};
+
+typedef std::function<RaftRetCode(const String& reqStr, String& respStr, const APISourceInfo& sourceInfo)> RestAPIFunction;
+
+class RestAPIEndpoint
+{
+public:
+    enum EndpointType
+    {
+        ENDPOINT_NONE,
+        ENDPOINT_CALLBACK
+    };
+    enum EndpointMethod
+    {
+        ENDPOINT_GET,
+        ENDPOINT_POST,
+        ENDPOINT_PUT,
+        ENDPOINT_DELETE,
+        ENDPOINT_OPTIONS
+    };
+};
+
+class RestAPIEndpointManager
+{
+public:
+    void addEndpoint(const char* pEndpointStr, RestAPIEndpoint::EndpointType endpointType,
+                RestAPIEndpoint::EndpointMethod endpointMethod, RestAPIFunction callbackMain, const char* pDescription)
+    {
+        _endpoints.push_back(Endpoint{pEndpointStr, callbackMain});
+    }
+
+    // Split request into path parameters and name=value pairs
+    static void getParamsAndNameValues(const char* reqStr, std::vector<String>& params,
+                std::vector<RaftJson::NameValuePair>& nameValuePairs)
+    {
+        params.clear();
+        nameValuePairs.clear();
+        String req(reqStr);
+        size_t queryPos = req.find('?');
+        String path = req.substr(0, queryPos);
+        size_t pos = 0;
+        while (pos <= path.size())
+        {
+            size_t nextPos = path.find('/', pos);
+            if (nextPos == std::string::npos)
+                nextPos = path.size();
+            params.push_back(path.substr(pos, nextPos - pos));
+            pos = nextPos + 1;
+        }
+        if (queryPos == std::string::npos)
+            return;
+        String query = req.substr(queryPos + 1);
+        pos = 0;
+        while (pos < query.size())
+        {
+            size_t nextPos = query.find('&', pos);
+            if (nextPos == std::string::npos)
+                nextPos = query.size();
+            String nameValue = query.substr(pos, nextPos - pos);
+            size_t eqPos = nameValue.find('=');
+            if (eqPos != std::string::npos)
+                nameValuePairs.push_back(RaftJson::NameValuePair(nameValue.substr(0, eqPos), nameValue.substr(eqPos + 1)));
+            pos = nextPos + 1;
+        }
+    }
+
+    // Handle a request (simulation) - returns false if there is no matching endpoint
+    bool handleApiRequest(const char* reqStr, String& respStr)
+    {
+        std::vector<String> params;
+        std::vector<RaftJson::NameValuePair> nameValues;
+        getParamsAndNameValues(reqStr, params, nameValues);
+        for (const Endpoint& endpoint : _endpoints)
+        {
+            if ((params.size() > 0) && params[0].equalsIgnoreCase(endpoint.name))
+            {
+                endpoint.callback(reqStr, respStr, APISourceInfo());
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Endpoint
+    {
+        String name;
+        RestAPIFunction callback;
+    };
+    std::vector<Endpoint> _endpoints;
+};
@@ -0,0 +1,39 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - simple moving average
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+
+template <int N, typename T = uint32_t, typename Total = uint64_t>
+class SimpleMovingAverage
+{
+public:
+    void sample(T sample)
+    {
+        if (_numSamples < N)
+            _samples[_numSamples++] = sample;
+        else
+        {
+            _total -= _samples[_pos];
+            _samples[_pos] = sample;
+        }
+        _total += sample;
+        _pos = (_pos + 1) % N;
+    }
+    T getAverage() const
+    {
+        return _numSamples > 0 ? _total / _numSamples : 0;
+    }
+
+private:
+    T _samples[N] = {};
+    Total _total = 0;
+    int _numSamples = 0;
+    int _pos = 0;
+};
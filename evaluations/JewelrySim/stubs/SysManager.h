@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - system manager
+//
+// Runs the setup and loop of registered modules and services data sources registered for publishing
+// (as the Publish SysMod does on the device, checking each source for state changes at a minimum interval)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "RaftSysMod.h"
+#include "RestAPIEndpointManager.h"
+#include "CommsChannelMsg.h"
+
+class DeviceManager;
+
+typedef std::function<bool(const char* messageName, CommsChannelMsg& msg)> SysMod_publishMsgGenFn;
+typedef std::function<void(const char* messageName, std::vector<uint8_t>& stateHash)> SysMod_stateDetectFn;
+
+class SysManager
+{
+public:
+    // Modules
+    void add(RaftSysMod* pSysMod)
+    {
+        pSysMod->_pSysManager = this;
+        _sysMods.push_back(pSysMod);
+    }
+    void setup()
+    {
+        for (RaftSysMod* pSysMod : _sysMods)
+            pSysMod->setup();
+        for (RaftSysMod* pSysMod : _sysMods)
+            pSysMod->addRestAPIEndpoints(_restAPIEndpointManager);
+        for (RaftSysMod* pSysMod : _sysMods)
+            pSysMod->postSetup();
+    }
+    void loop()
+    {
+        for (RaftSysMod* pSysMod : _sysMods)
+        {
+            pSysMod->loop();
+            servicePublishing();
+        }
+    }
+
+    // Device manager
+    void setDeviceManager(DeviceManager* pDeviceManager)
+    {
+        _pDeviceManager = pDeviceManager;
+    }
+    DeviceManager* getDeviceManager()
+    {
+        return _pDeviceManager;
+    }
+
+    // REST API
+    RestAPIEndpointManager& getRestAPIEndpointManager()
+    {
+        return _restAPIEndpointManager;
+    }
+
+    // Data sources for publishing
+    bool registerDataSource(const char* pubSysModName, const char* pubTopic, 
+                SysMod_publishMsgGenFn msgGenCB, SysMod_stateDetectFn stateDetectCB)
+    {
+        _dataSources.push_back(DataSource{pubTopic, msgGenCB, stateDetectCB});
+        return true;
+    }
+
+    // Publishing interval (0 to disable publishing)
+    void setPublishIntervalUs(uint64_t intervalUs)
+    {
+        _publishIntervalUs = intervalUs;
+    }
+
+    // Publishing stats
+    struct PublishStats
+    {
+        String topic;
+        uint32_t numMsgs = 0;
+        uint64_t numBytes = 0;
+    };
+    std::vector<PublishStats> getPublishStats() const
+    {
+        std::vector<PublishStats> stats;
+        for (const DataSource& dataSource : _dataSources)
+            stats.push_back(dataSource.stats);
+        return stats;
+    }
+
+private:
+    std::vector<RaftSysMod*> _sysMods;
+    DeviceManager* _pDeviceManager = nullptr;
+    RestAPIEndpointManager _restAPIEndpointManager;
+
+    // Data sources
+    struct DataSource
+    {
+        DataSource(const char* pTopic, SysMod_publishMsgGenFn msgGenCB, SysMod_stateDetectFn stateDetectCB) :
+            msgGenCB(msgGenCB), stateDetectCB(stateDetectCB)
+        {
+            stats.topic = pTopic;
+        }
+        SysMod_publishMsgGenFn msgGenCB;
+        SysMod_stateDetectFn stateDetectCB;
+        std::vector<uint8_t> lastStateHash;
+        uint64_t lastCheckUs = 0;
+        PublishStats stats;
+    };
+    std::vector<DataSource> _dataSources;
+    uint64_t _publishIntervalUs = 50000;
+
+    void servicePublishing()
+    {
+        if (_publishIntervalUs == 0)
+            return;
+        uint64_t nowUs = SimClock::get().nowUs();
+        for (DataSource& dataSource : _dataSources)
+        {
+            if (nowUs - dataSource.lastCheckUs < _publishIntervalUs)
+                continue;
+            dataSource.lastCheckUs = nowUs;
+            std::vector<uint8_t> stateHash;
+            dataSource.stateDetectCB(dataSource.stats.topic.c_str(), stateHash);
+            if (stateHash == dataSource.lastStateHash)
+                continue;
+            dataSource.lastStateHash = stateHash;
+            CommsChannelMsg msg;
+            if (dataSource.msgGenCB(dataSource.stats.topic.c_str(), msg))
+            {
+                dataSource.stats.numMsgs++;
+                dataSource.stats.numBytes += msg.getBufLen();
+            }
+        }
+    }
+};
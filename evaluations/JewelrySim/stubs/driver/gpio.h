@@ -0,0 +1,45 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - ESP-IDF GPIO
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "esp_sleep.h"
+#include "SimGPIO.h"
+
+typedef int gpio_num_t;
+
+typedef enum
+{
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL,
+    GPIO_INTR_HIGH_LEVEL,
+} gpio_int_type_t;
+
+// Wakeup from light sleep on a level - the simulation wakes on the GPIO wakeup event function set on the clock
+inline esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    return ESP_OK;
+}
+inline esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+inline esp_err_t gpio_hold_en(gpio_num_t gpio_num)
+{
+    SimGPIO::get().hold(gpio_num, true);
+    return ESP_OK;
+}
+inline esp_err_t gpio_hold_dis(gpio_num_t gpio_num)
+{
+    SimGPIO::get().hold(gpio_num, false);
+    return ESP_OK;
+}
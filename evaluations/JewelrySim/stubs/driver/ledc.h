@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - ESP-IDF LEDC
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "esp_sleep.h"
+#include "SimLEDC.h"
+
+#define ESP_ERR_INVALID_ARG 0x102
+
+typedef enum
+{
+    LEDC_LOW_SPEED_MODE,
+    LEDC_SPEED_MODE_MAX,
+} ledc_mode_t;
+
+typedef enum
+{
+    LEDC_TIMER_0,
+    LEDC_TIMER_1,
+    LEDC_TIMER_2,
+    LEDC_TIMER_3,
+    LEDC_TIMER_MAX,
+} ledc_timer_t;
+
+typedef enum
+{
+    LEDC_CHANNEL_0,
+    LEDC_CHANNEL_1,
+    LEDC_CHANNEL_2,
+    LEDC_CHANNEL_3,
+    LEDC_CHANNEL_4,
+    LEDC_CHANNEL_5,
+    LEDC_CHANNEL_MAX,
+} ledc_channel_t;
+
+typedef int ledc_timer_bit_t;
+
+typedef enum
+{
+    LEDC_AUTO_CLK,
+    LEDC_USE_RC_FAST_CLK,
+    LEDC_USE_APB_CLK,
+    LEDC_USE_XTAL_CLK,
+} ledc_clk_cfg_t;
+
+typedef enum
+{
+    LEDC_SLEEP_MODE_NO_ALIVE_NO_PD,
+    LEDC_SLEEP_MODE_NO_ALIVE_ALLOW_PD,
+    LEDC_SLEEP_MODE_KEEP_ALIVE,
+} ledc_sleep_mode_t;
+
+typedef enum
+{
+    LEDC_FADE_NO_WAIT,
+    LEDC_FADE_WAIT_DONE,
+} ledc_fade_mode_t;
+
+typedef struct
+{
+    ledc_mode_t speed_mode;
+    ledc_timer_bit_t duty_resolution;
+    ledc_timer_t timer_num;
+    uint32_t freq_hz;
+    ledc_clk_cfg_t clk_cfg;
+    bool deconfigure;
+} ledc_timer_config_t;
+
+typedef struct
+{
+    int gpio_num;
+    ledc_mode_t speed_mode;
+    ledc_channel_t channel;
+    int intr_type;
+    ledc_timer_t timer_sel;
+    uint32_t duty;
+    int hpoint;
+    ledc_sleep_mode_t sleep_mode;
+    struct
+    {
+        unsigned int output_invert: 1;
+    } flags;
+} ledc_channel_config_t;
+
+inline esp_err_t ledc_timer_config(const ledc_timer_config_t* timer_conf)
+{
+    if (!timer_conf || (timer_conf->timer_num >= LEDC_TIMER_MAX) || (timer_conf->duty_resolution < 1) || 
+                (timer_conf->duty_resolution > 14))
+        return ESP_ERR_INVALID_ARG;
+    SimLEDC::get().configTimer(timer_conf->timer_num, timer_conf->duty_resolution);
+    return ESP_OK;
+}
+inline esp_err_t ledc_channel_config(const ledc_channel_config_t* ledc_conf)
+{
+    if (!ledc_conf || (ledc_conf->channel >= LEDC_CHANNEL_MAX))
+        return ESP_ERR_INVALID_ARG;
+    SimLEDC::get().configChannel(ledc_conf->channel, ledc_conf->gpio_num, ledc_conf->timer_sel, ledc_conf->duty, 
+                ledc_conf->flags.output_invert);
+    return ESP_OK;
+}
+inline esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+inline esp_err_t ledc_set_duty_and_update(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty, uint32_t hpoint)
+{
+    SimLEDC::get().setDuty(channel, duty, 0);
+    return ESP_OK;
+}
+inline esp_err_t ledc_set_fade_time_and_start(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, 
+                uint32_t max_fade_time_ms, ledc_fade_mode_t fade_mode)
+{
+    SimLEDC::get().setDuty(channel, target_duty, max_fade_time_ms * 1000ULL);
+    return ESP_OK;
+}
+inline esp_err_t ledc_fade_stop(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    SimLEDC::get().stopFade(channel);
+    return ESP_OK;
+}
@@ -0,0 +1,14 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - ESP-IDF attributes
+//
+// Memory placement attributes have no effect - static data persists across a simulated restart (as RTC
+// memory does on the device) because the simulation process keeps running
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#define RTC_NOINIT_ATTR
@@ -0,0 +1,24 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - ESP-IDF clock
+//
+// The RTC time is the simulation virtual clock (it keeps counting through simulated restarts)
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "SimClock.h"
+
+inline int esp_clk_cpu_freq()
+{
+    return 160000000;
+}
+
+inline uint64_t esp_clk_rtc_time()
+{
+    return SimClock::get().nowUs();
+}
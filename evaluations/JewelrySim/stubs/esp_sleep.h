@@ -0,0 +1,50 @@
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Host simulation stub - ESP-IDF sleep
+//
+// Light sleep advances the simulation virtual clock to the earliest enabled wakeup source
+//
+// Rob Dobson 2024
+//
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <stdint.h>
+#include "SimClock.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_INVALID_STATE 0x103
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_ALL,
+    ESP_SLEEP_WAKEUP_EXT0,
+    ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER,
+    ESP_SLEEP_WAKEUP_TOUCHPAD,
+    ESP_SLEEP_WAKEUP_ULP,
+    ESP_SLEEP_WAKEUP_GPIO,
+} esp_sleep_source_t;
+
+inline esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    SimClock::get().enableTimerWakeup(time_in_us);
+    return ESP_OK;
+}
+inline esp_err_t esp_sleep_enable_gpio_wakeup()
+{
+    SimClock::get().enableGPIOWakeup();
+    return ESP_OK;
+}
+inline esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source)
+{
+    SimClock::get().disableWakeupSources();
+    return ESP_OK;
+}
+inline esp_err_t esp_light_sleep_start()
+{
+    return SimClock::get().lightSleep() ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
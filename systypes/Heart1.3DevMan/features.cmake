@@ -12,7 +12,7 @@ add_compile_definitions(FEATURE_HEART_JEWELRY)
 add_compile_definitions(FEATURE_POWER_CONTROL_SETUP)
 
 # Enable sleeping between animations
-# add_compile_definitions(FEATURE_ENABLE_SLEEP_MODE)
+add_compile_definitions(FEATURE_ENABLE_SLEEP_MODE)
 
 # Enable power control function check user shutdown - this will check the power
 # button for user input to shutdown the device
@@ -24,6 +24,9 @@ add_compile_definitions(FEATURE_POWER_CONTROL_SETUP)
 # Enable heart LED animations
 add_compile_definitions(FEATURE_HEART_ANIMATIONS)
 
+# Use fixed point arithmetic for the HRM bandpass filter (ESP32-C3 has no FPU)
+add_compile_definitions(HRM_FILTER_FIXED_POINT)
+
 # Add I2C bus in main
 add_compile_definitions(FEATURE_REGISTER_I2C_BUS_IN_MAIN)
 
@@ -0,0 +1,39 @@
+# Set the target Espressif chip
+set(IDF_TARGET "esp32c3")
+
+# Heart type jewelry
+add_compile_definitions(FEATURE_HEART_JEWELRY)
+
+# Enable power control function setup - this will keep the power on indefinitely if
+# other power control functions are not enabled
+add_compile_definitions(FEATURE_POWER_CONTROL_SETUP)
+
+# Enable sleeping between animations
+add_compile_definitions(FEATURE_ENABLE_SLEEP_MODE)
+
+# Enable power control function check user shutdown - this will check the power
+# button for user input to shutdown the device
+add_compile_definitions(FEATURE_POWER_CONTROL_USER_SHUTDOWN)
+
+# Enable power control function for low battery shutdown
+add_compile_definitions(FEATURE_POWER_CONTROL_LOW_BATTERY_SHUTDOWN)
+
+# Enable heart LED animations
+add_compile_definitions(FEATURE_HEART_ANIMATIONS)
+
+# Use fixed point arithmetic for the HRM bandpass filter (ESP32-C3 has no FPU)
+add_compile_definitions(HRM_FILTER_FIXED_POINT)
+
+# Add I2C bus in main
+add_compile_definitions(FEATURE_REGISTER_I2C_BUS_IN_MAIN)
+
+# Raft components
+set(RAFT_COMPONENTS
+    RaftCore@main
+    RaftSysMods@main
+    RaftI2C@main
+)
+
+# File system
+set(FS_TYPE "littlefs")
+set(FS_IMAGE_PATH "../Common/FSImage")
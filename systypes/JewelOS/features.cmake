@@ -5,7 +5,7 @@ set(IDF_TARGET "esp32c3")
 add_compile_definitions(SYSTEM_VERSION="2.0.1")
 
 # Enable sleeping between animations
-# add_compile_definitions(FEATURE_ENABLE_SLEEP_MODE)
+add_compile_definitions(FEATURE_ENABLE_SLEEP_MODE)
 
 # Enable power control function keeping the board alive
 # add_compile_definitions(FEATURE_POWER_CONTROL_KEEP_ALIVE)